@@ -0,0 +1,199 @@
+#include "abr.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_abr);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_abr       // set as default
+
+#define RTP_VIDEO_CLOCK_RATE 90000
+#define ABR_STEP_DOWN 0.75
+#define ABR_STEP_UP 1.15
+
+BitrateController::BitrateController(GstRTSPMedia *media, const std::string &mount, const MountConfig &config)
+    : media(GST_RTSP_MEDIA (g_object_ref(media))),
+      encoder(NULL),
+      filter(NULL),
+      mount(mount),
+      config(config),
+      poll_source(0),
+      bitrate(config.abr_max_kbps),
+      framerate(config.abr_max_fps),
+      last_change(0),
+      calm_since(0) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_ABR", GST_DEBUG_FG_GREEN, "Adaptive bitrate"
+  );
+
+  GstElement *element = gst_rtsp_media_get_element(media);
+  encoder = gst_bin_get_by_name(GST_BIN (element), config.abr_encoder.c_str());
+  if (!config.abr_filter.empty()) {
+    filter = gst_bin_get_by_name(GST_BIN (element), config.abr_filter.c_str());
+  }
+  gst_object_unref(element);
+
+  GCF_ERROR_RETURN(!encoder, "ABR of \"%s\": encoder \"%s\" is not found!",
+                   mount.c_str(), config.abr_encoder.c_str());
+
+  GCF_ERROR_RETURN(!g_object_class_find_property(G_OBJECT_GET_CLASS (encoder), "bitrate"),
+                   "ABR of \"%s\": encoder \"%s\" has no bitrate property!",
+                   mount.c_str(), config.abr_encoder.c_str());
+
+  // Start from the configured bitrate of the encoder
+  guint current = 0;
+  g_object_get(encoder, "bitrate", &current, NULL);
+  SetBitrate(CLAMP (current, config.abr_min_kbps, config.abr_max_kbps));
+
+  poll_source = g_timeout_add_seconds(ABR_POLL_INTERVAL, Poll, this);
+
+  GST_INFO("ABR of \"%s\" is active: %u-%u kbps", mount.c_str(), config.abr_min_kbps, config.abr_max_kbps);
+}
+
+BitrateController::~BitrateController() {
+  if (poll_source) {
+    g_source_remove(poll_source);
+  }
+
+  if (encoder) {
+    gst_object_unref(encoder);
+  }
+
+  if (filter) {
+    gst_object_unref(filter);
+  }
+
+  Metrics::Remove("abr." + mount + ".");
+  g_object_unref(media);
+}
+
+gboolean BitrateController::Poll(gpointer user_data) {
+  BitrateController *self = static_cast<BitrateController *>(user_data);
+
+  self->Adapt(self->Collect());
+
+  return TRUE;
+}
+
+// Average the last report blocks the receivers sent about our streams
+BitrateController::Reports BitrateController::Collect() {
+  Reports reports = {0, 0.0, 0.0, 0.0};
+
+  for (guint i = 0; i < gst_rtsp_media_n_streams(media); i++) {
+    GObject *session = gst_rtsp_stream_get_rtpsession(gst_rtsp_media_get_stream(media, i));
+    if (!session) {
+      continue;
+    }
+
+    GstStructure *stats = NULL;
+    g_object_get(session, "stats", &stats, NULL);
+    g_object_unref(session);
+
+    if (!stats) {
+      continue;
+    }
+
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    GValueArray *sources = (GValueArray *) g_value_get_boxed(gst_structure_get_value(stats, "source-stats"));
+
+    for (guint j = 0; sources && j < sources->n_values; j++) {
+      const GstStructure *source = gst_value_get_structure(g_value_array_get_nth(sources, j));
+      gboolean internal = TRUE, have_rb = FALSE;
+      guint fraction_lost = 0, jitter = 0, round_trip = 0;
+
+      gst_structure_get_boolean(source, "internal", &internal);
+      gst_structure_get_boolean(source, "have-rb", &have_rb);
+      if (internal || !have_rb) {
+        continue;
+      }
+
+      gst_structure_get_uint(source, "rb-fractionlost", &fraction_lost);
+      gst_structure_get_uint(source, "rb-jitter", &jitter);
+      gst_structure_get_uint(source, "rb-round-trip", &round_trip);
+
+      // Fraction lost is 1/256, round trip is 1/65536 seconds
+      reports.count++;
+      reports.loss += fraction_lost / 256.0;
+      reports.jitter_ms += jitter * 1000.0 / RTP_VIDEO_CLOCK_RATE;
+      reports.rtt_ms += round_trip * 1000.0 / 65536.0;
+    }
+    G_GNUC_END_IGNORE_DEPRECATIONS
+
+    gst_structure_free(stats);
+  }
+
+  if (reports.count) {
+    reports.loss /= reports.count;
+    reports.jitter_ms /= reports.count;
+    reports.rtt_ms /= reports.count;
+  }
+
+  return reports;
+}
+
+void BitrateController::Adapt(const Reports &reports) {
+  if (!encoder || reports.count == 0) {
+    return;
+  }
+
+  auto prefix = "abr." + mount + ".";
+  Metrics::Set(prefix + "receivers", reports.count);
+  Metrics::Set(prefix + "loss-permille", (gint64) (reports.loss * 1000));
+  Metrics::Set(prefix + "jitter-ms", (gint64) reports.jitter_ms);
+  Metrics::Set(prefix + "rtt-ms", (gint64) reports.rtt_ms);
+
+  gint64 now = g_get_monotonic_time();
+  bool congested = reports.loss > config.abr_loss_high || reports.rtt_ms > config.abr_rtt_high_ms;
+  bool calm = reports.loss < config.abr_loss_low && reports.rtt_ms < config.abr_rtt_high_ms / 2.0;
+
+  if (!calm) {
+    calm_since = 0;
+  } else if (!calm_since) {
+    calm_since = now;
+  }
+
+  // Step down fast, but let the previous step take effect first
+  if (congested && now - last_change >= 2 * ABR_POLL_INTERVAL * G_TIME_SPAN_SECOND) {
+    if (bitrate > config.abr_min_kbps) {
+      SetBitrate(MAX (config.abr_min_kbps, (guint) (bitrate * ABR_STEP_DOWN)));
+    } else if (filter && framerate > config.abr_min_fps) {
+      SetFramerate(MAX (config.abr_min_fps, framerate / 2));
+    }
+    last_change = now;
+  }
+
+  // Step up slowly, only after the reports were calm for the whole hold time
+  if (calm && now - calm_since >= (gint64) config.abr_hold_ms * G_TIME_SPAN_MILLISECOND) {
+    if (filter && framerate < config.abr_max_fps) {
+      SetFramerate(MIN (config.abr_max_fps, framerate * 2));
+    } else if (bitrate < config.abr_max_kbps) {
+      SetBitrate(MIN (config.abr_max_kbps, (guint) (bitrate * ABR_STEP_UP)));
+    }
+    last_change = now;
+    calm_since = now;
+  }
+}
+
+void BitrateController::SetBitrate(guint kbps) {
+  GST_INFO("ABR of \"%s\": bitrate %u => %u kbps", mount.c_str(), bitrate, kbps);
+
+  bitrate = kbps;
+  g_object_set(encoder, "bitrate", bitrate, NULL);
+
+  Metrics::Set("abr." + mount + ".bitrate-kbps", bitrate);
+}
+
+void BitrateController::SetFramerate(guint fps) {
+  GST_INFO("ABR of \"%s\": framerate %u => %u fps", mount.c_str(), framerate, fps);
+
+  framerate = fps;
+
+  GstCaps *caps = NULL;
+  g_object_get(filter, "caps", &caps, NULL);
+
+  caps = caps ? gst_caps_make_writable(caps) : gst_caps_new_empty_simple("video/x-raw");
+  gst_caps_set_simple(caps, "framerate", GST_TYPE_FRACTION, framerate, 1, NULL);
+  g_object_set(filter, "caps", caps, NULL);
+  gst_caps_unref(caps);
+
+  Metrics::Set("abr." + mount + ".fps", framerate);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <gst/rtsp-server/rtsp-server.h>
+#include <string>
+
+#include "mount.h"
+
+#define ABR_POLL_INTERVAL 1 // seconds
+
+// Adapts the encoder of a mount to the RTCP receiver reports of its clients.
+// The bitrate is lowered quickly on loss or high RTT and raised slowly after a
+// calm hold period, with a dead band between the two thresholds. When the
+// bitrate is already at its minimum, the framerate is lowered as well.
+
+class BitrateController {
+public:
+
+  BitrateController(GstRTSPMedia *media, const std::string &mount, const MountConfig &config);
+  ~BitrateController();
+
+private:
+
+  struct Reports {
+    guint count;
+    double loss;
+    double jitter_ms;
+    double rtt_ms;
+  };
+
+  static gboolean Poll(gpointer user_data);
+
+  Reports Collect();
+  void Adapt(const Reports &reports);
+  void SetBitrate(guint kbps);
+  void SetFramerate(guint fps);
+
+  GstRTSPMedia *media;
+  GstElement *encoder;
+  GstElement *filter;
+  std::string mount;
+  MountConfig config;
+  guint poll_source;
+
+  guint bitrate;
+  guint framerate;
+  gint64 last_change;
+  gint64 calm_since;
+};
@@ -0,0 +1,133 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alignedfile.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_alignedfile);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_alignedfile       // set as default
+
+AlignedFile::AlignedFile(gsize buffer_size, bool direct_io, guint64 preallocate)
+    : buffer_size(MAX (ALIGNED_FILE_BLOCK, buffer_size / ALIGNED_FILE_BLOCK * ALIGNED_FILE_BLOCK)),
+      direct_io(direct_io),
+      preallocate(preallocate),
+      fd(-1),
+      buffer(NULL),
+      used(0),
+      written(0) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_ALIGNEDFILE", GST_DEBUG_FG_WHITE, "Aligned file writer"
+  );
+
+  void *memory = NULL;
+  if (posix_memalign(&memory, ALIGNED_FILE_BLOCK, this->buffer_size) == 0) {
+    buffer = (guint8 *) memory;
+  }
+}
+
+AlignedFile::~AlignedFile() {
+  Close();
+  free(buffer);
+}
+
+bool AlignedFile::Open(const std::string &path) {
+  GCF_ERROR_RETURN_VAL(!buffer, false, "No buffer to write \"%s\"!", path.c_str());
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+#ifdef O_DIRECT
+  if (direct_io) {
+    fd = open(path.c_str(), flags | O_DIRECT, 0644);
+    if (fd < 0) {
+      GST_WARNING("No direct I/O for \"%s\": %s", path.c_str(), strerror(errno));
+    }
+  }
+#endif
+
+  if (fd < 0) {
+    fd = open(path.c_str(), flags, 0644);
+  }
+
+  GCF_ERROR_RETURN_VAL(fd < 0, false, "Can't open \"%s\": %s", path.c_str(), strerror(errno));
+
+  // Only a hint, the file is written anyway
+  if (preallocate) {
+#ifdef FALLOC_FL_KEEP_SIZE
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, preallocate) != 0) {
+      GST_DEBUG("No preallocation for \"%s\": %s", path.c_str(), strerror(errno));
+    }
+#else
+    posix_fallocate(fd, 0, preallocate);
+#endif
+  }
+
+  used = 0;
+  written = 0;
+  return true;
+}
+
+bool AlignedFile::Write(const void *data, gsize size) {
+  const guint8 *bytes = (const guint8 *) data;
+
+  while (size) {
+    gsize chunk = MIN (size, buffer_size - used);
+    memcpy(buffer + used, bytes, chunk);
+    used += chunk;
+    bytes += chunk;
+    size -= chunk;
+
+    if (used == buffer_size && !Flush()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Writes the whole buffer, only the tail at closing may be shorter
+bool AlignedFile::Flush() {
+  gsize done = 0;
+
+  while (done < used) {
+    ssize_t result = write(fd, buffer + done, used - done);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    GCF_ERROR_RETURN_VAL(result <= 0, false, "Write failed: %s", strerror(errno));
+    done += result;
+  }
+
+  written += used;
+  used = 0;
+  return true;
+}
+
+bool AlignedFile::Close() {
+  if (fd < 0) {
+    return true;
+  }
+
+#ifdef O_DIRECT
+  // The tail is not a whole block
+  if (used % ALIGNED_FILE_BLOCK) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+  }
+#endif
+
+  bool ok = Flush();
+
+  // Give back what the preallocation reserved beyond the data
+  if (preallocate && ftruncate(fd, written) != 0) {
+    GST_WARNING("Can't trim the preallocated space: %s", strerror(errno));
+  }
+
+  ok = fdatasync(fd) == 0 && ok;
+  ok = close(fd) == 0 && ok;
+  fd = -1;
+
+  return ok;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <string>
+
+#define ALIGNED_FILE_BLOCK 4096
+
+// Write-only file collecting the data in a large aligned buffer, written
+// out in whole buffers. With direct I/O the page cache is bypassed, the
+// unaligned tail is written after switching it off. Space can be
+// preallocated so long recordings don't fragment the disk.
+
+class AlignedFile {
+public:
+
+  AlignedFile(gsize buffer_size, bool direct_io, guint64 preallocate);
+  ~AlignedFile();
+
+  bool Open(const std::string &path);
+  bool Write(const void *data, gsize size);
+  bool Close();
+
+  guint64 Size() const { return written + used; }
+
+private:
+
+  bool Flush();
+
+  gsize buffer_size;
+  bool direct_io;
+  guint64 preallocate;
+
+  int fd;
+  guint8 *buffer;
+  gsize used;
+  guint64 written;
+};
@@ -0,0 +1,183 @@
+#include <atomic>
+#include <cstring>
+
+#include "arenaallocator.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_plugin_arena);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_plugin_arena       // set as default
+
+struct GcfArenaMemory {
+  GstMemory mem;
+
+  // Start of the slab, shared with the sub-memories
+  guint8 *data;
+};
+
+// The category is needed before the first instance: arenas over the budget make none
+G_DEFINE_TYPE_WITH_CODE (GcfArenaAllocator, gcf_arena_allocator, GST_TYPE_ALLOCATOR,
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "GCF_PLUGIN_ARENA", GST_DEBUG_FG_BLUE, "Slab arena allocator"));
+
+static std::atomic<gsize> reserved(0);
+static std::atomic<gsize> huge(0);
+static std::atomic<guint64> fallbacks(0);
+
+static GstMemory *gcf_arena_allocator_alloc(GstAllocator *allocator, gsize size, GstAllocationParams *params) {
+  SlabArena *arena = GCF_ARENA_ALLOCATOR (allocator)->arena;
+  gsize maxsize = size + params->prefix + params->padding;
+
+  guint8 *slab = NULL;
+  if (maxsize <= arena->SlabSize() && params->align < SLAB_PAGE_SIZE) {
+    slab = arena->Acquire();
+  }
+
+  if (!slab) {
+    fallbacks++;
+    GST_LOG_OBJECT (allocator, "No slab for %" G_GSIZE_FORMAT " bytes, using system memory", maxsize);
+    return gst_allocator_alloc(NULL, size, params);
+  }
+
+  auto *memory = g_slice_new(GcfArenaMemory);
+  gst_memory_init(GST_MEMORY_CAST (memory), params->flags, allocator, NULL, arena->SlabSize(), params->align,
+                  params->prefix, size);
+  memory->data = slab;
+
+  if (params->prefix && (params->flags & GST_MEMORY_FLAG_ZERO_PREFIXED)) {
+    memset(slab, 0, params->prefix);
+  }
+  if (params->flags & GST_MEMORY_FLAG_ZERO_PADDED) {
+    memset(slab + params->prefix + size, 0, arena->SlabSize() - params->prefix - size);
+  }
+
+  return GST_MEMORY_CAST (memory);
+}
+
+static void gcf_arena_allocator_free(GstAllocator *allocator, GstMemory *mem) {
+  auto *memory = (GcfArenaMemory *) mem;
+
+  // Sub-memories only borrow the slab of their parent
+  if (!mem->parent) {
+    GCF_ARENA_ALLOCATOR (allocator)->arena->Release(memory->data);
+  }
+
+  g_slice_free(GcfArenaMemory, memory);
+}
+
+static gpointer gcf_arena_memory_map(GstMemory *mem, gsize maxsize, GstMapFlags flags) {
+  return ((GcfArenaMemory *) mem)->data;
+}
+
+static void gcf_arena_memory_unmap(GstMemory *mem) {
+}
+
+static GstMemory *gcf_arena_memory_share(GstMemory *mem, gssize offset, gssize size) {
+  GstMemory *parent = mem->parent ? mem->parent : mem;
+
+  if (size == -1) {
+    size = mem->size - offset;
+  }
+
+  auto *shared = g_slice_new(GcfArenaMemory);
+  auto flags = (GstMemoryFlags) (GST_MINI_OBJECT_FLAGS (parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY);
+  gst_memory_init(GST_MEMORY_CAST (shared), flags, mem->allocator, parent, mem->maxsize, mem->align,
+                  mem->offset + offset, size);
+  shared->data = ((GcfArenaMemory *) mem)->data;
+
+  return GST_MEMORY_CAST (shared);
+}
+
+static gboolean gcf_arena_memory_is_span(GstMemory *mem1, GstMemory *mem2, gsize *offset) {
+  if (offset) {
+    *offset = mem1->offset - mem1->parent->offset;
+  }
+
+  return ((GcfArenaMemory *) mem1)->data + mem1->offset + mem1->size
+      == ((GcfArenaMemory *) mem2)->data + mem2->offset;
+}
+
+static void gcf_arena_allocator_finalize(GObject *object) {
+  GcfArenaAllocator *self = GCF_ARENA_ALLOCATOR (object);
+
+  if (self->arena) {
+    GST_DEBUG_OBJECT (self, "Unmapping %" G_GSIZE_FORMAT " bytes", self->arena->MappedSize());
+    reserved -= self->arena->MappedSize();
+    if (self->arena->Huge()) {
+      huge -= self->arena->MappedSize();
+    }
+    delete self->arena;
+    self->arena = NULL;
+  }
+
+  G_OBJECT_CLASS (gcf_arena_allocator_parent_class)->finalize(object);
+}
+
+static void gcf_arena_allocator_class_init(GcfArenaAllocatorClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+  gobject_class->finalize = gcf_arena_allocator_finalize;
+
+  allocator_class->alloc = gcf_arena_allocator_alloc;
+  allocator_class->free = gcf_arena_allocator_free;
+}
+
+static void gcf_arena_allocator_init(GcfArenaAllocator *self) {
+  GstAllocator *allocator = GST_ALLOCATOR_CAST (self);
+
+  allocator->mem_type = GCF_ARENA_MEMORY_TYPE;
+  allocator->mem_map = gcf_arena_memory_map;
+  allocator->mem_unmap = gcf_arena_memory_unmap;
+  allocator->mem_share = gcf_arena_memory_share;
+  allocator->mem_is_span = gcf_arena_memory_is_span;
+
+  self->arena = NULL;
+}
+
+GstAllocator *gcf_arena_allocator_new(gsize slab_size, guint slabs, gboolean hugepages, gsize budget) {
+  g_type_ensure(GCF_TYPE_ARENA_ALLOCATOR);
+  gsize footprint = SlabArena::Footprint(slab_size, slabs, hugepages);
+
+  // Claimed before mapping, two pipes negotiating at once can't both get the rest
+  gsize current = reserved.load();
+  do {
+    if (current + footprint > budget) {
+      GST_WARNING("Arena of %u x %" G_GSIZE_FORMAT " bytes is over the budget: %" G_GSIZE_FORMAT
+                  " of %" G_GSIZE_FORMAT " bytes in use", slabs, slab_size, current, budget);
+      return NULL;
+    }
+  } while (!reserved.compare_exchange_weak(current, current + footprint));
+
+  auto *arena = new SlabArena(slab_size, slabs, hugepages);
+  if (!arena->Valid()) {
+    GST_WARNING("Can't map an arena of %u x %" G_GSIZE_FORMAT " bytes", slabs, slab_size);
+    reserved -= footprint;
+    delete arena;
+    return NULL;
+  }
+
+  // Without hugepages the mapping is rounded to normal pages only
+  reserved -= footprint - arena->MappedSize();
+  if (arena->Huge()) {
+    huge += arena->MappedSize();
+  }
+
+  auto *self = (GcfArenaAllocator *) g_object_new(GCF_TYPE_ARENA_ALLOCATOR, NULL);
+  gst_object_ref_sink(self);
+  self->arena = arena;
+
+  GST_INFO_OBJECT (self, "%u slabs of %" G_GSIZE_FORMAT " bytes on %s pages", slabs, arena->SlabSize(),
+                   arena->Huge() ? "huge" : "normal");
+
+  return GST_ALLOCATOR_CAST (self);
+}
+
+gsize gcf_arena_allocator_reserved(void) {
+  return reserved;
+}
+
+gsize gcf_arena_allocator_huge(void) {
+  return huge;
+}
+
+guint64 gcf_arena_allocator_fallbacks(void) {
+  return fallbacks;
+}
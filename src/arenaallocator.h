@@ -0,0 +1,37 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include "slabarena.h"
+
+// GstAllocator handing out the slabs of one SlabArena. A request bigger
+// than a slab, or made while every slab is in use, gets system memory, so
+// the pool using it never stalls on the arena.
+
+#define GCF_TYPE_ARENA_ALLOCATOR (gcf_arena_allocator_get_type ())
+#define GCF_ARENA_ALLOCATOR(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GCF_TYPE_ARENA_ALLOCATOR, GcfArenaAllocator))
+#define GCF_IS_ARENA_ALLOCATOR(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GCF_TYPE_ARENA_ALLOCATOR))
+
+#define GCF_ARENA_MEMORY_TYPE "GcfArenaMemory"
+
+struct GcfArenaAllocator {
+  GstAllocator parent;
+
+  SlabArena *arena;
+};
+
+struct GcfArenaAllocatorClass {
+  GstAllocatorClass parent_class;
+};
+
+GType gcf_arena_allocator_get_type(void);
+
+// NULL when the arena would not fit into the budget or can't be mapped
+GstAllocator *gcf_arena_allocator_new(gsize slab_size, guint slabs, gboolean hugepages, gsize budget);
+
+// Bytes mapped by the living arenas, and the part of it on hugepages
+gsize gcf_arena_allocator_reserved(void);
+gsize gcf_arena_allocator_huge(void);
+
+// Allocations that got system memory instead of a slab
+guint64 gcf_arena_allocator_fallbacks(void);
@@ -0,0 +1,168 @@
+#include <gst/video/video.h>
+#include <gst/video/gstvideopool.h>
+
+#include "arenapool.h"
+#include "arenaallocator.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_arena);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_arena       // set as default
+
+MemoryConfig ArenaPool::config;
+
+// Only a plain system memory proposal is replaced
+static bool ProposesSystemMemory(GstQuery *query) {
+  if (gst_query_get_n_allocation_params(query)) {
+    GstAllocator *allocator = NULL;
+    gst_query_parse_nth_allocation_param(query, 0, &allocator, NULL);
+    if (allocator) {
+      bool system = !g_strcmp0(allocator->mem_type, GST_ALLOCATOR_SYSMEM);
+      gst_object_unref(allocator);
+      if (!system) {
+        return false;
+      }
+    }
+  }
+
+  if (gst_query_get_n_allocation_pools(query)) {
+    GstBufferPool *pool = NULL;
+    gst_query_parse_nth_allocation_pool(query, 0, &pool, NULL, NULL, NULL);
+    if (pool) {
+      GType type = G_OBJECT_TYPE (pool);
+      gst_object_unref(pool);
+      if (type != GST_TYPE_VIDEO_BUFFER_POOL && type != GST_TYPE_BUFFER_POOL) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void ArenaPool::Init(const MemoryConfig &config) {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_ARENA", GST_DEBUG_FG_GREEN, "Slab arena buffer pools"
+  );
+
+  ArenaPool::config = config;
+
+  if (config.arena) {
+    GST_INFO("Raw video from arenas of %u slabs, %u MB in all%s", config.slabs, config.budget_mb,
+             config.hugepages ? ", on hugepages if reserved" : "");
+    g_timeout_add_seconds(METRICS_DUMP_INTERVAL, UpdateMetrics, NULL);
+  }
+}
+
+void ArenaPool::Attach(GstElement *pipe) {
+  if (!config.arena) {
+    return;
+  }
+
+  GstIterator *iterator = gst_bin_iterate_recurse(GST_BIN (pipe));
+  GValue item = G_VALUE_INIT;
+
+  bool done = false;
+  while (!done) {
+    switch (gst_iterator_next(iterator, &item)) {
+      case GST_ITERATOR_OK:
+        gst_element_foreach_src_pad((GstElement *) g_value_get_object(&item), AttachPad, NULL);
+        g_value_reset(&item);
+        break;
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync(iterator);
+        break;
+      default:
+        done = true;
+        break;
+    }
+  }
+
+  g_value_unset(&item);
+  gst_iterator_free(iterator);
+}
+
+gboolean ArenaPool::AttachPad(GstElement *element, GstPad *pad, gpointer user_data) {
+  // Attached once, a resync may walk the elements again
+  if (!g_object_get_data(G_OBJECT (pad), "gcf-arena-probe")) {
+    g_object_set_data(G_OBJECT (pad), "gcf-arena-probe", GINT_TO_POINTER (TRUE));
+    gst_pad_add_probe(pad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM | GST_PAD_PROBE_TYPE_PULL),
+                      OfferArena, NULL, NULL);
+  }
+  return TRUE;
+}
+
+// Downstream has answered, the element is about to pick from the answer
+GstPadProbeReturn ArenaPool::OfferArena(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+  if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  GstCaps *caps = NULL;
+  gst_query_parse_allocation(query, &caps, NULL);
+
+  GstVideoInfo video_info;
+  if (!caps || !gst_video_info_from_caps(&video_info, caps)
+      || !gst_caps_features_is_equal(gst_caps_get_features(caps, 0), GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY)
+      || !ProposesSystemMemory(query)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  guint size = GST_VIDEO_INFO_SIZE (&video_info);
+  guint min = 0;
+  guint max = 0;
+  if (gst_query_get_n_allocation_pools(query)) {
+    gst_query_parse_nth_allocation_pool(query, 0, NULL, &size, &min, &max);
+    size = MAX (size, GST_VIDEO_INFO_SIZE (&video_info));
+  }
+
+  GstAllocationParams params;
+  gst_allocation_params_init(&params);
+  if (gst_query_get_n_allocation_params(query)) {
+    gst_query_parse_nth_allocation_param(query, 0, NULL, &params);
+  }
+
+  GstAllocator *allocator = gcf_arena_allocator_new(size + params.prefix + params.padding,
+                                                    MAX (config.slabs, min), config.hugepages,
+                                                    (gsize) config.budget_mb << 20);
+  if (!allocator) {
+    GST_WARNING_OBJECT (pad, "No arena for %" GST_PTR_FORMAT ", staying on system memory", caps);
+    return GST_PAD_PROBE_OK;
+  }
+
+  // No maximum: the allocator hands out system memory when the slabs run out
+  // rather than the pool blocking the streaming thread
+  GstBufferPool *pool = gst_video_buffer_pool_new();
+  GstStructure *pool_config = gst_buffer_pool_get_config(pool);
+  gst_buffer_pool_config_set_params(pool_config, caps, size, min, 0);
+  gst_buffer_pool_config_set_allocator(pool_config, allocator, &params);
+  gst_buffer_pool_config_add_option(pool_config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+  gst_buffer_pool_set_config(pool, pool_config);
+
+  if (gst_query_get_n_allocation_pools(query)) {
+    gst_query_set_nth_allocation_pool(query, 0, pool, size, min, 0);
+  } else {
+    gst_query_add_allocation_pool(query, pool, size, min, 0);
+  }
+
+  if (gst_query_get_n_allocation_params(query)) {
+    gst_query_set_nth_allocation_param(query, 0, allocator, &params);
+  } else {
+    gst_query_add_allocation_param(query, allocator, &params);
+  }
+
+  GST_DEBUG_OBJECT (pad, "Offered an arena pool of %u byte buffers", size);
+  Metrics::Add("arena.pools", 1);
+
+  gst_object_unref(pool);
+  gst_object_unref(allocator);
+  return GST_PAD_PROBE_OK;
+}
+
+gboolean ArenaPool::UpdateMetrics(gpointer user_data) {
+  Metrics::Set("arena.reserved-bytes", gcf_arena_allocator_reserved());
+  Metrics::Set("arena.hugepage-bytes", gcf_arena_allocator_huge());
+  Metrics::Set("arena.fallbacks", gcf_arena_allocator_fallbacks());
+  return G_SOURCE_CONTINUE;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <gst/gst.h>
+
+// Options of the "memory" json object
+struct MemoryConfig {
+  // Raw video buffers come from preallocated slab arenas
+  bool arena = false;
+  // All the arenas together, in megabytes
+  guint budget_mb = 256;
+  // Slabs of one arena, one arena per negotiated caps
+  guint slabs = 8;
+  bool hugepages = true;
+};
+
+// Raw frames of the app's pipes are allocated from slab arenas instead of
+// the heap: the allocation queries answered to the elements get an arena
+// backed pool in place of the plain system memory one. Pools of hardware
+// or shared memory stay where downstream proposed them.
+
+class ArenaPool {
+public:
+
+  static void Init(const MemoryConfig &config);
+
+  // Watches the allocation queries of every element in the pipe
+  static void Attach(GstElement *pipe);
+
+private:
+
+  static gboolean AttachPad(GstElement *element, GstPad *pad, gpointer user_data);
+  static GstPadProbeReturn OfferArena(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+  static gboolean UpdateMetrics(gpointer user_data);
+
+  static MemoryConfig config;
+};
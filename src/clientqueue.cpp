@@ -0,0 +1,271 @@
+#include "clientqueue.h"
+#include "metrics.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_client_queue);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_client_queue       // set as default
+
+void ClientQueue::Install(GstRTSPClient *client, const std::string &mount, const MountConfig &config) {
+  ClientQueue *queue = new ClientQueue(client, mount, config);
+
+  // The queue lives as long as the client uses it as send function
+  gst_rtsp_client_set_send_func(client, Send, queue, Destroy);
+  gst_rtsp_client_set_send_messages_func(client, SendMessages, queue, NULL);
+  g_signal_connect(client, "closed", G_CALLBACK(Closed), queue);
+}
+
+ClientQueue::ClientQueue(GstRTSPClient *client, const std::string &mount, const MountConfig &config)
+    : client(client),
+      max_bytes(config.tcp_queue_bytes),
+      max_time((gint64) config.tcp_queue_ms * G_TIME_SPAN_MILLISECOND),
+      disconnect_time((gint64) config.tcp_disconnect_ms * G_TIME_SPAN_MILLISECOND),
+      queued_bytes(0),
+      running(true),
+      skipping(false),
+      skipping_since(0),
+      previous_delta(true),
+      dropped(0) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_CLIENT_QUEUE", GST_DEBUG_FG_CYAN, "Send queue of TCP clients"
+  );
+
+  static gint client_count = 0;
+  connection = gst_rtsp_client_get_connection(client);
+  metrics_prefix = "tcp." + mount + "." + gst_rtsp_connection_get_ip(connection)
+      + "#" + std::to_string(g_atomic_int_add(&client_count, 1)) + ".";
+
+  g_mutex_init(&lock);
+  g_cond_init(&cond);
+  thread = g_thread_new("client-queue", Writer, this);
+
+  GST_INFO("Bounded send queue for %s: %" G_GSIZE_FORMAT " bytes, %" G_GINT64_FORMAT " ms",
+           metrics_prefix.c_str(), max_bytes, max_time / G_TIME_SPAN_MILLISECOND);
+}
+
+ClientQueue::~ClientQueue() {
+  Stop();
+  g_cond_clear(&cond);
+  g_mutex_clear(&lock);
+}
+
+gboolean ClientQueue::Send(GstRTSPClient *client, GstRTSPMessage *message, gboolean close, gpointer user_data) {
+  static_cast<ClientQueue *>(user_data)->Push(message, close);
+
+  // Dropping is the policy, not an error of the client
+  return TRUE;
+}
+
+gboolean ClientQueue::SendMessages(GstRTSPClient *client, GstRTSPMessage *messages, guint n_messages,
+                                   gboolean close, gpointer user_data) {
+  for (guint i = 0; i < n_messages; i++) {
+    static_cast<ClientQueue *>(user_data)->Push(&messages[i], close && i == n_messages - 1);
+  }
+
+  return TRUE;
+}
+
+void ClientQueue::Destroy(gpointer user_data) {
+  delete static_cast<ClientQueue *>(user_data);
+}
+
+// In the main loop, which must not wait for the writer: it is only cancelled
+// here and joined when the client lets the queue go
+void ClientQueue::Closed(GstRTSPClient *client, gpointer user_data) {
+  static_cast<ClientQueue *>(user_data)->Cancel();
+}
+
+gboolean ClientQueue::Disconnect(gpointer user_data) {
+  GstRTSPClient *client = GST_RTSP_CLIENT (user_data);
+
+  gst_rtsp_client_close(client);
+  g_object_unref(client);
+
+  return FALSE;
+}
+
+void ClientQueue::Push(GstRTSPMessage *message, gboolean close) {
+  bool media = false, delta = false, keyframe_start = false;
+  gsize size = 0;
+
+  if (gst_rtsp_message_get_type(message) == GST_RTSP_MESSAGE_DATA) {
+    guint8 channel = 0;
+    GstBuffer *body = NULL;
+    gst_rtsp_message_parse_data(message, &channel);
+
+    if (gst_rtsp_message_get_body_buffer(message, &body) == GST_RTSP_OK && body) {
+      size = gst_buffer_get_size(body);
+
+      // RTP is on the even channels, RTCP is tiny and is never dropped
+      if (channel % 2 == 0) {
+        delta = GST_BUFFER_FLAG_IS_SET (body, GST_BUFFER_FLAG_DELTA_UNIT);
+        media = true;
+      }
+    } else {
+      guint8 *data;
+      guint data_size = 0;
+      gst_rtsp_message_get_body(message, &data, &data_size);
+      size = data_size;
+    }
+  }
+
+  g_mutex_lock(&lock);
+
+  if (!running) {
+    g_mutex_unlock(&lock);
+    return;
+  }
+
+  gint64 now = g_get_monotonic_time();
+
+  if (media) {
+    keyframe_start = !delta && previous_delta;
+    previous_delta = delta;
+
+    if (skipping && keyframe_start) {
+      GST_INFO("%s: resuming at keyframe after %" G_GUINT64_FORMAT " dropped packets",
+               metrics_prefix.c_str(), dropped);
+      skipping = false;
+    }
+
+    if (!skipping) {
+      gint64 age = items.empty() ? 0 : now - items.front().queued_at;
+
+      if (queued_bytes + size > max_bytes || age > max_time) {
+        GST_WARNING("%s: backlog is over budget (%" G_GSIZE_FORMAT " bytes, %" G_GINT64_FORMAT " ms), "
+                    "skipping to the next keyframe", metrics_prefix.c_str(), queued_bytes,
+                    age / G_TIME_SPAN_MILLISECOND);
+        DropMedia();
+        skipping = true;
+        skipping_since = now;
+        Metrics::Add("tcp.skips", 1);
+      }
+    }
+
+    if (skipping) {
+      dropped++;
+
+      if (now - skipping_since > disconnect_time) {
+        GST_WARNING("%s: no keyframe could be delivered in time, disconnecting", metrics_prefix.c_str());
+        running = false;
+        g_cond_broadcast(&cond);
+        g_idle_add(Disconnect, g_object_ref(client));
+        Metrics::Add("tcp.disconnects", 1);
+      }
+
+      UpdateMetrics();
+      g_mutex_unlock(&lock);
+      return;
+    }
+  }
+
+  Item item;
+  gst_rtsp_message_copy(message, &item.message);
+  item.size = size;
+  item.queued_at = now;
+  item.media = media;
+  item.close = close;
+
+  items.push_back(item);
+  queued_bytes += size;
+  g_cond_signal(&cond);
+
+  UpdateMetrics();
+  g_mutex_unlock(&lock);
+}
+
+// Lock must be held
+void ClientQueue::DropMedia() {
+  for (auto itr = items.begin(); itr != items.end();) {
+    if (itr->media) {
+      queued_bytes -= itr->size;
+      gst_rtsp_message_free(itr->message);
+      itr = items.erase(itr);
+      dropped++;
+    } else {
+      ++itr;
+    }
+  }
+}
+
+// Lock must be held
+void ClientQueue::UpdateMetrics() {
+  gint64 age = items.empty() ? 0 : g_get_monotonic_time() - items.front().queued_at;
+
+  Metrics::Set(metrics_prefix + "backlog-bytes", queued_bytes);
+  Metrics::Set(metrics_prefix + "backlog-ms", age / G_TIME_SPAN_MILLISECOND);
+  Metrics::Set(metrics_prefix + "dropped-packets", dropped);
+}
+
+gpointer ClientQueue::Writer(gpointer user_data) {
+  ClientQueue *self = static_cast<ClientQueue *>(user_data);
+
+  g_mutex_lock(&self->lock);
+
+  while (self->running) {
+    if (self->items.empty()) {
+      g_cond_wait(&self->cond, &self->lock);
+      continue;
+    }
+
+    Item item = self->items.front();
+    self->items.pop_front();
+    self->queued_bytes -= item.size;
+
+    g_mutex_unlock(&self->lock);
+
+    // A write blocked longer than the disconnect threshold fails the client,
+    // Cancel() interrupts it sooner
+    GstRTSPResult result = gst_rtsp_connection_send_usec(self->connection, item.message, self->disconnect_time);
+    gst_rtsp_message_free(item.message);
+
+    g_mutex_lock(&self->lock);
+
+    if (!self->running) {
+      break;
+    }
+
+    if (result != GST_RTSP_OK || item.close) {
+      if (result != GST_RTSP_OK) {
+        GST_WARNING("%s: sending failed, disconnecting", self->metrics_prefix.c_str());
+        Metrics::Add("tcp.disconnects", 1);
+      }
+
+      self->running = false;
+      g_idle_add(Disconnect, g_object_ref(self->client));
+    }
+  }
+
+  g_mutex_unlock(&self->lock);
+
+  return NULL;
+}
+
+// Wakes the writer and interrupts the write it may be blocked in
+void ClientQueue::Cancel() {
+  g_mutex_lock(&lock);
+  running = false;
+  g_cond_broadcast(&cond);
+  g_mutex_unlock(&lock);
+
+  if (thread) {
+    gst_rtsp_connection_flush(connection, TRUE);
+  }
+}
+
+void ClientQueue::Stop() {
+  Cancel();
+
+  // Cancelled, the writer is out of the connection right away
+  if (thread) {
+    g_thread_join(thread);
+    thread = NULL;
+  }
+
+  for (auto &item : items) {
+    gst_rtsp_message_free(item.message);
+  }
+  items.clear();
+  queued_bytes = 0;
+
+  Metrics::Remove(metrics_prefix);
+}
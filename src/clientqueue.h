@@ -0,0 +1,69 @@
+#pragma once
+
+#include <gst/rtsp-server/rtsp-server.h>
+#include <string>
+#include <deque>
+
+#include "mount.h"
+
+// Bounded send queue of a client streaming RTP over the RTSP (TCP) connection.
+// Every message of the client goes through the queue and is written by a
+// dedicated thread, so a congested connection never blocks the shared media.
+// Above the byte/time budget the queued media is dropped and sending resumes
+// at the next keyframe, a client stuck for too long is disconnected.
+
+class ClientQueue {
+public:
+
+  // Takes over sending for the client, it's released together with the client
+  static void Install(GstRTSPClient *client, const std::string &mount, const MountConfig &config);
+
+private:
+
+  struct Item {
+    GstRTSPMessage *message;
+    gsize size;
+    gint64 queued_at;
+    bool media;
+    bool close;
+  };
+
+  ClientQueue(GstRTSPClient *client, const std::string &mount, const MountConfig &config);
+  ~ClientQueue();
+
+  static gboolean Send(GstRTSPClient *client, GstRTSPMessage *message, gboolean close, gpointer user_data);
+  static gboolean SendMessages(GstRTSPClient *client, GstRTSPMessage *messages, guint n_messages,
+                               gboolean close, gpointer user_data);
+  static void Destroy(gpointer user_data);
+  static void Closed(GstRTSPClient *client, gpointer user_data);
+  static gpointer Writer(gpointer user_data);
+  static gboolean Disconnect(gpointer user_data);
+
+  void Push(GstRTSPMessage *message, gboolean close);
+  void DropMedia();
+  void Cancel();
+  void Stop();
+  void UpdateMetrics();
+
+  GstRTSPClient *client;
+  GstRTSPConnection *connection;
+  std::string metrics_prefix;
+
+  // Budget
+  gsize max_bytes;
+  gint64 max_time;
+  gint64 disconnect_time;
+
+  GMutex lock;
+  GCond cond;
+  GThread *thread;
+  std::deque<Item> items;
+  gsize queued_bytes;
+  bool running;
+
+  // Keyframe tracking of the media channels
+  bool skipping;
+  gint64 skipping_since;
+  bool previous_delta;
+  guint64 dropped;
+};
@@ -0,0 +1,327 @@
+#include <glib/gstdio.h>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+
+#include "encoderselect.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_encoders);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_encoders       // set as default
+
+// Frames of a run, timed on the pads of the encoder
+struct EncoderSelector::Timing {
+  std::mutex lock;
+  std::map<GstClockTime, gint64> entered;
+  guint out = 0;
+  gint64 first_out = 0;
+  gint64 last_out = 0;
+  gint64 latency_sum = 0;
+  guint matched = 0;
+};
+
+std::map<std::string, EncoderChoiceConfig> EncoderSelector::Defaults() {
+  std::map<std::string, EncoderChoiceConfig> defaults;
+
+  // Hardware first, the software encoders set for live streams. All of them take
+  // "bitrate" in kbit/s as the ABR sets it, so v4l2 encoders, which have their
+  // rate in extra-controls, are not candidates by default.
+  defaults["@h264enc"].candidates = {
+      "vaapih264enc", "nvh264enc", "qsvh264enc",
+      "x264enc tune=zerolatency speed-preset=ultrafast",
+  };
+  defaults["@h265enc"].candidates = {
+      "vaapih265enc", "nvh265enc", "qsvh265enc",
+      "x265enc tune=zerolatency speed-preset=ultrafast",
+  };
+
+  return defaults;
+}
+
+// "x264enc tune=zerolatency", values without spaces
+bool EncoderSelector::Parse(const std::string &description, EncoderChoice *choice) {
+  gchar *text = g_strstrip(g_strdup(description.c_str()));
+  gchar **words = g_strsplit(text, " ", -1);
+  g_free(text);
+  bool valid = words[0] && *words[0];
+
+  if (valid) {
+    choice->factory = words[0];
+    choice->description = description;
+  }
+
+  for (guint i = 1; valid && words[i]; i++) {
+    if (!*words[i]) {
+      continue;
+    }
+
+    const gchar *equals = strchr(words[i], '=');
+    valid = equals && equals != words[i] && equals[1];
+    if (valid) {
+      choice->properties.emplace_back(std::string(words[i], equals - words[i]), equals + 1);
+    }
+  }
+
+  g_strfreev(words);
+  return valid;
+}
+
+std::string EncoderSelector::CachePath() {
+  gchar *path = g_build_filename(g_get_user_cache_dir(), "gcf", "encoders.ini", NULL);
+  std::string result(path);
+  g_free(path);
+  return result;
+}
+
+EncoderChoice EncoderSelector::Select(const std::string &type, const std::string &caps,
+                                      const EncoderChoiceConfig &config) {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_ENCODERS", GST_DEBUG_FG_MAGENTA, "Encoder selection"
+  );
+
+  // Only the candidates this host has, they key the decision along with the rest
+  std::vector<EncoderChoice> candidates;
+  gchar *version = gst_version_string();
+  std::string keyed = std::string(g_get_host_name()) + "\n" + ENCODER_BENCH_METHOD + "\n" + version + "\n" + type
+      + "\n" + caps + "\n" + std::to_string(config.latency_ms) + "\n" + std::to_string(config.frames);
+  g_free(version);
+
+  for (const auto &description : config.candidates) {
+    EncoderChoice candidate;
+    if (!Parse(description, &candidate)) {
+      GST_WARNING("Candidate \"%s\" of \"%s\" is not an element type with properties.", description.c_str(),
+                  type.c_str());
+      continue;
+    }
+
+    GstElementFactory *factory = gst_element_factory_find(candidate.factory.c_str());
+    if (factory) {
+      candidates.push_back(candidate);
+      keyed += "\n" + description;
+      gst_object_unref(factory);
+    }
+  }
+
+  gchar *key = g_compute_checksum_for_string(G_CHECKSUM_SHA256, keyed.c_str(), keyed.size());
+  std::string path = CachePath();
+  GKeyFile *cache = g_key_file_new();
+  g_key_file_load_from_file(cache, path.c_str(), G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+  EncoderChoice chosen;
+  gchar *cached = g_key_file_get_string(cache, type.c_str(), key, NULL);
+  for (const auto &candidate : candidates) {
+    if (cached && candidate.description == cached) {
+      chosen = candidate;
+      GST_INFO("\"%s\" at %s is \"%s\", measured before on this host", type.c_str(), caps.c_str(), cached);
+    }
+  }
+  g_free(cached);
+
+  if (chosen.factory.empty()) {
+    Result best = {false, 0, 0};
+
+    for (const auto &candidate : candidates) {
+      Result result = Measure(candidate, caps, config.frames);
+      if (!result.ok) {
+        GST_INFO("\"%s\": \"%s\" doesn't work here", type.c_str(), candidate.description.c_str());
+        continue;
+      }
+      GST_INFO("\"%s\": \"%s\" encodes %.1f fps with %.1f ms latency", type.c_str(), candidate.description.c_str(),
+               result.fps, result.latency_ms);
+
+      // Within the budget the fastest, outside of it the quickest to answer
+      bool within = result.latency_ms <= config.latency_ms;
+      bool best_within = best.ok && best.latency_ms <= config.latency_ms;
+      if (!best.ok || (within && (!best_within || result.fps > best.fps))
+          || (!within && !best_within && result.latency_ms < best.latency_ms)) {
+        best = result;
+        chosen = candidate;
+      }
+    }
+
+    if (!chosen.factory.empty()) {
+      if (best.latency_ms > config.latency_ms) {
+        GST_WARNING("No \"%s\" is within %u ms, \"%s\" answers the quickest", type.c_str(), config.latency_ms,
+                    chosen.description.c_str());
+      } else {
+        GST_INFO("\"%s\" at %s is \"%s\"", type.c_str(), caps.c_str(), chosen.description.c_str());
+      }
+
+      gchar *directory = g_path_get_dirname(path.c_str());
+      GError *error = NULL;
+      g_key_file_set_string(cache, type.c_str(), key, chosen.description.c_str());
+      if (g_mkdir_with_parents(directory, 0755) || !g_key_file_save_to_file(cache, path.c_str(), &error)) {
+        GST_WARNING("Can't cache the encoder choice at \"%s\": %s", path.c_str(),
+                    error ? error->message : g_strerror(errno));
+        g_clear_error(&error);
+      }
+      g_free(directory);
+    }
+  }
+
+  g_key_file_free(cache);
+  g_free(key);
+  return chosen;
+}
+
+// Raw caps of the bench: the size and rate of the branch, in memory any encoder takes
+GstCaps *EncoderSelector::BenchCaps(const std::string &caps_text) {
+  GstCaps *parsed = gst_caps_from_string(caps_text.c_str());
+  if (!parsed || gst_caps_is_empty(parsed) || gst_caps_is_any(parsed)
+      || !gst_structure_has_name(gst_caps_get_structure(parsed, 0), "video/x-raw")) {
+    if (parsed) {
+      gst_caps_unref(parsed);
+    }
+    parsed = gst_caps_from_string(ENCODER_DEFAULT_CAPS);
+  }
+
+  GstCaps *caps = gst_caps_truncate(parsed);
+  GstStructure *defaults = gst_structure_from_string(ENCODER_DEFAULT_CAPS, NULL);
+  GstStructure *structure = gst_caps_get_structure(caps, 0);
+  for (const char *field : {"width", "height", "framerate"}) {
+    if (!gst_structure_has_field(structure, field)) {
+      gst_structure_set_value(structure, field, gst_structure_get_value(defaults, field));
+    }
+  }
+  gst_structure_free(defaults);
+  gst_caps_set_features(caps, 0, gst_caps_features_new(GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY, NULL));
+
+  return caps;
+}
+
+// Throughput from frames queued ahead, so the encoder never waits for them;
+// latency from a live source paced at the rate of the branch, as a camera
+// feeds it, where an encoder buffering frames can't hide it behind a backlog
+EncoderSelector::Result EncoderSelector::Measure(const EncoderChoice &candidate, const std::string &caps_text,
+                                                 guint frames) {
+  Result result = {false, 0, 0};
+  GstCaps *caps = BenchCaps(caps_text);
+  Timing throughput, paced;
+
+  result.ok = Run(candidate, caps, frames, false, &throughput) && Run(candidate, caps, frames, true, &paced);
+  gst_caps_unref(caps);
+
+  // The first frame out carries the start of the encoder, the rate is taken after it
+  result.ok = result.ok && throughput.out > 1 && throughput.last_out > throughput.first_out && paced.matched > 0;
+  if (result.ok) {
+    result.fps = (throughput.out - 1) * (double) G_USEC_PER_SEC / (throughput.last_out - throughput.first_out);
+    result.latency_ms = paced.latency_sum / 1000.0 / paced.matched;
+  }
+  return result;
+}
+
+// One run of the candidate over the frames, timed on the pads of the encoder
+bool EncoderSelector::Run(const EncoderChoice &candidate, GstCaps *caps, guint frames, bool live, Timing *timing) {
+  GstElement *pipeline = gst_pipeline_new(NULL);
+  GstElement *source = gst_element_factory_make("videotestsrc", NULL);
+  GstElement *filter = gst_element_factory_make("capsfilter", NULL);
+  GstElement *queue = gst_element_factory_make("queue", NULL);
+  GstElement *encoder = gst_element_factory_make(candidate.factory.c_str(), NULL);
+  GstElement *sink = gst_element_factory_make("fakesink", NULL);
+
+  if (!source || !filter || !queue || !encoder || !sink) {
+    for (GstElement *element : {source, filter, queue, encoder, sink}) {
+      if (element) {
+        gst_object_unref(element);
+      }
+    }
+    gst_object_unref(pipeline);
+    return false;
+  }
+
+  // Moving bars, some motion for the encoders without the cost of noise
+  g_object_set(source, "num-buffers", frames, "horizontal-speed", 4, "is-live", live, NULL);
+  g_object_set(filter, "caps", caps, NULL);
+  g_object_set(queue, "max-size-buffers", frames, "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+  g_object_set(sink, "sync", live, NULL);
+
+  // A paced run lasts as long as its frames play, on top of the timeout
+  gint rate_n = 0, rate_d = 1;
+  guint timeout = ENCODER_BENCH_TIMEOUT_S;
+  gst_structure_get_fraction(gst_caps_get_structure(caps, 0), "framerate", &rate_n, &rate_d);
+  if (live && rate_n > 0) {
+    timeout += (guint) gst_util_uint64_scale_ceil(frames, rate_d, rate_n);
+  }
+
+  // As the plan converts them, a property it couldn't take rules the candidate out
+  bool configured = true;
+  for (const auto &property : candidate.properties) {
+    GParamSpec *pspec = g_object_class_find_property(G_OBJECT_GET_CLASS (encoder), property.first.c_str());
+    GValue value = G_VALUE_INIT;
+    if (pspec) {
+      g_value_init(&value, pspec->value_type);
+    }
+
+    if (!pspec || !gst_value_deserialize(&value, property.second.c_str())) {
+      GST_WARNING("\"%s\" has no property %s=%s", candidate.factory.c_str(), property.first.c_str(),
+                  property.second.c_str());
+      configured = false;
+    } else {
+      g_object_set_property(G_OBJECT (encoder), property.first.c_str(), &value);
+    }
+
+    if (pspec) {
+      g_value_unset(&value);
+    }
+  }
+
+  gst_bin_add_many(GST_BIN (pipeline), source, filter, queue, encoder, sink, NULL);
+  bool ok = false;
+
+  if (configured && gst_element_link_many(source, filter, queue, encoder, sink, NULL)) {
+    GstPad *encoder_sink = gst_element_get_static_pad(encoder, "sink");
+    GstPad *encoder_src = gst_element_get_static_pad(encoder, "src");
+    gst_pad_add_probe(encoder_sink, GST_PAD_PROBE_TYPE_BUFFER, InProbe, timing, NULL);
+    gst_pad_add_probe(encoder_src, GST_PAD_PROBE_TYPE_BUFFER, OutProbe, timing, NULL);
+    gst_object_unref(encoder_sink);
+    gst_object_unref(encoder_src);
+
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+      GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE (pipeline));
+      GstMessage *message = gst_bus_timed_pop_filtered(bus, timeout * GST_SECOND,
+                                                       (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+      ok = message && GST_MESSAGE_TYPE (message) == GST_MESSAGE_EOS;
+      if (message) {
+        gst_message_unref(message);
+      }
+      gst_object_unref(bus);
+    }
+  }
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+  return ok;
+}
+
+GstPadProbeReturn EncoderSelector::InProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  auto *timing = (Timing *) user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  std::lock_guard<std::mutex> guard(timing->lock);
+  timing->entered[GST_BUFFER_PTS (buffer)] = g_get_monotonic_time();
+  return GST_PAD_PROBE_OK;
+}
+
+// Frames are matched by their timestamps, reordered ones too
+GstPadProbeReturn EncoderSelector::OutProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  auto *timing = (Timing *) user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  gint64 now = g_get_monotonic_time();
+
+  std::lock_guard<std::mutex> guard(timing->lock);
+  if (!timing->out++) {
+    timing->first_out = now;
+  }
+  timing->last_out = now;
+
+  // The first frame out waited for the encoder to start, it doesn't count
+  auto entered = timing->entered.find(GST_BUFFER_PTS (buffer));
+  if (entered != timing->entered.end()) {
+    if (timing->out > 1) {
+      timing->latency_sum += now - entered->second;
+      timing->matched++;
+    }
+    timing->entered.erase(entered);
+  }
+  return GST_PAD_PROBE_OK;
+}
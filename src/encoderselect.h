@@ -0,0 +1,71 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Raw caps a branch is benchmarked at when its own caps don't tell
+#define ENCODER_DEFAULT_CAPS "video/x-raw,width=(int)1280,height=(int)720,framerate=(fraction)30/1"
+#define ENCODER_BENCH_TIMEOUT_S 10
+// Part of the cache key, a choice measured another way is measured again
+#define ENCODER_BENCH_METHOD "paced-latency"
+
+// An abstract encoder type of the "encoders" json object, e.g. "@h264enc"
+struct EncoderChoiceConfig {
+  // Element type and properties, "x264enc tune=zerolatency", in order of preference
+  std::vector<std::string> candidates;
+  // Mean time from a frame into the encoder to its encoded frame out, fed live
+  guint latency_ms = 100;
+  // Synthetic frames encoded by every candidate, in each of its two runs
+  guint frames = 60;
+};
+
+// The encoder chosen for an abstract type, with the properties of its candidate
+struct EncoderChoice {
+  std::string factory;
+  std::vector<std::pair<std::string, std::string>> properties;
+  std::string description;
+};
+
+// Elements of type "@h264enc" are given the encoder that does best on this
+// host. Every candidate the registry has encodes a short run of synthetic
+// frames at the caps of the branch twice: as fast as it can, for its frame
+// rate, and paced live at the rate of the branch, for its latency. The
+// fastest one within the latency budget wins, or the one with the least
+// latency if none is within it. A candidate failing to start, e.g. a
+// hardware encoder without its device, is left out. The choice is cached
+// per host, keyed by the candidates found, the caps and the GStreamer
+// version; removing the cache measures again.
+
+class EncoderSelector {
+public:
+
+  // Candidates of the abstract types known without configuration
+  static std::map<std::string, EncoderChoiceConfig> Defaults();
+
+  // Empty factory if no candidate works
+  static EncoderChoice Select(const std::string &type, const std::string &caps, const EncoderChoiceConfig &config);
+
+  // "x264enc tune=zerolatency" into its type and properties
+  static bool Parse(const std::string &description, EncoderChoice *choice);
+
+private:
+
+  struct Timing;
+
+  struct Result {
+    bool ok;
+    double fps;
+    double latency_ms;
+  };
+
+  static GstCaps *BenchCaps(const std::string &caps);
+  static Result Measure(const EncoderChoice &candidate, const std::string &caps, guint frames);
+  static bool Run(const EncoderChoice &candidate, GstCaps *caps, guint frames, bool live, Timing *timing);
+  static GstPadProbeReturn InProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+  static GstPadProbeReturn OutProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+
+  static std::string CachePath();
+};
@@ -0,0 +1,280 @@
+#include "failover.h"
+#include "topology.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_failover);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_failover       // set as default
+
+// The backup is brought to the caps of the source by this chain
+#define FAILOVER_BACKUP_CHAIN " ! videoconvert ! videoscale ! videorate ! capsfilter name=failover_caps"
+
+std::map<std::string, SourceFailover *> SourceFailover::failovers;
+
+void SourceFailover::Attach(Topology *topology) {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_FAILOVER", GST_DEBUG_FG_GREEN, "Source failover"
+  );
+
+  for (const auto &entry : topology->GetFailoverConfigs()) {
+    auto *failover = new SourceFailover(entry.first, topology->GetElement(entry.second.source), entry.second);
+    if (!failover->Build()) {
+      delete failover;
+      continue;
+    }
+
+    failovers[entry.first] = failover;
+    g_timeout_add(FAILOVER_CHECK_MS, Check, failover);
+
+    GST_INFO("Pipe \"%s\": \"%s\" is backed by \"%s\"", entry.first.c_str(), entry.second.source.c_str(),
+             entry.second.backup.c_str());
+  }
+}
+
+SourceFailover::SourceFailover(const std::string &pipe, GstElement *source, const FailoverConfig &config)
+    : pipe(pipe), source(source), selector(NULL), backup_caps(NULL),
+      primary_pad(NULL), backup_pad(NULL), config(config), on_backup(false), failed(false),
+      last_primary(0), primary_since(0), restarted(0), measuring(false), last_output(0),
+      frame_duration(0), switches(0) {
+}
+
+// Source -> selector -> what the source fed, the backup on the other input
+bool SourceFailover::Build() {
+  GError *error = NULL;
+  GstBin *bin = GST_BIN (GST_ELEMENT_PARENT (source));
+
+  GstPad *source_pad = gst_element_get_static_pad(source, "src");
+  GCF_ERROR_RETURN_VAL(!source_pad, false, "Pipe \"%s\": \"%s\" has no src pad to fail over.", pipe.c_str(),
+                       GST_ELEMENT_NAME (source));
+
+  GstPad *peer = gst_pad_get_peer(source_pad);
+  if (!peer) {
+    GST_ERROR("Pipe \"%s\": \"%s\" is not linked, nothing to fail over.", pipe.c_str(), GST_ELEMENT_NAME (source));
+    gst_object_unref(source_pad);
+    return false;
+  }
+
+  std::string description = config.backup + FAILOVER_BACKUP_CHAIN;
+  GstElement *backup = gst_parse_bin_from_description(description.c_str(), TRUE, &error);
+  if (!backup) {
+    GST_ERROR("Pipe \"%s\": can't make the backup \"%s\": %s", pipe.c_str(), config.backup.c_str(),
+              error ? error->message : "unknown");
+    g_clear_error(&error);
+    gst_object_unref(peer);
+    gst_object_unref(source_pad);
+    return false;
+  }
+  gst_object_set_name(GST_OBJECT (backup), ("failover_backup_" + pipe).c_str());
+  backup_caps = gst_bin_get_by_name(GST_BIN (backup), "failover_caps");
+
+  selector = gst_element_factory_make("input-selector", ("failover_" + pipe).c_str());
+  g_object_set(selector, "sync-streams", FALSE, NULL);
+
+  gst_pad_unlink(source_pad, peer);
+  gst_bin_add_many(bin, selector, backup, NULL);
+
+  GstPadTemplate *sink_template = gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS (selector), "sink_%u");
+  primary_pad = gst_element_request_pad(selector, sink_template, NULL, NULL);
+  backup_pad = gst_element_request_pad(selector, sink_template, NULL, NULL);
+  GstPad *selector_src = gst_element_get_static_pad(selector, "src");
+  GstPad *backup_src = gst_element_get_static_pad(backup, "src");
+
+  bool linked = gst_pad_link(source_pad, primary_pad) == GST_PAD_LINK_OK
+                && gst_pad_link(backup_src, backup_pad) == GST_PAD_LINK_OK
+                && gst_pad_link(selector_src, peer) == GST_PAD_LINK_OK;
+
+  if (linked) {
+    g_object_set(selector, "active-pad", primary_pad, NULL);
+    gst_pad_add_probe(source_pad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                      PrimaryProbe, this, NULL);
+    gst_pad_add_probe(selector_src, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                      OutputProbe, this, NULL);
+    Metrics::Set("failover." + pipe + ".active", 0);
+  } else {
+    GST_ERROR("Pipe \"%s\": can't put the failover behind \"%s\".", pipe.c_str(), GST_ELEMENT_NAME (source));
+  }
+
+  gst_object_unref(backup_src);
+  gst_object_unref(selector_src);
+  gst_object_unref(peer);
+  gst_object_unref(source_pad);
+  return linked;
+}
+
+// Under the lock
+void SourceFailover::SwitchTo(bool backup, const char *reason) {
+  g_object_set(selector, "active-pad", backup ? backup_pad : primary_pad, NULL);
+
+  on_backup = backup;
+  measuring = true;
+  restarted = g_get_monotonic_time();
+  switches++;
+
+  Metrics::Set("failover." + pipe + ".active", backup ? 1 : 0);
+  Metrics::Set("failover." + pipe + ".switches", switches);
+
+  if (backup) {
+    GST_WARNING("Pipe \"%s\": \"%s\" %s, switched to the backup", pipe.c_str(), GST_ELEMENT_NAME (source), reason);
+  } else {
+    GST_INFO("Pipe \"%s\": \"%s\" %s, switched back", pipe.c_str(), GST_ELEMENT_NAME (source), reason);
+  }
+}
+
+// Errors of a watched source don't reach the application, the backup takes over
+bool SourceFailover::Intercept(GstMessage *message) {
+  if (GST_MESSAGE_TYPE (message) != GST_MESSAGE_ERROR) {
+    return false;
+  }
+
+  for (const auto &entry : failovers) {
+    SourceFailover *failover = entry.second;
+    if (GST_MESSAGE_SRC (message) != GST_OBJECT (failover->source)
+        && !gst_object_has_as_ancestor(GST_MESSAGE_SRC (message), GST_OBJECT (failover->source))) {
+      continue;
+    }
+
+    GError *error = NULL;
+    gst_message_parse_error(message, &error, NULL);
+    GST_WARNING("Pipe \"%s\": error of \"%s\": %s", entry.first.c_str(), GST_MESSAGE_SRC_NAME (message),
+                error->message);
+    g_clear_error(&error);
+
+    std::lock_guard<std::mutex> guard(failover->lock);
+    failover->failed = true;
+    return true;
+  }
+
+  return false;
+}
+
+GstPadProbeReturn SourceFailover::PrimaryProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  auto *self = (SourceFailover *) user_data;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    gint64 now = g_get_monotonic_time();
+    std::lock_guard<std::mutex> guard(self->lock);
+
+    // Flowing again after a gap, it has to prove itself from here
+    if (now - self->last_primary > (gint64) self->config.timeout_ms * 1000) {
+      self->primary_since = now;
+    }
+    self->last_primary = now;
+    return GST_PAD_PROBE_OK;
+  }
+
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  switch (GST_EVENT_TYPE (event)) {
+
+    // The end of the source is a failure, the rest of the pipe goes on
+    case GST_EVENT_EOS: {
+      std::lock_guard<std::mutex> guard(self->lock);
+      self->failed = true;
+      return GST_PAD_PROBE_DROP;
+    }
+
+    // The backup follows the caps of the source, so a switch renegotiates nothing
+    case GST_EVENT_CAPS: {
+      GstCaps *caps;
+      gst_event_parse_caps(event, &caps);
+
+      if (!gst_structure_has_name(gst_caps_get_structure(caps, 0), "video/x-raw")) {
+        GST_WARNING("Pipe \"%s\": the backup can't be made %" GST_PTR_FORMAT, self->pipe.c_str(), caps);
+        break;
+      }
+      g_object_set(self->backup_caps, "caps", caps, NULL);
+      break;
+    }
+
+    default:
+      break;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+// Switch latency is the gap in the output, in frames of the negotiated rate
+GstPadProbeReturn SourceFailover::OutputProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  auto *self = (SourceFailover *) user_data;
+
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+    gint num, den;
+    GstCaps *caps;
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+      gst_event_parse_caps(event, &caps);
+      if (gst_structure_get_fraction(gst_caps_get_structure(caps, 0), "framerate", &num, &den) && num > 0) {
+        std::lock_guard<std::mutex> guard(self->lock);
+        self->frame_duration = G_TIME_SPAN_SECOND * den / num;
+      }
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  gint64 now = g_get_monotonic_time();
+  std::lock_guard<std::mutex> guard(self->lock);
+
+  if (self->measuring && self->last_output) {
+    gint64 gap = now - self->last_output;
+    gint64 frames = self->frame_duration ? (gap + self->frame_duration / 2) / self->frame_duration - 1 : 0;
+
+    Metrics::Set("failover." + self->pipe + ".switch-ms", gap / 1000);
+    Metrics::Set("failover." + self->pipe + ".switch-frames", MAX (frames, 0));
+    GST_INFO("Pipe \"%s\": %" G_GINT64_FORMAT " frames lost in the switch (%" G_GINT64_FORMAT " ms)",
+             self->pipe.c_str(), MAX (frames, 0), gap / 1000);
+  }
+
+  self->measuring = false;
+  self->last_output = now;
+  return GST_PAD_PROBE_OK;
+}
+
+gboolean SourceFailover::Check(gpointer user_data) {
+  auto *self = (SourceFailover *) user_data;
+  gint64 now = g_get_monotonic_time();
+  std::lock_guard<std::mutex> guard(self->lock);
+
+  // Nothing is expected from a pipe that doesn't play
+  if (GST_STATE (self->selector) != GST_STATE_PLAYING) {
+    self->last_primary = now;
+    return G_SOURCE_CONTINUE;
+  }
+
+  bool stalled = now - self->last_primary > (gint64) self->config.timeout_ms * 1000;
+
+  if (!self->on_backup) {
+    if (self->failed || stalled) {
+      self->SwitchTo(true, self->failed ? "failed" : "stalled");
+    }
+    return G_SOURCE_CONTINUE;
+  }
+
+  if (!self->failed && !stalled && now - self->primary_since >= (gint64) self->config.recover_ms * 1000) {
+    self->SwitchTo(false, "recovered");
+    return G_SOURCE_CONTINUE;
+  }
+
+  // Still out, it is started over now and then; blocking devices don't hold the loop
+  if ((self->failed || stalled) && now - self->restarted >= (gint64) self->config.recover_ms * 1000) {
+    self->restarted = now;
+    gst_element_call_async(self->source, Restart, self, NULL);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+// Runs in a thread of GStreamer's pool
+void SourceFailover::Restart(GstElement *source, gpointer user_data) {
+  auto *self = (SourceFailover *) user_data;
+  GST_DEBUG("Pipe \"%s\": restarting \"%s\"", self->pipe.c_str(), GST_ELEMENT_NAME (source));
+
+  gst_element_set_state(source, GST_STATE_NULL);
+  {
+    std::lock_guard<std::mutex> guard(self->lock);
+    self->failed = false;
+  }
+
+  if (!gst_element_sync_state_with_parent(source)) {
+    GST_DEBUG("Pipe \"%s\": \"%s\" is not back yet", self->pipe.c_str(), GST_ELEMENT_NAME (source));
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+class Topology;
+
+#define FAILOVER_CHECK_MS 100
+
+// Options of a pipe in the "failover" json object
+struct FailoverConfig {
+  // Element of the pipe watched, its output is switched
+  std::string source;
+  // Launch description of the backup input, e.g. "videotestsrc is-live=true"
+  std::string backup;
+  // No buffer for this long switches to the backup
+  guint timeout_ms = 1000;
+  // The primary has to deliver this long before it is switched back
+  guint recover_ms = 3000;
+};
+
+// Keeps a pipe running when its source stalls or fails. An input-selector
+// is put behind the source with the backup input on its other pad; the
+// backup is converted to the caps the source negotiated and runs all the
+// time, so switching is a matter of the active pad. The downstream chain,
+// the branches and the RTSP sessions never see the source go away. While
+// on the backup, the source is restarted every recover period and switched
+// back once it delivers again. The frames lost by every switch are counted.
+
+class SourceFailover {
+public:
+
+  // Builds the failovers of the topology, before the pipes are brought up
+  static void Attach(Topology *topology);
+
+  // From the sync handler of a bus: true if the message is an error of a
+  // watched source, it is taken over here and should be dropped
+  static bool Intercept(GstMessage *message);
+
+private:
+
+  SourceFailover(const std::string &pipe, GstElement *source, const FailoverConfig &config);
+
+  bool Build();
+  void SwitchTo(bool backup, const char *reason);
+
+  static GstPadProbeReturn PrimaryProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+  static GstPadProbeReturn OutputProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+  static gboolean Check(gpointer user_data);
+  static void Restart(GstElement *source, gpointer user_data);
+
+  std::string pipe;
+  GstElement *source;
+  GstElement *selector;
+  GstElement *backup_caps;
+  GstPad *primary_pad;
+  GstPad *backup_pad;
+  FailoverConfig config;
+
+  std::mutex lock;
+  bool on_backup;
+  bool failed;
+  gint64 last_primary;
+  gint64 primary_since;
+  gint64 restarted;
+
+  // Switch latency, from the last output buffer before the switch
+  bool measuring;
+  gint64 last_output;
+  gint64 frame_duration;
+  guint switches;
+
+  static std::map<std::string, SourceFailover *> failovers;
+};
@@ -0,0 +1,269 @@
+#include <cstring>
+
+#include "fmp4.h"
+
+#define FMP4_TRACK_ID 1
+
+#define TRUN_DATA_OFFSET 0x000001
+#define TRUN_DURATION 0x000100
+#define TRUN_SIZE 0x000200
+#define TRUN_FLAGS 0x000400
+#define TRUN_COMPOSITION_OFFSET 0x000800
+#define TFHD_DEFAULT_BASE_IS_MOOF 0x020000
+
+// Sync sample, or a sample depending on others
+#define SAMPLE_FLAGS_SYNC 0x02000000
+#define SAMPLE_FLAGS_DELTA 0x01010000
+
+namespace {
+
+// Big endian box writer, boxes are closed in reverse order of opening
+class Writer {
+public:
+
+  std::vector<guint8> data;
+
+  void U8(guint8 value) { data.push_back(value); }
+  void U16(guint16 value) { U8(value >> 8); U8(value); }
+  void U32(guint32 value) { U16(value >> 16); U16(value); }
+  void U64(guint64 value) { U32(value >> 32); U32(value); }
+  void Zeros(size_t count) { data.insert(data.end(), count, 0); }
+  void Bytes(const guint8 *bytes, size_t size) { data.insert(data.end(), bytes, bytes + size); }
+  void Type(const char *type) { Bytes((const guint8 *) type, 4); }
+
+  size_t Box(const char *type) {
+    size_t start = data.size();
+    U32(0);
+    Type(type);
+    return start;
+  }
+
+  size_t FullBox(const char *type, guint8 version, guint32 flags) {
+    size_t start = Box(type);
+    U32(((guint32) version << 24) | flags);
+    return start;
+  }
+
+  void End(size_t start) { Patch(start, data.size() - start); }
+
+  void Patch(size_t at, guint32 value) {
+    data[at] = value >> 24;
+    data[at + 1] = value >> 16;
+    data[at + 2] = value >> 8;
+    data[at + 3] = value;
+  }
+
+  void Matrix() {
+    const guint32 unity[] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+    for (auto value : unity) {
+      U32(value);
+    }
+  }
+};
+
+}
+
+std::vector<guint8> Fmp4::InitSegment(const GstCaps *caps) {
+  const GstStructure *structure = gst_caps_get_structure(caps, 0);
+  const GValue *codec_data = gst_structure_get_value(structure, "codec_data");
+  gint width = 0, height = 0;
+
+  gst_structure_get_int(structure, "width", &width);
+  gst_structure_get_int(structure, "height", &height);
+
+  if (!codec_data || !GST_VALUE_HOLDS_BUFFER (codec_data)) {
+    return std::vector<guint8>();
+  }
+
+  bool hevc = gst_structure_has_name(structure, "video/x-h265");
+  Writer w;
+
+  size_t ftyp = w.Box("ftyp");
+  w.Type("iso6");
+  w.U32(0);
+  w.Type("iso6");
+  w.Type("cmfc");
+  w.Type(hevc ? "hvc1" : "avc1");
+  w.End(ftyp);
+
+  size_t moov = w.Box("moov");
+
+  size_t mvhd = w.FullBox("mvhd", 0, 0);
+  w.U32(0);                   // creation time
+  w.U32(0);                   // modification time
+  w.U32(FMP4_TIMESCALE);
+  w.U32(0);                   // duration, unknown for live
+  w.U32(0x00010000);          // rate
+  w.U16(0x0100);              // volume
+  w.Zeros(10);
+  w.Matrix();
+  w.Zeros(24);
+  w.U32(FMP4_TRACK_ID + 1);   // next track
+  w.End(mvhd);
+
+  size_t trak = w.Box("trak");
+
+  size_t tkhd = w.FullBox("tkhd", 0, 0x000003);  // enabled, in movie
+  w.U32(0);
+  w.U32(0);
+  w.U32(FMP4_TRACK_ID);
+  w.U32(0);
+  w.U32(0);
+  w.Zeros(8);
+  w.U16(0);                   // layer
+  w.U16(0);                   // alternate group
+  w.U16(0);                   // volume
+  w.U16(0);
+  w.Matrix();
+  w.U32((guint32) width << 16);
+  w.U32((guint32) height << 16);
+  w.End(tkhd);
+
+  size_t mdia = w.Box("mdia");
+
+  size_t mdhd = w.FullBox("mdhd", 0, 0);
+  w.U32(0);
+  w.U32(0);
+  w.U32(FMP4_TIMESCALE);
+  w.U32(0);
+  w.U16(0x55c4);              // "und"
+  w.U16(0);
+  w.End(mdhd);
+
+  size_t hdlr = w.FullBox("hdlr", 0, 0);
+  w.U32(0);
+  w.Type("vide");
+  w.Zeros(12);
+  w.Bytes((const guint8 *) "VideoHandler", sizeof("VideoHandler"));
+  w.End(hdlr);
+
+  size_t minf = w.Box("minf");
+
+  size_t vmhd = w.FullBox("vmhd", 0, 0x000001);
+  w.Zeros(8);
+  w.End(vmhd);
+
+  size_t dinf = w.Box("dinf");
+  size_t dref = w.FullBox("dref", 0, 0);
+  w.U32(1);
+  w.End(w.FullBox("url ", 0, 0x000001));  // media is in the same file
+  w.End(dref);
+  w.End(dinf);
+
+  size_t stbl = w.Box("stbl");
+
+  size_t stsd = w.FullBox("stsd", 0, 0);
+  w.U32(1);
+  size_t entry = w.Box(hevc ? "hvc1" : "avc1");
+  w.Zeros(6);
+  w.U16(1);                   // data reference index
+  w.Zeros(16);
+  w.U16(width);
+  w.U16(height);
+  w.U32(0x00480000);          // 72 dpi
+  w.U32(0x00480000);
+  w.U32(0);
+  w.U16(1);                   // frame count
+  w.Zeros(32);                // compressor name
+  w.U16(0x0018);              // depth
+  w.U16(0xffff);
+
+  GstMapInfo map;
+  GstBuffer *config = gst_value_get_buffer(codec_data);
+  size_t configuration = w.Box(hevc ? "hvcC" : "avcC");
+  if (gst_buffer_map(config, &map, GST_MAP_READ)) {
+    w.Bytes(map.data, map.size);
+    gst_buffer_unmap(config, &map);
+  }
+  w.End(configuration);
+
+  w.End(entry);
+  w.End(stsd);
+
+  // Empty tables, the samples are in the fragments
+  const char *tables[] = {"stts", "stsc", "stco"};
+  for (auto table : tables) {
+    size_t box = w.FullBox(table, 0, 0);
+    w.U32(0);
+    w.End(box);
+  }
+  size_t stsz = w.FullBox("stsz", 0, 0);
+  w.U32(0);
+  w.U32(0);
+  w.End(stsz);
+
+  w.End(stbl);
+  w.End(minf);
+  w.End(mdia);
+  w.End(trak);
+
+  size_t mvex = w.Box("mvex");
+  size_t trex = w.FullBox("trex", 0, 0);
+  w.U32(FMP4_TRACK_ID);
+  w.U32(1);                   // sample description
+  w.U32(0);
+  w.U32(0);
+  w.U32(0);
+  w.End(trex);
+  w.End(mvex);
+
+  w.End(moov);
+
+  return w.data;
+}
+
+std::vector<guint8> Fmp4::Fragment(guint32 sequence, guint64 decode_time, const std::vector<Fmp4Sample> &samples) {
+  Writer w;
+
+  size_t moof = w.Box("moof");
+
+  size_t mfhd = w.FullBox("mfhd", 0, 0);
+  w.U32(sequence);
+  w.End(mfhd);
+
+  size_t traf = w.Box("traf");
+
+  size_t tfhd = w.FullBox("tfhd", 0, TFHD_DEFAULT_BASE_IS_MOOF);
+  w.U32(FMP4_TRACK_ID);
+  w.End(tfhd);
+
+  size_t tfdt = w.FullBox("tfdt", 1, 0);
+  w.U64(decode_time);
+  w.End(tfdt);
+
+  // Version 1 for signed composition offsets
+  size_t trun = w.FullBox("trun", 1, TRUN_DATA_OFFSET | TRUN_DURATION | TRUN_SIZE | TRUN_FLAGS
+      | TRUN_COMPOSITION_OFFSET);
+  w.U32(samples.size());
+  size_t data_offset = w.data.size();
+  w.U32(0);
+
+  gsize mdat_size = 0;
+  for (const auto &sample : samples) {
+    gsize size = gst_buffer_get_size(sample.buffer);
+    w.U32(sample.duration);
+    w.U32(size);
+    w.U32(sample.keyframe ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_DELTA);
+    w.U32((guint32) sample.composition_offset);
+    mdat_size += size;
+  }
+  w.End(trun);
+
+  w.End(traf);
+  w.End(moof);
+
+  // The data starts right after the mdat header
+  w.Patch(data_offset, w.data.size() + 8);
+
+  w.data.reserve(w.data.size() + 8 + mdat_size);
+  w.U32(8 + mdat_size);
+  w.Type("mdat");
+  for (const auto &sample : samples) {
+    size_t at = w.data.size();
+    gsize size = gst_buffer_get_size(sample.buffer);
+    w.data.resize(at + size);
+    gst_buffer_extract(sample.buffer, 0, &w.data[at], size);
+  }
+
+  return w.data;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <vector>
+
+// Minimal fragmented MP4 (CMAF) writer for one H.264 or H.265 video track
+
+#define FMP4_TIMESCALE 90000
+
+struct Fmp4Sample {
+  GstBuffer *buffer;
+  guint32 duration;           // in FMP4_TIMESCALE units
+  gint32 composition_offset;  // PTS - DTS
+  bool keyframe;
+};
+
+class Fmp4 {
+public:
+
+  // ftyp and moov with the codec configuration of the caps,
+  // empty if the caps have no codec data
+  static std::vector<guint8> InitSegment(const GstCaps *caps);
+
+  // moof and mdat of the samples, starting at the given decode time
+  static std::vector<guint8> Fragment(guint32 sequence, guint64 decode_time, const std::vector<Fmp4Sample> &samples);
+};
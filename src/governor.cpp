@@ -0,0 +1,279 @@
+#include "governor.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_governor);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_governor       // set as default
+
+// GstQueueLeaky of the queue element, the header is not public
+#define QUEUE_LEAKY_DOWNSTREAM 2
+
+GovernorConfig MemoryGovernor::config;
+std::mutex MemoryGovernor::lock;
+std::map<std::string, MemoryGovernor::Branch> MemoryGovernor::branches;
+std::map<std::string, MemoryGovernor::Cache> MemoryGovernor::caches;
+std::map<std::string, guint> MemoryGovernor::relax_ticks;
+
+void MemoryGovernor::Init(const GovernorConfig &config) {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_GOVERNOR", GST_DEBUG_FG_GREEN, "Memory budget of the branch queues"
+  );
+
+  std::lock_guard<std::mutex> guard(lock);
+  MemoryGovernor::config = config;
+
+  if (!config.budget_mb && config.group_budgets_mb.empty()) {
+    return;
+  }
+
+  GST_INFO("%u MB for %zu branch queues and their caches, %zu groups on their own", config.budget_mb,
+           branches.size(), config.group_budgets_mb.size());
+  Metrics::Set("governor.budget-bytes", (gint64) config.budget_mb << 20);
+  for (const auto &group : config.group_budgets_mb) {
+    Metrics::Set("governor.group." + group.first + ".budget-bytes", (gint64) group.second << 20);
+  }
+
+  Balance();
+  g_timeout_add(config.interval_ms, Govern, NULL);
+}
+
+// Queues may be made before Init, so nothing is logged here
+void MemoryGovernor::Register(const std::string &branch, GstElement *queue, const std::string &owner) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (branches.count(branch)) {
+    return;
+  }
+
+  Branch entry = {};
+  entry.queue = (GstElement *) gst_object_ref(queue);
+  entry.owner = owner;
+  g_object_get(queue, "max-size-bytes", &entry.max_bytes, "leaky", &entry.leaky, NULL);
+  branches[branch] = entry;
+
+  if (config.budget_mb || !config.group_budgets_mb.empty()) {
+    Balance();
+  }
+}
+
+void MemoryGovernor::Unregister(const std::string &branch) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  auto found = branches.find(branch);
+  if (found == branches.end()) {
+    return;
+  }
+
+  gst_object_unref(found->second.queue);
+  branches.erase(found);
+  Metrics::Remove("governor." + branch + ".");
+
+  if (config.budget_mb || !config.group_budgets_mb.empty()) {
+    Balance();
+  }
+}
+
+void MemoryGovernor::AddCache(const std::string &name, gsize bytes, const std::string &owner) {
+  std::lock_guard<std::mutex> guard(lock);
+  caches[name] = {bytes, owner};
+
+  if (config.budget_mb || !config.group_budgets_mb.empty()) {
+    Balance();
+  }
+}
+
+void MemoryGovernor::RemoveCache(const std::string &name) {
+  std::lock_guard<std::mutex> guard(lock);
+  caches.erase(name);
+
+  if (config.budget_mb || !config.group_budgets_mb.empty()) {
+    Balance();
+  }
+}
+
+// By the name of the branch first, then by its owner; "" is the shared budget
+std::string MemoryGovernor::GroupOf(const std::string &name, const std::string &owner) {
+  auto group = config.groups.find(name);
+  if (group == config.groups.end()) {
+    group = config.groups.find(owner);
+  }
+  return group != config.groups.end() ? group->second : "";
+}
+
+guint64 MemoryGovernor::Budget(const std::string &group) {
+  if (group.empty()) {
+    return (guint64) config.budget_mb << 20;
+  }
+
+  auto budget = config.group_budgets_mb.find(group);
+  return budget != config.group_budgets_mb.end() ? (guint64) budget->second << 20 : 0;
+}
+
+// Shares of the queues from what the caches leave of their group's budget, under the lock
+void MemoryGovernor::Balance() {
+  std::map<std::string, guint64> available;
+  for (const auto &cache : caches) {
+    std::string group = GroupOf(cache.first, cache.second.owner);
+    if (!available.count(group)) {
+      available[group] = Budget(group);
+    }
+    available[group] -= MIN (available[group], cache.second.bytes);
+  }
+
+  std::map<std::string, guint64> weights;
+  for (auto &branch : branches) {
+    auto priority = config.priorities.find(branch.first);
+    if (priority == config.priorities.end()) {
+      priority = config.priorities.find(branch.second.owner);
+    }
+    branch.second.priority = priority != config.priorities.end() ? priority->second : config.default_priority;
+    branch.second.group = GroupOf(branch.first, branch.second.owner);
+    weights[branch.second.group] += branch.second.priority;
+
+    if (!available.count(branch.second.group)) {
+      available[branch.second.group] = Budget(branch.second.group);
+    }
+  }
+
+  for (auto &branch : branches) {
+    // No budget, the queue keeps its own limits
+    if (!Budget(branch.second.group)) {
+      continue;
+    }
+
+    guint64 weight = weights[branch.second.group];
+    guint64 share = available[branch.second.group] * branch.second.priority / weight;
+    // Never above what the queue was made with
+    if (branch.second.max_bytes) {
+      share = MIN (share, branch.second.max_bytes);
+    }
+    branch.second.limit = share;
+    Apply(branch.second);
+
+    GST_DEBUG("Branch \"%s\"%s%s: priority %u, %" G_GUINT64_FORMAT " bytes", branch.first.c_str(),
+              branch.second.group.empty() ? "" : " of ", branch.second.group.c_str(), branch.second.priority, share);
+  }
+}
+
+void MemoryGovernor::Apply(Branch &branch) {
+  guint64 limit = MAX (branch.limit >> branch.squeeze, GOVERNOR_MIN_BYTES);
+  g_object_set(branch.queue,
+               "max-size-bytes", (guint) MIN (limit, G_MAXUINT),
+               "leaky", branch.squeeze ? QUEUE_LEAKY_DOWNSTREAM : branch.leaky,
+               NULL);
+}
+
+gboolean MemoryGovernor::Govern(gpointer user_data) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  std::map<std::string, guint64> used = {{"", 0}};
+  for (const auto &group : config.group_budgets_mb) {
+    used[group.first] = 0;
+  }
+
+  guint64 cache_bytes = 0, total = 0;
+  for (const auto &cache : caches) {
+    used[GroupOf(cache.first, cache.second.owner)] += cache.second.bytes;
+    cache_bytes += cache.second.bytes;
+  }
+  Metrics::Set("governor.cache-bytes", cache_bytes);
+
+  for (const auto &branch : branches) {
+    guint level = 0;
+    g_object_get(branch.second.queue, "current-level-bytes", &level, NULL);
+    used[branch.second.group] += level;
+
+    Metrics::Set("governor." + branch.first + ".bytes", level);
+    Metrics::Set("governor." + branch.first + ".limit-bytes",
+                 MAX (branch.second.limit >> branch.second.squeeze, GOVERNOR_MIN_BYTES));
+  }
+
+  for (const auto &group : used) {
+    total += group.second;
+    if (!group.first.empty()) {
+      Metrics::Set("governor.group." + group.first + ".used-bytes", group.second);
+    }
+
+    if (Budget(group.first)) {
+      GovernGroup(group.first, group.second);
+    }
+  }
+  Metrics::Set("governor.used-bytes", total);
+
+  return G_SOURCE_CONTINUE;
+}
+
+// One tick of a group with a budget, under the lock
+void MemoryGovernor::GovernGroup(const std::string &group, guint64 used) {
+  guint64 budget = Budget(group);
+  guint &ticks = relax_ticks[group];
+  const char *of = group.empty() ? "" : " of ";
+
+  if (used > budget) {
+    ticks = 0;
+
+    // Lowest priority first, the fullest of those
+    Branch *victim = NULL;
+    const std::string *victim_name = NULL;
+    guint victim_level = 0;
+    for (auto &branch : branches) {
+      if (branch.second.group != group || branch.second.squeeze >= GOVERNOR_MAX_SQUEEZE) {
+        continue;
+      }
+
+      guint level = 0;
+      g_object_get(branch.second.queue, "current-level-bytes", &level, NULL);
+      if (!victim || branch.second.priority < victim->priority
+          || (branch.second.priority == victim->priority && level > victim_level)) {
+        victim = &branch.second;
+        victim_name = &branch.first;
+        victim_level = level;
+      }
+    }
+
+    // Nothing left to take, the drops of the leaky queues have to do
+    if (!victim) {
+      GST_DEBUG("%" G_GUINT64_FORMAT " bytes over the budget%s%s, every branch is squeezed", used - budget, of,
+                group.c_str());
+      return;
+    }
+
+    victim->squeeze++;
+    Apply(*victim);
+    Metrics::Add("governor.squeezes", 1);
+
+    GST_WARNING("%" G_GUINT64_FORMAT " bytes over the budget%s%s: branch \"%s\" (priority %u) is leaky at 1/%u of its share",
+                used - budget, of, group.c_str(), victim_name->c_str(), victim->priority, 1u << victim->squeeze);
+    return;
+  }
+
+  // Some headroom, so a branch is not squeezed and relaxed by turns
+  if (used > budget / 4 * 3) {
+    ticks = 0;
+    return;
+  }
+
+  if (++ticks < GOVERNOR_RELAX_TICKS) {
+    return;
+  }
+  ticks = 0;
+
+  // Highest priority first
+  Branch *relaxed = NULL;
+  const std::string *relaxed_name = NULL;
+  for (auto &branch : branches) {
+    if (branch.second.group == group && branch.second.squeeze
+        && (!relaxed || branch.second.priority > relaxed->priority)) {
+      relaxed = &branch.second;
+      relaxed_name = &branch.first;
+    }
+  }
+
+  if (relaxed) {
+    relaxed->squeeze--;
+    Apply(*relaxed);
+
+    GST_INFO("Branch \"%s\" (priority %u) is back to 1/%u of its share", relaxed_name->c_str(),
+             relaxed->priority, 1u << relaxed->squeeze);
+  }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Options of the "governor" json object
+struct GovernorConfig {
+  // Branch queues and frame caches together in megabytes, 0 leaves the queues alone
+  guint budget_mb = 0;
+  guint interval_ms = 500;
+  // Weight of a branch in the budget, by branch or by the pipe it belongs to
+  guint default_priority = 1;
+  std::map<std::string, guint> priorities;
+  // Groups with a budget of their own, by the branches or pipes in them; the
+  // rest shares "budget_mb"
+  std::map<std::string, guint> group_budgets_mb;
+  std::map<std::string, std::string> groups;
+};
+
+// Byte limit of a branch never goes below this, 0 would lift the limit
+#define GOVERNOR_MIN_BYTES (256 * 1024)
+
+// Halvings of the share a low priority branch can be squeezed by
+#define GOVERNOR_MAX_SQUEEZE 3
+
+// Ticks spent well under the budget before a squeezed branch is relaxed
+#define GOVERNOR_RELAX_TICKS 10
+
+// Every queue feeding a branch gets a byte limit from one process-wide
+// budget, shared by priority after the fixed frame caches are taken off.
+// When the queued bytes go over the budget anyway, the lowest priority
+// branches are made leaky and their limits halved, one step per tick, so
+// they drop their oldest frames instead of holding memory or stalling the
+// tee. Once the usage stays low, the branches are given their share back.
+// A group, e.g. the pipes of one camera instance, can have a budget of its
+// own: it is governed apart, so it neither starves nor is starved by others.
+
+class MemoryGovernor {
+public:
+
+  static void Init(const GovernorConfig &config);
+
+  // Queue in front of a branch; "owner" gives the priority when the branch has none
+  static void Register(const std::string &branch, GstElement *queue, const std::string &owner = "");
+  static void Unregister(const std::string &branch);
+
+  // Memory of a fixed size cache, taken off the budget of the queues of its owner's group
+  static void AddCache(const std::string &name, gsize bytes, const std::string &owner = "");
+  static void RemoveCache(const std::string &name);
+
+private:
+
+  struct Branch {
+    GstElement *queue;
+    std::string owner;
+    std::string group;
+    guint priority;
+    // Limits the queue was made with
+    guint max_bytes;
+    gint leaky;
+    guint64 limit;
+    guint squeeze;
+  };
+
+  struct Cache {
+    gsize bytes;
+    std::string owner;
+  };
+
+  static std::string GroupOf(const std::string &name, const std::string &owner);
+  static guint64 Budget(const std::string &group);
+  static void Balance();
+  static void Apply(Branch &branch);
+  static gboolean Govern(gpointer user_data);
+  static void GovernGroup(const std::string &group, guint64 used);
+
+  static GovernorConfig config;
+  static std::mutex lock;
+  static std::map<std::string, Branch> branches;
+  static std::map<std::string, Cache> caches;
+  static std::map<std::string, guint> relax_ticks;
+};
@@ -0,0 +1,218 @@
+#include <gio/gunixconnection.h>
+#include <gio/gunixsocketaddress.h>
+#include <unistd.h>
+
+#include "handover.h"
+#include "server.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_handover);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_handover       // set as default
+
+std::string Handover::path = HANDOVER_SOCKET;
+GSocketService *Handover::service = NULL;
+GSocketConnection *Handover::predecessor = NULL;
+GSocketConnection *Handover::successor = NULL;
+RtspServer *Handover::server = NULL;
+GSourceFunc Handover::stop = NULL;
+gint64 Handover::drain_start = 0;
+guint8 Handover::ready_byte = 0;
+
+void Handover::Init(const std::string &path) {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_HANDOVER", GST_DEBUG_FG_GREEN, "Listening socket handover"
+  );
+
+  Handover::path = path;
+}
+
+GSocket *Handover::Take() {
+  GError *error = NULL;
+
+  GSocketClient *client = g_socket_client_new();
+  GSocketAddress *address = g_unix_socket_address_new(path.c_str());
+  GSocketConnection *connection = g_socket_client_connect(client, G_SOCKET_CONNECTABLE (address), NULL, &error);
+  g_object_unref(address);
+  g_object_unref(client);
+
+  if (!connection) {
+    GST_INFO("Nothing to take over on \"%s\", starting afresh: %s", path.c_str(), error->message);
+    g_clear_error(&error);
+    return NULL;
+  }
+
+  // One byte tells if a listening socket follows
+  guint8 has_socket = 0;
+  GInputStream *input = g_io_stream_get_input_stream(G_IO_STREAM (connection));
+  if (g_input_stream_read(input, &has_socket, 1, NULL, &error) != 1) {
+    GST_WARNING("The running process did not answer on \"%s\", starting afresh", path.c_str());
+    g_clear_error(&error);
+    g_object_unref(connection);
+    return NULL;
+  }
+
+  GSocket *socket = NULL;
+  if (has_socket) {
+    gint fd = g_unix_connection_receive_fd(G_UNIX_CONNECTION (connection), NULL, &error);
+    socket = fd >= 0 ? g_socket_new_from_fd(fd, &error) : NULL;
+    if (!socket) {
+      GST_ERROR("Can't take over the listening socket: %s", error->message);
+      g_clear_error(&error);
+      if (fd >= 0) {
+        close(fd);
+      }
+      g_object_unref(connection);
+      return NULL;
+    }
+    g_socket_set_blocking(socket, FALSE);
+  }
+
+  GST_INFO("Taking over from the running process%s", socket ? ", on its listening socket" : "");
+  predecessor = connection;
+  return socket;
+}
+
+bool Handover::Upgrading() {
+  return predecessor != NULL;
+}
+
+void Handover::Ready(RtspServer *server, GSourceFunc stop) {
+  GError *error = NULL;
+  bool upgrading = Upgrading();
+
+  if (predecessor) {
+    guint8 ready = 1;
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM (predecessor));
+    if (g_output_stream_write(output, &ready, 1, NULL, &error) != 1) {
+      GST_ERROR("Can't tell the previous process to drain: %s", error ? error->message : "closed");
+      g_clear_error(&error);
+    } else {
+      GST_INFO("Up, the previous process drains now");
+    }
+
+    g_object_unref(predecessor);
+    predecessor = NULL;
+  }
+
+  Handover::server = server;
+  Handover::stop = stop;
+
+  // Only the process taking over, or a stale path left behind, is replaced; another
+  // running process keeps its path, with its own upgrades
+  if (!upgrading && Listening()) {
+    GST_WARNING("No upgrades: another process takes them on \"%s\"", path.c_str());
+    return;
+  }
+  unlink(path.c_str());
+
+  GSocketAddress *address = g_unix_socket_address_new(path.c_str());
+  service = g_socket_service_new();
+  gboolean listening = g_socket_listener_add_address(G_SOCKET_LISTENER (service), address,
+                                                     G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+                                                     NULL, NULL, &error);
+  g_object_unref(address);
+
+  if (!listening) {
+    GST_ERROR("No upgrades: can't listen on \"%s\": %s", path.c_str(), error->message);
+    g_clear_error(&error);
+    g_object_unref(service);
+    service = NULL;
+    return;
+  }
+
+  g_signal_connect(service, "incoming", G_CALLBACK (Incoming), NULL);
+  g_socket_service_start(service);
+
+  GST_INFO("Upgrades are taken on \"%s\"", path.c_str());
+}
+
+// Somebody accepts on the path, not just a socket file left behind by a crash. A running
+// process takes the probe for a successor that went away before it was up.
+bool Handover::Listening() {
+  GSocketClient *client = g_socket_client_new();
+  GSocketAddress *address = g_unix_socket_address_new(path.c_str());
+  GSocketConnection *connection = g_socket_client_connect(client, G_SOCKET_CONNECTABLE (address), NULL, NULL);
+  g_object_unref(address);
+  g_object_unref(client);
+
+  if (connection) {
+    g_object_unref(connection);
+  }
+  return connection != NULL;
+}
+
+// Runs in the main loop, the answer is sent right away
+gboolean Handover::Incoming(GSocketService *service, GSocketConnection *connection,
+                            GObject *source, gpointer user_data) {
+  GError *error = NULL;
+
+  GCF_WARNING_RETURN_VAL(successor, TRUE, "An upgrade is already in progress, the new one is refused.");
+
+  GSocket *socket = server->ListeningSocket();
+  guint8 has_socket = socket != NULL;
+  GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM (connection));
+
+  if (g_output_stream_write(output, &has_socket, 1, NULL, &error) != 1
+      || (socket && !g_unix_connection_send_fd(G_UNIX_CONNECTION (connection), g_socket_get_fd(socket),
+                                               NULL, &error))) {
+    GST_ERROR("Can't hand over the listening socket: %s", error ? error->message : "closed");
+    g_clear_error(&error);
+    return TRUE;
+  }
+
+  GST_INFO("A new process takes over%s, serving until it is up", socket ? " the listening socket" : "");
+  Metrics::Add("handover.offers", 1);
+
+  successor = (GSocketConnection *) g_object_ref(connection);
+  GInputStream *input = g_io_stream_get_input_stream(G_IO_STREAM (connection));
+  g_input_stream_read_async(input, &ready_byte, 1, G_PRIORITY_DEFAULT, NULL, SuccessorReady, NULL);
+
+  return TRUE;
+}
+
+void Handover::SuccessorReady(GObject *stream, GAsyncResult *result, gpointer user_data) {
+  GError *error = NULL;
+  gssize read = g_input_stream_read_finish(G_INPUT_STREAM (stream), result, &error);
+
+  g_object_unref(successor);
+  successor = NULL;
+
+  // Gone before it was up, this process is still the one serving
+  if (read != 1) {
+    GST_WARNING("The new process is gone before it was up: %s", error ? error->message : "closed");
+    g_clear_error(&error);
+    return;
+  }
+
+  // The path is the successor's from now on
+  g_socket_service_stop(service);
+  g_socket_listener_close(G_SOCKET_LISTENER (service));
+  g_object_unref(service);
+  service = NULL;
+
+  server->StopAccepting();
+  drain_start = g_get_monotonic_time();
+  GST_INFO("The new process is up: no new clients here, draining %u", server->CountClients());
+
+  g_timeout_add_seconds(1, Drain, NULL);
+}
+
+gboolean Handover::Drain(gpointer user_data) {
+  guint clients = server->CountClients();
+  gint64 elapsed = g_get_monotonic_time() - drain_start;
+  Metrics::Set("handover.draining-clients", clients);
+
+  if (clients && elapsed < HANDOVER_DRAIN_TIMEOUT * G_TIME_SPAN_SECOND) {
+    return G_SOURCE_CONTINUE;
+  }
+
+  if (clients) {
+    GST_WARNING("%u clients are still here after %d s, they have to reconnect", clients, HANDOVER_DRAIN_TIMEOUT);
+  } else {
+    GST_INFO("Drained in %.1f s", elapsed / (double) G_TIME_SPAN_SECOND);
+  }
+
+  stop(NULL);
+  return G_SOURCE_REMOVE;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <gio/gio.h>
+#include <string>
+
+class RtspServer;
+
+#define HANDOVER_SOCKET "/tmp/gcf-handover.sock"
+#define HANDOVER_DRAIN_TIMEOUT 30 // seconds
+
+// Graceful upgrade. A running process offers its RTSP listening socket on a
+// unix socket; a new one started with --upgrade takes it, so the port stays
+// open all along, and says when its pipes are up. The old process then
+// stops accepting, lets its clients finish and quits. Clients still there
+// at the drain timeout are dropped and reconnect to the new process.
+
+class Handover {
+public:
+
+  static void Init(const std::string &path);
+
+  // New side: the listening socket of the running process, NULL if there
+  // is none; a running process with workers hands over no socket
+  static GSocket *Take();
+  static bool Upgrading();
+
+  // Tells the previous process to drain, if any, and offers this one to
+  // the next; "stop" quits the process once it is drained. Without an
+  // upgrade, a path another process listens on is left to it.
+  static void Ready(RtspServer *server, GSourceFunc stop);
+
+private:
+
+  static bool Listening();
+  static gboolean Incoming(GSocketService *service, GSocketConnection *connection,
+                           GObject *source, gpointer user_data);
+  static void SuccessorReady(GObject *stream, GAsyncResult *result, gpointer user_data);
+  static gboolean Drain(gpointer user_data);
+
+  static std::string path;
+  static GSocketService *service;
+  static GSocketConnection *predecessor;
+  static GSocketConnection *successor;
+  static RtspServer *server;
+  static GSourceFunc stop;
+  static gint64 drain_start;
+  static guint8 ready_byte;
+};
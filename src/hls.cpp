@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <chrono>
+
+#include "hls.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_hls);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_hls       // set as default
+
+// Segments listed with their parts, older ones only as whole segments
+#define HLS_PART_SEGMENTS 3
+
+static std::string Seconds(GstClockTime time) {
+  gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+  return g_ascii_formatd(buffer, sizeof(buffer), "%.3f", (gdouble) time / GST_SECOND);
+}
+
+HlsPackager::HlsPackager(const std::string &mount, const MountConfig &config)
+    : mount(mount),
+      segment_target(config.hls_segment_ms * GST_MSECOND),
+      part_target(config.hls_part_ms * GST_MSECOND),
+      max_segments(config.hls_segments),
+      closing(false),
+      init_caps(NULL),
+      pending(NULL),
+      pending_dts(GST_CLOCK_TIME_NONE),
+      pending_pts(GST_CLOCK_TIME_NONE),
+      default_duration(GST_SECOND / 25),
+      part_duration(0),
+      decode_time(0),
+      fragment_sequence(0) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_HLS", GST_DEBUG_FG_MAGENTA, "LL-HLS packaging"
+  );
+
+  GST_INFO("HLS of \"%s\": %u ms segments, %u ms parts, %u segments kept",
+           mount.c_str(), config.hls_segment_ms, config.hls_part_ms, max_segments);
+}
+
+HlsPackager::~HlsPackager() {
+  for (auto &sample : samples) {
+    gst_buffer_unref(sample.buffer);
+  }
+
+  if (pending) {
+    gst_buffer_unref(pending);
+  }
+
+  if (init_caps) {
+    gst_caps_unref(init_caps);
+  }
+
+  Metrics::Remove("hls." + mount + ".");
+}
+
+void HlsPackager::Push(GstSample *sample, gpointer user_data) {
+  HlsPackager *self = static_cast<HlsPackager *>(user_data);
+
+  self->Add(gst_sample_get_buffer(sample), gst_sample_get_caps(sample));
+}
+
+void HlsPackager::Add(GstBuffer *buffer, GstCaps *caps) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  // New parameter sets need a new initialization segment
+  if (caps && (!init_caps || !gst_caps_is_equal(caps, init_caps))) {
+    auto data = Fmp4::InitSegment(caps);
+    if (data.empty()) {
+      GST_WARNING("HLS of \"%s\": no codec data in %" GST_PTR_FORMAT, mount.c_str(), caps);
+      return;
+    }
+
+    gint num = 0, den = 1;
+    if (gst_structure_get_fraction(gst_caps_get_structure(caps, 0), "framerate", &num, &den) && num) {
+      default_duration = gst_util_uint64_scale(GST_SECOND, den, num);
+    }
+
+    gst_caps_replace(&init_caps, caps);
+    init = std::make_shared<const std::vector<guint8>>(std::move(data));
+    changed.notify_all();
+  }
+
+  GstClockTime dts = GST_BUFFER_DTS_OR_PTS (buffer);
+
+  if (pending) {
+    bool ordered = GST_CLOCK_TIME_IS_VALID (dts) && GST_CLOCK_TIME_IS_VALID (pending_dts) && dts > pending_dts;
+    Append(ordered ? dts - pending_dts : default_duration);
+  }
+
+  pending = gst_buffer_ref(buffer);
+  pending_dts = dts;
+  pending_pts = GST_BUFFER_PTS (buffer);
+}
+
+// Moves the pending frame into the current part, cutting parts and segments on the way
+void HlsPackager::Append(GstClockTime duration) {
+  bool keyframe = !GST_BUFFER_FLAG_IS_SET (pending, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  // Segments start with a keyframe
+  if (segments.empty() && !keyframe) {
+    gst_buffer_unref(pending);
+    pending = NULL;
+    return;
+  }
+
+  if (segments.empty() || (keyframe && segments.back().duration + part_duration >= segment_target)) {
+    if (!samples.empty()) {
+      ClosePart();
+    }
+    if (!segments.empty()) {
+      CloseSegment();
+    }
+
+    guint64 sequence = segments.empty() ? 0 : segments.back().sequence + 1;
+    segments.push_back({sequence, 0, std::vector<Part>(), false});
+  } else if (!samples.empty() && part_duration + duration > part_target) {
+    ClosePart();
+  }
+
+  gint64 offset = 0;
+  if (GST_CLOCK_TIME_IS_VALID (pending_pts) && GST_CLOCK_TIME_IS_VALID (pending_dts)) {
+    offset = GST_CLOCK_DIFF (pending_dts, pending_pts);
+  }
+
+  samples.push_back({
+      pending,
+      (guint32) gst_util_uint64_scale(duration, FMP4_TIMESCALE, GST_SECOND),
+      (gint32) (offset * FMP4_TIMESCALE / (gint64) GST_SECOND),
+      keyframe
+  });
+  part_duration += duration;
+  pending = NULL;
+}
+
+void HlsPackager::ClosePart() {
+  Segment &segment = segments.back();
+
+  auto data = Fmp4::Fragment(++fragment_sequence, decode_time, samples);
+  segment.parts.push_back({std::make_shared<const std::vector<guint8>>(std::move(data)),
+                           part_duration, samples.front().keyframe});
+  segment.duration += part_duration;
+
+  for (auto &sample : samples) {
+    decode_time += sample.duration;
+    gst_buffer_unref(sample.buffer);
+  }
+  samples.clear();
+  part_duration = 0;
+
+  changed.notify_all();
+}
+
+void HlsPackager::CloseSegment() {
+  segments.back().complete = true;
+
+  while (segments.size() > max_segments) {
+    segments.pop_front();
+  }
+
+  GST_LOG("HLS of \"%s\": segment %" G_GUINT64_FORMAT " is complete",
+          mount.c_str(), segments.back().sequence);
+  Metrics::Set("hls." + mount + ".sequence", segments.back().sequence);
+
+  changed.notify_all();
+}
+
+HlsPackager::Segment *HlsPackager::Find(guint64 sequence) {
+  for (auto &segment : segments) {
+    if (segment.sequence == sequence) {
+      return &segment;
+    }
+  }
+
+  return NULL;
+}
+
+// The client may wait up to three target durations, as blocking reload allows
+template<typename Condition>
+bool HlsPackager::Wait(std::unique_lock<std::mutex> &guard, Condition condition) {
+  return changed.wait_for(guard, std::chrono::nanoseconds(3 * segment_target),
+                          [this, &condition]() { return closing || condition(); }) && !closing;
+}
+
+void HlsPackager::Shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    closing = true;
+  }
+  changed.notify_all();
+}
+
+bool HlsPackager::GetPlaylist(gint64 msn, gint64 part, std::string &playlist) {
+  std::unique_lock<std::mutex> guard(lock);
+
+  // Too far ahead to be waited for
+  if (msn >= 0 && !segments.empty() && (guint64) msn > segments.back().sequence + 2) {
+    return false;
+  }
+
+  bool ready = Wait(guard, [this, msn, part]() {
+    if (!init || segments.empty() || segments.back().parts.empty()) {
+      return false;
+    }
+    const Segment &current = segments.back();
+    return msn < 0 || current.sequence > (guint64) msn
+        || (current.sequence == (guint64) msn && part >= 0 && current.parts.size() > (guint64) part);
+  });
+
+  if (!ready) {
+    return false;
+  }
+
+  GstClockTime longest = segment_target;
+  for (const auto &segment : segments) {
+    longest = MAX (longest, segment.duration);
+  }
+
+  std::string text = "#EXTM3U\n"
+      "#EXT-X-VERSION:6\n"
+      "#EXT-X-TARGETDURATION:" + std::to_string((longest + GST_SECOND - 1) / GST_SECOND) + "\n"
+      "#EXT-X-PART-INF:PART-TARGET=" + Seconds(part_target) + "\n"
+      "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=" + Seconds(3 * part_target) + "\n"
+      "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(segments.front().sequence) + "\n"
+      "#EXT-X-MAP:URI=\"init.mp4\"\n";
+
+  for (size_t i = 0; i < segments.size(); i++) {
+    const Segment &segment = segments[i];
+    auto sequence = std::to_string(segment.sequence);
+
+    if (i + HLS_PART_SEGMENTS >= segments.size()) {
+      for (size_t j = 0; j < segment.parts.size(); j++) {
+        text += "#EXT-X-PART:DURATION=" + Seconds(segment.parts[j].duration)
+            + ",URI=\"part" + sequence + "." + std::to_string(j) + ".m4s\""
+            + (segment.parts[j].independent ? ",INDEPENDENT=YES\n" : "\n");
+      }
+    }
+
+    if (segment.complete) {
+      text += "#EXTINF:" + Seconds(segment.duration) + ",\nseg" + sequence + ".m4s\n";
+    }
+  }
+
+  const Segment &current = segments.back();
+  text += "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"part" + std::to_string(current.sequence) + "."
+      + std::to_string(current.parts.size()) + ".m4s\"\n";
+
+  playlist = text;
+  return true;
+}
+
+bool HlsPackager::GetInit(Data &data) {
+  std::unique_lock<std::mutex> guard(lock);
+
+  if (!Wait(guard, [this]() { return init != nullptr; })) {
+    return false;
+  }
+
+  data = init;
+  return true;
+}
+
+bool HlsPackager::GetPart(guint64 sequence, guint index, Data &data) {
+  bool last;
+  return GetSegmentPart(sequence, index, data, last);
+}
+
+bool HlsPackager::GetSegmentPart(guint64 sequence, guint index, Data &data, bool &last) {
+  std::unique_lock<std::mutex> guard(lock);
+
+  // Only the part being produced and the next segment are waited for
+  if (segments.empty() || sequence > segments.back().sequence + 1) {
+    return false;
+  }
+
+  Wait(guard, [this, sequence, index]() {
+    if (segments.empty() || sequence < segments.front().sequence) {
+      return true;
+    }
+    Segment *segment = Find(sequence);
+    return segment && (segment->parts.size() > index || segment->complete);
+  });
+
+  Segment *segment = Find(sequence);
+  if (!segment || index >= segment->parts.size()) {
+    return false;
+  }
+
+  data = segment->parts[index].data;
+  last = segment->complete && index + 1 == segment->parts.size();
+  return true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fmp4.h"
+#include "mount.h"
+
+// Packages the shared encode of a mount into CMAF segments and parts for
+// Low-Latency HLS. The last few segments are kept in memory, nothing is
+// written to disk. The HTTP side blocks on the getters until the asked
+// playlist version or part is ready, as blocking playlist reload and
+// preload hints expect.
+
+class HlsPackager {
+public:
+
+  typedef std::shared_ptr<const std::vector<guint8>> Data;
+
+  HlsPackager(const std::string &mount, const MountConfig &config);
+  ~HlsPackager();
+
+  // Encoded frames from the shared encoder
+  static void Push(GstSample *sample, gpointer user_data);
+
+  // Playlist containing at least part "part" of segment "msn", negative values don't wait
+  bool GetPlaylist(gint64 msn, gint64 part, std::string &playlist);
+  bool GetInit(Data &data);
+  bool GetPart(guint64 sequence, guint index, Data &data);
+
+  // Parts of a segment one by one, "last" is set with the final one
+  bool GetSegmentPart(guint64 sequence, guint index, Data &data, bool &last);
+
+  // Wakes the waiting getters and makes the later ones return right away
+  void Shutdown();
+
+private:
+
+  struct Part {
+    Data data;
+    GstClockTime duration;
+    bool independent;
+  };
+
+  struct Segment {
+    guint64 sequence;
+    GstClockTime duration;
+    std::vector<Part> parts;
+    bool complete;
+  };
+
+  void Add(GstBuffer *buffer, GstCaps *caps);
+  void Append(GstClockTime duration);
+  void ClosePart();
+  void CloseSegment();
+  Segment *Find(guint64 sequence);
+
+  // Waits until the condition holds or the request times out
+  template<typename Condition>
+  bool Wait(std::unique_lock<std::mutex> &guard, Condition condition);
+
+  std::string mount;
+  GstClockTime segment_target;
+  GstClockTime part_target;
+  guint max_segments;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  bool closing;
+
+  Data init;
+  GstCaps *init_caps;
+  std::deque<Segment> segments;
+
+  // Frame waiting for the next one to know its duration
+  GstBuffer *pending;
+  GstClockTime pending_dts;
+  GstClockTime pending_pts;
+  GstClockTime default_duration;
+
+  // Part being collected
+  std::vector<Fmp4Sample> samples;
+  GstClockTime part_duration;
+  guint64 decode_time;
+  guint32 fragment_sequence;
+};
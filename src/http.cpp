@@ -0,0 +1,281 @@
+#include <cstdio>
+#include <cstring>
+
+#include "http.h"
+#include "hls.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_http);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_http       // set as default
+
+#define HTTP_MAX_HEADERS 64
+
+static const char *StatusText(guint status) {
+  switch (status) {
+    case 200:
+      return "OK";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 503:
+      return "Service Unavailable";
+    default:
+      return "Error";
+  }
+}
+
+// Value of a numeric query parameter, or -1
+static gint64 QueryValue(const std::string &query, const char *key) {
+  gint64 result = -1;
+  gchar **params = g_strsplit(query.c_str(), "&", -1);
+
+  for (gchar **param = params; *param; param++) {
+    gchar **pair = g_strsplit(*param, "=", 2);
+    if (pair[0] && pair[1] && !g_strcmp0(pair[0], key)) {
+      result = g_ascii_strtoll(pair[1], NULL, 10);
+    }
+    g_strfreev(pair);
+  }
+
+  g_strfreev(params);
+  return result;
+}
+
+HttpServer::HttpServer(guint16 port)
+    : port(port),
+      service(NULL),
+      run_handler(0),
+      cancellable(g_cancellable_new()),
+      handlers(0),
+      closing(false) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_HTTP", GST_DEBUG_FG_MAGENTA, "HTTP server"
+  );
+}
+
+HttpServer::~HttpServer() {
+  if (service) {
+    g_socket_service_stop(service);
+    g_socket_listener_close(G_SOCKET_LISTENER (service));
+    if (run_handler) {
+      g_signal_handler_disconnect(service, run_handler);
+    }
+  }
+
+  // A handler may be blocked on a client or on a packager for a while
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    closing = true;
+    g_cancellable_cancel(cancellable);
+    for (auto &output : outputs) {
+      output.second->Shutdown();
+    }
+    finished.wait(guard, [this]() { return !handlers; });
+  }
+
+  if (service) {
+    g_object_unref(service);
+  }
+  g_object_unref(cancellable);
+}
+
+void HttpServer::AddOutput(const std::string &mount, HlsPackager *packager) {
+  outputs[mount] = packager;
+
+  GST_INFO("HLS output is available at :%u/%s/index.m3u8", port, mount.c_str());
+}
+
+gboolean HttpServer::Start() {
+  GError *error = NULL;
+
+  service = g_threaded_socket_service_new(HTTP_MAX_THREADS);
+
+  if (!g_socket_listener_add_inet_port(G_SOCKET_LISTENER (service), port, NULL, &error)) {
+    GST_ERROR("Can't listen on port %u: %s", port, error->message);
+    g_clear_error(&error);
+    return FALSE;
+  }
+
+  run_handler = g_signal_connect(service, "run", G_CALLBACK (Run), this);
+  g_socket_service_start(service);
+
+  GST_INFO("HTTP server is listening on port %u", port);
+  return TRUE;
+}
+
+// Runs in its own thread for every connection
+gboolean HttpServer::Run(GThreadedSocketService *service, GSocketConnection *connection,
+                         GObject *source_object, gpointer user_data) {
+  HttpServer *self = static_cast<HttpServer *>(user_data);
+  {
+    std::lock_guard<std::mutex> guard(self->lock);
+    if (self->closing) {
+      return TRUE;
+    }
+    self->handlers++;
+  }
+
+  GDataInputStream *input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM (connection)));
+  g_data_input_stream_set_newline_type(input, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+  GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM (connection));
+
+  Request request;
+  while (self->ReadRequest(input, request) && self->Respond(output, request) && request.keep_alive) {
+  }
+
+  g_object_unref(input);
+
+  std::lock_guard<std::mutex> guard(self->lock);
+  if (!--self->handlers) {
+    self->finished.notify_all();
+  }
+  return TRUE;
+}
+
+bool HttpServer::ReadRequest(GDataInputStream *input, Request &request) {
+  gchar *line = g_data_input_stream_read_line(input, NULL, cancellable, NULL);
+  if (!line) {
+    return false;
+  }
+
+  gchar **parts = g_strsplit(line, " ", 3);
+  bool valid = parts[0] && parts[1] && parts[2];
+
+  if (valid) {
+    std::string target(parts[1]);
+    auto question = target.find('?');
+
+    request.method = parts[0];
+    request.path = target.substr(0, question);
+    request.query = question == std::string::npos ? "" : target.substr(question + 1);
+    request.keep_alive = !g_strcmp0(parts[2], "HTTP/1.1");
+  }
+
+  g_strfreev(parts);
+  g_free(line);
+
+  // Only the connection handling is taken from the headers
+  for (guint i = 0; valid && i < HTTP_MAX_HEADERS; i++) {
+    line = g_data_input_stream_read_line(input, NULL, cancellable, NULL);
+    if (!line) {
+      return false;
+    }
+
+    bool end = !*line;
+    if (!g_ascii_strncasecmp(line, "Connection:", strlen("Connection:"))) {
+      request.keep_alive = !strstr(line, "close") && !strstr(line, "Close");
+    }
+
+    g_free(line);
+    if (end) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool HttpServer::Respond(GOutputStream *output, const Request &request) {
+  GST_LOG("%s %s?%s", request.method.c_str(), request.path.c_str(), request.query.c_str());
+
+  if (request.method != "GET") {
+    return SendHeader(output, 405, "text/plain", 0, request.keep_alive);
+  }
+
+  // /<mount>/<file>
+  gchar **parts = g_strsplit(request.path.c_str(), "/", -1);
+  bool routed = g_strv_length(parts) == 3 && !*parts[0] && outputs.count(parts[1]);
+  std::string file = routed ? parts[2] : "";
+  HlsPackager *packager = routed ? outputs.at(parts[1]) : NULL;
+  g_strfreev(parts);
+
+  if (!packager) {
+    return SendHeader(output, 404, "text/plain", 0, request.keep_alive);
+  }
+
+  guint64 sequence;
+  guint index;
+  char tail;
+  HlsPackager::Data data;
+
+  if (file == "index.m3u8") {
+    std::string playlist;
+    if (!packager->GetPlaylist(QueryValue(request.query, "_HLS_msn"), QueryValue(request.query, "_HLS_part"),
+                               playlist)) {
+      return SendHeader(output, 503, "text/plain", 0, request.keep_alive);
+    }
+    return SendHeader(output, 200, "application/vnd.apple.mpegurl", playlist.size(), request.keep_alive)
+        && Send(output, playlist.data(), playlist.size());
+  }
+
+  if (file == "init.mp4") {
+    if (!packager->GetInit(data)) {
+      return SendHeader(output, 503, "text/plain", 0, request.keep_alive);
+    }
+    return SendHeader(output, 200, "video/mp4", data->size(), request.keep_alive)
+        && Send(output, data->data(), data->size());
+  }
+
+  if (sscanf(file.c_str(), "part%" G_GUINT64_FORMAT ".%u.m4s%c", &sequence, &index, &tail) == 2) {
+    if (!packager->GetPart(sequence, index, data)) {
+      return SendHeader(output, 404, "text/plain", 0, request.keep_alive);
+    }
+    return SendHeader(output, 200, "video/iso.segment", data->size(), request.keep_alive)
+        && Send(output, data->data(), data->size());
+  }
+
+  if (sscanf(file.c_str(), "seg%" G_GUINT64_FORMAT ".m4s%c", &sequence, &tail) == 1) {
+    bool last = false;
+    if (!packager->GetSegmentPart(sequence, 0, data, last)) {
+      return SendHeader(output, 404, "text/plain", 0, request.keep_alive);
+    }
+
+    // The parts are sent as soon as they are ready
+    if (!SendHeader(output, 200, "video/iso.segment", -1, request.keep_alive)) {
+      return false;
+    }
+    for (index = 1; SendChunk(output, data->data(), data->size()); index++) {
+      if (last || !packager->GetSegmentPart(sequence, index, data, last)) {
+        return SendChunk(output, NULL, 0);
+      }
+    }
+    return false;
+  }
+
+  return SendHeader(output, 404, "text/plain", 0, request.keep_alive);
+}
+
+bool HttpServer::Send(GOutputStream *output, const void *data, gsize size) {
+  return g_output_stream_write_all(output, data, size, NULL, cancellable, NULL);
+}
+
+// A negative length means chunked transfer
+bool HttpServer::SendHeader(GOutputStream *output, guint status, const char *type, gssize length, bool keep_alive) {
+  std::string body = length < 0 ? "Transfer-Encoding: chunked" : "Content-Length: " + std::to_string(length);
+
+  gchar *header = g_strdup_printf(
+      "HTTP/1.1 %u %s\r\n"
+      "Content-Type: %s\r\n"
+      "%s\r\n"
+      "Cache-Control: no-cache\r\n"
+      "Access-Control-Allow-Origin: *\r\n"
+      "Connection: %s\r\n"
+      "\r\n",
+      status, StatusText(status), type, body.c_str(), keep_alive ? "keep-alive" : "close");
+
+  bool sent = Send(output, header, strlen(header));
+  g_free(header);
+  return sent;
+}
+
+// An empty chunk ends the body
+bool HttpServer::SendChunk(GOutputStream *output, const void *data, gsize size) {
+  gchar *header = g_strdup_printf("%" G_GSIZE_MODIFIER "x\r\n", size);
+  bool sent = Send(output, header, strlen(header)) && (!size || Send(output, data, size)) && Send(output, "\r\n", 2);
+  g_free(header);
+  return sent;
+}
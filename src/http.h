@@ -0,0 +1,60 @@
+#pragma once
+
+#include <gio/gio.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+
+#define HTTP_DEFAULT_PORT 8080
+#define HTTP_MAX_THREADS 64
+
+class HlsPackager;
+
+// Serves the LL-HLS outputs of the mounts at /<mount>/index.m3u8.
+// Every connection gets its own thread, so requests can block until the
+// playlist or part they ask for is ready. Segments still being produced
+// are streamed with chunked transfer encoding part by part. Deleting the
+// server wakes and waits for the connection threads, so the packagers can
+// be deleted right after it.
+
+class HttpServer {
+public:
+
+  explicit HttpServer(guint16 port = HTTP_DEFAULT_PORT);
+  ~HttpServer();
+
+  void AddOutput(const std::string &mount, HlsPackager *packager);
+  gboolean Start();
+
+private:
+
+  struct Request {
+    std::string method;
+    std::string path;
+    std::string query;
+    bool keep_alive;
+  };
+
+  static gboolean Run(GThreadedSocketService *service, GSocketConnection *connection,
+                      GObject *source_object, gpointer user_data);
+
+  bool ReadRequest(GDataInputStream *input, Request &request);
+  bool Respond(GOutputStream *output, const Request &request);
+
+  bool Send(GOutputStream *output, const void *data, gsize size);
+  bool SendHeader(GOutputStream *output, guint status, const char *type, gssize length, bool keep_alive);
+  bool SendChunk(GOutputStream *output, const void *data, gsize size);
+
+  guint16 port;
+  GSocketService *service;
+  gulong run_handler;
+  std::map<std::string, HlsPackager *> outputs;
+
+  // Connection threads, reads and writes are cancelled on shutdown
+  GCancellable *cancellable;
+  std::mutex lock;
+  std::condition_variable finished;
+  guint handlers;
+  bool closing;
+};
@@ -0,0 +1,156 @@
+#include <pthread.h>
+#include <cstdlib>
+
+#include "instances.h"
+#include "threadpool.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_instances);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_instances       // set as default
+
+std::map<std::string, InstanceResources::Instance> InstanceResources::instances;
+std::map<std::string, InstanceResources::Instance *> InstanceResources::pipes;
+cpu_set_t InstanceResources::process_cpus;
+bool InstanceResources::restore = false;
+
+void InstanceResources::Init(const std::map<std::string, InstanceConfig> &instances) {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_INSTANCES", GST_DEBUG_FG_GREEN, "Resources of the template instances"
+  );
+
+  // What a thread goes back to when its task is done
+  restore = !sched_getaffinity(0, sizeof(cpu_set_t), &process_cpus);
+
+  for (const auto &config : instances) {
+    GError *error = NULL;
+    Instance &instance = InstanceResources::instances[config.first];
+    instance.name = config.first;
+
+    instance.pool = gcf_thread_pool_new(("gcf-" + config.first).c_str());
+    gst_task_pool_prepare(instance.pool, &error);
+    if (error) {
+      GST_ERROR("Instance \"%s\" shares the default thread pool: %s", config.first.c_str(), error->message);
+      g_clear_error(&error);
+      gst_object_unref(instance.pool);
+      instance.pool = NULL;
+    }
+
+    instance.pinned = !config.second.cpus.empty();
+    if (instance.pinned && !ParseCpus(config.second.cpus, &instance.cpus)) {
+      GST_ERROR("Instance \"%s\" runs on any CPU: \"%s\" is not a CPU list", config.first.c_str(),
+                config.second.cpus.c_str());
+      instance.pinned = false;
+    }
+
+    for (const auto &pipe : config.second.pipes) {
+      pipes[pipe] = &instance;
+    }
+
+    GST_INFO("Instance \"%s\" of \"%s\": %zu pipes on %s", config.first.c_str(),
+             config.second.template_name.c_str(), config.second.pipes.size(),
+             instance.pinned ? config.second.cpus.c_str() : "any CPU");
+  }
+}
+
+// "0-3,6" style, as taskset and cpusets take it
+bool InstanceResources::ParseCpus(const std::string &list, cpu_set_t *cpus) {
+  CPU_ZERO(cpus);
+
+  const char *position = list.c_str();
+  while (*position) {
+    char *end;
+    long first = strtol(position, &end, 10);
+    long last = first;
+    if (end == position || first < 0) {
+      return false;
+    }
+
+    if (*end == '-') {
+      position = end + 1;
+      last = strtol(position, &end, 10);
+      if (end == position || last < first) {
+        return false;
+      }
+    }
+
+    if (last >= CPU_SETSIZE) {
+      return false;
+    }
+    for (long cpu = first; cpu <= last; cpu++) {
+      CPU_SET(cpu, cpus);
+    }
+
+    if (*end != ',' && *end) {
+      return false;
+    }
+    position = *end ? end + 1 : end;
+  }
+
+  return CPU_COUNT(cpus) > 0;
+}
+
+void InstanceResources::Place(GstMessage *message, const std::string &pipe) {
+  if (GST_MESSAGE_TYPE (message) != GST_MESSAGE_STREAM_STATUS) {
+    return;
+  }
+
+  auto found = pipes.find(pipe);
+  if (found == pipes.end()) {
+    return;
+  }
+  Instance *instance = found->second;
+
+  GstStreamStatusType type;
+  GstElement *owner;
+  gst_message_parse_stream_status(message, &type, &owner);
+
+  switch (type) {
+
+    // Before the task starts, its thread comes from the pool of the instance
+    case GST_STREAM_STATUS_TYPE_CREATE: {
+      const GValue *value = gst_message_get_stream_status_object(message);
+      if (instance->pool && value && G_VALUE_HOLDS (value, GST_TYPE_TASK)) {
+        gst_task_set_pool(GST_TASK (g_value_get_object(value)), instance->pool);
+      }
+      break;
+    }
+
+    // Posted from the streaming thread itself
+    case GST_STREAM_STATUS_TYPE_ENTER:
+      if (instance->pinned && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &instance->cpus)) {
+        GST_WARNING("Instance \"%s\": the thread of \"%s\" can't be pinned", instance->name.c_str(),
+                    GST_ELEMENT_NAME (owner));
+      }
+      Metrics::Add("instance." + instance->name + ".threads", 1);
+      break;
+
+    // Also from the streaming thread, which may run other tasks after this one
+    case GST_STREAM_STATUS_TYPE_LEAVE:
+      if (instance->pinned && restore
+          && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &process_cpus)) {
+        GST_WARNING("Instance \"%s\": the thread of \"%s\" can't be unpinned", instance->name.c_str(),
+                    GST_ELEMENT_NAME (owner));
+      }
+      Metrics::Add("instance." + instance->name + ".threads", -1);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void InstanceResources::Watch(GstElement *pipeline, const std::string &pipe) {
+  if (!pipes.count(pipe)) {
+    return;
+  }
+
+  GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE (pipeline));
+  gst_bus_set_sync_handler(bus, SyncHandler, g_strdup(pipe.c_str()), g_free);
+  gst_object_unref(bus);
+}
+
+GstBusSyncReply InstanceResources::SyncHandler(GstBus *bus, GstMessage *message, gpointer user_data) {
+  Place(message, (const gchar *) user_data);
+  return GST_BUS_PASS;
+}
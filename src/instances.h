@@ -0,0 +1,54 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <sched.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// An entry of the "instances" json array, made of a template
+struct InstanceConfig {
+  std::string template_name;
+  // Pipes made from the template for this instance
+  std::vector<std::string> pipes;
+  // CPUs of the streaming threads, e.g. "2-3,6"; empty runs them anywhere
+  std::string cpus;
+  // Budget of the branch queues of the instance, 0 shares the process-wide one
+  guint budget_mb = 0;
+};
+
+// Streaming threads of an instance come from a task pool of its own, with a
+// dedicated thread per task, and are pinned to its CPU set as they start,
+// so a busy camera keeps to its cores and its threads instead of starving
+// the others. A thread gets the affinity of the process back when its task
+// leaves. The threads are placed from the sync handlers of the buses, in
+// the thread that starts them.
+
+class InstanceResources {
+public:
+
+  static void Init(const std::map<std::string, InstanceConfig> &instances);
+
+  // A message of the bus of "pipe", from its sync handler
+  static void Place(GstMessage *message, const std::string &pipe);
+
+  // A pipeline made apart from the topology, e.g. the RTSP media of "pipe"
+  static void Watch(GstElement *pipeline, const std::string &pipe);
+
+private:
+
+  struct Instance {
+    std::string name;
+    GstTaskPool *pool;
+    bool pinned;
+    cpu_set_t cpus;
+  };
+
+  static bool ParseCpus(const std::string &list, cpu_set_t *cpus);
+  static GstBusSyncReply SyncHandler(GstBus *bus, GstMessage *message, gpointer user_data);
+
+  static std::map<std::string, Instance> instances;
+  static std::map<std::string, Instance *> pipes;
+  static cpu_set_t process_cpus;
+  static bool restore;
+};
@@ -2,7 +2,9 @@ struct JsonParseException;
 #define RAPIDJSON_PARSE_ERROR_NORETURN(parseErrorCode,offset) \
    throw JsonParseException(parseErrorCode, #parseErrorCode, offset)
 
+#include <cstring>
 #include <fstream>
+#include <map>
 #include "json.h"
 
 GST_DEBUG_CATEGORY_STATIC (log_app_json);  // define debug category (statically)
@@ -15,21 +17,399 @@ Json::Json(const char* json_file) {
       GST_CAT_DEFAULT, "GCF_APP_JSON", GST_DEBUG_FG_MAGENTA, "Json utils"
   );
 
-  // Get json string from file
+  // Get json string from file, it keys the cached plan too
   std::ifstream ifs(json_file);
-  std::string content(
+  content.assign(
       (std::istreambuf_iterator<char>(ifs)),
       (std::istreambuf_iterator<char>()));
 
   // Parse the assigned JSON source
   json_src.Parse(content.c_str());
+  ExpandTemplates();
+  GetEncoderChoices();
 }
 
 Json::~Json() {
 }
 
+
+// Read an optional unsigned number from an option object
+static guint GetUintOption(const rapidjson::Value &options, const char *key, guint default_value,
+                           const std::string &owner) {
+  if (!options.HasMember(key)) {
+    return default_value;
+  }
+
+  GCF_ASSERT(options[key].IsUint(), JsonInvalidTypeException,
+             std::string("Option \"") + key + "\" of \"" + owner + "\" is not a valid unsigned number!");
+
+  return options[key].GetUint();
+}
+
+// Read an optional number from an option object
+static double GetDoubleOption(const rapidjson::Value &options, const char *key, double default_value,
+                              const std::string &owner) {
+  if (!options.HasMember(key)) {
+    return default_value;
+  }
+
+  GCF_ASSERT(options[key].IsNumber(), JsonInvalidTypeException,
+             std::string("Option \"") + key + "\" of \"" + owner + "\" is not a valid number!");
+
+  return options[key].GetDouble();
+}
+
+// Read an optional boolean from an option object
+static bool GetBoolOption(const rapidjson::Value &options, const char *key, bool default_value,
+                          const std::string &owner) {
+  if (!options.HasMember(key)) {
+    return default_value;
+  }
+
+  GCF_ASSERT(options[key].IsBool(), JsonInvalidTypeException,
+             std::string("Option \"") + key + "\" of \"" + owner + "\" is not a valid boolean!");
+
+  return options[key].GetBool();
+}
+
+// Read an optional string from an option object
+static std::string GetStringOption(const rapidjson::Value &options, const char *key, const std::string &default_value,
+                                   const std::string &owner) {
+  if (!options.HasMember(key)) {
+    return default_value;
+  }
+
+  GCF_ASSERT(options[key].IsString(), JsonInvalidTypeException,
+             std::string("Option \"") + key + "\" of \"" + owner + "\" is not a valid string!");
+
+  return options[key].GetString();
+}
+
+// Parameters of a template or an instance; an instance only overrides what its template declares
+static void ReadParams(const rapidjson::Value &owner, const std::string &owner_name, bool declare,
+                       std::map<std::string, std::string> &params) {
+  if (!owner.HasMember("params")) {
+    return;
+  }
+
+  const rapidjson::Value &values = owner["params"];
+  GCF_ASSERT(values.IsObject(), JsonInvalidTypeException,
+             "Parameters of \"" + owner_name + "\" are not a valid object!");
+
+  for (auto param = values.MemberBegin(); param != values.MemberEnd(); ++param) {
+    std::string key = param->name.GetString();
+    GCF_ASSERT(param->value.IsString(), JsonInvalidTypeException,
+               "Parameter \"" + key + "\" of \"" + owner_name + "\" is not a string!");
+    GCF_ASSERT(declare || params.count(key), JsonInvalidTypeException,
+               "Instance \"" + owner_name + "\": its template has no parameter \"" + key + "\"!");
+    params[key] = param->value.GetString();
+  }
+}
+
+// Copy of a template value with the parameters put in its names and strings
+static rapidjson::Value Instantiate(const rapidjson::Value &value, const std::map<std::string, std::string> &params,
+                                    rapidjson::Document::AllocatorType &allocator, const std::string &owner) {
+  auto substitute = [&](const char *text) {
+    std::string result = text;
+    size_t start;
+    while ((start = result.find("${")) != std::string::npos) {
+      size_t end = result.find('}', start);
+      GCF_ASSERT(end != std::string::npos, JsonInvalidTypeException,
+                 "Unterminated parameter in \"" + result + "\" of \"" + owner + "\"!");
+
+      auto param = params.find(result.substr(start + 2, end - start - 2));
+      GCF_ASSERT(param != params.end(), JsonInvalidTypeException,
+                 "Unknown parameter " + result.substr(start, end - start + 1) + " in \"" + owner + "\"!");
+      result.replace(start, end - start + 1, param->second);
+    }
+    return rapidjson::Value(result.c_str(), (rapidjson::SizeType) result.size(), allocator);
+  };
+
+  if (value.IsString()) {
+    return substitute(value.GetString());
+  }
+
+  if (value.IsObject()) {
+    rapidjson::Value object(rapidjson::kObjectType);
+    for (auto itr = value.MemberBegin(); itr != value.MemberEnd(); ++itr) {
+      object.AddMember(substitute(itr->name.GetString()), Instantiate(itr->value, params, allocator, owner), allocator);
+    }
+    return object;
+  }
+
+  if (value.IsArray()) {
+    rapidjson::Value array(rapidjson::kArrayType);
+    for (auto itr = value.Begin(); itr != value.End(); ++itr) {
+      array.PushBack(Instantiate(*itr, params, allocator, owner), allocator);
+    }
+    return array;
+  }
+
+  return rapidjson::Value(value, allocator);
+}
+
+// Every instance gets its own copy of the sections of its template, merged
+// into the document as if they were written there
+void Json::ExpandTemplates() {
+  if (!json_src.IsObject() || !json_src.HasMember(JSON_TAG_INSTANCES)) {
+    return;
+  }
+
+  // Taken out first, the sections are added to the document below
+  rapidjson::Value templates(rapidjson::kObjectType), instance_list;
+  if (json_src.HasMember(JSON_TAG_TEMPLATES)) {
+    templates.Swap(json_src[JSON_TAG_TEMPLATES]);
+    json_src.RemoveMember(JSON_TAG_TEMPLATES);
+  }
+  instance_list.Swap(json_src[JSON_TAG_INSTANCES]);
+  json_src.RemoveMember(JSON_TAG_INSTANCES);
+
+  GCF_ASSERT(templates.IsObject(), JsonInvalidTypeException, "Templates are not a valid object!");
+  GCF_ASSERT(instance_list.IsArray(), JsonInvalidTypeException, "Instances are not a valid array!");
+
+  auto &allocator = json_src.GetAllocator();
+  for (auto itr = instance_list.Begin(); itr != instance_list.End(); ++itr) {
+    GCF_ASSERT(itr->IsObject() && itr->HasMember("name") && (*itr)["name"].IsString()
+                   && itr->HasMember("template") && (*itr)["template"].IsString(), JsonInvalidTypeException,
+               "An instance needs a \"name\" and a \"template\"!");
+    std::string name = (*itr)["name"].GetString();
+    std::string template_name = (*itr)["template"].GetString();
+
+    GCF_ASSERT(!instances.count(name), JsonInvalidTypeException, "Instance \"" + name + "\" is defined twice!");
+    GCF_ASSERT(templates.HasMember(template_name.c_str()) && templates[template_name.c_str()].IsObject(),
+               JsonInvalidTypeException, "Instance \"" + name + "\": no template \"" + template_name + "\"!");
+    const rapidjson::Value &templ = templates[template_name.c_str()];
+
+    // Defaults of the template, overridden by the instance
+    std::map<std::string, std::string> params = {{"instance", name}};
+    ReadParams(templ, template_name, true, params);
+    ReadParams(*itr, name, false, params);
+
+    InstanceConfig config;
+    config.template_name = template_name;
+    config.cpus = GetStringOption(*itr, "cpus", config.cpus, name);
+    config.budget_mb = GetUintOption(*itr, "budget-mb", config.budget_mb, name);
+
+    for (auto section = templ.MemberBegin(); section != templ.MemberEnd(); ++section) {
+      const char *tag = section->name.GetString();
+      if (!strcmp(tag, "params")) {
+        continue;
+      }
+
+      // Only what belongs to pipes can be templated, the rest is process-wide
+      bool keyed = false;
+      for (const char *known : {JSON_TAG_CAPS, JSON_TAG_PIPES, JSON_TAG_MOUNTS, JSON_TAG_CONNECTIONS,
+                                JSON_TAG_FAILOVER, JSON_TAG_STATES}) {
+        keyed |= !strcmp(tag, known);
+      }
+      bool listed = !strcmp(tag, JSON_TAG_RTSP) || !strcmp(tag, JSON_TAG_LINKS);
+      GCF_ASSERT(keyed || listed, JsonInvalidTypeException,
+                 "Template \"" + template_name + "\": section \"" + tag + "\" can't be templated!");
+
+      rapidjson::Value copy = Instantiate(section->value, params, allocator, name);
+      GCF_ASSERT(keyed ? copy.IsObject() : copy.IsArray(), JsonInvalidTypeException,
+                 "Template \"" + template_name + "\": section \"" + tag + "\" is not valid!");
+
+      if (!json_src.HasMember(tag)) {
+        json_src.AddMember(rapidjson::Value(tag, allocator),
+                           rapidjson::Value(keyed ? rapidjson::kObjectType : rapidjson::kArrayType), allocator);
+      }
+      rapidjson::Value &target = json_src[tag];
+      GCF_ASSERT(keyed ? target.IsObject() : target.IsArray(), JsonInvalidTypeException,
+                 std::string("Section \"") + tag + "\" is not valid!");
+
+      if (listed) {
+        for (auto item = copy.Begin(); item != copy.End(); ++item) {
+          target.PushBack(*item, allocator);
+        }
+        continue;
+      }
+
+      for (auto member = copy.MemberBegin(); member != copy.MemberEnd(); ++member) {
+        GCF_ASSERT(!target.HasMember(member->name), JsonInvalidTypeException,
+                   "Instance \"" + name + "\": \"" + member->name.GetString() + "\" of \"" + tag
+                       + "\" is defined twice!");
+        if (!strcmp(tag, JSON_TAG_PIPES)) {
+          config.pipes.push_back(member->name.GetString());
+        }
+        target.AddMember(member->name, member->value, allocator);
+      }
+    }
+
+    GST_DEBUG("Instance \"%s\" of \"%s\": %zu pipes", name.c_str(), template_name.c_str(), config.pipes.size());
+    instances[name] = config;
+  }
+}
+
+// Element definition of any pipe, NULL if there is none
+static const rapidjson::Value *FindElement(const rapidjson::Value &json, const char *name) {
+  const rapidjson::Value &json_pipes_obj = json[JSON_TAG_PIPES];
+  for (auto pipe = json_pipes_obj.MemberBegin(); pipe != json_pipes_obj.MemberEnd(); ++pipe) {
+    if (pipe->value.IsObject() && pipe->value.HasMember(name) && pipe->value[name].IsObject()) {
+      return &pipe->value[name];
+    }
+  }
+  return NULL;
+}
+
+// Caps of the last capsfilter upstream of an element, followed into the
+// pipe feeding its own through the connections; empty if there is none
+static std::string CapsUpstreamOf(const rapidjson::Value &json, const std::string &element_name) {
+  if (!json.HasMember(JSON_TAG_LINKS) || !json[JSON_TAG_LINKS].IsArray()
+      || !json.HasMember(JSON_TAG_CAPS) || !json[JSON_TAG_CAPS].IsObject()) {
+    return "";
+  }
+
+  const rapidjson::Value &links = json[JSON_TAG_LINKS];
+  std::string current = element_name;
+
+  // Every hop is another chain, a loop of connections ends with the links
+  for (rapidjson::SizeType hops = 0; !current.empty() && hops < links.Size(); hops++) {
+    const rapidjson::Value *chain = NULL;
+    rapidjson::SizeType position = 0;
+    for (auto link = links.Begin(); !chain && link != links.End(); ++link) {
+      for (rapidjson::SizeType i = 0; link->IsArray() && i < link->Size(); i++) {
+        if ((*link)[i].IsString() && current == (*link)[i].GetString()) {
+          chain = &*link;
+          position = i;
+          break;
+        }
+      }
+    }
+    if (!chain) {
+      return "";
+    }
+
+    for (rapidjson::SizeType i = position; i-- > 0;) {
+      const rapidjson::Value *element = (*chain)[i].IsString() ? FindElement(json, (*chain)[i].GetString()) : NULL;
+      if (element && element->HasMember("filter") && (*element)["filter"].IsString()) {
+        const char *caps_name = (*element)["filter"].GetString();
+        const rapidjson::Value &json_caps_obj = json[JSON_TAG_CAPS];
+        return json_caps_obj.HasMember(caps_name) && json_caps_obj[caps_name].IsString()
+               ? json_caps_obj[caps_name].GetString() : "";
+      }
+    }
+
+    current = "";
+    if (json.HasMember(JSON_TAG_CONNECTIONS) && json[JSON_TAG_CONNECTIONS].IsObject() && (*chain)[0].IsString()) {
+      const rapidjson::Value &json_connections_obj = json[JSON_TAG_CONNECTIONS];
+      for (auto itr = json_connections_obj.MemberBegin(); itr != json_connections_obj.MemberEnd(); ++itr) {
+        const rapidjson::Value &connection = itr->value;
+        if (connection.IsObject() && connection.HasMember("first_elem") && connection["first_elem"].IsString()
+            && connection.HasMember("src_last_elem") && connection["src_last_elem"].IsString()
+            && !strcmp(connection["first_elem"].GetString(), (*chain)[0].GetString())) {
+          current = connection["src_last_elem"].GetString();
+        }
+      }
+    }
+  }
+
+  return "";
+}
+
+// Read only, nothing is measured or loaded for it
+void Json::GetEncoderChoices() {
+  choices = EncoderSelector::Defaults();
+  if (json_src.IsObject() && json_src.HasMember(JSON_TAG_ENCODERS)) {
+    const rapidjson::Value &json_encoders_obj = json_src[JSON_TAG_ENCODERS];
+    GCF_ASSERT(json_encoders_obj.IsObject(), JsonInvalidTypeException, "Encoder options are not a valid object!");
+
+    for (auto itr = json_encoders_obj.MemberBegin(); itr != json_encoders_obj.MemberEnd(); ++itr) {
+      std::string type = itr->name.GetString();
+      GCF_ASSERT(type[0] == '@' && itr->value.IsObject(), JsonInvalidTypeException,
+                 "Encoder type \"" + type + "\" must start with @ and be a valid object!");
+      const rapidjson::Value &options = itr->value;
+      EncoderChoiceConfig &config = choices[type];
+
+      if (options.HasMember("candidates")) {
+        GCF_ASSERT(options["candidates"].IsArray(), JsonInvalidTypeException,
+                   "Candidates of \"" + type + "\" are not a valid array!");
+        config.candidates.clear();
+        for (auto candidate = options["candidates"].Begin(); candidate != options["candidates"].End(); ++candidate) {
+          GCF_ASSERT(candidate->IsString(), JsonInvalidTypeException,
+                     "A candidate of \"" + type + "\" is not a string!");
+          config.candidates.push_back(candidate->GetString());
+        }
+      }
+      config.latency_ms = GetUintOption(options, "latency-ms", config.latency_ms, type);
+      config.frames = GetUintOption(options, "frames", config.frames, type);
+
+      GCF_ASSERT(!config.candidates.empty(), JsonInvalidTypeException, "\"" + type + "\" has no candidates!");
+      GCF_ASSERT(config.frames >= 2, JsonInvalidTypeException,
+                 "Encoder option \"frames\" of \"" + type + "\" must be 2 at least!");
+    }
+  }
+}
+
+// Elements of an abstract encoder type get the encoder chosen on this host,
+// before the topology reads their types; their own properties are kept over
+// the ones of the candidate, so they should be common to the candidates
+void Json::ResolveEncoders() {
+  if (resolved || !json_src.IsObject() || !json_src.HasMember(JSON_TAG_PIPES)
+      || !json_src[JSON_TAG_PIPES].IsObject()) {
+    return;
+  }
+  resolved = true;
+
+  // One run per type and caps, shared by the branches alike
+  std::map<std::string, EncoderChoice> chosen;
+  auto &allocator = json_src.GetAllocator();
+
+  rapidjson::Value &json_pipes_obj = json_src[JSON_TAG_PIPES];
+  for (auto pipe_itr = json_pipes_obj.MemberBegin(); pipe_itr != json_pipes_obj.MemberEnd(); ++pipe_itr) {
+    if (!pipe_itr->value.IsObject()) {
+      continue;
+    }
+
+    for (auto elem_itr = pipe_itr->value.MemberBegin(); elem_itr != pipe_itr->value.MemberEnd(); ++elem_itr) {
+      rapidjson::Value &element = elem_itr->value;
+      if (!element.IsObject() || !element.HasMember("type") || !element["type"].IsString()
+          || element["type"].GetString()[0] != '@') {
+        continue;
+      }
+
+      std::string element_name = elem_itr->name.GetString();
+      std::string type = element["type"].GetString();
+      auto config = choices.find(type);
+      GCF_ASSERT(config != choices.end(), JsonInvalidTypeException,
+                 "Element \"" + element_name + "\" has an unknown encoder type \"" + type + "\"!");
+
+      std::string caps = CapsUpstreamOf(json_src, element_name);
+      if (caps.empty()) {
+        caps = ENCODER_DEFAULT_CAPS;
+      }
+
+      std::string key = type + " " + caps;
+      if (!chosen.count(key)) {
+        chosen[key] = EncoderSelector::Select(type, caps, config->second);
+        GCF_ASSERT(!chosen[key].factory.empty(), JsonInvalidTypeException,
+                   "No candidate of \"" + type + "\" works on this host!");
+        encoders += key + " => " + chosen[key].description + "\n";
+      }
+
+      const EncoderChoice &choice = chosen[key];
+      element["type"].SetString(choice.factory.c_str(), allocator);
+      for (const auto &property : choice.properties) {
+        if (!element.HasMember(property.first.c_str())) {
+          element.AddMember(rapidjson::Value(property.first.c_str(), allocator),
+                            rapidjson::Value(property.second.c_str(), allocator), allocator);
+        }
+      }
+
+      GST_INFO("Element \"%s\" of type \"%s\" is \"%s\"", element_name.c_str(), type.c_str(),
+               choice.description.c_str());
+    }
+  }
+}
+
+void Json::GetInstances(Topology *topology) {
+  for (const auto &instance : instances) {
+    topology->SetInstanceConfig(instance.first, instance.second);
+  }
+}
+
 // Load, create and store caps
-void Json::GetCaps(Topology *topology) {
+void Json::GetCaps(TopologyPlan *plan) {
 
   if (json_src.HasMember(JSON_TAG_CAPS)) {
     GST_DEBUG("Reading caps from JSON...");
@@ -46,7 +426,7 @@ void Json::GetCaps(Topology *topology) {
         throw JsonInvalidTypeException("Invalid cap found!");
       }
 
-      topology->CreateCap(itr->name.GetString(), itr->value.GetString());
+      plan->AddCaps(itr->name.GetString(), itr->value.GetString());
     }
   } else {
     GST_DEBUG("No caps are defined.");
@@ -81,6 +461,177 @@ void Json::GetRtspPipes(Topology *topology) {
   }
 }
 
+// Read the per-mount options of the RTSP pipes
+void Json::GetMounts(Topology *topology) {
+
+  if (json_src.HasMember(JSON_TAG_MOUNTS)) {
+    GST_DEBUG("Reading mount options from JSON...");
+
+    const rapidjson::Value &json_mounts_obj = json_src[JSON_TAG_MOUNTS];
+    GCF_ASSERT(json_mounts_obj.IsObject(), JsonInvalidTypeException,
+               "Object to store mount options is not a valid object!");
+
+    for (rapidjson::Value::ConstMemberIterator mount_itr = json_mounts_obj.MemberBegin();
+         mount_itr != json_mounts_obj.MemberEnd(); ++mount_itr) {
+
+      GCF_ASSERT(mount_itr->name.IsString(), JsonInvalidTypeException, "Mount name is not a string value!");
+      const char *pipe_name = mount_itr->name.GetString();
+
+      GCF_ASSERT(mount_itr->value.IsObject(), JsonInvalidTypeException,
+                 std::string("Options of mount \"") + pipe_name + "\" are not a valid object!");
+      const rapidjson::Value &options = mount_itr->value;
+
+      MountConfig config;
+
+      // Batched UDP egress
+      if (options.HasMember("udp-batch")) {
+        const rapidjson::Value &batch = options["udp-batch"];
+        GCF_ASSERT(batch.IsObject(), JsonInvalidTypeException,
+                   std::string("UDP batching of mount \"") + pipe_name + "\" is not a valid object!");
+
+        config.udp_batch = true;
+        config.batch_packets = GetUintOption(batch, "packets", config.batch_packets, pipe_name);
+        config.batch_tick_ms = GetUintOption(batch, "tick-ms", config.batch_tick_ms, pipe_name);
+      }
+
+      // Slow TCP client isolation
+      if (options.HasMember("tcp-queue")) {
+        const rapidjson::Value &queue = options["tcp-queue"];
+        GCF_ASSERT(queue.IsObject(), JsonInvalidTypeException,
+                   std::string("TCP queue of mount \"") + pipe_name + "\" is not a valid object!");
+
+        config.tcp_queue = true;
+        config.tcp_queue_bytes = GetUintOption(queue, "max-bytes", config.tcp_queue_bytes, pipe_name);
+        config.tcp_queue_ms = GetUintOption(queue, "max-time-ms", config.tcp_queue_ms, pipe_name);
+        config.tcp_disconnect_ms = GetUintOption(queue, "disconnect-ms", config.tcp_disconnect_ms, pipe_name);
+      }
+
+      // Receiver report driven bitrate
+      if (options.HasMember("abr")) {
+        const rapidjson::Value &abr = options["abr"];
+        GCF_ASSERT(abr.IsObject(), JsonInvalidTypeException,
+                   std::string("ABR of mount \"") + pipe_name + "\" is not a valid object!");
+
+        config.abr = true;
+        config.abr_encoder = GetStringOption(abr, "encoder", config.abr_encoder, pipe_name);
+        config.abr_min_kbps = GetUintOption(abr, "min-kbps", config.abr_min_kbps, pipe_name);
+        config.abr_max_kbps = GetUintOption(abr, "max-kbps", config.abr_max_kbps, pipe_name);
+        config.abr_loss_high = GetDoubleOption(abr, "loss-high", config.abr_loss_high, pipe_name);
+        config.abr_loss_low = GetDoubleOption(abr, "loss-low", config.abr_loss_low, pipe_name);
+        config.abr_rtt_high_ms = GetUintOption(abr, "rtt-high-ms", config.abr_rtt_high_ms, pipe_name);
+        config.abr_hold_ms = GetUintOption(abr, "hold-ms", config.abr_hold_ms, pipe_name);
+        config.abr_filter = GetStringOption(abr, "filter", config.abr_filter, pipe_name);
+        config.abr_min_fps = GetUintOption(abr, "min-fps", config.abr_min_fps, pipe_name);
+        config.abr_max_fps = GetUintOption(abr, "max-fps", config.abr_max_fps, pipe_name);
+
+        GCF_ASSERT(!config.abr_encoder.empty(), JsonInvalidTypeException,
+                   std::string("ABR of mount \"") + pipe_name + "\" has no encoder!");
+        GCF_ASSERT(config.abr_min_kbps <= config.abr_max_kbps && config.abr_min_fps <= config.abr_max_fps
+                       && config.abr_loss_low <= config.abr_loss_high, JsonInvalidTypeException,
+                   std::string("ABR bounds of mount \"") + pipe_name + "\" are invalid!");
+      }
+
+      // Retransmission
+      if (options.HasMember("rtx")) {
+        const rapidjson::Value &rtx = options["rtx"];
+        GCF_ASSERT(rtx.IsObject(), JsonInvalidTypeException,
+                   std::string("Retransmission of mount \"") + pipe_name + "\" is not a valid object!");
+
+        config.rtx = true;
+        config.rtx_time_ms = GetUintOption(rtx, "time-ms", config.rtx_time_ms, pipe_name);
+        config.rtx_packets = GetUintOption(rtx, "packets", config.rtx_packets, pipe_name);
+        config.rtx_pt = GetUintOption(rtx, "pt", config.rtx_pt, pipe_name);
+
+        GCF_ASSERT(config.rtx_pt >= 96 && config.rtx_pt <= 127, JsonInvalidTypeException,
+                   std::string("Retransmission payload type of mount \"") + pipe_name + "\" is not dynamic!");
+      }
+
+      // On-demand renditions
+      if (options.HasMember("renditions")) {
+        const rapidjson::Value &renditions = options["renditions"];
+        GCF_ASSERT(renditions.IsObject(), JsonInvalidTypeException,
+                   std::string("Renditions of mount \"") + pipe_name + "\" are not a valid object!");
+
+        config.max_renditions = GetUintOption(renditions, "max", 1, pipe_name);
+      }
+
+      // Temporal layers
+      if (options.HasMember("temporal")) {
+        const rapidjson::Value &temporal = options["temporal"];
+        GCF_ASSERT(temporal.IsObject(), JsonInvalidTypeException,
+                   std::string("Temporal layers of mount \"") + pipe_name + "\" are not a valid object!");
+
+        config.temporal_levels = GetUintOption(temporal, "levels", 3, pipe_name);
+        config.temporal_encoder = GetStringOption(temporal, "encoder", config.temporal_encoder, pipe_name);
+
+        GCF_ASSERT(!config.temporal_encoder.empty(), JsonInvalidTypeException,
+                   std::string("Temporal layers of mount \"") + pipe_name + "\" have no encoder!");
+        GCF_ASSERT(config.temporal_levels >= 2 && config.temporal_levels <= 4, JsonInvalidTypeException,
+                   std::string("Temporal levels of mount \"") + pipe_name + "\" must be between 2 and 4!");
+      }
+
+      // LL-HLS output
+      if (options.HasMember("hls")) {
+        const rapidjson::Value &hls = options["hls"];
+        GCF_ASSERT(hls.IsObject(), JsonInvalidTypeException,
+                   std::string("HLS of mount \"") + pipe_name + "\" is not a valid object!");
+
+        config.hls = true;
+        config.hls_segment_ms = GetUintOption(hls, "segment-ms", config.hls_segment_ms, pipe_name);
+        config.hls_part_ms = GetUintOption(hls, "part-ms", config.hls_part_ms, pipe_name);
+        config.hls_segments = GetUintOption(hls, "segments", config.hls_segments, pipe_name);
+
+        GCF_ASSERT(config.hls_part_ms && config.hls_part_ms <= config.hls_segment_ms && config.hls_segments >= 2,
+                   JsonInvalidTypeException, std::string("HLS timing of mount \"") + pipe_name + "\" is invalid!");
+      }
+
+      // Segmented recording
+      if (options.HasMember("record")) {
+        const rapidjson::Value &record = options["record"];
+        GCF_ASSERT(record.IsObject(), JsonInvalidTypeException,
+                   std::string("Recording of mount \"") + pipe_name + "\" is not a valid object!");
+
+        config.record = true;
+        config.record_path = GetStringOption(record, "path", config.record_path, pipe_name);
+        config.record_segment_s = GetUintOption(record, "segment-s", config.record_segment_s, pipe_name);
+        config.record_keep_segments = GetUintOption(record, "keep-segments", config.record_keep_segments, pipe_name);
+        config.record_keep_mb = GetUintOption(record, "keep-mb", config.record_keep_mb, pipe_name);
+        config.record_buffer_kb = GetUintOption(record, "buffer-kb", config.record_buffer_kb, pipe_name);
+        config.record_direct_io = GetBoolOption(record, "direct-io", config.record_direct_io, pipe_name);
+        config.record_preallocate_mb = GetUintOption(record, "preallocate-mb", config.record_preallocate_mb, pipe_name);
+        config.record_autostart = GetBoolOption(record, "autostart", config.record_autostart, pipe_name);
+
+        GCF_ASSERT(!config.record_path.empty() && config.record_segment_s, JsonInvalidTypeException,
+                   std::string("Recording of mount \"") + pipe_name + "\" needs a path and a segment length!");
+      }
+
+      // In-memory time-shift
+      if (options.HasMember("timeshift")) {
+        const rapidjson::Value &timeshift = options["timeshift"];
+        GCF_ASSERT(timeshift.IsObject(), JsonInvalidTypeException,
+                   std::string("Time-shift of mount \"") + pipe_name + "\" is not a valid object!");
+
+        config.timeshift_mb = GetUintOption(timeshift, "mb", 64, pipe_name);
+        config.timeshift_max_s = GetUintOption(timeshift, "max-s", config.timeshift_max_s, pipe_name);
+
+        GCF_ASSERT(config.timeshift_mb && config.timeshift_mb <= 4096, JsonInvalidTypeException,
+                   std::string("Time-shift memory of mount \"") + pipe_name + "\" must be between 1 and 4096 MB!");
+      }
+
+      GCF_ASSERT(!config.abr || !config.SharedEncode(), JsonInvalidTypeException,
+                 std::string("ABR of mount \"") + pipe_name + "\" can't drive a shared encoder!");
+      GCF_ASSERT(!config.rtx || !config.SharedEncode(), JsonInvalidTypeException,
+                 std::string("RTX of mount \"") + pipe_name + "\" is not available on a shared encoder!");
+
+      topology->SetMountConfig(pipe_name, config);
+
+      GST_DEBUG("Loaded options of mount \"%s\"", pipe_name);
+    }
+  } else {
+    GST_DEBUG("No mount options are defined.");
+  }
+}
+
 // Intervideo powered pipe connections
 void Json::GetInterConnections(Topology *topology) {
 
@@ -127,8 +678,8 @@ void Json::GetInterConnections(Topology *topology) {
   }
 }
 
-// Read, create, and save pipes and elements. Set element attributes, then fill them into the pipe
-void Json::GetPipelineStructure(Topology *topology) {
+// Read and check pipes and elements with their attributes into the plan
+void Json::GetPipelineStructure(TopologyPlan *plan) {
   if (json_src.HasMember(JSON_TAG_PIPES)) {
     GST_DEBUG("Reading pipelines from json");
 
@@ -147,7 +698,7 @@ void Json::GetPipelineStructure(Topology *topology) {
       const char *pipe_name = pipe_itr->name.GetString();
 
       // Create the pipe
-      topology->CreatePipeline(pipe_name);
+      plan->AddPipe(pipe_name);
 
       // Check whether the pipe is a valid object
       GCF_ASSERT(pipe_itr->value.IsObject(), JsonInvalidTypeException,
@@ -180,8 +731,8 @@ void Json::GetPipelineStructure(Topology *topology) {
 
         const char *type_name = json_properties_obj["type"].GetString();
 
-        // Try to create the element
-        topology->CreateElement(elem_name, type_name);
+        // Try to resolve the element, it's made with its pipe later
+        plan->AddElement(pipe_name, elem_name, type_name);
 
         // Iterate through its properties
         for (rapidjson::Value::ConstMemberIterator prop_itr = json_properties_obj.MemberBegin();
@@ -203,19 +754,16 @@ void Json::GetPipelineStructure(Topology *topology) {
 
           // Attach property as pre-defined filtercaps and continue processing
           if (!strcmp("filter", prop_name)) {
-            topology->AssignCap(elem_name, prop_value);
+            plan->SetFilter(elem_name, prop_value);
             continue;
           }
 
           // Finally, it's not a reserved keyword so set it as a generic property
-          topology->SetProperty(elem_name, prop_name, prop_value);
+          plan->AddProperty(elem_name, prop_name, prop_value);
 
           // End of processing properties
         }
 
-        // Try to add this element to the pipe
-        topology->AddElementToBin(elem_name, pipe_name);
-
         // End of processing pipe elements
       }
 
@@ -229,7 +777,7 @@ void Json::GetPipelineStructure(Topology *topology) {
 }
 
 // Load connections and link elements
-void Json::GetConnections(Topology *topology) {
+void Json::GetConnections(TopologyPlan *plan) {
 
   if (json_src.HasMember(JSON_TAG_LINKS)) {
     GST_DEBUG("Reading element connections from json");
@@ -267,7 +815,7 @@ void Json::GetConnections(Topology *topology) {
             );
           }
           // Now connect them
-          topology->ConnectElements(src_name, element_itr->GetString());
+          plan->AddLink(src_name, element_itr->GetString());
         }
       }
     }
@@ -276,12 +824,281 @@ void Json::GetConnections(Topology *topology) {
   }
 }
 
+// Rework the chains before anything is linked to them
+void Json::GetOptimizations(Topology *topology) {
+  OptimizeConfig config;
+
+  if (json_src.HasMember(JSON_TAG_OPTIMIZE)) {
+    const rapidjson::Value &options = json_src[JSON_TAG_OPTIMIZE];
+    GCF_ASSERT(options.IsObject(), JsonInvalidTypeException, "Optimization options are not a valid object!");
+
+    config.fuse_scale_convert = GetBoolOption(options, "fuse-scale-convert", config.fuse_scale_convert,
+                                              JSON_TAG_OPTIMIZE);
+    config.analyze = GetBoolOption(options, "analyze", config.analyze, JSON_TAG_OPTIMIZE);
+    config.rebuild = GetBoolOption(options, "rebuild", config.rebuild, JSON_TAG_OPTIMIZE);
+    config.delay_ms = GetUintOption(options, "analyze-delay-ms", config.delay_ms, JSON_TAG_OPTIMIZE);
+  }
+  topology->SetOptimizeConfig(config);
+
+  if (!config.fuse_scale_convert || !json_src.HasMember(JSON_TAG_LINKS) || !json_src[JSON_TAG_LINKS].IsArray()) {
+    return;
+  }
+
+  const rapidjson::Value &json_links_arr = json_src[JSON_TAG_LINKS];
+  for (rapidjson::Value::ConstValueIterator itr = json_links_arr.Begin(); itr != json_links_arr.End(); ++itr) {
+    if (!itr->IsArray()) {
+      continue;
+    }
+
+    std::vector<std::string> chain;
+    for (rapidjson::Value::ConstValueIterator element_itr = itr->Begin(); element_itr != itr->End(); ++element_itr) {
+      if (element_itr->IsString()) {
+        chain.push_back(element_itr->GetString());
+      }
+    }
+
+    topology->FuseScaleConvert(chain);
+  }
+}
+
+// Buffer allocation of the raw video
+void Json::GetMemory(Topology *topology) {
+  MemoryConfig config;
+
+  if (json_src.HasMember(JSON_TAG_MEMORY)) {
+    const rapidjson::Value &options = json_src[JSON_TAG_MEMORY];
+    GCF_ASSERT(options.IsObject(), JsonInvalidTypeException, "Memory options are not a valid object!");
+
+    config.arena = GetBoolOption(options, "arena", config.arena, JSON_TAG_MEMORY);
+    config.budget_mb = GetUintOption(options, "budget-mb", config.budget_mb, JSON_TAG_MEMORY);
+    config.slabs = GetUintOption(options, "slabs", config.slabs, JSON_TAG_MEMORY);
+    config.hugepages = GetBoolOption(options, "hugepages", config.hugepages, JSON_TAG_MEMORY);
+
+    GCF_ASSERT(config.slabs > 0, JsonInvalidTypeException, "Memory option \"slabs\" must not be 0!");
+  }
+
+  topology->SetMemoryConfig(config);
+}
+
+void Json::GetGovernor(Topology *topology) {
+  GovernorConfig config;
+
+  if (json_src.HasMember(JSON_TAG_GOVERNOR)) {
+    const rapidjson::Value &options = json_src[JSON_TAG_GOVERNOR];
+    GCF_ASSERT(options.IsObject(), JsonInvalidTypeException, "Governor options are not a valid object!");
+
+    config.budget_mb = GetUintOption(options, "budget-mb", config.budget_mb, JSON_TAG_GOVERNOR);
+    config.interval_ms = GetUintOption(options, "interval-ms", config.interval_ms, JSON_TAG_GOVERNOR);
+    config.default_priority = GetUintOption(options, "default-priority", config.default_priority, JSON_TAG_GOVERNOR);
+
+    GCF_ASSERT(config.interval_ms > 0, JsonInvalidTypeException, "Governor option \"interval-ms\" must not be 0!");
+    GCF_ASSERT(config.default_priority > 0, JsonInvalidTypeException,
+               "Governor option \"default-priority\" must not be 0!");
+
+    // Branches or pipes by name, the branches of a mount take its priority
+    if (options.HasMember("priorities")) {
+      const rapidjson::Value &priorities = options["priorities"];
+      GCF_ASSERT(priorities.IsObject(), JsonInvalidTypeException, "Governor priorities are not a valid object!");
+
+      for (rapidjson::Value::ConstMemberIterator itr = priorities.MemberBegin(); itr != priorities.MemberEnd(); ++itr) {
+        GCF_ASSERT(itr->value.IsUint() && itr->value.GetUint() > 0, JsonInvalidTypeException,
+                   std::string("Governor priority of \"") + itr->name.GetString() + "\" is not a positive number!");
+        config.priorities[itr->name.GetString()] = itr->value.GetUint();
+      }
+    }
+  }
+
+  // An instance with a budget of its own is governed apart from the rest
+  for (const auto &instance : instances) {
+    if (!instance.second.budget_mb) {
+      continue;
+    }
+
+    config.group_budgets_mb[instance.first] = instance.second.budget_mb;
+    for (const auto &pipe : instance.second.pipes) {
+      config.groups[pipe] = instance.first;
+    }
+  }
+
+  topology->SetGovernorConfig(config);
+}
+
+void Json::GetWatchdog(Topology *topology) {
+  WatchdogConfig config;
+
+  if (json_src.HasMember(JSON_TAG_WATCHDOG)) {
+    const rapidjson::Value &options = json_src[JSON_TAG_WATCHDOG];
+    GCF_ASSERT(options.IsObject(), JsonInvalidTypeException, "Watchdog options are not a valid object!");
+
+    config.stall_ms = GetUintOption(options, "stall-ms", config.stall_ms, JSON_TAG_WATCHDOG);
+    config.interval_ms = GetUintOption(options, "interval-ms", config.interval_ms, JSON_TAG_WATCHDOG);
+    config.backoff_ms = GetUintOption(options, "backoff-ms", config.backoff_ms, JSON_TAG_WATCHDOG);
+    config.max_backoff_ms = GetUintOption(options, "max-backoff-ms", config.max_backoff_ms, JSON_TAG_WATCHDOG);
+
+    GCF_ASSERT(config.interval_ms > 0, JsonInvalidTypeException, "Watchdog option \"interval-ms\" must not be 0!");
+    GCF_ASSERT(config.backoff_ms <= config.max_backoff_ms, JsonInvalidTypeException,
+               "Watchdog option \"backoff-ms\" is over \"max-backoff-ms\"!");
+  }
+
+  topology->SetWatchdogConfig(config);
+}
+
+void Json::GetFailovers(Topology *topology) {
+
+  if (!json_src.HasMember(JSON_TAG_FAILOVER)) {
+    return;
+  }
+
+  const rapidjson::Value &json_failover_obj = json_src[JSON_TAG_FAILOVER];
+  GCF_ASSERT(json_failover_obj.IsObject(), JsonInvalidTypeException, "Failover options are not a valid object!");
+
+  for (rapidjson::Value::ConstMemberIterator itr = json_failover_obj.MemberBegin();
+       itr != json_failover_obj.MemberEnd(); ++itr) {
+    const char *pipe_name = itr->name.GetString();
+
+    GCF_ASSERT(itr->value.IsObject(), JsonInvalidTypeException,
+               std::string("Failover of pipe \"") + pipe_name + "\" is not a valid object!");
+    const rapidjson::Value &options = itr->value;
+
+    FailoverConfig config;
+    config.source = GetStringOption(options, "source", config.source, pipe_name);
+    config.backup = GetStringOption(options, "backup", config.backup, pipe_name);
+    config.timeout_ms = GetUintOption(options, "timeout-ms", config.timeout_ms, pipe_name);
+    config.recover_ms = GetUintOption(options, "recover-ms", config.recover_ms, pipe_name);
+
+    GCF_ASSERT(!config.source.empty() && !config.backup.empty(), JsonInvalidTypeException,
+               std::string("Failover of pipe \"") + pipe_name + "\" needs a source and a backup!");
+    GCF_ASSERT(config.timeout_ms > 0, JsonInvalidTypeException,
+               std::string("Failover option \"timeout-ms\" of pipe \"") + pipe_name + "\" must not be 0!");
+
+    topology->SetFailoverConfig(pipe_name, config);
+  }
+}
+
+std::set<std::string> Json::GetElementTypes() {
+  std::set<std::string> types;
+
+  if (!json_src.HasMember(JSON_TAG_PIPES) || !json_src[JSON_TAG_PIPES].IsObject()) {
+    return types;
+  }
+
+  // Malformed entries are reported when the pipes are made
+  const rapidjson::Value &json_pipes_obj = json_src[JSON_TAG_PIPES];
+  for (rapidjson::Value::ConstMemberIterator pipe_itr = json_pipes_obj.MemberBegin();
+       pipe_itr != json_pipes_obj.MemberEnd(); ++pipe_itr) {
+    if (!pipe_itr->value.IsObject()) {
+      continue;
+    }
+
+    for (rapidjson::Value::ConstMemberIterator elem_itr = pipe_itr->value.MemberBegin();
+         elem_itr != pipe_itr->value.MemberEnd(); ++elem_itr) {
+      if (!elem_itr->value.IsObject() || !elem_itr->value.HasMember("type") || !elem_itr->value["type"].IsString()) {
+        continue;
+      }
+
+      std::string type = elem_itr->value["type"].GetString();
+      auto config = choices.find(type);
+      if (type[0] != '@') {
+        types.insert(type);
+      } else if (config != choices.end()) {
+        // The candidates this host registers; with none, all of them are reported missing
+        std::set<std::string> candidates, registered;
+        for (const auto &description : config->second.candidates) {
+          EncoderChoice candidate;
+          if (EncoderSelector::Parse(description, &candidate)) {
+            candidates.insert(candidate.factory);
+            GstPluginFeature *feature = gst_registry_lookup_feature(gst_registry_get(), candidate.factory.c_str());
+            if (feature) {
+              registered.insert(candidate.factory);
+              gst_object_unref(feature);
+            }
+          }
+        }
+        const auto &required = registered.empty() ? candidates : registered;
+        types.insert(required.begin(), required.end());
+      }
+      // An unknown abstract type is reported when the encoders are resolved
+    }
+  }
+
+  return types;
+}
+
+// Initial state of the pipes; if nothing is declared, the pipes feeding
+// others play, or every pipe when nothing is connected
+void Json::GetStates(Topology *topology) {
+  if (!json_src.HasMember(JSON_TAG_STATES)) {
+    bool connected = false;
+
+    // The connections are checked by now
+    if (json_src.HasMember(JSON_TAG_CONNECTIONS)) {
+      const rapidjson::Value &json_conns_obj = json_src[JSON_TAG_CONNECTIONS];
+      for (rapidjson::Value::ConstMemberIterator itr = json_conns_obj.MemberBegin();
+           itr != json_conns_obj.MemberEnd(); ++itr) {
+        topology->SetInitialState(itr->value["src_pipe"].GetString(), GST_STATE_PLAYING);
+        connected = true;
+      }
+    }
+
+    for (const auto &pipe : topology->GetPipes()) {
+      if (!connected && !topology->HasRtspPipe(pipe.first)) {
+        topology->SetInitialState(pipe.first, GST_STATE_PLAYING);
+      }
+    }
+    return;
+  }
+
+  const rapidjson::Value &json_states_obj = json_src[JSON_TAG_STATES];
+  GCF_ASSERT(json_states_obj.IsObject(), JsonInvalidTypeException, "Initial states are not a valid object!");
+
+  for (rapidjson::Value::ConstMemberIterator state_itr = json_states_obj.MemberBegin();
+       state_itr != json_states_obj.MemberEnd(); ++state_itr) {
+
+    GCF_ASSERT(state_itr->name.IsString() && state_itr->value.IsString(), JsonInvalidTypeException,
+               "Initial states must be given as \"pipe\":\"state\" strings!");
+    const char *pipe_name = state_itr->name.GetString();
+    std::string state_name = state_itr->value.GetString();
+
+    GstState state = GST_STATE_VOID_PENDING;
+    for (GstState candidate : {GST_STATE_NULL, GST_STATE_READY, GST_STATE_PAUSED, GST_STATE_PLAYING}) {
+      if (!g_ascii_strcasecmp(state_name.c_str(), gst_element_state_get_name(candidate))) {
+        state = candidate;
+      }
+    }
+
+    GCF_ASSERT(state != GST_STATE_VOID_PENDING, JsonInvalidTypeException,
+               std::string("Initial state \"") + state_name + "\" of \"" + pipe_name + "\" is not a valid state!");
+
+    topology->SetInitialState(pipe_name, state);
+  }
+}
+
 void Json::CreateTopology(Topology* topology) {
-  GetCaps(topology);
-  GetPipelineStructure(topology);
+  ResolveEncoders();
+
+  // Caps, pipes and links come from the plan compiled for this very json and its encoders
+  TopologyPlan plan;
+  std::string key = TopologyPlan::Key(content + encoders);
+  if (!plan.Load(key)) {
+    GetCaps(&plan);
+    GetPipelineStructure(&plan);
+    GetConnections(&plan);
+    plan.SortLinks();
+    plan.Save(key);
+  }
+
+  plan.Instantiate(topology);
+  GetInstances(topology);
+  GetOptimizations(topology);
+  GetMemory(topology);
+  GetGovernor(topology);
+  GetWatchdog(topology);
   GetRtspPipes(topology);
+  GetMounts(topology);
+  GetFailovers(topology);
   GetInterConnections(topology);
-  GetConnections(topology);
+  plan.Link(topology);
+  GetStates(topology);
 }
 
 JsonParseException::JsonParseException(rapidjson::ParseErrorCode code, const char *msg, size_t offset)
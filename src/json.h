@@ -1,13 +1,29 @@
 #pragma once
 
 #include "rapidjson/document.h"
+#include <map>
+#include <set>
+#include <string>
+
 #include "topology.h"
+#include "plan.h"
+#include "encoderselect.h"
 
 #define JSON_TAG_CAPS "caps"
 #define JSON_TAG_PIPES "pipes"
 #define JSON_TAG_RTSP "rtsp"
 #define JSON_TAG_CONNECTIONS "connections"
 #define JSON_TAG_LINKS "links"
+#define JSON_TAG_MOUNTS "mounts"
+#define JSON_TAG_OPTIMIZE "optimize"
+#define JSON_TAG_MEMORY "memory"
+#define JSON_TAG_GOVERNOR "governor"
+#define JSON_TAG_FAILOVER "failover"
+#define JSON_TAG_WATCHDOG "watchdog"
+#define JSON_TAG_STATES "states"
+#define JSON_TAG_TEMPLATES "templates"
+#define JSON_TAG_INSTANCES "instances"
+#define JSON_TAG_ENCODERS "encoders"
 
 class Json {
  public:
@@ -17,15 +33,45 @@ class Json {
 
   void CreateTopology(Topology* topology);
 
-  void GetCaps(Topology *topology);
-  void GetPipelineStructure(Topology *topology);
+  // Element types of the pipes, before anything is made of them; an abstract
+  // encoder type stands for the candidates of it the registry has
+  std::set<std::string> GetElementTypes();
+
+  // Abstract encoder types, "@h264enc", are given the encoder chosen for this
+  // host, once their plugins are loaded; done by CreateTopology if not before
+  void ResolveEncoders();
+
+  // Compiled into the plan, the rest goes to the topology directly
+  void GetCaps(TopologyPlan *plan);
+  void GetPipelineStructure(TopologyPlan *plan);
+  void GetConnections(TopologyPlan *plan);
+
   void GetRtspPipes(Topology *topology);
+  void GetMounts(Topology *topology);
   void GetInterConnections(Topology *topology);
-  void GetConnections(Topology *topology);
+  void GetOptimizations(Topology *topology);
+  void GetMemory(Topology *topology);
+  void GetGovernor(Topology *topology);
+  void GetFailovers(Topology *topology);
+  void GetWatchdog(Topology *topology);
+  void GetStates(Topology *topology);
+  void GetInstances(Topology *topology);
 
  private:
 
+  // Instances of the templates are merged into the document once it is parsed
+  void ExpandTemplates();
+
+  // Candidates and budgets of the abstract encoder types, defaults and json
+  void GetEncoderChoices();
+
+  std::string content;
+  std::map<std::string, EncoderChoiceConfig> choices;
+  bool resolved = false;
+  // Choices of the abstract encoder types, they key the plan along with the json
+  std::string encoders;
   rapidjson::Document json_src;
+  std::map<std::string, InstanceConfig> instances;
 };
 
 // Exceptions
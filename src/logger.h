@@ -13,6 +13,8 @@
 
 #define GCF_ERROR_RETURN(B, ...) if (B) { GST_ERROR(__VA_ARGS__); return;}
 #define GCF_WARNING_RETURN(B, ...) if (B) { GST_WARNING(__VA_ARGS__); return;}
+#define GCF_ERROR_RETURN_VAL(B, V, ...) if (B) { GST_ERROR(__VA_ARGS__); return V;}
+#define GCF_WARNING_RETURN_VAL(B, V, ...) if (B) { GST_WARNING(__VA_ARGS__); return V;}
 
 class Logger {
 public:
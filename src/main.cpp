@@ -1,11 +1,24 @@
 #include <gst/gst.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "logger.h"
 #include "exception.h"
 #include "topology.h"
 #include "json.h"
 #include "server.h"
+#include "plugin.h"
+#include "metrics.h"
+#include "workers.h"
+#include "optimizer.h"
+#include "arenapool.h"
+#include "governor.h"
+#include "startup.h"
+#include "registry.h"
+#include "handover.h"
+#include "failover.h"
+#include "watchdog.h"
+#include "instances.h"
 
 // Local log category
 #define GST_CAT_DEFAULT log_app_main
@@ -16,10 +29,49 @@ guint msg_watch = 0;
 GIOChannel *io_stdin = NULL;
 RtspServer *server = NULL;
 Topology *topology = NULL;
+WorkerPool *workers = NULL;
 
-bool led = false;
+// Serve RTSP from worker processes instead of the capture process
+gint worker_count = 0;
+gboolean worker = FALSE;
 
-void Stop() {
+// Pinned plugin registry, set up before GStreamer reads it
+gboolean registry_write = FALSE;
+
+// Topology to build, the cameras of a box are instances of its templates
+gchar *config_path = NULL;
+
+// Take the port over from the running process instead of binding it
+gboolean upgrade = FALSE;
+gchar *handover_path = NULL;
+
+static gboolean RegistryOption(const gchar *name, const gchar *value, gpointer data, GError **error) {
+  registry_write = !g_strcmp0(name, "--write-registry");
+  if (registry_write) {
+    Registry::WriteSnapshot(value);
+  } else {
+    Registry::UseSnapshot(value);
+  }
+  return TRUE;
+}
+
+static GOptionEntry options[] = {
+    {"config", 0, 0, G_OPTION_ARG_FILENAME, &config_path, "Topology json, test.json by default", "FILE"},
+    {"workers", 0, 0, G_OPTION_ARG_INT, &worker_count, "RTSP worker processes to start", "N"},
+    {"registry", 0, 0, G_OPTION_ARG_CALLBACK, (gpointer) RegistryOption,
+     "Read the plugin registry from a snapshot, without scanning the plugins", "FILE"},
+    {"write-registry", 0, 0, G_OPTION_ARG_CALLBACK, (gpointer) RegistryOption,
+     "Scan the plugins, write the registry snapshot and quit", "FILE"},
+    {"upgrade", 0, 0, G_OPTION_ARG_NONE, &upgrade,
+     "Take over from the running process, its clients are drained once this one is up", NULL},
+    {"handover", 0, 0, G_OPTION_ARG_FILENAME, &handover_path,
+     "Unix socket the upgrades are taken on, " HANDOVER_SOCKET " by default", "PATH"},
+    {"worker", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &worker, "Run as RTSP worker", NULL},
+    {NULL}
+};
+
+// Non-zero status for the failures, so a supervisor sees the startup did not work
+void Stop(int status = EXIT_SUCCESS) {
 
   if (msg_watch)
     g_source_remove (msg_watch);
@@ -27,6 +79,10 @@ void Stop() {
   if (io_stdin)
     g_io_channel_unref (io_stdin);
 
+  if (workers) {
+    delete workers;
+  }
+
   if (server) {
     delete server;
   }
@@ -41,7 +97,7 @@ void Stop() {
   }
 
   // TODO shut down properly
-  exit(0);
+  exit(status);
 }
 
 static const char *gst_stream_status_string(GstStreamStatusType status) {
@@ -102,10 +158,16 @@ static gboolean MessageHandler(GstBus * bus, GstMessage * msg, gpointer user_dat
       if (GST_IS_PIPELINE(msg->src)) {
         gst_message_parse_state_changed (msg, NULL, &state, NULL);
         GST_INFO ("%s => %s", GST_MESSAGE_SRC_NAME(msg), gst_element_state_get_name (state));
+
+        // Caps are negotiated by now, see what the pipe does for nothing
+        if (state == GST_STATE_PLAYING) {
+          Startup::Playing(GST_ELEMENT (msg->src));
+          PipeOptimizer::Schedule(GST_ELEMENT (msg->src));
+        }
       } else {
-        GST_DEBUG("State change received from element %s:\n[ %s ]",
+        GST_DEBUG("State change received from element %s:\n[ %" GST_PTR_FORMAT " ]",
                   GST_OBJECT_NAME(msg->src),
-                  gst_structure_to_string(gst_message_get_structure(msg)));
+                  gst_message_get_structure(msg));
       }
       break;
     case GST_MESSAGE_STREAM_STATUS: {
@@ -125,109 +187,102 @@ static gboolean MessageHandler(GstBus * bus, GstMessage * msg, gpointer user_dat
   return TRUE;
 }
 
-/* Process keyboard input */
-static gboolean KeyboardHandler(GIOChannel *source, GIOCondition cond, gpointer *data) {
-  gchar *str;
-
-  if (g_io_channel_read_line (source, &str, NULL, NULL, NULL) != G_IO_STATUS_NORMAL) {
-    return TRUE;
-  }
-
-  switch (g_ascii_tolower (str[0])) {
-
-    // Leave
-    case 'q':
-      Stop();
-      break;
-
-
-      // Test
-    case '1':
-      gst_element_set_state (topology->GetPipe("TestPipe"), GST_STATE_PLAYING);
-      break;
-
-    case '2':
-      gst_element_set_state (topology->GetPipe("TestPipe"), GST_STATE_PAUSED);
-      break;
-
-    case '3':
-      gst_element_set_state (topology->GetPipe("TestPipe"), GST_STATE_READY);
-      break;
-
-    case '4':
-      gst_element_set_state (topology->GetPipe("TestPipe"), GST_STATE_NULL);
-      break;
-
-    case 'l':
-      led = !led;
-      g_object_set (topology->GetElement("MainSource"), "led-power", led, NULL);
-      break;
-
-      // Main
-    case 'w':
-      gst_element_set_state (topology->GetPipe("MainPipe"), GST_STATE_PLAYING);
-      break;
+// Runs in the thread posting the message, before the bus watch gets it
+static GstBusSyncReply SyncHandler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+  InstanceResources::Place(msg, GST_ELEMENT_NAME (user_data));
+  return SourceFailover::Intercept(msg) ? GST_BUS_DROP : GST_BUS_PASS;
+}
 
-    case 'e':
-      gst_element_set_state (topology->GetPipe("MainPipe"), GST_STATE_PAUSED);
-      break;
+// user_data is the exit status, NULL when done
+static gboolean StopFromLoop(gpointer user_data) {
+  Stop(GPOINTER_TO_INT (user_data));
+  return G_SOURCE_REMOVE;
+}
 
-    case 'r':
-      gst_element_set_state (topology->GetPipe("MainPipe"), GST_STATE_READY);
-      break;
+// Startup report: the previous process drains once this one is up
+static gboolean HandoverReady(gpointer user_data) {
+  if (!GPOINTER_TO_INT (user_data) && Handover::Upgrading()) {
+    GST_ERROR ("The pipes did not come up, the running process keeps serving. Quit.");
+    Stop(EXIT_FAILURE);
+  }
 
-    case 't':
-      gst_element_set_state (topology->GetPipe("MainPipe"), GST_STATE_NULL);
-      break;
+  Handover::Ready(server, StopFromLoop);
+  return G_SOURCE_REMOVE;
+}
 
-      // View
-    case 's':
-      gst_element_set_state (topology->GetPipe("ViewPipe"), GST_STATE_PLAYING);
-      break;
+// Runs in a thread of GStreamer's pool, the pipes don't wait for each other
+static void BringUp(GstElement *pipe, gpointer user_data) {
+  auto state = (GstState) GPOINTER_TO_INT (user_data);
 
-    case 'd':
-      gst_element_set_state (topology->GetPipe("ViewPipe"), GST_STATE_PAUSED);
-      break;
+  if (gst_element_set_state(pipe, state) == GST_STATE_CHANGE_FAILURE) {
+    GST_ERROR ("Unable to set \"%s\" to the %s state.", GST_ELEMENT_NAME (pipe), gst_element_state_get_name(state));
+    g_idle_add(StopFromLoop, GINT_TO_POINTER (EXIT_FAILURE));
+  }
+}
 
-    case 'f':
-      gst_element_set_state (topology->GetPipe("ViewPipe"), GST_STATE_READY);
-      break;
+// Pipes are named by the topology, missing ones are only reported
+static void SetPipeState(const char *pipe_name, const char *state_name) {
+  if (!topology->HasPipe(pipe_name)) {
+    GST_WARNING("No pipe \"%s\" in the topology.", pipe_name);
+    return;
+  }
 
-    case 'g':
-      gst_element_set_state (topology->GetPipe("ViewPipe"), GST_STATE_NULL);
-      break;
+  for (GstState state : {GST_STATE_NULL, GST_STATE_READY, GST_STATE_PAUSED, GST_STATE_PLAYING}) {
+    if (!g_ascii_strcasecmp(state_name, gst_element_state_get_name(state))) {
+      gst_element_set_state(topology->GetPipe(pipe_name), state);
+      return;
+    }
+  }
 
-      // Web
-    case 'x':
-      gst_element_set_state (topology->GetPipe("WebPipe"), GST_STATE_PLAYING);
-      break;
+  GST_WARNING("No state \"%s\", use null, ready, paused or playing.", state_name);
+}
 
-    case 'c':
-      gst_element_set_state (topology->GetPipe("WebPipe"), GST_STATE_PAUSED);
-      break;
+/* Process keyboard input: "q" quits, "o" toggles the recording,
+ * "<pipe> <state>" sets the state of a pipe and
+ * "<element> <property> <value>" sets a property of an element */
+static gboolean KeyboardHandler(GIOChannel *source, GIOCondition cond, gpointer *data) {
+  gchar *str;
 
-    case 'v':
-      gst_element_set_state (topology->GetPipe("WebPipe"), GST_STATE_READY);
-      break;
+  if (g_io_channel_read_line (source, &str, NULL, NULL, NULL) != G_IO_STATUS_NORMAL) {
+    return TRUE;
+  }
 
-    case 'b':
-      gst_element_set_state (topology->GetPipe("WebPipe"), GST_STATE_NULL);
-      break;
+  gchar **words = g_strsplit(g_strstrip(str), " ", 3);
+  guint count = g_strv_length(words);
 
-    default:
-      break;
+  if (count == 1 && !g_ascii_strcasecmp(words[0], "q")) {
+    Stop();
+  } else if (count == 1 && !g_ascii_strcasecmp(words[0], "o")) {
+    server->ToggleRecording();
+  } else if (count == 2) {
+    SetPipeState(words[0], words[1]);
+  } else if (count == 3 && topology->HasElement(words[0])) {
+    topology->SetProperty(words[0], words[1], words[2]);
+  } else if (count) {
+    GST_WARNING("Unknown command \"%s\".", str);
   }
 
+  g_strfreev(words);
   g_free(str);
 
   return TRUE;
 }
 
-
 int main(int argc, char *argv[]) {
-
-  // Initialize GStreamer
-  gst_init (&argc, &argv);
+  Startup::Begin();
+
+  // Initialize GStreamer along with the options
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("- GStreamer camera framework");
+  g_option_context_add_main_entries(context, options, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
 
   // Set up logging
   GST_DEBUG_CATEGORY_INIT (
@@ -235,55 +290,144 @@ int main(int argc, char *argv[]) {
   );
   Logger::Init();
 
+  // Make the in-app elements available for the topology and the server
+  Plugin::Init();
+
+  // Counters of the modules are dumped periodically
+  Metrics::Init();
+
+  Startup::Init();
+  Handover::Init(handover_path ? handover_path : HANDOVER_SOCKET);
+  Startup::Mark("init");
+
   // Object to keep track of registered elements and properties
   topology = new Topology();
 
   try {
     // Build pipeline directly from json definitions
-    Json("test.json").CreateTopology(topology);
+    Json json(config_path ? config_path : "test.json");
+    Startup::Mark("load");
+
+    // Only the plugins of the topology are loaded, a missing one stops here
+    auto types = json.GetElementTypes();
+    auto internal_types = Registry::InternalTypes();
+    types.insert(internal_types.begin(), internal_types.end());
+    if (!Registry::Require(types)) {
+      GST_ERROR ("The topology can't be built with these plugins. Quit.");
+      Stop(EXIT_FAILURE);
+    }
+    Startup::Mark("registry");
+
+    if (registry_write) {
+      GST_INFO ("Registry snapshot is written.");
+      Stop();
+    }
+
+    // Candidates of the abstract encoder types are loaded, measured on a cold cache
+    json.ResolveEncoders();
+    Startup::Mark("encoders");
+
+    json.CreateTopology(topology);
   }
   catch (GcfException) {
-    Stop();
+    Stop(EXIT_FAILURE);
+  }
+
+  // Backup inputs stand by behind the sources, before the arenas are attached
+  SourceFailover::Attach(topology);
+
+  // Negotiated pipes are analyzed once they play
+  PipeOptimizer::Init(topology->GetOptimizeConfig());
+
+  // Raw frames come from the arenas, if configured
+  ArenaPool::Init(topology->GetMemoryConfig());
+  for (const auto &pipe : topology->GetPipes()) {
+    ArenaPool::Attach(pipe.second);
   }
 
+  // Branch queues share one budget, if configured
+  MemoryGovernor::Init(topology->GetGovernorConfig());
 
-  GstBus *bus;
+  // Stalled pipes and branches are restarted, if configured
+  FlowWatchdog::Init(topology->GetWatchdogConfig());
 
-  // attach messagehandler
-  bus  = gst_pipeline_get_bus (GST_PIPELINE (topology->GetPipe("TestPipe")));
-  msg_watch = gst_bus_add_watch (bus, MessageHandler, NULL);
-  gst_object_unref (bus);
+  // Threads of the instances come from their own pools, on their own CPUs
+  InstanceResources::Init(topology->GetInstanceConfigs());
+  Startup::Mark("topology");
 
-  // attach messagehandler
-  bus  = gst_pipeline_get_bus (GST_PIPELINE (topology->GetPipe("MainPipe")));
-  msg_watch = gst_bus_add_watch (bus, MessageHandler, NULL);
-  gst_object_unref (bus);
 
-  // attach messagehandler
-  bus  = gst_pipeline_get_bus (GST_PIPELINE (topology->GetPipe("ViewPipe")));
-  msg_watch = gst_bus_add_watch (bus, MessageHandler, NULL);
-  gst_object_unref (bus);
+  // attach messagehandler to the pipes, the RTSP pipes are watched by their medias
+  for (const auto &pipe : topology->GetPipes()) {
+    if (worker || topology->HasRtspPipe(pipe.first)) {
+      continue;
+    }
+
+    GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipe.second));
+    msg_watch = gst_bus_add_watch (bus, MessageHandler, NULL);
+    gst_bus_set_sync_handler (bus, SyncHandler, pipe.second, NULL);
+    gst_object_unref (bus);
 
-  // attach messagehandler
-  bus  = gst_pipeline_get_bus (GST_PIPELINE (topology->GetPipe("WebPipe")));
-  msg_watch = gst_bus_add_watch (bus, MessageHandler, NULL);
-  gst_object_unref (bus);
+    FlowWatchdog::Watch(pipe.second);
+  }
 
 
   // Create the server
-  server = new RtspServer();
+  RtspServerMode mode = worker ? RTSP_MODE_WORKER : worker_count > 0 ? RTSP_MODE_CAPTURE : RTSP_MODE_SINGLE;
+  server = new RtspServer(mode);
+  server->mount_configs = topology->GetMountConfigs();
   if (!server->RegisterRtspPipes(topology->GetRtspPipes())) {
     GST_ERROR ("Can't create server RTSP pipeline. Quit.");
-    Stop();
+    Stop(EXIT_FAILURE);
   }
 
   // TODO -
   server->intersinks = topology->intersinks;
   server->queues = topology->queues;
-  server->TODO_tee = topology->GetElement("MainTee");
-  server->TODO_pipe = topology->GetPipe("MainPipe");
+  server->source_tees = topology->source_tees;
+  server->source_pipes = topology->source_pipes;
+
+  // The port stays open: the running process keeps serving until this one is up
+  if (upgrade && !worker) {
+    GSocket *inherited = Handover::Take();
+    if (inherited) {
+      server->Adopt(inherited);
+      g_object_unref(inherited);
+    }
+  }
 
-  server->Start();
+  if (!server->Start()) {
+    GST_ERROR ("Can't start the server. Quit.");
+    Stop(EXIT_FAILURE);
+  }
+  Startup::Mark("server");
+
+  // A worker only serves what the capture process exports
+  if (worker) {
+    Startup::Done();
+    main_loop = g_main_loop_new (NULL, FALSE);
+    g_main_loop_run (main_loop);
+    return 0;
+  }
+
+  if (mode == RTSP_MODE_CAPTURE) {
+    gchar *executable = g_file_read_link("/proc/self/exe", NULL);
+    gchar *config = g_canonicalize_filename(config_path ? config_path : "test.json", NULL);
+
+    // The workers load the same topology, from the same registry
+    std::vector<std::string> arguments = {"--config", config};
+    if (!Registry::Snapshot().empty()) {
+      arguments.insert(arguments.end(), {"--registry", Registry::Snapshot()});
+    }
+    if (handover_path) {
+      arguments.insert(arguments.end(), {"--handover", handover_path});
+    }
+
+    workers = new WorkerPool(executable ? executable : argv[0], worker_count, arguments);
+    workers->Start();
+    g_free(config);
+    g_free(executable);
+    Startup::Mark("workers");
+  }
 
 
   // User keypresses
@@ -295,11 +439,21 @@ int main(int argc, char *argv[]) {
   g_io_add_watch(io_stdin, G_IO_IN, (GIOFunc) KeyboardHandler, NULL);
 
 
-  // Start playing
-  if (gst_element_set_state(topology->GetPipe("MainPipe"), GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
-    GST_ERROR ("Unable to set the main pipeline to the playing state.");
-    Stop();
+  // Bring the pipes to their declared states all at once
+  for (const auto &initial : topology->GetInitialStates()) {
+    if (initial.second == GST_STATE_NULL) {
+      continue;
+    }
+
+    GstElement *pipe = topology->GetPipe(initial.first);
+    if (initial.second == GST_STATE_PLAYING) {
+      Startup::Expect(pipe);
+    }
+    gst_element_call_async(pipe, BringUp, GINT_TO_POINTER (initial.second), NULL);
   }
+  Startup::Mark("bring-up");
+  Startup::WhenReady(HandoverReady);
+  Startup::Done();
 
   // Create a GLib Main Loop and set it to run
   main_loop = g_main_loop_new (NULL, FALSE);
@@ -0,0 +1,66 @@
+#include <unistd.h>
+#include <cstdio>
+
+#include "metrics.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_metrics);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_metrics       // set as default
+
+std::mutex Metrics::lock;
+std::map<std::string, gint64> Metrics::values = std::map<std::string, gint64>();
+
+void Metrics::Init() {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_METRICS", GST_DEBUG_FG_WHITE, "Counters and gauges"
+  );
+
+  g_timeout_add_seconds(METRICS_DUMP_INTERVAL, Dump, NULL);
+}
+
+void Metrics::Set(const std::string &name, gint64 value) {
+  std::lock_guard<std::mutex> guard(lock);
+  values[name] = value;
+}
+
+void Metrics::Add(const std::string &name, gint64 delta) {
+  std::lock_guard<std::mutex> guard(lock);
+  values[name] += delta;
+}
+
+// Drop every value whose name starts with the prefix, e.g. when a client leaves
+void Metrics::Remove(const std::string &prefix) {
+  std::lock_guard<std::mutex> guard(lock);
+  auto itr = values.lower_bound(prefix);
+  while (itr != values.end() && itr->first.compare(0, prefix.size(), prefix) == 0) {
+    itr = values.erase(itr);
+  }
+}
+
+std::map<std::string, gint64> Metrics::Snapshot() {
+  std::lock_guard<std::mutex> guard(lock);
+  return values;
+}
+
+// Resident memory of the process, growth over days is a leak
+static gint64 ResidentBytes() {
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (!statm) {
+    return -1;
+  }
+
+  long size = 0, resident = 0;
+  int fields = fscanf(statm, "%ld %ld", &size, &resident);
+  fclose(statm);
+
+  return fields == 2 ? (gint64) resident * sysconf(_SC_PAGESIZE) : -1;
+}
+
+gboolean Metrics::Dump(gpointer user_data) {
+  Set("process.rss-bytes", ResidentBytes());
+
+  for (const auto &value : Snapshot()) {
+    GST_INFO("%s = %" G_GINT64_FORMAT, value.first.c_str(), value.second);
+  }
+
+  return TRUE;
+}
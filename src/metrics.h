@@ -0,0 +1,30 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <string>
+#include <map>
+#include <mutex>
+
+// Process-wide registry of counters and gauges.
+// Values are dumped to the log periodically and can be queried by the outputs.
+
+#define METRICS_DUMP_INTERVAL 10 // seconds
+
+class Metrics {
+public:
+
+  static void Init();
+
+  static void Set(const std::string &name, gint64 value);
+  static void Add(const std::string &name, gint64 delta);
+  static void Remove(const std::string &prefix);
+
+  static std::map<std::string, gint64> Snapshot();
+
+private:
+
+  static gboolean Dump(gpointer user_data);
+
+  static std::mutex lock;
+  static std::map<std::string, gint64> values;
+};
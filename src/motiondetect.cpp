@@ -0,0 +1,286 @@
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "motiondetect.h"
+#include "motionsad.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_plugin_motiondetect);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_plugin_motiondetect       // set as default
+
+#define DEFAULT_THRESHOLD 10
+#define DEFAULT_MIN_BLOCKS 4
+#define DEFAULT_STEP 4
+
+// Gates treat an unknown scene as moving
+#define MOTION_UNKNOWN G_MAXINT64
+
+enum {
+  PROP_0,
+  PROP_THRESHOLD,
+  PROP_MIN_BLOCKS,
+  PROP_STEP,
+  PROP_SCORE
+};
+
+#define MOTION_DETECT_CAPS GST_VIDEO_CAPS_MAKE ("{ I420, YV12, NV12, NV21, Y42B, Y444, GRAY8 }")
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE (
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS (MOTION_DETECT_CAPS));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE (
+    "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS (MOTION_DETECT_CAPS));
+
+G_DEFINE_TYPE (GcfMotionDetect, gcf_motion_detect, GST_TYPE_BASE_TRANSFORM);
+
+GcfMotionState *gcf_motion_state_get(const gchar *name) {
+  static std::mutex lock;
+  static std::map<std::string, GcfMotionState *> states;
+
+  std::lock_guard<std::mutex> guard(lock);
+
+  // Kept for the lifetime of the process, the gates hold on to them
+  GcfMotionState *&state = states[name];
+  if (!state) {
+    state = new GcfMotionState();
+    state->last_motion = MOTION_UNKNOWN;
+    state->score = 0;
+  }
+
+  return state;
+}
+
+static void gcf_motion_detect_free(GcfMotionDetect *self) {
+  g_free(self->reference);
+  g_free(self->sums);
+  self->reference = NULL;
+  self->sums = NULL;
+  self->primed = FALSE;
+}
+
+static gboolean gcf_motion_detect_start(GstBaseTransform *trans) {
+  GcfMotionDetect *self = GCF_MOTION_DETECT (trans);
+
+  self->state = gcf_motion_state_get(GST_OBJECT_NAME (self));
+  self->state->last_motion = MOTION_UNKNOWN;
+  self->active = TRUE;
+
+  return TRUE;
+}
+
+static gboolean gcf_motion_detect_stop(GstBaseTransform *trans) {
+  GcfMotionDetect *self = GCF_MOTION_DETECT (trans);
+
+  // Nobody looks at the scene anymore, the gates open up
+  self->state->last_motion = MOTION_UNKNOWN;
+  gcf_motion_detect_free(self);
+
+  return TRUE;
+}
+
+static gboolean gcf_motion_detect_set_caps(GstBaseTransform *trans, GstCaps *incaps, GstCaps *outcaps) {
+  GcfMotionDetect *self = GCF_MOTION_DETECT (trans);
+
+  if (!gst_video_info_from_caps(&self->info, incaps)) {
+    GST_ERROR_OBJECT (self, "Invalid caps %" GST_PTR_FORMAT, incaps);
+    return FALSE;
+  }
+
+  gcf_motion_detect_free(self);
+
+  guint blocks = GST_VIDEO_INFO_WIDTH (&self->info) / MOTION_BLOCK;
+  guint rows = GST_VIDEO_INFO_HEIGHT (&self->info) / MOTION_BLOCK * MOTION_BLOCK;
+  if (!blocks || !rows) {
+    GST_WARNING_OBJECT (self, "Frames are smaller than a block, every frame counts as motion");
+    return TRUE;
+  }
+
+  self->reference = (guint8 *) g_malloc0((gsize) rows * blocks * MOTION_BLOCK);
+  self->sums = g_new0 (guint32, blocks);
+
+  GST_INFO_OBJECT (self, "%u blocks per row, %s kernel", blocks, MotionRowSadName());
+
+  return TRUE;
+}
+
+// Counts the blocks that changed since the previous frame
+static guint gcf_motion_detect_score(GcfMotionDetect *self, const GstVideoFrame *frame, guint step) {
+  MotionRowSadFunc kernel = MotionRowSad();
+  const guint8 *luma = (const guint8 *) GST_VIDEO_FRAME_COMP_DATA (frame, 0);
+  gint stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, 0);
+  guint blocks = GST_VIDEO_FRAME_WIDTH (frame) / MOTION_BLOCK;
+  guint rows = GST_VIDEO_FRAME_HEIGHT (frame) / MOTION_BLOCK * MOTION_BLOCK;
+
+  // Mean difference over the sampled pixels of a block
+  guint32 limit = self->threshold * MOTION_BLOCK * (MOTION_BLOCK / step);
+  guint8 *reference = self->reference;
+  guint changed = 0;
+
+  for (guint block_row = 0; block_row < rows; block_row += MOTION_BLOCK) {
+    memset(self->sums, 0, blocks * sizeof(guint32));
+
+    for (guint y = block_row; y < block_row + MOTION_BLOCK; y += step) {
+      kernel(luma + (gsize) y * stride, reference, blocks, self->sums);
+      reference += blocks * MOTION_BLOCK;
+    }
+
+    for (guint i = 0; i < blocks; i++) {
+      changed += self->sums[i] > limit;
+    }
+  }
+
+  return changed;
+}
+
+static GstFlowReturn gcf_motion_detect_transform_ip(GstBaseTransform *trans, GstBuffer *buffer) {
+  GcfMotionDetect *self = GCF_MOTION_DETECT (trans);
+
+  if (!self->reference) {
+    return GST_FLOW_OK;
+  }
+
+  GstVideoFrame frame;
+  if (!gst_video_frame_map(&frame, &self->info, buffer, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (self, "Can't map frame, skipping detection");
+    return GST_FLOW_OK;
+  }
+
+  // Largest power of two up to the property, so the rows fill the blocks evenly
+  guint step = 1;
+  while (step * 2 <= self->step) {
+    step *= 2;
+  }
+
+  guint score = gcf_motion_detect_score(self, &frame, step);
+  gst_video_frame_unmap(&frame);
+
+  // Nothing to compare the first frame with
+  gboolean motion = !self->primed || score >= self->min_blocks;
+  self->primed = TRUE;
+
+  self->state->score = score;
+  if (motion) {
+    self->state->last_motion = g_get_monotonic_time();
+  }
+
+  if (motion != self->active) {
+    self->active = motion;
+    GST_INFO_OBJECT (self, "Motion %s, %u blocks changed", motion ? "started" : "stopped", score);
+
+    gst_element_post_message(GST_ELEMENT (self),
+        gst_message_new_element(GST_OBJECT (self),
+            gst_structure_new("gcf-motion", "active", G_TYPE_BOOLEAN, motion, "score", G_TYPE_UINT, score, NULL)));
+  }
+
+  return GST_FLOW_OK;
+}
+
+static void gcf_motion_detect_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+  GcfMotionDetect *self = GCF_MOTION_DETECT (object);
+
+  switch (prop_id) {
+    case PROP_THRESHOLD:
+      self->threshold = g_value_get_uint(value);
+      break;
+    case PROP_MIN_BLOCKS:
+      self->min_blocks = g_value_get_uint(value);
+      break;
+    case PROP_STEP:
+      self->step = g_value_get_uint(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gcf_motion_detect_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+  GcfMotionDetect *self = GCF_MOTION_DETECT (object);
+
+  switch (prop_id) {
+    case PROP_THRESHOLD:
+      g_value_set_uint(value, self->threshold);
+      break;
+    case PROP_MIN_BLOCKS:
+      g_value_set_uint(value, self->min_blocks);
+      break;
+    case PROP_STEP:
+      g_value_set_uint(value, self->step);
+      break;
+    case PROP_SCORE:
+      g_value_set_uint(value, self->state ? self->state->score.load() : 0);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gcf_motion_detect_finalize(GObject *object) {
+  gcf_motion_detect_free(GCF_MOTION_DETECT (object));
+
+  G_OBJECT_CLASS (gcf_motion_detect_parent_class)->finalize(object);
+}
+
+static void gcf_motion_detect_class_init(GcfMotionDetectClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_PLUGIN_MOTIONDETECT", GST_DEBUG_FG_BLUE, "Motion detector"
+  );
+
+  gobject_class->set_property = gcf_motion_detect_set_property;
+  gobject_class->get_property = gcf_motion_detect_get_property;
+  gobject_class->finalize = gcf_motion_detect_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_THRESHOLD,
+      g_param_spec_uint("threshold", "Threshold", "Mean luma difference of a changed block",
+                        1, 255, DEFAULT_THRESHOLD,
+                        (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class, PROP_MIN_BLOCKS,
+      g_param_spec_uint("min-blocks", "Minimum blocks", "Changed blocks of a frame with motion",
+                        1, G_MAXUINT, DEFAULT_MIN_BLOCKS,
+                        (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class, PROP_STEP,
+      g_param_spec_uint("step", "Step", "Every step-th row is compared, rounded down to a power of two",
+                        1, MOTION_BLOCK, DEFAULT_STEP,
+                        (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class, PROP_SCORE,
+      g_param_spec_uint("score", "Score", "Changed blocks of the last frame",
+                        0, G_MAXUINT, 0,
+                        (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  transform_class->start = gcf_motion_detect_start;
+  transform_class->stop = gcf_motion_detect_stop;
+  transform_class->set_caps = gcf_motion_detect_set_caps;
+  transform_class->transform_ip = gcf_motion_detect_transform_ip;
+  transform_class->transform_ip_on_passthrough = TRUE;
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+
+  gst_element_class_set_static_metadata(element_class,
+      "Motion detector", "Filter/Analyzer/Video",
+      "Scores the luma difference of consecutive frames for the motion gates", "gst-rtsp-app");
+}
+
+static void gcf_motion_detect_init(GcfMotionDetect *self) {
+  gst_base_transform_set_passthrough(GST_BASE_TRANSFORM (self), TRUE);
+
+  gst_video_info_init(&self->info);
+  self->state = NULL;
+  self->reference = NULL;
+  self->sums = NULL;
+  self->primed = FALSE;
+  self->active = TRUE;
+
+  self->threshold = DEFAULT_THRESHOLD;
+  self->min_blocks = DEFAULT_MIN_BLOCKS;
+  self->step = DEFAULT_STEP;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <gst/video/video.h>
+#include <atomic>
+
+// Scores every frame against the previous one on the luma plane and
+// publishes whether the scene moves. Only every step-th row is compared;
+// a 16x16 block counts as changed when its mean difference is above the
+// threshold. The frames pass untouched. Gates in other pipes find the
+// result by the name of the detector, so it survives the inter elements.
+
+#define GCF_TYPE_MOTION_DETECT (gcf_motion_detect_get_type ())
+#define GCF_MOTION_DETECT(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GCF_TYPE_MOTION_DETECT, GcfMotionDetect))
+
+// What a detector saw last, shared with the gates
+struct GcfMotionState {
+  std::atomic<gint64> last_motion;  // monotonic time (us) of the last frame with motion
+  std::atomic<guint> score;         // changed blocks of the last frame
+};
+
+struct GcfMotionDetect {
+  GstBaseTransform parent;
+
+  GstVideoInfo info;
+  GcfMotionState *state;
+
+  // Sampled luma rows of the previous frame and the block sums of a row
+  guint8 *reference;
+  guint32 *sums;
+  gboolean primed;
+  gboolean active;
+
+  // Properties
+  guint threshold;
+  guint min_blocks;
+  guint step;
+};
+
+struct GcfMotionDetectClass {
+  GstBaseTransformClass parent_class;
+};
+
+GType gcf_motion_detect_get_type(void);
+
+// State of the detector with the given name, created on the first call
+GcfMotionState *gcf_motion_state_get(const gchar *name);
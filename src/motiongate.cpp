@@ -0,0 +1,196 @@
+#include "motiongate.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_plugin_motiongate);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_plugin_motiongate       // set as default
+
+#define DEFAULT_KEEPALIVE_FPS 1.0
+#define DEFAULT_HOLD_MS 2000
+
+enum {
+  PROP_0,
+  PROP_DETECTOR,
+  PROP_KEEPALIVE_FPS,
+  PROP_HOLD_MS
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE (
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE (
+    "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE (GcfMotionGate, gcf_motion_gate, GST_TYPE_ELEMENT);
+
+// Still for longer than the hold time; a detector that never ran or has
+// stopped leaves the gate open
+static gboolean gcf_motion_gate_is_still(GcfMotionGate *self) {
+  if (!self->state) {
+    if (!self->detector) {
+      return FALSE;
+    }
+    self->state = gcf_motion_state_get(self->detector);
+  }
+
+  gint64 last_motion = self->state->last_motion;
+  return g_get_monotonic_time() - last_motion >= (gint64) self->hold_ms * 1000;
+}
+
+static GstFlowReturn gcf_motion_gate_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer) {
+  GcfMotionGate *self = GCF_MOTION_GATE (parent);
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+
+  if (!gcf_motion_gate_is_still(self)) {
+    if (self->gated) {
+      GST_INFO_OBJECT (self, "Motion, back to full rate");
+      self->gated = FALSE;
+    }
+    self->last_pass = pts;
+    return gst_pad_push(self->srcpad, buffer);
+  }
+
+  if (!self->gated) {
+    GST_INFO_OBJECT (self, "Scene is still, keeping alive at %.2f fps", self->keepalive_fps);
+    self->gated = TRUE;
+  }
+
+  // One frame per keep-alive interval, by the timestamps of the stream
+  GstClockTime interval = (GstClockTime) (GST_SECOND / self->keepalive_fps);
+  if (GST_CLOCK_TIME_IS_VALID (pts) && GST_CLOCK_TIME_IS_VALID (self->last_pass)
+      && pts >= self->last_pass && pts - self->last_pass < interval) {
+    GST_LOG_OBJECT (self, "Dropping still frame %" GST_TIME_FORMAT, GST_TIME_ARGS (pts));
+    gst_buffer_unref(buffer);
+    return GST_FLOW_OK;
+  }
+
+  self->last_pass = pts;
+  return gst_pad_push(self->srcpad, buffer);
+}
+
+static gboolean gcf_motion_gate_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+  GcfMotionGate *self = GCF_MOTION_GATE (parent);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP || GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+    self->last_pass = GST_CLOCK_TIME_NONE;
+  }
+
+  return gst_pad_event_default(pad, parent, event);
+}
+
+static GstStateChangeReturn gcf_motion_gate_change_state(GstElement *element, GstStateChange transition) {
+  GcfMotionGate *self = GCF_MOTION_GATE (element);
+
+  GstStateChangeReturn ret =
+      GST_ELEMENT_CLASS (gcf_motion_gate_parent_class)->change_state(element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    self->last_pass = GST_CLOCK_TIME_NONE;
+    self->gated = FALSE;
+  }
+
+  return ret;
+}
+
+static void gcf_motion_gate_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+  GcfMotionGate *self = GCF_MOTION_GATE (object);
+
+  switch (prop_id) {
+    case PROP_DETECTOR:
+      g_free(self->detector);
+      self->detector = g_value_dup_string(value);
+      self->state = NULL;
+      break;
+    case PROP_KEEPALIVE_FPS:
+      self->keepalive_fps = g_value_get_double(value);
+      break;
+    case PROP_HOLD_MS:
+      self->hold_ms = g_value_get_uint(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gcf_motion_gate_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+  GcfMotionGate *self = GCF_MOTION_GATE (object);
+
+  switch (prop_id) {
+    case PROP_DETECTOR:
+      g_value_set_string(value, self->detector);
+      break;
+    case PROP_KEEPALIVE_FPS:
+      g_value_set_double(value, self->keepalive_fps);
+      break;
+    case PROP_HOLD_MS:
+      g_value_set_uint(value, self->hold_ms);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gcf_motion_gate_finalize(GObject *object) {
+  GcfMotionGate *self = GCF_MOTION_GATE (object);
+
+  g_free(self->detector);
+
+  G_OBJECT_CLASS (gcf_motion_gate_parent_class)->finalize(object);
+}
+
+static void gcf_motion_gate_class_init(GcfMotionGateClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_PLUGIN_MOTIONGATE", GST_DEBUG_FG_BLUE, "Motion gate"
+  );
+
+  gobject_class->set_property = gcf_motion_gate_set_property;
+  gobject_class->get_property = gcf_motion_gate_get_property;
+  gobject_class->finalize = gcf_motion_gate_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_DETECTOR,
+      g_param_spec_string("detector", "Detector", "Name of the gcfmotiondetect element to follow",
+                          NULL, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class, PROP_KEEPALIVE_FPS,
+      g_param_spec_double("keepalive-fps", "Keep-alive framerate", "Framerate passed while the scene is still",
+                          0.01, 120.0, DEFAULT_KEEPALIVE_FPS,
+                          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class, PROP_HOLD_MS,
+      g_param_spec_uint("hold-ms", "Hold", "Full rate is kept this long after the last motion",
+                        0, G_MAXUINT, DEFAULT_HOLD_MS,
+                        (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  element_class->change_state = gcf_motion_gate_change_state;
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+
+  gst_element_class_set_static_metadata(element_class,
+      "Motion gate", "Filter/Video",
+      "Drops to a keep-alive framerate while the scene is still", "gst-rtsp-app");
+}
+
+static void gcf_motion_gate_init(GcfMotionGate *self) {
+  self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+  gst_pad_set_chain_function(self->sinkpad, gcf_motion_gate_chain);
+  gst_pad_set_event_function(self->sinkpad, gcf_motion_gate_sink_event);
+  GST_PAD_SET_PROXY_CAPS (self->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION (self->sinkpad);
+  gst_element_add_pad(GST_ELEMENT (self), self->sinkpad);
+
+  self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+  GST_PAD_SET_PROXY_CAPS (self->srcpad);
+  gst_element_add_pad(GST_ELEMENT (self), self->srcpad);
+
+  self->state = NULL;
+  self->last_pass = GST_CLOCK_TIME_NONE;
+  self->gated = FALSE;
+
+  self->detector = NULL;
+  self->keepalive_fps = DEFAULT_KEEPALIVE_FPS;
+  self->hold_ms = DEFAULT_HOLD_MS;
+}
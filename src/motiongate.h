@@ -0,0 +1,36 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include "motiondetect.h"
+
+// Lets a branch drop to a keep-alive framerate while its detector sees a
+// still scene. Frames pass at full rate from the first one the detector
+// marks as moving until the scene has been still for the hold time.
+
+#define GCF_TYPE_MOTION_GATE (gcf_motion_gate_get_type ())
+#define GCF_MOTION_GATE(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GCF_TYPE_MOTION_GATE, GcfMotionGate))
+
+struct GcfMotionGate {
+  GstElement parent;
+
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  GcfMotionState *state;
+
+  // Timestamp of the last frame let through while gated
+  GstClockTime last_pass;
+  gboolean gated;
+
+  // Properties
+  gchar *detector;
+  gdouble keepalive_fps;
+  guint hold_ms;
+};
+
+struct GcfMotionGateClass {
+  GstElementClass parent_class;
+};
+
+GType gcf_motion_gate_get_type(void);
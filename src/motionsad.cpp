@@ -0,0 +1,120 @@
+#include "motionsad.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MOTION_SAD_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define MOTION_SAD_NEON
+#include <arm_neon.h>
+#endif
+
+void MotionRowSadScalar(const uint8_t *current, uint8_t *reference, size_t blocks, uint32_t *sums) {
+  for (size_t block = 0; block < blocks; block++) {
+    uint32_t sum = 0;
+
+    for (size_t i = 0; i < MOTION_BLOCK; i++) {
+      int diff = current[i] - reference[i];
+      sum += diff < 0 ? -diff : diff;
+    }
+
+    memcpy(reference, current, MOTION_BLOCK);
+    sums[block] += sum;
+    current += MOTION_BLOCK;
+    reference += MOTION_BLOCK;
+  }
+}
+
+#ifdef MOTION_SAD_X86
+
+// psadbw leaves the sums of the two halves of a block in two 64 bit lanes
+__attribute__((target("sse2")))
+static void MotionRowSadSse2(const uint8_t *current, uint8_t *reference, size_t blocks, uint32_t *sums) {
+  for (size_t block = 0; block < blocks; block++) {
+    __m128i a = _mm_loadu_si128((const __m128i *) current);
+    __m128i b = _mm_loadu_si128((const __m128i *) reference);
+    __m128i sad = _mm_sad_epu8(a, b);
+
+    _mm_storeu_si128((__m128i *) reference, a);
+    sums[block] += _mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4);
+    current += MOTION_BLOCK;
+    reference += MOTION_BLOCK;
+  }
+}
+
+// Two blocks per register, the odd block is left to SSE2
+__attribute__((target("avx2")))
+static void MotionRowSadAvx2(const uint8_t *current, uint8_t *reference, size_t blocks, uint32_t *sums) {
+  size_t block = 0;
+
+  for (; block + 2 <= blocks; block += 2) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) current);
+    __m256i b = _mm256_loadu_si256((const __m256i *) reference);
+    __m256i sad = _mm256_sad_epu8(a, b);
+
+    _mm256_storeu_si256((__m256i *) reference, a);
+    sums[block] += _mm256_extract_epi16(sad, 0) + _mm256_extract_epi16(sad, 4);
+    sums[block + 1] += _mm256_extract_epi16(sad, 8) + _mm256_extract_epi16(sad, 12);
+    current += 2 * MOTION_BLOCK;
+    reference += 2 * MOTION_BLOCK;
+  }
+
+  if (block < blocks) {
+    MotionRowSadSse2(current, reference, blocks - block, sums + block);
+  }
+}
+
+#endif
+
+#ifdef MOTION_SAD_NEON
+
+static void MotionRowSadNeon(const uint8_t *current, uint8_t *reference, size_t blocks, uint32_t *sums) {
+  for (size_t block = 0; block < blocks; block++) {
+    uint8x16_t a = vld1q_u8(current);
+    uint8x16_t b = vld1q_u8(reference);
+    uint64x2_t sad = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vabdq_u8(a, b))));
+
+    vst1q_u8(reference, a);
+    sums[block] += (uint32_t) (vgetq_lane_u64(sad, 0) + vgetq_lane_u64(sad, 1));
+    current += MOTION_BLOCK;
+    reference += MOTION_BLOCK;
+  }
+}
+
+#endif
+
+struct MotionRowSadVariant {
+  MotionRowSadFunc func;
+  const char *name;
+};
+
+static MotionRowSadVariant MotionRowSadSelect() {
+#ifdef MOTION_SAD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {MotionRowSadAvx2, "avx2"};
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return {MotionRowSadSse2, "sse2"};
+  }
+#endif
+#ifdef MOTION_SAD_NEON
+  return {MotionRowSadNeon, "neon"};
+#endif
+  return {MotionRowSadScalar, "scalar"};
+}
+
+// Picked once, the CPU does not change while running
+static const MotionRowSadVariant &MotionRowSadVariantGet() {
+  static const MotionRowSadVariant variant = MotionRowSadSelect();
+  return variant;
+}
+
+MotionRowSadFunc MotionRowSad() {
+  return MotionRowSadVariantGet().func;
+}
+
+const char *MotionRowSadName() {
+  return MotionRowSadVariantGet().name;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Sum of absolute differences of luma rows, the kernel of the motion
+// detector. Every 16 pixels of a row are one block column: the difference
+// of a row is added to the sum of its blocks, and the row is copied into
+// the reference in the same pass. Pixels after the last full block are
+// not compared. Needs no GStreamer, so the benchmark can link it alone.
+
+#define MOTION_BLOCK 16
+
+typedef void (*MotionRowSadFunc)(const uint8_t *current, uint8_t *reference, size_t blocks, uint32_t *sums);
+
+// Fastest variant the CPU supports: AVX2, SSE2, NEON or plain C
+MotionRowSadFunc MotionRowSad();
+const char *MotionRowSadName();
+
+// Plain C variant, the reference of the others
+void MotionRowSadScalar(const uint8_t *current, uint8_t *reference, size_t blocks, uint32_t *sums);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <string>
+
+// Per-mount options of the RTSP pipes, loaded from the "mounts" section
+struct MountConfig {
+
+  // Batched UDP egress: RTP packets are grouped into buffer lists so the
+  // udp sinks can send them to every client with a single sendmmsg call
+  bool udp_batch = false;
+  guint batch_packets = 32;
+  guint batch_tick_ms = 5;
+
+  // Bounded send queue of the clients using RTP over the RTSP connection
+  bool tcp_queue = false;
+  guint tcp_queue_bytes = 2 * 1024 * 1024;
+  guint tcp_queue_ms = 2000;
+  guint tcp_disconnect_ms = 10000;
+
+  // Encoder bitrate (and framerate) driven by the RTCP receiver reports
+  bool abr = false;
+  std::string abr_encoder;
+  guint abr_min_kbps = 500;
+  guint abr_max_kbps = 8000;
+  double abr_loss_high = 0.05;
+  double abr_loss_low = 0.01;
+  guint abr_rtt_high_ms = 500;
+  guint abr_hold_ms = 10000;
+  std::string abr_filter;
+  guint abr_min_fps = 5;
+  guint abr_max_fps = 15;
+
+  // RTP retransmission on NACK requests, with the history kept by the senders
+  bool rtx = false;
+  guint rtx_time_ms = 500;
+  guint rtx_packets = 100;
+  guint rtx_pt = 97;
+
+  // Maximum number of on-demand renditions running at the same time, 0 disables them
+  guint max_renditions = 0;
+
+  // One hierarchical-P encode shared by the full, half and quarter rate
+  // clients, 0 keeps the encoder of the mount pipe. ABR and RTX can't be
+  // used along with it, or with any other output of the shared encode.
+  guint temporal_levels = 0;
+  std::string temporal_encoder;
+
+  // LL-HLS output packaged from the shared encode, kept in memory
+  bool hls = false;
+  guint hls_segment_ms = 2000;
+  guint hls_part_ms = 200;
+  guint hls_segments = 6;
+
+  // Recording of the shared encode into keyframe aligned MP4 segments,
+  // the oldest ones are deleted above the kept count or size (0: no limit)
+  bool record = false;
+  std::string record_path;
+  guint record_segment_s = 60;
+  guint record_keep_segments = 0;
+  guint record_keep_mb = 0;
+  guint record_buffer_kb = 1024;
+  bool record_direct_io = false;
+  guint record_preallocate_mb = 0;
+  bool record_autostart = false;
+
+  // Last seconds of the shared encode kept in memory for the "?timeshift"
+  // playback, bounded by the arena size and optionally by time (0: no limit)
+  guint timeshift_mb = 0;
+  guint timeshift_max_s = 0;
+
+  // The RTSP clients are fed from one encoder shared with the other outputs
+  bool SharedEncode() const { return temporal_levels || hls || record || timeshift_mb; }
+};
@@ -0,0 +1,430 @@
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <gst/video/video.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "optimizer.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_optimizer);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_optimizer       // set as default
+
+// Marks the pipes already scheduled
+#define OPTIMIZER_SCHEDULED "gcf-optimizer-scheduled"
+
+OptimizeConfig PipeOptimizer::config;
+
+// Negotiated video on one pad of an element
+struct VideoSide {
+  gint width;
+  gint height;
+  gdouble fps;
+  GstCaps *caps;
+};
+
+// Something the chain does for nothing
+struct Finding {
+  enum Action {
+    REMOVE,  // drop "first"
+    SWAP,    // move "second" in front of "first"
+  } action;
+
+  GstElement *first;
+  GstElement *second;
+
+  // Pixels read and written per second that the change saves
+  gdouble saving;
+  std::string what;
+};
+
+// Chain rebuilt from an idle probe on the pad feeding it
+struct Relink {
+  GstPad *head;
+  GstPad *tail;
+  std::vector<GstElement *> old_chain;
+  std::vector<GstElement *> new_chain;
+  std::vector<GstElement *> removed;
+};
+
+static const char *FactoryName(GstElement *element) {
+  GstElementFactory *factory = gst_element_get_factory(element);
+  return factory ? GST_OBJECT_NAME (factory) : "";
+}
+
+static bool IsScaleOrConvert(GstElement *element) {
+  std::string factory = FactoryName(element);
+  return factory == "videoscale" || factory == "videoconvert" || factory == "videoconvertscale"
+      || factory == "gcfscaleconvert";
+}
+
+static bool GetVideoSide(GstElement *element, const char *pad_name, VideoSide &side) {
+  GstPad *pad = gst_element_get_static_pad(element, pad_name);
+  if (!pad) {
+    return false;
+  }
+
+  side.caps = gst_pad_get_current_caps(pad);
+  gst_object_unref(pad);
+
+  GstVideoInfo info;
+  if (!side.caps || !gst_video_info_from_caps(&info, side.caps)) {
+    if (side.caps) {
+      gst_caps_unref(side.caps);
+    }
+    return false;
+  }
+
+  side.width = GST_VIDEO_INFO_WIDTH (&info);
+  side.height = GST_VIDEO_INFO_HEIGHT (&info);
+  side.fps = GST_VIDEO_INFO_FPS_D (&info) ? (gdouble) GST_VIDEO_INFO_FPS_N (&info) / GST_VIDEO_INFO_FPS_D (&info) : 0;
+  return true;
+}
+
+static gdouble PixelRate(const VideoSide &side) {
+  return (gdouble) side.width * side.height * side.fps;
+}
+
+// Element on the other side of a static pad, NULL at the ends of the chain
+static GstElement *Neighbour(GstElement *element, const char *pad_name) {
+  GstPad *pad = gst_element_get_static_pad(element, pad_name);
+  if (!pad) {
+    return NULL;
+  }
+
+  GstPad *peer = gst_pad_get_peer(pad);
+  gst_object_unref(pad);
+  if (!peer) {
+    return NULL;
+  }
+
+  GstElement *neighbour = gst_pad_get_parent_element(peer);
+  gst_object_unref(peer);
+  return neighbour;
+}
+
+static GstPad *PeerOf(GstElement *element, const char *pad_name) {
+  GstPad *pad = gst_element_get_static_pad(element, pad_name);
+  if (!pad) {
+    return NULL;
+  }
+
+  GstPad *peer = gst_pad_get_peer(pad);
+  gst_object_unref(pad);
+  return peer;
+}
+
+static void LinkStatic(GstPad *src, GstElement *element) {
+  GstPad *sink = gst_element_get_static_pad(element, "sink");
+  if (gst_pad_link(src, sink) != GST_PAD_LINK_OK) {
+    GST_ERROR("Can't link %s:%s to \"%s\"!", GST_DEBUG_PAD_NAME (src), GST_ELEMENT_NAME (element));
+  }
+  gst_object_unref(sink);
+}
+
+// Streaming is between two buffers here, nothing flows through the chain
+static GstPadProbeReturn RelinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  auto *relink = (Relink *) user_data;
+
+  GstPad *peer = gst_pad_get_peer(relink->head);
+  if (peer) {
+    gst_pad_unlink(relink->head, peer);
+    gst_object_unref(peer);
+  }
+  for (auto element : relink->old_chain) {
+    GstPad *src = gst_element_get_static_pad(element, "src");
+    peer = gst_pad_get_peer(src);
+    if (peer) {
+      gst_pad_unlink(src, peer);
+      gst_object_unref(peer);
+    }
+    gst_object_unref(src);
+  }
+
+  // The sticky events of the head are sent again, the new chain negotiates with them
+  GstPad *src = (GstPad *) gst_object_ref(relink->head);
+  for (auto element : relink->new_chain) {
+    LinkStatic(src, element);
+    gst_object_unref(src);
+    src = gst_element_get_static_pad(element, "src");
+  }
+  if (gst_pad_link(src, relink->tail) != GST_PAD_LINK_OK) {
+    GST_ERROR("Can't link %s:%s to %s:%s!", GST_DEBUG_PAD_NAME (src), GST_DEBUG_PAD_NAME (relink->tail));
+  }
+  gst_object_unref(src);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+// Dropped elements stay in the bin, out of its state changes:
+// the topology keeps pointing to them by name
+static gboolean FinishRelink(gpointer user_data) {
+  auto *relink = (Relink *) user_data;
+
+  for (auto element : relink->removed) {
+    gst_element_set_locked_state(element, TRUE);
+    gst_element_set_state(element, GST_STATE_NULL);
+    GST_INFO("\"%s\" is out of the chain.", GST_ELEMENT_NAME (element));
+  }
+
+  for (auto element : relink->old_chain) {
+    gst_object_unref(element);
+  }
+  gst_object_unref(relink->head);
+  gst_object_unref(relink->tail);
+  delete relink;
+  return G_SOURCE_REMOVE;
+}
+
+// The probe may be done in a streaming thread, states are changed from the loop
+static void RelinkDone(gpointer user_data) {
+  g_idle_add(FinishRelink, user_data);
+}
+
+static void Rebuild(const Finding &finding) {
+  GstElement *last = finding.action == Finding::SWAP ? finding.second : finding.first;
+
+  auto *relink = new Relink();
+  relink->head = PeerOf(finding.first, "sink");
+  relink->tail = PeerOf(last, "src");
+
+  if (!relink->head || !relink->tail) {
+    GST_WARNING("Can't rebuild around \"%s\": it is at the end of the chain.", GST_ELEMENT_NAME (finding.first));
+    if (relink->head) {
+      gst_object_unref(relink->head);
+    }
+    if (relink->tail) {
+      gst_object_unref(relink->tail);
+    }
+    delete relink;
+    return;
+  }
+
+  relink->old_chain.push_back((GstElement *) gst_object_ref(finding.first));
+  if (finding.action == Finding::SWAP) {
+    relink->old_chain.push_back((GstElement *) gst_object_ref(finding.second));
+    relink->new_chain = {finding.second, finding.first};
+  } else {
+    relink->removed.push_back(finding.first);
+  }
+
+  gst_pad_add_probe(relink->head, GST_PAD_PROBE_TYPE_IDLE, RelinkProbe, relink, RelinkDone);
+}
+
+// Collects the video elements of the bin and its sub-bins
+static std::vector<GstElement *> VideoElements(GstBin *bin) {
+  std::vector<GstElement *> elements;
+  GstIterator *iterator = gst_bin_iterate_recurse(bin);
+  GValue item = G_VALUE_INIT;
+
+  bool done = false;
+  while (!done) {
+    switch (gst_iterator_next(iterator, &item)) {
+      case GST_ITERATOR_OK: {
+        auto *element = (GstElement *) g_value_get_object(&item);
+        if (IsScaleOrConvert(element) || std::string(FactoryName(element)) == "videorate") {
+          elements.push_back((GstElement *) gst_object_ref(element));
+        }
+        g_value_reset(&item);
+        break;
+      }
+      case GST_ITERATOR_RESYNC:
+        for (auto element : elements) {
+          gst_object_unref(element);
+        }
+        elements.clear();
+        gst_iterator_resync(iterator);
+        break;
+      default:
+        done = true;
+        break;
+    }
+  }
+
+  g_value_unset(&item);
+  gst_iterator_free(iterator);
+  return elements;
+}
+
+static void FindWaste(GstElement *element, std::vector<Finding> &findings, std::set<GstElement *> &used) {
+  if (used.count(element)) {
+    return;
+  }
+
+  VideoSide in, out;
+  if (!GetVideoSide(element, "sink", in)) {
+    return;
+  }
+  if (!GetVideoSide(element, "src", out)) {
+    gst_caps_unref(in.caps);
+    return;
+  }
+
+  bool same_caps = gst_caps_is_equal(in.caps, out.caps);
+  gst_caps_unref(in.caps);
+  gst_caps_unref(out.caps);
+
+  gdouble cost = PixelRate(in) + PixelRate(out);
+  bool is_rate = std::string(FactoryName(element)) == "videorate";
+
+  // Frames go through untouched, or are copied for nothing
+  if (same_caps && !is_rate) {
+    bool passthrough = GST_IS_BASE_TRANSFORM (element) && gst_base_transform_is_passthrough(GST_BASE_TRANSFORM (element));
+    findings.push_back({Finding::REMOVE, element, NULL, passthrough ? 0 : cost,
+                        passthrough ? "passthrough" : "copies the frames unchanged"});
+    used.insert(element);
+    return;
+  }
+
+  // A videorate that has not dropped or duplicated anything yet
+  if (same_caps) {
+    guint64 dropped = 0, duplicated = 0;
+    g_object_get(element, "drop", &dropped, "duplicate", &duplicated, NULL);
+    if (!dropped && !duplicated) {
+      findings.push_back({Finding::REMOVE, element, NULL, 0, "idle, the rate is already right"});
+      used.insert(element);
+    }
+    return;
+  }
+
+  if (is_rate) {
+    return;
+  }
+
+  GstElement *next = Neighbour(element, "src");
+  if (!next) {
+    return;
+  }
+
+  VideoSide next_in, next_out;
+  if (used.count(next) || !GetVideoSide(next, "sink", next_in)) {
+    gst_object_unref(next);
+    return;
+  }
+  gst_caps_unref(next_in.caps);
+  if (!GetVideoSide(next, "src", next_out)) {
+    gst_object_unref(next);
+    return;
+  }
+  gst_caps_unref(next_out.caps);
+
+  std::string next_factory = FactoryName(next);
+  gdouble saving = 0;
+  std::string what;
+
+  // Converting the full frame, then shrinking it: A + A + A + B
+  // against A + B + B + B when the smaller frame is converted
+  if (std::string(FactoryName(element)) == "videoconvert" && next_factory == "videoscale"
+      && PixelRate(next_out) < PixelRate(next_in)) {
+    saving = 2 * (PixelRate(next_in) - PixelRate(next_out));
+    what = "converts before \"" + std::string(GST_ELEMENT_NAME (next)) + "\" shrinks the frame";
+  }
+
+  // Every frame is processed, then some are dropped
+  if (next_factory == "videorate" && next_in.fps > 0 && next_out.fps < next_in.fps) {
+    saving = cost * (1 - next_out.fps / next_in.fps);
+    what = "processes frames \"" + std::string(GST_ELEMENT_NAME (next)) + "\" drops after";
+  }
+
+  if (saving > 0) {
+    findings.push_back({Finding::SWAP, element, next, saving, what});
+    used.insert(element);
+    used.insert(next);
+  }
+  gst_object_unref(next);
+}
+
+// Two rebuilds may not share a link: one probe would relink the pads of the other
+static bool Claim(const Finding &finding, std::set<GstElement *> &touched) {
+  GstElement *last = finding.action == Finding::SWAP ? finding.second : finding.first;
+  std::vector<GstElement *> around = {finding.first, finding.second,
+                                      Neighbour(finding.first, "sink"), Neighbour(last, "src")};
+
+  bool clear = true;
+  for (auto element : around) {
+    clear = clear && (!element || !touched.count(element));
+  }
+
+  for (size_t i = 0; i < around.size(); i++) {
+    if (clear && around[i]) {
+      touched.insert(around[i]);
+    }
+    if (i >= 2 && around[i]) {
+      gst_object_unref(around[i]);
+    }
+  }
+
+  if (!clear) {
+    GST_INFO("\"%s\" is left as is, it is next to another change.", GST_ELEMENT_NAME (finding.first));
+  }
+  return clear;
+}
+
+void PipeOptimizer::Init(const OptimizeConfig &config) {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_OPTIMIZER", GST_DEBUG_FG_GREEN, "Negotiated pipe optimizer"
+  );
+
+  PipeOptimizer::config = config;
+}
+
+void PipeOptimizer::Schedule(GstElement *pipe) {
+  if (!config.analyze || g_object_get_data(G_OBJECT (pipe), OPTIMIZER_SCHEDULED)) {
+    return;
+  }
+
+  g_object_set_data(G_OBJECT (pipe), OPTIMIZER_SCHEDULED, GINT_TO_POINTER (TRUE));
+  g_timeout_add(config.delay_ms, Analyze, gst_object_ref(pipe));
+}
+
+gboolean PipeOptimizer::Analyze(gpointer user_data) {
+  auto *pipe = (GstElement *) user_data;
+  std::string pipe_name = GST_ELEMENT_NAME (pipe);
+
+  // Stopped in the meantime, the caps tell nothing
+  GstState state;
+  gst_element_get_state(pipe, &state, NULL, 0);
+  if (state != GST_STATE_PLAYING) {
+    GST_DEBUG("\"%s\" is not playing, nothing to analyze.", pipe_name.c_str());
+    g_object_set_data(G_OBJECT (pipe), OPTIMIZER_SCHEDULED, NULL);
+    gst_object_unref(pipe);
+    return G_SOURCE_REMOVE;
+  }
+
+  std::vector<Finding> findings;
+  std::set<GstElement *> used;
+  auto elements = VideoElements(GST_BIN (pipe));
+  for (auto element : elements) {
+    FindWaste(element, findings, used);
+  }
+
+  gdouble total = 0;
+  std::set<GstElement *> touched;
+  for (const auto &finding : findings) {
+    GST_INFO("\"%s\": \"%s\" %s, %s it saves %.1f Mpx/s.", pipe_name.c_str(), GST_ELEMENT_NAME (finding.first),
+             finding.what.c_str(), finding.action == Finding::SWAP ? "swapping" : "removing", finding.saving / 1e6);
+    total += finding.saving;
+
+    if (config.rebuild && Claim(finding, touched)) {
+      Rebuild(finding);
+    }
+  }
+
+  if (findings.empty()) {
+    GST_INFO("\"%s\": nothing to optimize.", pipe_name.c_str());
+  } else {
+    GST_INFO("\"%s\": %zu findings, %.1f Mpx/s to save%s.", pipe_name.c_str(), findings.size(), total / 1e6,
+             config.rebuild ? ", rebuilding" : "");
+  }
+
+  Metrics::Set("optimizer." + pipe_name + ".findings", findings.size());
+  Metrics::Set("optimizer." + pipe_name + ".waste-kpx", (gint64) (total / 1000));
+
+  for (auto element : elements) {
+    gst_object_unref(element);
+  }
+  gst_object_unref(pipe);
+  return G_SOURCE_REMOVE;
+}
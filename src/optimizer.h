@@ -0,0 +1,37 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <string>
+
+// Options of the "optimize" json object
+struct OptimizeConfig {
+  // Fuse videoscale/videoconvert pairs while loading
+  bool fuse_scale_convert = true;
+  // Look at the negotiated pipes once they play
+  bool analyze = true;
+  // Drop the passthrough elements and reorder the wasteful chains
+  bool rebuild = false;
+  guint delay_ms = 2000;
+};
+
+// Once a pipe has been playing for a while, its negotiated caps show what
+// the chain costs: scalers and converters that pass frames untouched, a
+// format conversion done before the frame is shrunk, or frames scaled only
+// to be dropped by the videorate after. The findings are logged with the
+// pixel operations they waste and, if asked, the chain is rebuilt while
+// it plays.
+
+class PipeOptimizer {
+public:
+
+  static void Init(const OptimizeConfig &config);
+
+  // Analyzes the pipe after the delay, only the first time it plays
+  static void Schedule(GstElement *pipe);
+
+private:
+
+  static gboolean Analyze(gpointer user_data);
+
+  static OptimizeConfig config;
+};
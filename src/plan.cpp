@@ -0,0 +1,502 @@
+#include <algorithm>
+#include <cerrno>
+#include <queue>
+
+#include "plan.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_plan);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_plan       // set as default
+
+// Variant of a property type, NULL if it's kept as text, checked when compiling
+static const char *VariantTypeOf(GType type) {
+  switch (G_TYPE_FUNDAMENTAL (type)) {
+    case G_TYPE_BOOLEAN:
+      return "b";
+    case G_TYPE_INT:
+    case G_TYPE_ENUM:
+      return "i";
+    case G_TYPE_UINT:
+    case G_TYPE_FLAGS:
+      return "u";
+    case G_TYPE_LONG:
+    case G_TYPE_INT64:
+      return "x";
+    case G_TYPE_ULONG:
+    case G_TYPE_UINT64:
+      return "t";
+    case G_TYPE_FLOAT:
+    case G_TYPE_DOUBLE:
+      return "d";
+    case G_TYPE_STRING:
+      return "s";
+    default:
+      return NULL;
+  }
+}
+
+static GVariant *ToVariant(GParamSpec *pspec, const char *text) {
+  GValue value = G_VALUE_INIT;
+  g_value_init(&value, pspec->value_type);
+
+  if (!gst_value_deserialize(&value, text)) {
+    g_value_unset(&value);
+    return NULL;
+  }
+
+  GVariant *variant;
+  switch (G_TYPE_FUNDAMENTAL (pspec->value_type)) {
+    case G_TYPE_BOOLEAN:
+      variant = g_variant_new_boolean(g_value_get_boolean(&value));
+      break;
+    case G_TYPE_INT:
+      variant = g_variant_new_int32(g_value_get_int(&value));
+      break;
+    case G_TYPE_ENUM:
+      variant = g_variant_new_int32(g_value_get_enum(&value));
+      break;
+    case G_TYPE_UINT:
+      variant = g_variant_new_uint32(g_value_get_uint(&value));
+      break;
+    case G_TYPE_FLAGS:
+      variant = g_variant_new_uint32(g_value_get_flags(&value));
+      break;
+    case G_TYPE_LONG:
+      variant = g_variant_new_int64(g_value_get_long(&value));
+      break;
+    case G_TYPE_INT64:
+      variant = g_variant_new_int64(g_value_get_int64(&value));
+      break;
+    case G_TYPE_ULONG:
+      variant = g_variant_new_uint64(g_value_get_ulong(&value));
+      break;
+    case G_TYPE_UINT64:
+      variant = g_variant_new_uint64(g_value_get_uint64(&value));
+      break;
+    case G_TYPE_FLOAT:
+      variant = g_variant_new_double(g_value_get_float(&value));
+      break;
+    case G_TYPE_DOUBLE:
+      variant = g_variant_new_double(g_value_get_double(&value));
+      break;
+    case G_TYPE_STRING:
+      variant = g_variant_new_string(g_value_get_string(&value) ? g_value_get_string(&value) : "");
+      break;
+    default:
+      // Caps, fractions and the like: checked now, deserialized again when built
+      variant = g_variant_new("(s)", text);
+      break;
+  }
+
+  g_value_unset(&value);
+  return g_variant_ref_sink(variant);
+}
+
+// False if the property or its type has changed since the plan was compiled
+static bool ToValue(GObject *object, const std::string &property, GVariant *variant, GValue *value) {
+  GParamSpec *pspec = g_object_class_find_property(G_OBJECT_GET_CLASS (object), property.c_str());
+  if (!pspec) {
+    return false;
+  }
+
+  g_value_init(value, pspec->value_type);
+
+  const char *variant_type = VariantTypeOf(pspec->value_type);
+  if (!variant_type) {
+    const char *text = NULL;
+    if (!g_variant_is_of_type(variant, G_VARIANT_TYPE ("(s)"))) {
+      return false;
+    }
+    g_variant_get(variant, "(&s)", &text);
+    return gst_value_deserialize(value, text);
+  }
+
+  if (!g_variant_is_of_type(variant, G_VARIANT_TYPE (variant_type))) {
+    return false;
+  }
+
+  switch (G_TYPE_FUNDAMENTAL (pspec->value_type)) {
+    case G_TYPE_BOOLEAN:
+      g_value_set_boolean(value, g_variant_get_boolean(variant));
+      break;
+    case G_TYPE_INT:
+      g_value_set_int(value, g_variant_get_int32(variant));
+      break;
+    case G_TYPE_ENUM:
+      g_value_set_enum(value, g_variant_get_int32(variant));
+      break;
+    case G_TYPE_UINT:
+      g_value_set_uint(value, g_variant_get_uint32(variant));
+      break;
+    case G_TYPE_FLAGS:
+      g_value_set_flags(value, g_variant_get_uint32(variant));
+      break;
+    case G_TYPE_LONG:
+      g_value_set_long(value, g_variant_get_int64(variant));
+      break;
+    case G_TYPE_INT64:
+      g_value_set_int64(value, g_variant_get_int64(variant));
+      break;
+    case G_TYPE_ULONG:
+      g_value_set_ulong(value, g_variant_get_uint64(variant));
+      break;
+    case G_TYPE_UINT64:
+      g_value_set_uint64(value, g_variant_get_uint64(variant));
+      break;
+    case G_TYPE_FLOAT:
+      g_value_set_float(value, g_variant_get_double(variant));
+      break;
+    case G_TYPE_DOUBLE:
+      g_value_set_double(value, g_variant_get_double(variant));
+      break;
+    case G_TYPE_STRING:
+      g_value_set_string(value, g_variant_get_string(variant, NULL));
+      break;
+  }
+  return true;
+}
+
+TopologyPlan::TopologyPlan() {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_PLAN", GST_DEBUG_FG_MAGENTA, "Compiled topology plans"
+  );
+}
+
+TopologyPlan::~TopologyPlan() {
+  for (auto &pipe : pipes) {
+    for (auto &element : pipe.elements) {
+      for (auto &property : element.properties) {
+        g_variant_unref(property.second);
+      }
+    }
+  }
+
+  for (auto &klass : classes) {
+    g_type_class_unref(klass.second);
+  }
+}
+
+std::string TopologyPlan::Key(const std::string &json_text) {
+  gchar *version = gst_version_string();
+  std::string keyed = json_text + "\n" + version + "\n" + PLAN_FORMAT_VERSION;
+  g_free(version);
+
+  gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA256, keyed.c_str(), keyed.size());
+  std::string key(checksum);
+  g_free(checksum);
+  return key;
+}
+
+std::string TopologyPlan::CachePath(const std::string &key) {
+  gchar *path = g_build_filename(g_get_user_cache_dir(), "gcf", ("plan-" + key + ".gvariant").c_str(), NULL);
+  std::string result(path);
+  g_free(path);
+  return result;
+}
+
+TopologyPlan::Element *TopologyPlan::FindElement(const std::string &name) {
+  auto index = element_index.find(name);
+  return index == element_index.end() ? NULL : &pipes[index->second.first].elements[index->second.second];
+}
+
+void TopologyPlan::AddCaps(const char *name, const char *definition) {
+  GstCaps *parsed = gst_caps_from_string(definition);
+  GCF_ASSERT(parsed, TopologyGstreamerException, std::string("Cap \"") + name + "\" could not be created!");
+
+  // Kept in the canonical form, it parses straight back
+  gchar *canonical = gst_caps_to_string(parsed);
+  caps.emplace_back(name, canonical);
+  g_free(canonical);
+  gst_caps_unref(parsed);
+}
+
+void TopologyPlan::AddPipe(const char *name) {
+  for (const auto &pipe : pipes) {
+    GCF_ASSERT(pipe.name != name, TopologyInvalidAttributeException,
+               std::string("Can't create \"") + name + "\": it already exists.");
+  }
+
+  pipes.push_back({name, {}});
+}
+
+void TopologyPlan::AddElement(const char *pipe_name, const char *name, const char *type) {
+  GCF_ASSERT(!element_index.count(name), TopologyInvalidAttributeException,
+             std::string("Can't create \"") + name + "\": it already exists.");
+
+  // Made once per type, for the types of its properties
+  if (!classes.count(type)) {
+    GstElementFactory *factory = gst_element_factory_find(type);
+    auto *loaded = factory ? (GstElementFactory *) gst_plugin_feature_load(GST_PLUGIN_FEATURE (factory)) : NULL;
+    GType element_type = loaded ? gst_element_factory_get_element_type(loaded) : G_TYPE_INVALID;
+
+    if (loaded) {
+      gst_object_unref(loaded);
+    }
+    if (factory) {
+      gst_object_unref(factory);
+    }
+
+    GCF_ASSERT(element_type != G_TYPE_INVALID, TopologyGstreamerException,
+               std::string("Element \"") + name + "\" (type: " + type + ") could not be created.");
+    classes[type] = g_type_class_ref(element_type);
+  }
+
+  for (size_t i = 0; i < pipes.size(); i++) {
+    if (pipes[i].name == pipe_name) {
+      element_index[name] = {i, pipes[i].elements.size()};
+      pipes[i].elements.push_back({name, type, "", {}});
+      return;
+    }
+  }
+
+  throw TopologyInvalidAttributeException(
+      std::string("Adding element \"") + name + "\" to invalid pipe \"" + pipe_name + "\"");
+}
+
+void TopologyPlan::AddProperty(const char *element_name, const char *property, const char *value) {
+  Element *element = FindElement(element_name);
+  GCF_ASSERT(element, TopologyInvalidAttributeException,
+             std::string("Can't set properties of \"") + element_name + "\": it does not exist!");
+
+  GParamSpec *pspec = g_object_class_find_property(G_OBJECT_CLASS (classes[element->factory]), property);
+  GCF_WARNING_RETURN(!pspec, "\"%s\" (type: %s) has no property \"%s\", it is left out.",
+                     element_name, element->factory.c_str(), property);
+
+  GVariant *variant = ToVariant(pspec, value);
+  GCF_WARNING_RETURN(!variant, "Property \"%s\" of \"%s\" can't be \"%s\", it is left out.",
+                     property, element_name, value);
+
+  element->properties.emplace_back(property, variant);
+}
+
+void TopologyPlan::SetFilter(const char *element_name, const char *caps_name) {
+  Element *element = FindElement(element_name);
+  GCF_ASSERT(element, TopologyInvalidAttributeException,
+             std::string("Can't assign cap to filter \"") + element_name + "\": filter does not exist!");
+
+  bool known = std::any_of(caps.begin(), caps.end(), [caps_name](const std::pair<std::string, std::string> &cap) {
+    return cap.first == caps_name;
+  });
+  GCF_ASSERT(known, TopologyInvalidAttributeException,
+             std::string("Can't assign cap \"") + caps_name + "\": cap does not exist!");
+
+  element->filter = caps_name;
+}
+
+void TopologyPlan::AddLink(const char *src_name, const char *dst_name) {
+  links.emplace_back(src_name, dst_name);
+}
+
+// Kahn's algorithm, ties broken by the order the json names the elements in
+void TopologyPlan::SortLinks() {
+  std::map<std::string, size_t> appearance;
+  std::map<std::string, std::vector<std::string>> downstream;
+  std::map<std::string, size_t> indegree;
+
+  for (const auto &link : links) {
+    appearance.emplace(link.first, appearance.size());
+    appearance.emplace(link.second, appearance.size());
+    downstream[link.first].push_back(link.second);
+    indegree[link.second]++;
+  }
+
+  typedef std::pair<size_t, std::string> Ready;
+  std::priority_queue<Ready, std::vector<Ready>, std::greater<Ready>> ready;
+  for (const auto &node : appearance) {
+    if (!indegree[node.first]) {
+      ready.push({node.second, node.first});
+    }
+  }
+
+  std::map<std::string, size_t> rank;
+  while (!ready.empty()) {
+    std::string node = ready.top().second;
+    ready.pop();
+    size_t position = rank.size();
+    rank[node] = position;
+
+    for (const auto &next : downstream[node]) {
+      if (!--indegree[next]) {
+        ready.push({appearance[next], next});
+      }
+    }
+  }
+
+  GCF_WARNING_RETURN(rank.size() != appearance.size(), "The links have a loop, they are kept in json order.");
+
+  std::stable_sort(links.begin(), links.end(), [&rank](const std::pair<std::string, std::string> &a,
+                                                       const std::pair<std::string, std::string> &b) {
+    return rank.at(a.first) < rank.at(b.first);
+  });
+}
+
+bool TopologyPlan::Load(const std::string &key) {
+  std::string path = CachePath(key);
+
+  gchar *data = NULL;
+  gsize size = 0;
+  if (!g_file_get_contents(path.c_str(), &data, &size, NULL)) {
+    GST_DEBUG("No cached plan at \"%s\"", path.c_str());
+    return false;
+  }
+
+  GVariant *plan = g_variant_ref_sink(
+      g_variant_new_from_data(G_VARIANT_TYPE (PLAN_VARIANT_TYPE), data, size, FALSE, g_free, data));
+
+  const gchar *stored_key = NULL;
+  GVariantIter *caps_iter, *pipes_iter, *links_iter;
+  g_variant_get(plan, "(&sa(ss)a(sa(sssa(sv)))a(ss))", &stored_key, &caps_iter, &pipes_iter, &links_iter);
+
+  // Cut or written by another version, compiled again
+  bool valid = key == stored_key;
+  if (valid) {
+    const gchar *name, *definition, *element_name, *factory, *filter, *property;
+    GVariantIter *elements_iter, *properties_iter;
+    GVariant *value;
+
+    while (g_variant_iter_loop(caps_iter, "(&s&s)", &name, &definition)) {
+      caps.emplace_back(name, definition);
+    }
+
+    while (g_variant_iter_loop(pipes_iter, "(&sa(sssa(sv)))", &name, &elements_iter)) {
+      pipes.push_back({name, {}});
+
+      while (g_variant_iter_loop(elements_iter, "(&s&s&sa(sv))", &element_name, &factory, &filter,
+                                 &properties_iter)) {
+        pipes.back().elements.push_back({element_name, factory, filter, {}});
+
+        while (g_variant_iter_loop(properties_iter, "(&sv)", &property, &value)) {
+          pipes.back().elements.back().properties.emplace_back(property, g_variant_ref(value));
+        }
+      }
+    }
+
+    while (g_variant_iter_loop(links_iter, "(&s&s)", &name, &definition)) {
+      links.emplace_back(name, definition);
+    }
+  }
+
+  g_variant_iter_free(caps_iter);
+  g_variant_iter_free(pipes_iter);
+  g_variant_iter_free(links_iter);
+  g_variant_unref(plan);
+
+  if (valid) {
+    GST_INFO("Topology plan is loaded from \"%s\"", path.c_str());
+  } else {
+    GST_WARNING("Cached plan \"%s\" is not for this json, compiling it again.", path.c_str());
+  }
+  return valid;
+}
+
+void TopologyPlan::Save(const std::string &key) {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE (PLAN_VARIANT_TYPE));
+  g_variant_builder_add(&builder, "s", key.c_str());
+
+  g_variant_builder_open(&builder, G_VARIANT_TYPE ("a(ss)"));
+  for (const auto &cap : caps) {
+    g_variant_builder_add(&builder, "(ss)", cap.first.c_str(), cap.second.c_str());
+  }
+  g_variant_builder_close(&builder);
+
+  g_variant_builder_open(&builder, G_VARIANT_TYPE ("a(sa(sssa(sv)))"));
+  for (const auto &pipe : pipes) {
+    g_variant_builder_open(&builder, G_VARIANT_TYPE ("(sa(sssa(sv)))"));
+    g_variant_builder_add(&builder, "s", pipe.name.c_str());
+    g_variant_builder_open(&builder, G_VARIANT_TYPE ("a(sssa(sv))"));
+
+    for (const auto &element : pipe.elements) {
+      g_variant_builder_open(&builder, G_VARIANT_TYPE ("(sssa(sv))"));
+      g_variant_builder_add(&builder, "s", element.name.c_str());
+      g_variant_builder_add(&builder, "s", element.factory.c_str());
+      g_variant_builder_add(&builder, "s", element.filter.c_str());
+      g_variant_builder_open(&builder, G_VARIANT_TYPE ("a(sv)"));
+      for (const auto &property : element.properties) {
+        g_variant_builder_add(&builder, "(sv)", property.first.c_str(), property.second);
+      }
+      g_variant_builder_close(&builder);
+      g_variant_builder_close(&builder);
+    }
+
+    g_variant_builder_close(&builder);
+    g_variant_builder_close(&builder);
+  }
+  g_variant_builder_close(&builder);
+
+  g_variant_builder_open(&builder, G_VARIANT_TYPE ("a(ss)"));
+  for (const auto &link : links) {
+    g_variant_builder_add(&builder, "(ss)", link.first.c_str(), link.second.c_str());
+  }
+  g_variant_builder_close(&builder);
+
+  GVariant *plan = g_variant_ref_sink(g_variant_builder_end(&builder));
+  std::string path = CachePath(key);
+  gchar *directory = g_path_get_dirname(path.c_str());
+  GError *error = NULL;
+
+  // Written aside and renamed, a start reading it meanwhile sees the old or the new one
+  if (g_mkdir_with_parents(directory, 0755)
+      || !g_file_set_contents(path.c_str(), (const gchar *) g_variant_get_data(plan), g_variant_get_size(plan), &error)) {
+    GST_WARNING("Can't cache the topology plan at \"%s\": %s", path.c_str(),
+                error ? error->message : g_strerror(errno));
+    g_clear_error(&error);
+  } else {
+    GST_INFO("Topology plan is cached at \"%s\"", path.c_str());
+  }
+
+  g_free(directory);
+  g_variant_unref(plan);
+}
+
+void TopologyPlan::Instantiate(Topology *topology) {
+  for (const auto &cap : caps) {
+    topology->CreateCap(cap.first.c_str(), cap.second.c_str());
+  }
+
+  // Every type is looked up in the registry once
+  std::map<std::string, GstElementFactory *> factories;
+
+  for (const auto &pipe : pipes) {
+    topology->CreatePipeline(pipe.name.c_str());
+
+    for (const auto &element : pipe.elements) {
+      auto factory = factories.find(element.factory);
+      if (factory == factories.end()) {
+        factory = factories.emplace(element.factory, gst_element_factory_find(element.factory.c_str())).first;
+      }
+      topology->CreateElement(element.name, factory->second);
+
+      if (!element.filter.empty()) {
+        topology->AssignCap(element.name.c_str(), element.filter.c_str());
+      }
+
+      for (const auto &property : element.properties) {
+        GValue value = G_VALUE_INIT;
+        if (ToValue(G_OBJECT (topology->GetElement(element.name)), property.first, property.second, &value)) {
+          topology->SetProperty(element.name.c_str(), property.first.c_str(), &value);
+        } else {
+          GST_WARNING("Property \"%s\" of \"%s\" has changed since the plan was compiled, it is left out.",
+                      property.first.c_str(), element.name.c_str());
+        }
+        if (G_IS_VALUE (&value)) {
+          g_value_unset(&value);
+        }
+      }
+
+      topology->AddElementToBin(element.name, pipe.name);
+    }
+  }
+
+  for (auto &factory : factories) {
+    if (factory.second) {
+      gst_object_unref(factory.second);
+    }
+  }
+}
+
+void TopologyPlan::Link(Topology *topology) {
+  for (const auto &link : links) {
+    topology->ConnectElements(link.first, link.second);
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "topology.h"
+
+// Pipes, elements, caps and links of a topology json, checked and typed
+// once. The element factories are resolved and every property value is
+// converted with the type of its property while compiling; the result is
+// cached on disk, keyed by the json and the GStreamer version, and the
+// next start builds the topology straight from it.
+
+#define PLAN_FORMAT_VERSION "1"
+
+// key, caps, pipes (elements: name, factory, filter, properties), links
+#define PLAN_VARIANT_TYPE "(sa(ss)a(sa(sssa(sv)))a(ss))"
+
+class TopologyPlan {
+public:
+
+  TopologyPlan();
+  ~TopologyPlan();
+
+  // Cache key of a json text with the running GStreamer
+  static std::string Key(const std::string &json_text);
+
+  // Compiling
+  void AddCaps(const char *name, const char *definition);
+  void AddPipe(const char *name);
+  void AddElement(const char *pipe_name, const char *name, const char *type);
+  void AddProperty(const char *element_name, const char *property, const char *value);
+  void SetFilter(const char *element_name, const char *caps_name);
+  void AddLink(const char *src_name, const char *dst_name);
+
+  // Orders the links from the sources downstream
+  void SortLinks();
+
+  // Cached plan of the key, false if there is none or it is unusable
+  bool Load(const std::string &key);
+  void Save(const std::string &key);
+
+  // Caps, pipes, elements and their properties, then the links
+  void Instantiate(Topology *topology);
+  void Link(Topology *topology);
+
+private:
+
+  struct Element {
+    std::string name;
+    std::string factory;
+    std::string filter;
+    std::vector<std::pair<std::string, GVariant *>> properties;
+  };
+
+  struct Pipe {
+    std::string name;
+    std::vector<Element> elements;
+  };
+
+  Element *FindElement(const std::string &name);
+
+  static std::string CachePath(const std::string &key);
+
+  std::vector<std::pair<std::string, std::string>> caps;
+  std::vector<Pipe> pipes;
+  std::vector<std::pair<std::string, std::string>> links;
+
+  // Where each element is, and the classes of their types, while compiling
+  std::map<std::string, std::pair<size_t, size_t>> element_index;
+  std::map<std::string, gpointer> classes;
+};
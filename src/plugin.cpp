@@ -0,0 +1,25 @@
+#include "plugin.h"
+#include "rtpbatch.h"
+#include "temporalfilter.h"
+#include "shmsink.h"
+#include "motiondetect.h"
+#include "motiongate.h"
+#include "scaleconvert.h"
+
+static gboolean RegisterElements(GstPlugin *plugin) {
+  return gst_element_register(plugin, "gcfrtpbatch", GST_RANK_NONE, GCF_TYPE_RTP_BATCH)
+      && gst_element_register(plugin, "gcftemporalfilter", GST_RANK_NONE, GCF_TYPE_TEMPORAL_FILTER)
+      && gst_element_register(plugin, "gcfshmsink", GST_RANK_NONE, GCF_TYPE_SHM_SINK)
+      && gst_element_register(plugin, "gcfmotiondetect", GST_RANK_NONE, GCF_TYPE_MOTION_DETECT)
+      && gst_element_register(plugin, "gcfmotiongate", GST_RANK_NONE, GCF_TYPE_MOTION_GATE)
+      && gst_element_register(plugin, "gcfscaleconvert", GST_RANK_NONE, GCF_TYPE_SCALE_CONVERT);
+}
+
+void Plugin::Init() {
+  gst_plugin_register_static(
+      GST_VERSION_MAJOR, GST_VERSION_MINOR,
+      "gcf", "GStreamer Camera Firmware elements",
+      RegisterElements, VERSION, "LGPL",
+      "gst-rtsp-app", "gst-rtsp-app", "https://github.com/half2me/gst-rtsp-app"
+  );
+}
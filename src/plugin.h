@@ -0,0 +1,11 @@
+#pragma once
+#include <gst/gst.h>
+
+// Elements implemented by the application itself
+
+class Plugin {
+public:
+
+  static void Init();
+
+};
@@ -0,0 +1,330 @@
+#include <glib/gstdio.h>
+#include <algorithm>
+#include <cstring>
+
+#include "recorder.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_recorder);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_recorder       // set as default
+
+#define RECORDER_SUFFIX ".mp4"
+#define RECORDER_PARTIAL ".part"
+
+Recorder::Recorder(const std::string &mount, const MountConfig &config)
+    : mount(mount),
+      config(config),
+      running(false),
+      stopping(false),
+      resync(true),
+      file(config.record_buffer_kb * 1024, config.record_direct_io, (guint64) config.record_preallocate_mb << 20),
+      segment_caps(NULL),
+      segment_start(GST_CLOCK_TIME_NONE),
+      pending(NULL),
+      pending_dts(GST_CLOCK_TIME_NONE),
+      fragment_start(GST_CLOCK_TIME_NONE),
+      fragment_duration(0),
+      fragment_sequence(0) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_RECORDER", GST_DEBUG_FG_RED, "Segmented recording"
+  );
+
+  if (g_mkdir_with_parents(config.record_path.c_str(), 0755) != 0) {
+    GST_ERROR("Recording of \"%s\": can't create \"%s\"!", mount.c_str(), config.record_path.c_str());
+  }
+}
+
+Recorder::~Recorder() {
+  Stop();
+  gst_caps_replace(&segment_caps, NULL);
+
+  Metrics::Remove("record." + mount + ".");
+}
+
+void Recorder::Start() {
+  if (running) {
+    return;
+  }
+
+  GST_INFO("Recording of \"%s\" starts into \"%s\"", mount.c_str(), config.record_path.c_str());
+
+  // Nothing of an earlier recording opens this one
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto sample : queue) {
+      gst_sample_unref(sample);
+    }
+    queue.clear();
+    stopping = false;
+    resync = true;
+  }
+  running = true;
+  writer = std::thread(&Recorder::Run, this);
+}
+
+// The encoder has to be detached already, the queued frames are still written
+void Recorder::Stop() {
+  if (!running) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  queued.notify_one();
+  writer.join();
+  running = false;
+
+  GST_INFO("Recording of \"%s\" is stopped", mount.c_str());
+}
+
+void Recorder::Push(GstSample *sample, gpointer user_data) {
+  Recorder *self = static_cast<Recorder *>(user_data);
+  bool keyframe = !GST_BUFFER_FLAG_IS_SET (gst_sample_get_buffer(sample), GST_BUFFER_FLAG_DELTA_UNIT);
+
+  {
+    std::lock_guard<std::mutex> guard(self->lock);
+
+    // Late for a recording that is stopping or stopped
+    if (self->stopping) {
+      return;
+    }
+
+    // After a drop, the frames are useless until the next keyframe
+    if (self->queue.size() >= RECORDER_MAX_QUEUE || (self->resync && !keyframe)) {
+      if (!self->resync) {
+        GST_WARNING("Recording of \"%s\" can't keep up, dropping frames", self->mount.c_str());
+      }
+      self->resync = true;
+      Metrics::Add("record." + self->mount + ".dropped", 1);
+      return;
+    }
+
+    self->resync = false;
+    self->queue.push_back(gst_sample_ref(sample));
+  }
+
+  self->queued.notify_one();
+}
+
+void Recorder::Run() {
+  while (true) {
+    GstSample *sample = NULL;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      queued.wait(guard, [this]() { return stopping || !queue.empty(); });
+
+      if (queue.empty()) {
+        break;
+      }
+
+      sample = queue.front();
+      queue.pop_front();
+    }
+
+    Write(sample);
+    gst_sample_unref(sample);
+  }
+
+  // The last frame gets the duration of the one before
+  if (pending) {
+    Append(fragment_duration && !samples.empty() ? fragment_duration / samples.size() : GST_SECOND / 25);
+  }
+  CloseSegment();
+}
+
+void Recorder::Write(GstSample *sample) {
+  GstClockTime dts = GST_BUFFER_DTS_OR_PTS (gst_sample_get_buffer(sample));
+
+  if (pending) {
+    bool ordered = GST_CLOCK_TIME_IS_VALID (dts) && GST_CLOCK_TIME_IS_VALID (pending_dts) && dts > pending_dts;
+    Append(ordered ? dts - pending_dts : 0);
+  }
+
+  pending = gst_sample_ref(sample);
+  pending_dts = dts;
+}
+
+// Moves the pending frame into the fragment, splitting the segment on keyframes
+void Recorder::Append(GstClockTime duration) {
+  GstBuffer *buffer = gst_sample_get_buffer(pending);
+  GstCaps *caps = gst_sample_get_caps(pending);
+  bool keyframe = !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  if (keyframe) {
+    bool changed = caps && (!segment_caps || !gst_caps_is_equal(caps, segment_caps));
+    bool full = GST_CLOCK_TIME_IS_VALID (segment_start)
+        && pending_dts >= segment_start + config.record_segment_s * GST_SECOND;
+
+    if (segment_path.empty() || changed || full) {
+      CloseSegment();
+      gst_caps_replace(&segment_caps, caps);
+      segment_start = pending_dts;
+      OpenSegment();
+    } else if (fragment_duration >= RECORDER_FRAGMENT_TIME) {
+      FlushFragment();
+    }
+  }
+
+  if (segment_path.empty()) {
+    gst_sample_unref(pending);
+    pending = NULL;
+    return;
+  }
+
+  if (samples.empty()) {
+    fragment_start = pending_dts;
+  }
+
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+  gint64 offset = GST_CLOCK_TIME_IS_VALID (pts) ? GST_CLOCK_DIFF (pending_dts, pts) : 0;
+
+  samples.push_back({
+      gst_buffer_ref(buffer),
+      (guint32) gst_util_uint64_scale(duration, FMP4_TIMESCALE, GST_SECOND),
+      (gint32) (offset * FMP4_TIMESCALE / (gint64) GST_SECOND),
+      keyframe
+  });
+  fragment_duration += duration;
+
+  gst_sample_unref(pending);
+  pending = NULL;
+}
+
+void Recorder::FlushFragment() {
+  if (samples.empty()) {
+    return;
+  }
+
+  // Decode time follows the timestamps, so gaps after drops stay gaps
+  guint64 decode_time = gst_util_uint64_scale(fragment_start - segment_start, FMP4_TIMESCALE, GST_SECOND);
+  auto data = Fmp4::Fragment(++fragment_sequence, decode_time, samples);
+
+  if (!file.Write(data.data(), data.size())) {
+    GST_ERROR("Recording of \"%s\": writing \"%s\" failed!", mount.c_str(), segment_path.c_str());
+  }
+  Metrics::Add("record." + mount + ".bytes", data.size());
+
+  for (auto &sample : samples) {
+    gst_buffer_unref(sample.buffer);
+  }
+  samples.clear();
+  fragment_duration = 0;
+}
+
+bool Recorder::OpenSegment() {
+  // UTC to the millisecond, so names sort in time order and don't repeat across DST or short segments
+  GDateTime *now = g_date_time_new_now_utc();
+  gchar *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+  gchar *name = g_strdup_printf("%s-%s.%03dZ%s", mount.c_str(), stamp, g_date_time_get_microsecond(now) / 1000,
+                                RECORDER_SUFFIX);
+  g_date_time_unref(now);
+  g_free(stamp);
+
+  gchar *path = g_build_filename(config.record_path.c_str(), name, NULL);
+  segment_path = path;
+  g_free(path);
+  g_free(name);
+
+  // Written under a temporary name, so readers only see complete segments
+  auto init = Fmp4::InitSegment(segment_caps);
+  if (init.empty() || !file.Open(segment_path + RECORDER_PARTIAL) || !file.Write(init.data(), init.size())) {
+    GST_ERROR("Recording of \"%s\": can't start \"%s\"!", mount.c_str(), segment_path.c_str());
+    segment_path.clear();
+    return false;
+  }
+
+  fragment_sequence = 0;
+
+  GST_DEBUG("Recording of \"%s\": new segment \"%s\"", mount.c_str(), segment_path.c_str());
+  return true;
+}
+
+void Recorder::CloseSegment() {
+  FlushFragment();
+
+  if (segment_path.empty()) {
+    return;
+  }
+
+  if (file.Close() && g_rename((segment_path + RECORDER_PARTIAL).c_str(), segment_path.c_str()) == 0) {
+    Metrics::Add("record." + mount + ".segments", 1);
+  } else {
+    GST_ERROR("Recording of \"%s\": can't complete \"%s\"!", mount.c_str(), segment_path.c_str());
+  }
+
+  segment_path.clear();
+  Retain();
+}
+
+// <mount>-<yyyymmdd>-<hhmmss>.<ms>Z.mp4 of this very mount, not of another
+// one whose name starts the same, e.g. "h264-low" for "h264"
+static bool IsSegmentOf(const std::string &mount, const gchar *name) {
+  static const char pattern[] = "########-######.###Z" RECORDER_SUFFIX;
+
+  if (strncmp(name, mount.c_str(), mount.size()) || name[mount.size()] != '-') {
+    return false;
+  }
+
+  const gchar *stamp = name + mount.size() + 1;
+  for (guint i = 0; i < sizeof(pattern); i++) {
+    bool digit = pattern[i] == '#';
+    if (digit ? !g_ascii_isdigit(stamp[i]) : stamp[i] != pattern[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Deletes the oldest segments above the kept count or size
+void Recorder::Retain() {
+  if (!config.record_keep_segments && !config.record_keep_mb) {
+    return;
+  }
+
+  GDir *dir = g_dir_open(config.record_path.c_str(), 0, NULL);
+  if (!dir) {
+    return;
+  }
+
+  // The names sort by time
+  std::vector<std::pair<std::string, guint64>> segments;
+  guint64 total = 0;
+
+  while (const gchar *name = g_dir_read_name(dir)) {
+    if (!IsSegmentOf(mount, name)) {
+      continue;
+    }
+
+    gchar *path = g_build_filename(config.record_path.c_str(), name, NULL);
+    GStatBuf stat;
+    if (g_stat(path, &stat) == 0) {
+      segments.push_back({path, (guint64) stat.st_size});
+      total += stat.st_size;
+    }
+    g_free(path);
+  }
+  g_dir_close(dir);
+
+  std::sort(segments.begin(), segments.end());
+
+  guint64 max_bytes = (guint64) config.record_keep_mb << 20;
+  for (size_t i = 0; i < segments.size(); i++) {
+    size_t left = segments.size() - i;
+    bool too_many = config.record_keep_segments && left > config.record_keep_segments;
+    bool too_big = max_bytes && total > max_bytes && left > 1;
+
+    if (!too_many && !too_big) {
+      break;
+    }
+
+    GST_INFO("Recording of \"%s\": deleting \"%s\"", mount.c_str(), segments[i].first.c_str());
+    if (g_unlink(segments[i].first.c_str()) == 0) {
+      total -= segments[i].second;
+    }
+  }
+}
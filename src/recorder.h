@@ -0,0 +1,75 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "alignedfile.h"
+#include "fmp4.h"
+#include "mount.h"
+
+#define RECORDER_MAX_QUEUE 512 // frames
+#define RECORDER_FRAGMENT_TIME GST_SECOND
+
+// Records the shared encode of a mount into fragmented MP4 files, split
+// on the first keyframe after the segment time. The frames are only
+// queued in the streaming thread, a writer thread of its own does the
+// packaging and the disk I/O, so a slow disk drops recorded frames
+// instead of holding up the live clients. Segments are named
+// <mount>-<yyyymmdd>-<hhmmss>.<ms>Z.mp4 after their UTC start.
+
+class Recorder {
+public:
+
+  Recorder(const std::string &mount, const MountConfig &config);
+  ~Recorder();
+
+  bool IsRunning() const { return running; }
+
+  // Runtime control, the server attaches and detaches the encoder around them
+  void Start();
+  void Stop();
+
+  // Encoded frames from the shared encoder
+  static void Push(GstSample *sample, gpointer user_data);
+
+private:
+
+  void Run();
+  void Write(GstSample *sample);
+  void Append(GstClockTime duration);
+  void FlushFragment();
+  bool OpenSegment();
+  void CloseSegment();
+  void Retain();
+
+  std::string mount;
+  MountConfig config;
+  bool running;
+
+  // Frames between the streaming and the writer thread
+  std::mutex lock;
+  std::condition_variable queued;
+  std::deque<GstSample *> queue;
+  bool stopping;
+  bool resync;
+  std::thread writer;
+
+  // Writer thread only
+  AlignedFile file;
+  std::string segment_path;
+  GstCaps *segment_caps;
+  GstClockTime segment_start;
+
+  GstSample *pending;
+  GstClockTime pending_dts;
+
+  std::vector<Fmp4Sample> samples;
+  GstClockTime fragment_start;
+  GstClockTime fragment_duration;
+  guint32 fragment_sequence;
+};
@@ -0,0 +1,95 @@
+#include "registry.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_registry);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_registry       // set as default
+
+std::string Registry::snapshot;
+
+void Registry::UseSnapshot(const std::string &path) {
+  snapshot = path;
+  g_setenv(REGISTRY_ENV, path.c_str(), TRUE);
+  g_setenv(REGISTRY_UPDATE_ENV, "no", TRUE);
+}
+
+void Registry::WriteSnapshot(const std::string &path) {
+  snapshot = path;
+  g_setenv(REGISTRY_ENV, path.c_str(), TRUE);
+  g_setenv(REGISTRY_UPDATE_ENV, "yes", TRUE);
+
+  // Scanned in this process, a missing plugin shows up in its log
+  g_setenv(REGISTRY_FORK_ENV, "no", TRUE);
+}
+
+const std::string &Registry::Snapshot() {
+  return snapshot;
+}
+
+std::set<std::string> Registry::InternalTypes() {
+  return {
+      // Topology, renditions, shared encoders and time-shift
+      "queue", "intervideosink", "intervideosrc", "appsrc", "appsink", "identity",
+      // Source failover
+      "input-selector",
+      // Encoder selection runs
+      "videotestsrc", "capsfilter", "fakesink",
+      // RTSP server
+      "rtpbin", "udpsrc", "udpsink", "funnel",
+  };
+}
+
+bool Registry::Require(const std::set<std::string> &types) {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_REGISTRY", GST_DEBUG_FG_GREEN, "Plugin registry"
+  );
+
+  std::string missing;
+  std::set<GstPlugin *> plugins;
+
+  for (const auto &type : types) {
+    GstElementFactory *factory = gst_element_factory_find(type.c_str());
+    if (!factory) {
+      missing += (missing.empty() ? "" : ", ") + type;
+      continue;
+    }
+
+    // The static gcf plugin is loaded already, the rest is loaded here
+    auto *loaded = (GstElementFactory *) gst_plugin_feature_load(GST_PLUGIN_FEATURE (factory));
+    GstPlugin *plugin = loaded ? gst_plugin_feature_get_plugin(GST_PLUGIN_FEATURE (loaded)) : NULL;
+    if (!plugin) {
+      missing += (missing.empty() ? "" : ", ") + type + " (plugin fails to load)";
+    } else {
+      plugins.insert(plugin);
+      gst_object_unref(plugin);
+    }
+
+    if (loaded) {
+      gst_object_unref(loaded);
+    }
+    gst_object_unref(factory);
+  }
+
+  if (!missing.empty()) {
+    GST_ERROR("Element types missing from the %s: %s", snapshot.empty() ? "plugin registry"
+              : ("registry snapshot \"" + snapshot + "\"").c_str(), missing.c_str());
+    return false;
+  }
+
+  guint registered = 0;
+  guint loaded = 0;
+  GList *list = gst_registry_get_plugin_list(gst_registry_get());
+  for (GList *item = list; item; item = item->next) {
+    registered++;
+    loaded += gst_plugin_is_loaded(GST_PLUGIN (item->data)) ? 1 : 0;
+  }
+  gst_plugin_list_free(list);
+
+  GST_INFO("%zu element types from %zu plugins, %u of %u registered plugins loaded%s",
+           types.size(), plugins.size(), loaded, registered,
+           snapshot.empty() ? "" : (", registry \"" + snapshot + "\"").c_str());
+
+  Metrics::Set("registry.plugins", registered);
+  Metrics::Set("registry.loaded-plugins", loaded);
+  return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <set>
+#include <string>
+
+// Plugin registry pinned by the deployment. By default gst_init checks
+// every plugin file on the system against the registry cache; with a
+// snapshot it only reads the snapshot, and the topology loads the plugins
+// of its own element types up front. The snapshot is written once, on the
+// target, with --write-registry.
+
+#define REGISTRY_ENV "GST_REGISTRY"
+#define REGISTRY_UPDATE_ENV "GST_REGISTRY_UPDATE"
+#define REGISTRY_FORK_ENV "GST_REGISTRY_FORK"
+
+class Registry {
+public:
+
+  // Both before gst_init: read the snapshot as it is, or scan and write it
+  static void UseSnapshot(const std::string &path);
+  static void WriteSnapshot(const std::string &path);
+
+  // The snapshot in use, empty for the plugin registry
+  static const std::string &Snapshot();
+
+  // Loads the plugins of the types; false, naming all of them, if any is missing
+  static bool Require(const std::set<std::string> &types);
+
+  // Made by the app and the RTSP server themselves, not listed in the topology
+  static std::set<std::string> InternalTypes();
+
+private:
+
+  static std::string snapshot;
+};
@@ -0,0 +1,212 @@
+#include "rendition.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_rendition);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_rendition       // set as default
+
+#define RENDITION_MIN_SIZE 16
+#define RENDITION_MAX_SIZE 7680
+#define RENDITION_MAX_FPS 120
+
+static bool ParseInt(const gchar *value, gint min, gint max, gint &result) {
+  gchar *end = NULL;
+  gint64 number = g_ascii_strtoll(value, &end, 10);
+
+  if (!end || end == value || *end || number < min || number > max) {
+    return false;
+  }
+
+  result = (gint) number;
+  return true;
+}
+
+bool RenditionRequest::Parse(const char *query) {
+  gchar **params = g_strsplit(query, "&", -1);
+  bool valid = true;
+
+  for (gchar **param = params; valid && *param; param++) {
+    gchar **pair = g_strsplit(*param, "=", 2);
+
+    if (!pair[0] || !pair[1]) {
+      valid = false;
+    } else if (!g_strcmp0(pair[0], "width")) {
+      valid = ParseInt(pair[1], RENDITION_MIN_SIZE, RENDITION_MAX_SIZE, width) && width % 2 == 0;
+    } else if (!g_strcmp0(pair[0], "height")) {
+      valid = ParseInt(pair[1], RENDITION_MIN_SIZE, RENDITION_MAX_SIZE, height) && height % 2 == 0;
+    } else if (!g_strcmp0(pair[0], "fps")) {
+      valid = ParseInt(pair[1], 1, RENDITION_MAX_FPS, fps);
+    } else {
+      valid = false;
+    }
+
+    g_strfreev(pair);
+  }
+
+  g_strfreev(params);
+
+  // Size is only accepted as a pair, and something has to be asked
+  return valid && (width == 0) == (height == 0) && (width || fps);
+}
+
+std::string RenditionRequest::Name(const std::string &mount) const {
+  std::string name = mount;
+
+  if (width) {
+    name += "_" + std::to_string(width) + "x" + std::to_string(height);
+  }
+
+  if (fps) {
+    name += "_" + std::to_string(fps) + "fps";
+  }
+
+  return name;
+}
+
+GstElement *Rendition::Build(GstElement *mount_pipe,
+                             const std::string &mount,
+                             const std::string &name,
+                             const RenditionRequest &request,
+                             GstElement **queue,
+                             GstElement **intersink) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_RENDITION", GST_DEBUG_FG_YELLOW, "On-demand renditions"
+  );
+
+  // The chain starts at the tunnel end of the mount pipe
+  GstElement *element = gst_bin_get_by_name(GST_BIN (mount_pipe), ("intersrc_" + mount).c_str());
+  GCF_ERROR_RETURN_VAL(!element, NULL, "Rendition \"%s\": mount \"%s\" is not connected to a source!",
+                       name.c_str(), mount.c_str());
+
+  auto gateway_name = "gateway_" + name;
+  GstElement *bin = gst_pipeline_new(name.c_str());
+  GstElement *previous = NULL;
+  bool filtered = false, complete = false;
+
+  while (element && !complete) {
+    GstElement *copy = Clone(element);
+    GstElementFactory *factory = gst_element_get_factory(element);
+    const gchar *factory_name = factory ? GST_OBJECT_NAME (factory) : "";
+
+    if (!g_strcmp0(factory_name, "intervideosrc")) {
+      g_object_set(copy, "channel", gateway_name.c_str(), NULL);
+    } else if (!g_strcmp0(factory_name, "capsfilter")) {
+      ApplyRequest(copy, request);
+      filtered = true;
+    }
+
+    // The payloader is the last element of a mount
+    complete = g_str_has_prefix(GST_ELEMENT_NAME (element), "pay");
+
+    if (!gst_bin_add(GST_BIN (bin), copy) || (previous && !gst_element_link(previous, copy))) {
+      GST_ERROR("Rendition \"%s\": can't copy \"%s\"!", name.c_str(), GST_ELEMENT_NAME (element));
+      gst_object_unref(element);
+      gst_object_unref(bin);
+      return NULL;
+    }
+
+    previous = copy;
+
+    GstElement *next = NextElement(element);
+    gst_object_unref(element);
+    element = next;
+  }
+
+  if (element) {
+    gst_object_unref(element);
+  }
+
+  if (!complete || !filtered) {
+    GST_ERROR("Rendition \"%s\": mount \"%s\" needs a caps filter and a payloader!", name.c_str(), mount.c_str());
+    gst_object_unref(bin);
+    return NULL;
+  }
+
+  // Other side of the tunnel, the server links it to the source tee
+  *queue = gst_element_factory_make("queue", ("queue_" + name).c_str());
+  *intersink = gst_element_factory_make("intervideosink", ("intersink_" + name).c_str());
+
+  if (!*queue || !*intersink) {
+    GST_ERROR("Rendition \"%s\": can't create the tunnel elements!", name.c_str());
+    gst_object_unref(bin);
+    return NULL;
+  }
+
+  // Owned by the server from here on, it lends the reference to the source pipe while linked
+  gst_object_ref_sink(*queue);
+  gst_object_ref_sink(*intersink);
+  g_object_set(*intersink, "channel", gateway_name.c_str(), NULL);
+
+  GST_INFO("Rendition \"%s\" is built from mount \"%s\"", name.c_str(), mount.c_str());
+
+  return bin;
+}
+
+// Create an element of the same type with the same non-default properties
+GstElement *Rendition::Clone(GstElement *element) {
+  GstElement *copy = gst_element_factory_create(gst_element_get_factory(element), GST_ELEMENT_NAME (element));
+
+  guint n_specs = 0;
+  GParamSpec **specs = g_object_class_list_properties(G_OBJECT_GET_CLASS (element), &n_specs);
+
+  for (guint i = 0; i < n_specs; i++) {
+    GParamSpec *spec = specs[i];
+
+    if (!(spec->flags & G_PARAM_READABLE) || !(spec->flags & G_PARAM_WRITABLE)
+        || (spec->flags & G_PARAM_CONSTRUCT_ONLY)
+        || !g_strcmp0(spec->name, "name") || !g_strcmp0(spec->name, "parent")) {
+      continue;
+    }
+
+    GValue value = G_VALUE_INIT;
+    g_value_init(&value, spec->value_type);
+    g_object_get_property(G_OBJECT (element), spec->name, &value);
+
+    if (!g_param_value_defaults(spec, &value)) {
+      g_object_set_property(G_OBJECT (copy), spec->name, &value);
+    }
+
+    g_value_unset(&value);
+  }
+
+  g_free(specs);
+
+  return copy;
+}
+
+void Rendition::ApplyRequest(GstElement *filter, const RenditionRequest &request) {
+  GstCaps *caps = NULL;
+  g_object_get(filter, "caps", &caps, NULL);
+
+  caps = caps ? gst_caps_make_writable(caps) : gst_caps_new_empty_simple("video/x-raw");
+
+  if (request.width) {
+    gst_caps_set_simple(caps, "width", G_TYPE_INT, request.width, "height", G_TYPE_INT, request.height, NULL);
+  }
+
+  if (request.fps) {
+    gst_caps_set_simple(caps, "framerate", GST_TYPE_FRACTION, request.fps, 1, NULL);
+  }
+
+  GST_DEBUG("Rendition filter \"%s\": %" GST_PTR_FORMAT, GST_ELEMENT_NAME (filter), caps);
+
+  g_object_set(filter, "caps", caps, NULL);
+  gst_caps_unref(caps);
+}
+
+// The element linked to the source pad, or NULL at the end of the chain
+GstElement *Rendition::NextElement(GstElement *element) {
+  GstElement *next = NULL;
+  GstPad *src = gst_element_get_static_pad(element, "src");
+
+  if (src) {
+    GstPad *peer = gst_pad_get_peer(src);
+    if (peer) {
+      next = gst_pad_get_parent_element(peer);
+      gst_object_unref(peer);
+    }
+    gst_object_unref(src);
+  }
+
+  return next;
+}
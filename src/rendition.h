@@ -0,0 +1,43 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <string>
+
+// Parameters of an on-demand rendition asked in the URL query,
+// e.g. rtsp://host:8554/h264?width=640&height=360&fps=15
+
+struct RenditionRequest {
+  gint width = 0;
+  gint height = 0;
+  gint fps = 0;
+
+  // Returns false for unknown keys or out of range values
+  bool Parse(const char *query);
+
+  // Normalized name, the same for every order of the query parameters
+  std::string Name(const std::string &mount) const;
+};
+
+// Builds a rendition as a copy of the mount pipe (rate/scale/encode chain)
+// with its caps filters changed to the requested size and framerate.
+// The copy gets its own tunnel from the source tee, which is returned
+// as the queue and intersink pair to be linked by the server.
+
+class Rendition {
+public:
+
+  static GstElement *Build(GstElement *mount_pipe,
+                           const std::string &mount,
+                           const std::string &name,
+                           const RenditionRequest &request,
+                           GstElement **queue,
+                           GstElement **intersink);
+
+  // Shared with the other builders walking a mount pipe
+  static GstElement *Clone(GstElement *element);
+  static GstElement *NextElement(GstElement *element);
+
+private:
+
+  static void ApplyRequest(GstElement *filter, const RenditionRequest &request);
+};
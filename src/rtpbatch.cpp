@@ -0,0 +1,216 @@
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include "rtpbatch.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_plugin_rtpbatch);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_plugin_rtpbatch       // set as default
+
+#define DEFAULT_MAX_PACKETS 32
+#define DEFAULT_TICK (5 * GST_MSECOND)
+#define DEFAULT_FLUSH_ON_MARKER TRUE
+
+enum {
+  PROP_0,
+  PROP_MAX_PACKETS,
+  PROP_TICK,
+  PROP_FLUSH_ON_MARKER
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE (
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS ("application/x-rtp"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE (
+    "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS ("application/x-rtp"));
+
+G_DEFINE_TYPE (GcfRtpBatch, gcf_rtp_batch, GST_TYPE_ELEMENT);
+
+// Push everything collected so far as one buffer list
+static GstFlowReturn gcf_rtp_batch_flush(GcfRtpBatch *self) {
+  if (gst_buffer_list_length(self->pending) == 0) {
+    return GST_FLOW_OK;
+  }
+
+  GstBufferList *list = self->pending;
+  self->pending = gst_buffer_list_new_sized(self->max_packets);
+  self->first_pts = GST_CLOCK_TIME_NONE;
+
+  GST_LOG_OBJECT (self, "Pushing batch of %u packets", gst_buffer_list_length(list));
+
+  return gst_pad_push_list(self->srcpad, list);
+}
+
+static void gcf_rtp_batch_clear(GcfRtpBatch *self) {
+  gst_buffer_list_unref(self->pending);
+  self->pending = gst_buffer_list_new_sized(self->max_packets);
+  self->first_pts = GST_CLOCK_TIME_NONE;
+}
+
+static gboolean gcf_rtp_batch_has_marker(GstBuffer *buffer) {
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  gboolean marker = FALSE;
+
+  if (gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp)) {
+    marker = gst_rtp_buffer_get_marker(&rtp);
+    gst_rtp_buffer_unmap(&rtp);
+  }
+
+  return marker;
+}
+
+static GstFlowReturn gcf_rtp_batch_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer) {
+  GcfRtpBatch *self = GCF_RTP_BATCH (parent);
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+
+  // The tick is over: send out the previous batch before starting a new one
+  if (GST_CLOCK_TIME_IS_VALID (self->first_pts) && GST_CLOCK_TIME_IS_VALID (pts)
+      && pts >= self->first_pts + self->tick) {
+    ret = gcf_rtp_batch_flush(self);
+  }
+
+  if (gst_buffer_list_length(self->pending) == 0) {
+    self->first_pts = pts;
+  }
+
+  // The end of a frame or a full batch is sent right away
+  gboolean marker = self->flush_on_marker && gcf_rtp_batch_has_marker(buffer);
+  gst_buffer_list_add(self->pending, buffer);
+
+  if (ret == GST_FLOW_OK && (marker || gst_buffer_list_length(self->pending) >= self->max_packets)) {
+    ret = gcf_rtp_batch_flush(self);
+  }
+
+  return ret;
+}
+
+static gboolean gcf_rtp_batch_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+  GcfRtpBatch *self = GCF_RTP_BATCH (parent);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_STOP:
+      gcf_rtp_batch_clear(self);
+      break;
+    default:
+      // Keep the order of data and serialized events
+      if (GST_EVENT_IS_SERIALIZED (event)) {
+        gcf_rtp_batch_flush(self);
+      }
+      break;
+  }
+
+  return gst_pad_event_default(pad, parent, event);
+}
+
+static GstStateChangeReturn gcf_rtp_batch_change_state(GstElement *element, GstStateChange transition) {
+  GcfRtpBatch *self = GCF_RTP_BATCH (element);
+
+  GstStateChangeReturn ret = GST_ELEMENT_CLASS (gcf_rtp_batch_parent_class)->change_state(element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    gcf_rtp_batch_clear(self);
+  }
+
+  return ret;
+}
+
+static void gcf_rtp_batch_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+  GcfRtpBatch *self = GCF_RTP_BATCH (object);
+
+  switch (prop_id) {
+    case PROP_MAX_PACKETS:
+      self->max_packets = g_value_get_uint(value);
+      break;
+    case PROP_TICK:
+      self->tick = g_value_get_uint64(value);
+      break;
+    case PROP_FLUSH_ON_MARKER:
+      self->flush_on_marker = g_value_get_boolean(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gcf_rtp_batch_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+  GcfRtpBatch *self = GCF_RTP_BATCH (object);
+
+  switch (prop_id) {
+    case PROP_MAX_PACKETS:
+      g_value_set_uint(value, self->max_packets);
+      break;
+    case PROP_TICK:
+      g_value_set_uint64(value, self->tick);
+      break;
+    case PROP_FLUSH_ON_MARKER:
+      g_value_set_boolean(value, self->flush_on_marker);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gcf_rtp_batch_finalize(GObject *object) {
+  GcfRtpBatch *self = GCF_RTP_BATCH (object);
+
+  gst_buffer_list_unref(self->pending);
+
+  G_OBJECT_CLASS (gcf_rtp_batch_parent_class)->finalize(object);
+}
+
+static void gcf_rtp_batch_class_init(GcfRtpBatchClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_PLUGIN_RTPBATCH", GST_DEBUG_FG_BLUE, "RTP packet batching"
+  );
+
+  gobject_class->set_property = gcf_rtp_batch_set_property;
+  gobject_class->get_property = gcf_rtp_batch_get_property;
+  gobject_class->finalize = gcf_rtp_batch_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_MAX_PACKETS,
+      g_param_spec_uint("max-packets", "Max packets", "Maximum number of packets in one batch",
+                        1, G_MAXUINT, DEFAULT_MAX_PACKETS,
+                        (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class, PROP_TICK,
+      g_param_spec_uint64("tick", "Tick", "Maximum timestamp span of one batch (ns)",
+                          0, G_MAXUINT64, DEFAULT_TICK,
+                          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class, PROP_FLUSH_ON_MARKER,
+      g_param_spec_boolean("flush-on-marker", "Flush on marker", "Send the batch when a frame is complete",
+                           DEFAULT_FLUSH_ON_MARKER,
+                           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  element_class->change_state = gcf_rtp_batch_change_state;
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+
+  gst_element_class_set_static_metadata(element_class,
+      "RTP batch", "Filter/Network/RTP",
+      "Groups RTP packets into buffer lists for batched sending", "gst-rtsp-app");
+}
+
+static void gcf_rtp_batch_init(GcfRtpBatch *self) {
+  self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+  gst_pad_set_chain_function(self->sinkpad, gcf_rtp_batch_chain);
+  gst_pad_set_event_function(self->sinkpad, gcf_rtp_batch_sink_event);
+  GST_PAD_SET_PROXY_CAPS (self->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION (self->sinkpad);
+  gst_element_add_pad(GST_ELEMENT (self), self->sinkpad);
+
+  self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+  GST_PAD_SET_PROXY_CAPS (self->srcpad);
+  gst_element_add_pad(GST_ELEMENT (self), self->srcpad);
+
+  self->max_packets = DEFAULT_MAX_PACKETS;
+  self->tick = DEFAULT_TICK;
+  self->flush_on_marker = DEFAULT_FLUSH_ON_MARKER;
+  self->pending = gst_buffer_list_new_sized(DEFAULT_MAX_PACKETS);
+  self->first_pts = GST_CLOCK_TIME_NONE;
+}
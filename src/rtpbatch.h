@@ -0,0 +1,31 @@
+#pragma once
+
+#include <gst/gst.h>
+
+// Collects outgoing RTP packets into buffer lists, so the sinks
+// can send a whole batch of packets with one syscall per tick
+
+#define GCF_TYPE_RTP_BATCH (gcf_rtp_batch_get_type ())
+#define GCF_RTP_BATCH(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GCF_TYPE_RTP_BATCH, GcfRtpBatch))
+
+struct GcfRtpBatch {
+  GstElement parent;
+
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  // Packets waiting to be pushed and the timestamp of the first one
+  GstBufferList *pending;
+  GstClockTime first_pts;
+
+  // Properties
+  guint max_packets;
+  GstClockTime tick;
+  gboolean flush_on_marker;
+};
+
+struct GcfRtpBatchClass {
+  GstElementClass parent_class;
+};
+
+GType gcf_rtp_batch_get_type(void);
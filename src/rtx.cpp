@@ -0,0 +1,137 @@
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include "rtx.h"
+#include "metrics.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_rtx);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_rtx       // set as default
+
+RetransmissionMonitor::RetransmissionMonitor(GstRTSPMedia *media, const std::string &mount,
+                                             const MountConfig &config)
+    : media(GST_RTSP_MEDIA (g_object_ref(media))),
+      mount(mount),
+      config(config),
+      senders(NULL),
+      rtx_bytes(0),
+      reported_bytes(0) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_RTX", GST_DEBUG_FG_GREEN, "RTP retransmission"
+  );
+
+  // Every stream gets its own retransmission payload type
+  for (guint i = 0; i < gst_rtsp_media_n_streams(media); i++) {
+    gst_rtsp_stream_set_retransmission_pt(gst_rtsp_media_get_stream(media, i), config.rtx_pt + i);
+  }
+
+  // The senders are created by the streams while the media is prepared
+  prepared_handler = g_signal_connect(media, "prepared", G_CALLBACK(Prepared), this);
+  poll_source = g_timeout_add_seconds(RTX_POLL_INTERVAL, Poll, this);
+}
+
+RetransmissionMonitor::~RetransmissionMonitor() {
+  g_source_remove(poll_source);
+  g_signal_handler_disconnect(media, prepared_handler);
+  g_list_free_full(senders, gst_object_unref);
+  Metrics::Remove("rtx." + mount + ".");
+  g_object_unref(media);
+}
+
+void RetransmissionMonitor::Prepared(GstRTSPMedia *media, gpointer user_data) {
+  RetransmissionMonitor *self = static_cast<RetransmissionMonitor *>(user_data);
+  GstElement *element = gst_rtsp_media_get_element(media);
+  GstElement *pipeline = GST_ELEMENT (gst_element_get_parent(element));
+  gst_object_unref(element);
+
+  if (!pipeline) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(self->lock);
+
+  // The reusable media keeps its senders between preparations
+  g_list_free_full(self->senders, gst_object_unref);
+  self->senders = NULL;
+
+  GstIterator *itr = gst_bin_iterate_recurse(GST_BIN (pipeline));
+  GValue item = G_VALUE_INIT;
+
+  while (gst_iterator_next(itr, &item) == GST_ITERATOR_OK) {
+    GstElement *sender = GST_ELEMENT (g_value_get_object(&item));
+    GstElementFactory *factory = gst_element_get_factory(sender);
+
+    if (factory && !g_strcmp0(GST_OBJECT_NAME (factory), "rtprtxsend")) {
+      g_object_set(sender,
+                   "max-size-time", self->config.rtx_time_ms,
+                   "max-size-packets", self->config.rtx_packets,
+                   NULL);
+
+      // Counted once, however often the media is prepared again
+      GstPad *src = gst_element_get_static_pad(sender, "src");
+      if (!g_object_get_data(G_OBJECT (src), "gcf-rtx-probe")) {
+        g_object_set_data(G_OBJECT (src), "gcf-rtx-probe", GINT_TO_POINTER (TRUE));
+        gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BUFFER, CountRetransmission, self, NULL);
+      }
+      gst_object_unref(src);
+
+      self->senders = g_list_prepend(self->senders, gst_object_ref(sender));
+
+      GST_INFO("Retransmission of \"%s\": %u ms, %u packets of history",
+               self->mount.c_str(), self->config.rtx_time_ms, self->config.rtx_packets);
+    }
+
+    g_value_reset(&item);
+  }
+
+  g_value_unset(&item);
+  gst_iterator_free(itr);
+  gst_object_unref(pipeline);
+}
+
+GstPadProbeReturn RetransmissionMonitor::CountRetransmission(GstPad *pad, GstPadProbeInfo *info,
+                                                             gpointer user_data) {
+  RetransmissionMonitor *self = static_cast<RetransmissionMonitor *>(user_data);
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  // Retransmitted packets are sent with the payload types above the configured base
+  if (gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp)) {
+    guint pt = gst_rtp_buffer_get_payload_type(&rtp);
+    gst_rtp_buffer_unmap(&rtp);
+
+    if (pt >= self->config.rtx_pt && pt < self->config.rtx_pt + gst_rtsp_media_n_streams(self->media)) {
+      self->rtx_bytes += gst_buffer_get_size(buffer);
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+gboolean RetransmissionMonitor::Poll(gpointer user_data) {
+  RetransmissionMonitor *self = static_cast<RetransmissionMonitor *>(user_data);
+  guint requests = 0, packets = 0;
+
+  std::unique_lock<std::mutex> guard(self->lock);
+  for (GList *sender = self->senders; sender; sender = sender->next) {
+    guint sender_requests = 0, sender_packets = 0;
+    g_object_get(sender->data,
+                 "num-rtx-requests", &sender_requests,
+                 "num-rtx-packets", &sender_packets,
+                 NULL);
+    requests += sender_requests;
+    packets += sender_packets;
+  }
+  guard.unlock();
+
+  guint64 bytes = self->rtx_bytes;
+  auto prefix = "rtx." + self->mount + ".";
+
+  Metrics::Set(prefix + "requests", requests);
+  Metrics::Set(prefix + "packets", packets);
+  Metrics::Set(prefix + "bytes", bytes);
+  Metrics::Set(prefix + "kbps", (bytes - self->reported_bytes) * 8 / 1000 / RTX_POLL_INTERVAL);
+
+  self->reported_bytes = bytes;
+
+  return TRUE;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <gst/rtsp-server/rtsp-server.h>
+#include <string>
+#include <atomic>
+#include <mutex>
+
+#include "mount.h"
+
+#define RTX_POLL_INTERVAL 1 // seconds
+
+// Configures the retransmission senders of a mount once the media is prepared
+// and exports how many retransmissions were requested and what they cost.
+
+class RetransmissionMonitor {
+public:
+
+  RetransmissionMonitor(GstRTSPMedia *media, const std::string &mount, const MountConfig &config);
+  ~RetransmissionMonitor();
+
+private:
+
+  static void Prepared(GstRTSPMedia *media, gpointer user_data);
+  static GstPadProbeReturn CountRetransmission(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+  static gboolean Poll(gpointer user_data);
+
+  GstRTSPMedia *media;
+  std::string mount;
+  MountConfig config;
+  guint poll_source;
+  gulong prepared_handler;
+
+  // Senders are found from the media thread, bytes are counted by the streaming threads
+  std::mutex lock;
+  GList *senders;
+  std::atomic<guint64> rtx_bytes;
+  guint64 reported_bytes;
+};
@@ -0,0 +1,239 @@
+#include "scaleconvert.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_plugin_scaleconvert);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_plugin_scaleconvert       // set as default
+
+#define SCALE_CONVERT_CAPS GST_VIDEO_CAPS_MAKE (GST_VIDEO_FORMATS_ALL)
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE (
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS (SCALE_CONVERT_CAPS));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE (
+    "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS (SCALE_CONVERT_CAPS));
+
+G_DEFINE_TYPE (GcfScaleConvert, gcf_scale_convert, GST_TYPE_VIDEO_FILTER);
+
+static void gcf_scale_convert_free(GcfScaleConvert *self) {
+  for (guint i = 0; i < self->n_scalers; i++) {
+    delete self->scalers[i];
+    self->scalers[i] = NULL;
+  }
+  self->n_scalers = 0;
+
+  if (self->converter) {
+    gst_video_converter_free(self->converter);
+    self->converter = NULL;
+  }
+}
+
+// Size, format and the fields depending on the format are left open
+static GstCaps *gcf_scale_convert_transform_caps(GstBaseTransform *trans, GstPadDirection direction,
+                                                 GstCaps *caps, GstCaps *filter) {
+  GstCaps *result = gst_caps_new_empty();
+
+  for (guint i = 0; i < gst_caps_get_size(caps); i++) {
+    GstStructure *structure = gst_caps_get_structure(caps, i);
+    GstCapsFeatures *features = gst_caps_get_features(caps, i);
+
+    if (i > 0 && gst_caps_is_subset_structure_full(result, structure, features)) {
+      continue;
+    }
+
+    structure = gst_structure_copy(structure);
+    if (!gst_caps_features_is_any(features)
+        && gst_caps_features_is_equal(features, GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY)) {
+      gst_structure_set(structure,
+                        "width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+                        "height", GST_TYPE_INT_RANGE, 1, G_MAXINT, NULL);
+      gst_structure_remove_fields(structure, "format", "colorimetry", "chroma-site", "pixel-aspect-ratio", NULL);
+    }
+
+    gst_caps_append_structure_full(result, structure, gst_caps_features_copy(features));
+  }
+
+  if (filter) {
+    GstCaps *intersection = gst_caps_intersect_full(filter, result, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref(result);
+    result = intersection;
+  }
+
+  GST_DEBUG_OBJECT (trans, "%" GST_PTR_FORMAT " => %" GST_PTR_FORMAT, caps, result);
+
+  return result;
+}
+
+// Whatever downstream leaves open is kept as it comes in
+static GstCaps *gcf_scale_convert_fixate_caps(GstBaseTransform *trans, GstPadDirection direction,
+                                              GstCaps *caps, GstCaps *othercaps) {
+  othercaps = gst_caps_make_writable(gst_caps_truncate(othercaps));
+
+  GstStructure *in = gst_caps_get_structure(caps, 0);
+  GstStructure *out = gst_caps_get_structure(othercaps, 0);
+  gint value, denominator;
+  const gchar *string;
+
+  if (gst_structure_get_int(in, "width", &value)) {
+    gst_structure_fixate_field_nearest_int(out, "width", value);
+  }
+  if (gst_structure_get_int(in, "height", &value)) {
+    gst_structure_fixate_field_nearest_int(out, "height", value);
+  }
+  if (gst_structure_get_fraction(in, "pixel-aspect-ratio", &value, &denominator)) {
+    gst_structure_fixate_field_nearest_fraction(out, "pixel-aspect-ratio", value, denominator);
+  }
+
+  const gchar *fields[] = {"format", "colorimetry", "chroma-site"};
+  for (const gchar *field : fields) {
+    if ((string = gst_structure_get_string(in, field))) {
+      gst_structure_fixate_field_string(out, field, string);
+    }
+  }
+
+  return gst_caps_fixate(othercaps);
+}
+
+static gboolean gcf_scale_convert_is_fast(const GstVideoInfo *in_info, const GstVideoInfo *out_info) {
+  switch (GST_VIDEO_INFO_FORMAT (in_info)) {
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_YV12:
+    case GST_VIDEO_FORMAT_NV12:
+    case GST_VIDEO_FORMAT_NV21:
+      break;
+    default:
+      return FALSE;
+  }
+
+  if (GST_VIDEO_INFO_FORMAT (out_info) != GST_VIDEO_FORMAT_I420
+      && GST_VIDEO_INFO_FORMAT (out_info) != GST_VIDEO_FORMAT_YV12) {
+    return FALSE;
+  }
+
+  // Same matrix on both sides, and room for two taps on every plane
+  return gst_video_colorimetry_is_equal(&in_info->colorimetry, &out_info->colorimetry)
+      && GST_VIDEO_INFO_COMP_WIDTH (in_info, 1) >= 2 && GST_VIDEO_INFO_COMP_HEIGHT (in_info, 1) >= 2
+      && GST_VIDEO_INFO_COMP_WIDTH (out_info, 1) >= 1 && GST_VIDEO_INFO_COMP_HEIGHT (out_info, 1) >= 1;
+}
+
+static gboolean gcf_scale_convert_set_info(GstVideoFilter *filter, GstCaps *incaps, GstVideoInfo *in_info,
+                                           GstCaps *outcaps, GstVideoInfo *out_info) {
+  GcfScaleConvert *self = GCF_SCALE_CONVERT (filter);
+
+  gcf_scale_convert_free(self);
+
+  if (!gcf_scale_convert_is_fast(in_info, out_info)) {
+    self->converter = gst_video_converter_new(in_info, out_info, NULL);
+    GST_INFO_OBJECT (self, "%s %dx%d => %s %dx%d with the video converter",
+                     GST_VIDEO_INFO_NAME (in_info), GST_VIDEO_INFO_WIDTH (in_info), GST_VIDEO_INFO_HEIGHT (in_info),
+                     GST_VIDEO_INFO_NAME (out_info), GST_VIDEO_INFO_WIDTH (out_info), GST_VIDEO_INFO_HEIGHT (out_info));
+    return self->converter != NULL;
+  }
+
+  // Interleaved chroma is one plane with two components
+  guint chroma_components = GST_VIDEO_INFO_N_PLANES (in_info) == 2 ? 2 : 1;
+
+  self->scalers[self->n_scalers++] = new PlaneScaler(
+      GST_VIDEO_INFO_COMP_WIDTH (in_info, 0), GST_VIDEO_INFO_COMP_HEIGHT (in_info, 0), 1,
+      GST_VIDEO_INFO_COMP_WIDTH (out_info, 0), GST_VIDEO_INFO_COMP_HEIGHT (out_info, 0));
+
+  for (guint c = 1; c < GST_VIDEO_INFO_N_COMPONENTS (in_info); c += chroma_components) {
+    self->scalers[self->n_scalers++] = new PlaneScaler(
+        GST_VIDEO_INFO_COMP_WIDTH (in_info, c), GST_VIDEO_INFO_COMP_HEIGHT (in_info, c), chroma_components,
+        GST_VIDEO_INFO_COMP_WIDTH (out_info, c), GST_VIDEO_INFO_COMP_HEIGHT (out_info, c));
+  }
+
+  GST_INFO_OBJECT (self, "%s %dx%d => %s %dx%d in one pass, %s rows",
+                   GST_VIDEO_INFO_NAME (in_info), GST_VIDEO_INFO_WIDTH (in_info), GST_VIDEO_INFO_HEIGHT (in_info),
+                   GST_VIDEO_INFO_NAME (out_info), GST_VIDEO_INFO_WIDTH (out_info), GST_VIDEO_INFO_HEIGHT (out_info),
+                   ScaleBlendRowName());
+
+  return TRUE;
+}
+
+static GstFlowReturn gcf_scale_convert_transform_frame(GstVideoFilter *filter, GstVideoFrame *in_frame,
+                                                       GstVideoFrame *out_frame) {
+  GcfScaleConvert *self = GCF_SCALE_CONVERT (filter);
+
+  if (self->converter) {
+    gst_video_converter_frame(self->converter, in_frame, out_frame);
+    return GST_FLOW_OK;
+  }
+
+  guint8 *planes[2];
+  gsize strides[2];
+
+  planes[0] = (guint8 *) GST_VIDEO_FRAME_COMP_DATA (out_frame, 0);
+  strides[0] = GST_VIDEO_FRAME_COMP_STRIDE (out_frame, 0);
+  self->scalers[0]->Scale((const guint8 *) GST_VIDEO_FRAME_COMP_DATA (in_frame, 0),
+                          GST_VIDEO_FRAME_COMP_STRIDE (in_frame, 0), planes, strides);
+
+  const guint8 *u = (const guint8 *) GST_VIDEO_FRAME_COMP_DATA (in_frame, 1);
+  const guint8 *v = (const guint8 *) GST_VIDEO_FRAME_COMP_DATA (in_frame, 2);
+
+  if (self->n_scalers == 2) {
+    // NV12 starts the pairs with U, NV21 with V
+    gboolean u_first = u < v;
+    planes[0] = (guint8 *) GST_VIDEO_FRAME_COMP_DATA (out_frame, u_first ? 1 : 2);
+    planes[1] = (guint8 *) GST_VIDEO_FRAME_COMP_DATA (out_frame, u_first ? 2 : 1);
+    strides[0] = GST_VIDEO_FRAME_COMP_STRIDE (out_frame, 1);
+    strides[1] = GST_VIDEO_FRAME_COMP_STRIDE (out_frame, 2);
+    self->scalers[1]->Scale(u_first ? u : v, GST_VIDEO_FRAME_COMP_STRIDE (in_frame, 1), planes, strides);
+    return GST_FLOW_OK;
+  }
+
+  for (guint c = 1; c <= 2; c++) {
+    planes[0] = (guint8 *) GST_VIDEO_FRAME_COMP_DATA (out_frame, c);
+    strides[0] = GST_VIDEO_FRAME_COMP_STRIDE (out_frame, c);
+    self->scalers[c]->Scale((const guint8 *) GST_VIDEO_FRAME_COMP_DATA (in_frame, c),
+                            GST_VIDEO_FRAME_COMP_STRIDE (in_frame, c), planes, strides);
+  }
+
+  return GST_FLOW_OK;
+}
+
+static gboolean gcf_scale_convert_stop(GstBaseTransform *trans) {
+  gcf_scale_convert_free(GCF_SCALE_CONVERT (trans));
+
+  return TRUE;
+}
+
+static void gcf_scale_convert_finalize(GObject *object) {
+  gcf_scale_convert_free(GCF_SCALE_CONVERT (object));
+
+  G_OBJECT_CLASS (gcf_scale_convert_parent_class)->finalize(object);
+}
+
+static void gcf_scale_convert_class_init(GcfScaleConvertClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+  GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_PLUGIN_SCALECONVERT", GST_DEBUG_FG_BLUE, "Fused scaler and converter"
+  );
+
+  gobject_class->finalize = gcf_scale_convert_finalize;
+
+  transform_class->transform_caps = gcf_scale_convert_transform_caps;
+  transform_class->fixate_caps = gcf_scale_convert_fixate_caps;
+  transform_class->stop = gcf_scale_convert_stop;
+  transform_class->passthrough_on_same_caps = TRUE;
+
+  filter_class->set_info = gcf_scale_convert_set_info;
+  filter_class->transform_frame = gcf_scale_convert_transform_frame;
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+
+  gst_element_class_set_static_metadata(element_class,
+      "Scaler and converter", "Filter/Converter/Video/Scaler",
+      "Scales and converts raw video in one pass", "gst-rtsp-app");
+}
+
+static void gcf_scale_convert_init(GcfScaleConvert *self) {
+  for (guint i = 0; i < G_N_ELEMENTS (self->scalers); i++) {
+    self->scalers[i] = NULL;
+  }
+  self->n_scalers = 0;
+  self->converter = NULL;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+
+#include "scalekernels.h"
+
+// videoscale and videoconvert in one element. I420, YV12, NV12 and NV21
+// sources are scaled into I420 or YV12 in a single pass over the frame;
+// everything else goes through a GstVideoConverter, which also scales and
+// converts at once. The topology swaps it in for plain scale/convert pairs.
+
+#define GCF_TYPE_SCALE_CONVERT (gcf_scale_convert_get_type ())
+#define GCF_SCALE_CONVERT(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GCF_TYPE_SCALE_CONVERT, GcfScaleConvert))
+
+struct GcfScaleConvert {
+  GstVideoFilter parent;
+
+  // Fast path: one scaler for the luma and one per chroma plane
+  PlaneScaler *scalers[3];
+  guint n_scalers;
+
+  // Every other format
+  GstVideoConverter *converter;
+};
+
+struct GcfScaleConvertClass {
+  GstVideoFilterClass parent_class;
+};
+
+GType gcf_scale_convert_get_type(void);
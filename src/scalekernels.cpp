@@ -0,0 +1,206 @@
+#include "scalekernels.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCALE_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define SCALE_NEON
+#include <arm_neon.h>
+#endif
+
+#define SCALE_FIXED_BITS 16
+
+static void ScaleBlendRowScalar(const uint8_t *top, const uint8_t *bottom, uint8_t *out, size_t size,
+                                unsigned weight) {
+  unsigned inverse = SCALE_WEIGHT_ONE - weight;
+
+  for (size_t i = 0; i < size; i++) {
+    out[i] = (uint8_t) ((top[i] * inverse + bottom[i] * weight + SCALE_WEIGHT_ONE / 2) >> SCALE_WEIGHT_BITS);
+  }
+}
+
+#ifdef SCALE_X86
+
+__attribute__((target("sse2")))
+static void ScaleBlendRowSse2(const uint8_t *top, const uint8_t *bottom, uint8_t *out, size_t size,
+                              unsigned weight) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i w_bottom = _mm_set1_epi16((short) weight);
+  const __m128i w_top = _mm_set1_epi16((short) (SCALE_WEIGHT_ONE - weight));
+  const __m128i round = _mm_set1_epi16(SCALE_WEIGHT_ONE / 2);
+  size_t i = 0;
+
+  for (; i + 16 <= size; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *) (top + i));
+    __m128i b = _mm_loadu_si128((const __m128i *) (bottom + i));
+
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w_top),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w_bottom));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w_top),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w_bottom));
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, round), SCALE_WEIGHT_BITS);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, round), SCALE_WEIGHT_BITS);
+
+    _mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(lo, hi));
+  }
+
+  ScaleBlendRowScalar(top + i, bottom + i, out + i, size - i, weight);
+}
+
+// Unpack and pack both work within the 128 bit lanes, so the order is kept
+__attribute__((target("avx2")))
+static void ScaleBlendRowAvx2(const uint8_t *top, const uint8_t *bottom, uint8_t *out, size_t size,
+                              unsigned weight) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i w_bottom = _mm256_set1_epi16((short) weight);
+  const __m256i w_top = _mm256_set1_epi16((short) (SCALE_WEIGHT_ONE - weight));
+  const __m256i round = _mm256_set1_epi16(SCALE_WEIGHT_ONE / 2);
+  size_t i = 0;
+
+  for (; i + 32 <= size; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) (top + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *) (bottom + i));
+
+    __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), w_top),
+                                  _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), w_bottom));
+    __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), w_top),
+                                  _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), w_bottom));
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), SCALE_WEIGHT_BITS);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), SCALE_WEIGHT_BITS);
+
+    _mm256_storeu_si256((__m256i *) (out + i), _mm256_packus_epi16(lo, hi));
+  }
+
+  ScaleBlendRowSse2(top + i, bottom + i, out + i, size - i, weight);
+}
+
+#endif
+
+#ifdef SCALE_NEON
+
+static void ScaleBlendRowNeon(const uint8_t *top, const uint8_t *bottom, uint8_t *out, size_t size,
+                              unsigned weight) {
+  const uint8x8_t w_bottom = vdup_n_u8((uint8_t) weight);
+  const uint8x8_t w_top = vdup_n_u8((uint8_t) (SCALE_WEIGHT_ONE - weight));
+  size_t i = 0;
+
+  for (; i + 16 <= size; i += 16) {
+    uint8x16_t a = vld1q_u8(top + i);
+    uint8x16_t b = vld1q_u8(bottom + i);
+
+    uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), w_top), vget_low_u8(b), w_bottom);
+    uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(a), w_top), vget_high_u8(b), w_bottom);
+
+    vst1q_u8(out + i, vcombine_u8(vrshrn_n_u16(lo, SCALE_WEIGHT_BITS), vrshrn_n_u16(hi, SCALE_WEIGHT_BITS)));
+  }
+
+  ScaleBlendRowScalar(top + i, bottom + i, out + i, size - i, weight);
+}
+
+#endif
+
+struct ScaleBlendRowVariant {
+  ScaleBlendRowFunc func;
+  const char *name;
+};
+
+static ScaleBlendRowVariant ScaleBlendRowSelect() {
+#ifdef SCALE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {ScaleBlendRowAvx2, "avx2"};
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return {ScaleBlendRowSse2, "sse2"};
+  }
+#endif
+#ifdef SCALE_NEON
+  return {ScaleBlendRowNeon, "neon"};
+#endif
+  return {ScaleBlendRowScalar, "scalar"};
+}
+
+// Picked once, the CPU does not change while running
+static const ScaleBlendRowVariant &ScaleBlendRowVariantGet() {
+  static const ScaleBlendRowVariant variant = ScaleBlendRowSelect();
+  return variant;
+}
+
+ScaleBlendRowFunc ScaleBlendRow() {
+  return ScaleBlendRowVariantGet().func;
+}
+
+const char *ScaleBlendRowName() {
+  return ScaleBlendRowVariantGet().name;
+}
+
+// Pixel centers are mapped onto each other; the last source pixel is
+// reached as the second tap with full weight, so no tap reads past it
+static void ScaleTaps(size_t src_size, size_t dst_size, std::vector<uint32_t> &index, std::vector<uint8_t> &weight) {
+  index.resize(dst_size);
+  weight.resize(dst_size);
+
+  int64_t step = ((int64_t) src_size << SCALE_FIXED_BITS) / dst_size;
+  int64_t position = step / 2 - (1 << (SCALE_FIXED_BITS - 1));
+
+  for (size_t i = 0; i < dst_size; i++, position += step) {
+    int64_t clamped = position < 0 ? 0 : position;
+    int64_t first = clamped >> SCALE_FIXED_BITS;
+    unsigned fraction = (unsigned) ((clamped >> (SCALE_FIXED_BITS - SCALE_WEIGHT_BITS)) & (SCALE_WEIGHT_ONE - 1));
+
+    if (first >= (int64_t) src_size - 1) {
+      first = src_size - 2;
+      fraction = SCALE_WEIGHT_ONE;
+    }
+
+    index[i] = (uint32_t) first;
+    weight[i] = (uint8_t) fraction;
+  }
+}
+
+PlaneScaler::PlaneScaler(size_t src_width, size_t src_height, size_t components, size_t dst_width,
+                         size_t dst_height)
+    : components(components),
+      src_width(src_width),
+      dst_width(dst_width),
+      dst_height(dst_height),
+      row(src_width * components),
+      blend(ScaleBlendRow()) {
+
+  ScaleTaps(src_width, dst_width, x_index, x_weight);
+  ScaleTaps(src_height, dst_height, y_index, y_weight);
+}
+
+void PlaneScaler::Scale(const uint8_t *src, size_t src_stride, uint8_t *const *dst, const size_t *dst_stride) {
+  size_t row_size = src_width * components;
+
+  for (size_t y = 0; y < dst_height; y++) {
+    const uint8_t *top = src + y_index[y] * src_stride;
+
+    // Rows that fall on a source row are read in place
+    const uint8_t *line = top;
+    if (y_weight[y]) {
+      blend(top, top + src_stride, row.data(), row_size, y_weight[y]);
+      line = row.data();
+    }
+
+    for (size_t c = 0; c < components; c++) {
+      uint8_t *out = dst[c] + y * dst_stride[c];
+
+      if (components == 1 && dst_width == src_width) {
+        memcpy(out, line, dst_width);
+        continue;
+      }
+
+      for (size_t x = 0; x < dst_width; x++) {
+        const uint8_t *tap = line + x_index[x] * components + c;
+        unsigned weight = x_weight[x];
+
+        out[x] = (uint8_t) ((tap[0] * (SCALE_WEIGHT_ONE - weight) + tap[components] * weight
+            + SCALE_WEIGHT_ONE / 2) >> SCALE_WEIGHT_BITS);
+      }
+    }
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bilinear scaling of one 8 bit plane in a single pass over the source:
+// every output row blends its two source rows into a cached row buffer,
+// then the horizontal taps read from that buffer. A plane of interleaved
+// components (the UV plane of NV12) is split into separate planes on the
+// way, so scaling and the 4:2:0 layout conversion share the pass. Needs
+// no GStreamer, so the benchmark can link it alone.
+
+#define SCALE_WEIGHT_BITS 7
+#define SCALE_WEIGHT_ONE (1 << SCALE_WEIGHT_BITS)
+
+// out = (top * (ONE - weight) + bottom * weight) / ONE, weight <= ONE
+typedef void (*ScaleBlendRowFunc)(const uint8_t *top, const uint8_t *bottom, uint8_t *out, size_t size,
+                                  unsigned weight);
+
+// Fastest variant the CPU supports: AVX2, SSE2, NEON or plain C
+ScaleBlendRowFunc ScaleBlendRow();
+const char *ScaleBlendRowName();
+
+class PlaneScaler {
+public:
+
+  // Both sizes need at least 2x2 pixels
+  PlaneScaler(size_t src_width, size_t src_height, size_t components, size_t dst_width, size_t dst_height);
+
+  // dst holds one plane per component, in the order they are interleaved
+  void Scale(const uint8_t *src, size_t src_stride, uint8_t *const *dst, const size_t *dst_stride);
+
+private:
+
+  size_t components;
+  size_t src_width;
+  size_t dst_width;
+  size_t dst_height;
+
+  // First source pixel/row of every output one, and the weight of the next
+  std::vector<uint32_t> x_index;
+  std::vector<uint8_t> x_weight;
+  std::vector<uint32_t> y_index;
+  std::vector<uint8_t> y_weight;
+
+  std::vector<uint8_t> row;
+  ScaleBlendRowFunc blend;
+};
@@ -1,8 +1,26 @@
 #include <gst/rtsp-server/rtsp-media-factory.h>
+#include <gst/app/gstappsrc.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <stdlib.h>
 #include <cstdio>
 
 #include "server.h"
+#include "clientqueue.h"
+#include "abr.h"
+#include "rtx.h"
+#include "rendition.h"
+#include "sharedencoder.h"
+#include "hls.h"
+#include "http.h"
+#include "recorder.h"
+#include "timeshift.h"
+#include "streamexport.h"
+#include "workerfeed.h"
+#include "optimizer.h"
+#include "governor.h"
+#include "instances.h"
+#include "logger.h"
 
 #define GST_CAT_DEFAULT log_app_rtsp
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -23,25 +41,95 @@ std::map<std::string, GstRTSPMedia *> RtspServer::medias = std::map<std::string,
 std::map<std::string, GstElement *> RtspServer::intersinks = std::map<std::string, GstElement *>();
 std::map<std::string, GstElement *> RtspServer::queues = std::map<std::string, GstElement *>();
 std::map<std::string, bool> RtspServer::rtsp_active = std::map<std::string, bool>();
-GstElement* RtspServer::TODO_tee = NULL;
-GstElement* RtspServer::TODO_pipe = NULL;
-
-RtspServer::RtspServer() {
+std::map<std::string, MountConfig> RtspServer::mount_configs = std::map<std::string, MountConfig>();
+std::map<std::string, BitrateController*> RtspServer::abr_controllers = std::map<std::string, BitrateController*>();
+std::map<std::string, RetransmissionMonitor*> RtspServer::rtx_monitors = std::map<std::string, RetransmissionMonitor*>();
+std::map<std::string, GstElement *> RtspServer::source_tees = std::map<std::string, GstElement *>();
+std::map<std::string, GstElement *> RtspServer::source_pipes = std::map<std::string, GstElement *>();
+std::map<std::string, std::string> RtspServer::renditions = std::map<std::string, std::string>();
+std::map<std::string, std::string> RtspServer::layers = std::map<std::string, std::string>();
+std::map<std::string, SharedEncoder*> RtspServer::shared_encoders = std::map<std::string, SharedEncoder*>();
+std::map<std::string, TimeshiftRing*> RtspServer::timeshift_rings = std::map<std::string, TimeshiftRing*>();
+std::map<std::string, TimeshiftReader*> RtspServer::timeshift_readers = std::map<std::string, TimeshiftReader*>();
+std::map<std::string, WorkerFeed*> RtspServer::worker_feeds = std::map<std::string, WorkerFeed*>();
+std::map<std::string, std::string> RtspServer::worker_streams = std::map<std::string, std::string>();
+RtspServerMode RtspServer::mode = RTSP_MODE_SINGLE;
+
+RtspServer::RtspServer(RtspServerMode mode) {
 
   GST_DEBUG_CATEGORY_INIT (log_app_rtsp, "GCF_APP_RTSP",
                            GST_DEBUG_FG_CYAN, "RTSP Server");
 
+  RtspServer::mode = mode;
+
   gst_rtsp_server = gst_rtsp_server_new();
   gst_rtsp_server_set_service(gst_rtsp_server, "8554");
   gst_rtsp_server_source = 0;
+  listen_socket = NULL;
+  http_server = NULL;
 
   // add a timeout for the session cleanup
   g_timeout_add_seconds(2, (GSourceFunc) SessionPoolTimeout, gst_rtsp_server);
+
+  // watch the clients for the transport they choose
+  g_signal_connect(gst_rtsp_server, "client-connected", G_CALLBACK(ClientConnected), NULL);
 }
 
 RtspServer::~RtspServer() {
   GST_INFO("Stop RTSP Server");
-  g_source_remove(gst_rtsp_server_source);
+
+  for (auto &controller : abr_controllers) {
+    delete controller.second;
+  }
+  abr_controllers.clear();
+
+  for (auto &monitor : rtx_monitors) {
+    delete monitor.second;
+  }
+  rtx_monitors.clear();
+
+  for (auto &recorder : recorders) {
+    StopRecording(recorder.first);
+    delete recorder.second;
+  }
+
+  delete http_server;
+
+  for (auto &encoder : shared_encoders) {
+    delete encoder.second;
+  }
+  shared_encoders.clear();
+
+  for (auto &packager : hls_packagers) {
+    delete packager.second;
+  }
+
+  for (auto &stream_export : stream_exports) {
+    delete stream_export.second;
+  }
+
+  for (auto &feed : worker_feeds) {
+    delete feed.second;
+  }
+  worker_feeds.clear();
+
+  for (auto &reader : timeshift_readers) {
+    delete reader.second;
+  }
+  timeshift_readers.clear();
+
+  for (auto &ring : timeshift_rings) {
+    MemoryGovernor::RemoveCache("timeshift_" + ring.first);
+    delete ring.second;
+  }
+  timeshift_rings.clear();
+
+  if (gst_rtsp_server_source) {
+    g_source_remove(gst_rtsp_server_source);
+  }
+  if (listen_socket) {
+    g_object_unref(listen_socket);
+  }
   g_object_unref(gst_rtsp_server);
 }
 
@@ -52,10 +140,48 @@ RtspServer::Start() {
 
   GST_INFO("RTSP Server init...");
 
-  gst_rtsp_server_source = gst_rtsp_server_attach(gst_rtsp_server, NULL);
-  if (gst_rtsp_server_source == 0) {
-    GST_ERROR("Failed to attach the server!");
-    return FALSE;
+  // The workers serve the clients, only the outputs without clients stay here
+  if (mode == RTSP_MODE_CAPTURE) {
+    StartExport();
+  } else if (mode == RTSP_MODE_WORKER) {
+    if (!AttachReusePort()) {
+      return FALSE;
+    }
+
+    for (const auto &pipe : rtsp_pipes) {
+      worker_feeds[pipe.first] = new WorkerFeed(pipe.first);
+    }
+
+    return TRUE;
+  } else {
+    // The socket is kept, so it can be handed to the next process
+    GError *error = NULL;
+    if (!listen_socket) {
+      listen_socket = gst_rtsp_server_create_socket(gst_rtsp_server, NULL, &error);
+    }
+
+    GSource *source = listen_socket ? gst_rtsp_server_create_source(gst_rtsp_server, listen_socket, NULL, &error)
+                                    : NULL;
+    if (!source) {
+      GST_ERROR("Failed to attach the server: %s", error ? error->message : "no socket");
+      g_clear_error(&error);
+      return FALSE;
+    }
+
+    gst_rtsp_server_source = g_source_attach(source, NULL);
+    g_source_unref(source);
+  }
+
+  StartHls();
+  StartTimeshift();
+
+  for (const auto &config : mount_configs) {
+    if (config.second.record) {
+      recorders[config.first] = new Recorder(config.first, config.second);
+      if (config.second.record_autostart) {
+        StartRecording(config.first);
+      }
+    }
   }
 /*
   GST_DEBUG("Destroying RTSP Pipe connector elements");
@@ -89,16 +215,24 @@ gboolean RtspServer::RegisterRtspPipes(const std::map<std::string, GstElement *>
     // Set this shitty pipeline to shared between all the fucked up clients so they won't mess up the driver's state
     gst_rtsp_media_factory_set_shared(factory, TRUE);
 
+    // Retransmission needs the feedback profile, but plain clients are still welcome
+    auto config = mount_configs.find(pipe_name);
+    if (config != mount_configs.end() && config->second.rtx) {
+      gst_rtsp_media_factory_set_retransmission_time(factory, config->second.rtx_time_ms * GST_MSECOND);
+      gst_rtsp_media_factory_set_profiles(factory, (GstRTSPProfile) (GST_RTSP_PROFILE_AVP | GST_RTSP_PROFILE_AVPF));
+    }
+
     // attach the test factory to the /testN url
     gst_rtsp_mount_points_add_factory(mount, std::string('/' + pipe_name).c_str(), factory);
 
     // don't need the ref to the mapper anymore
     g_object_unref(mount);
 
-    GST_INFO("Pipe is available at %s:%s/%s",
-             gst_rtsp_server_get_address(gst_rtsp_server),
-             gst_rtsp_server_get_service(gst_rtsp_server),
-             pipe_name.c_str());
+    gchar *address = gst_rtsp_server_get_address(gst_rtsp_server);
+    gchar *service = gst_rtsp_server_get_service(gst_rtsp_server);
+    GST_INFO("Pipe is available at %s:%s/%s", address, service, pipe_name.c_str());
+    g_free(address);
+    g_free(service);
 
     // Savce a reference so server will be able to recall
     rtsp_pipes[pipe_name] = iter->second;
@@ -107,50 +241,682 @@ gboolean RtspServer::RegisterRtspPipes(const std::map<std::string, GstElement *>
   return TRUE;
 }
 
+// The HTTP outputs run all the time, so their encoders are started right away
+void
+RtspServer::StartHls() {
+  for (const auto &config : mount_configs) {
+    if (!config.second.hls) {
+      continue;
+    }
+
+    SharedEncoder *encoder = GetSharedEncoder(config.first);
+    if (!encoder) {
+      GST_ERROR("No HLS output for \"%s\": the encoder can't be shared!", config.first.c_str());
+      continue;
+    }
+
+    if (!http_server) {
+      http_server = new HttpServer();
+      if (!http_server->Start()) {
+        return;
+      }
+    }
+
+    HlsPackager *packager = new HlsPackager(config.first, config.second);
+    hls_packagers[config.first] = packager;
+    http_server->AddOutput(config.first, packager);
+
+    if (encoder->AddListener(HlsPackager::Push, packager)) {
+      LinkToSource(encoder->Name());
+    }
+  }
+}
+
+// The rings have to be filled before anyone asks, so they are started right away
+void
+RtspServer::StartTimeshift() {
+  for (const auto &config : mount_configs) {
+    if (!config.second.timeshift_mb) {
+      continue;
+    }
+
+    SharedEncoder *encoder = GetSharedEncoder(config.first);
+    if (!encoder) {
+      GST_ERROR("No time-shift for \"%s\": the encoder can't be shared!", config.first.c_str());
+      continue;
+    }
+
+    TimeshiftRing *ring = new TimeshiftRing(config.first, config.second);
+    timeshift_rings[config.first] = ring;
+    MemoryGovernor::AddCache("timeshift_" + config.first, (gsize) config.second.timeshift_mb << 20, config.first);
+
+    if (encoder->AddListener(TimeshiftRing::Push, ring)) {
+      LinkToSource(encoder->Name());
+    }
+  }
+}
+
+// Every mount is encoded once here, whether the workers have clients or not
+void
+RtspServer::StartExport() {
+  for (const auto &pipe : rtsp_pipes) {
+    if (!mount_configs.count(pipe.first)) {
+      mount_configs[pipe.first] = MountConfig();
+    }
+
+    SharedEncoder *encoder = GetSharedEncoder(pipe.first);
+    if (!encoder) {
+      GST_ERROR("Workers can't serve \"%s\": the encoder can't be shared!", pipe.first.c_str());
+      continue;
+    }
+
+    StreamExport *stream_export = new StreamExport(encoder, pipe.first);
+    if (!stream_export->Start()) {
+      delete stream_export;
+      continue;
+    }
+    stream_exports[pipe.first] = stream_export;
+
+    if (encoder->AddListener(StreamExport::Push, stream_export)) {
+      LinkToSource(encoder->Name());
+    }
+  }
+}
+
+// Same as gst_rtsp_server_attach(), but on a socket with SO_REUSEPORT set
+gboolean
+RtspServer::AttachReusePort() {
+  GError *error = NULL;
+  gchar *service = gst_rtsp_server_get_service(gst_rtsp_server);
+  guint16 port = (guint16) atoi(service);
+  g_free(service);
+
+  GSocket *socket = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, &error);
+  if (!socket) {
+    GST_ERROR("Can't create the RTSP socket: %s", error->message);
+    g_clear_error(&error);
+    return FALSE;
+  }
+
+  GInetAddress *any = g_inet_address_new_any(G_SOCKET_FAMILY_IPV4);
+  GSocketAddress *address = g_inet_socket_address_new(any, port);
+  g_object_unref(any);
+
+  g_socket_set_blocking(socket, FALSE);
+  gboolean bound = g_socket_set_option(socket, SOL_SOCKET, SO_REUSEPORT, 1, &error)
+      && g_socket_bind(socket, address, TRUE, &error)
+      && g_socket_listen(socket, &error);
+  g_object_unref(address);
+
+  if (!bound) {
+    GST_ERROR("Can't listen on port %u: %s", port, error->message);
+    g_clear_error(&error);
+    g_object_unref(socket);
+    return FALSE;
+  }
+
+  GSource *source = g_socket_create_source(socket, G_IO_IN, NULL);
+  g_source_set_callback(source, (GSourceFunc) gst_rtsp_server_io_func,
+                        g_object_ref(gst_rtsp_server), (GDestroyNotify) g_object_unref);
+  gst_rtsp_server_source = g_source_attach(source, NULL);
+  g_source_unref(source);
+  g_object_unref(socket);
+
+  GST_INFO("Worker %d is listening on port %u", getpid(), port);
+
+  return TRUE;
+}
+
+void
+RtspServer::Adopt(GSocket *socket) {
+  if (listen_socket) {
+    g_object_unref(listen_socket);
+  }
+  listen_socket = (GSocket *) g_object_ref(socket);
+}
+
+GSocket *
+RtspServer::ListeningSocket() {
+  return listen_socket;
+}
+
+void
+RtspServer::StopAccepting() {
+  if (gst_rtsp_server_source) {
+    g_source_remove(gst_rtsp_server_source);
+    gst_rtsp_server_source = 0;
+  }
+}
+
+guint
+RtspServer::CountClients() {
+  GList *clients = gst_rtsp_server_client_filter(gst_rtsp_server, NULL, NULL);
+  guint count = g_list_length(clients);
+  g_list_free_full(clients, g_object_unref);
+
+  return count;
+}
+
+void
+RtspServer::ToggleRecording() {
+  for (const auto &recorder : recorders) {
+    if (recorder.second->IsRunning()) {
+      StopRecording(recorder.first);
+    } else {
+      StartRecording(recorder.first);
+    }
+  }
+}
+
+// The recorder taps the shared encoder, the live clients are not touched
+void
+RtspServer::StartRecording(const std::string &pipe_name) {
+  SharedEncoder *encoder = GetSharedEncoder(pipe_name);
+  GCF_ERROR_RETURN(!encoder, "Can't record \"%s\": the encoder can't be shared!", pipe_name.c_str());
+
+  Recorder *recorder = recorders.at(pipe_name);
+  recorder->Start();
+
+  if (encoder->AddListener(Recorder::Push, recorder)) {
+    LinkToSource(encoder->Name());
+  }
+}
+
+void
+RtspServer::StopRecording(const std::string &pipe_name) {
+  Recorder *recorder = recorders.at(pipe_name);
+  if (!recorder->IsRunning()) {
+    return;
+  }
+
+  SharedEncoder *encoder = shared_encoders.at(pipe_name);
+  if (encoder->RemoveListener(Recorder::Push, recorder)) {
+    UnlinkFromSource(encoder->Name());
+  }
+
+  recorder->Stop();
+}
+
 GstElement *
 RtspServer::ImportPipeline(GstRTSPMediaFactory *factory, const GstRTSPUrl *url) {
 
-  auto pipe_name = std::string(gst_rtsp_media_factory_get_launch(factory));
+  gchar *launch = gst_rtsp_media_factory_get_launch(factory);
+  auto pipe_name = std::string(launch);
+  g_free(launch);
   auto url_path = std::string("rtsp://") + url->host + ":" + std::to_string(url->port) + url->abspath;
 
   GST_INFO("Building media \"%s\" from pipe \"%s\".",
           url_path.c_str(),
           pipe_name.c_str());
 
+  // Workers only relay what the capture process encoded
+  if (mode == RTSP_MODE_WORKER) {
+    return ImportWorkerStream(pipe_name, url->query);
+  }
+
+  // Playback from the past, rtsp://host:8554/h264?timeshift
+  if (!g_strcmp0(url->query, "timeshift")) {
+    return ImportTimeshift(pipe_name);
+  }
+
+  // Parameters in the query ask for a rendition of the pipe
+  if (url->query && *url->query) {
+    return ImportRendition(pipe_name, url->query);
+  }
+
+  // Full rate subset of the shared encode
+  auto config = mount_configs.find(pipe_name);
+  if (config != mount_configs.end() && config->second.SharedEncode()) {
+    SharedEncoder *encoder = GetSharedEncoder(pipe_name);
+    return encoder ? ImportLayer(encoder, pipe_name, pipe_name + "_full", encoder->TopLayer()) : NULL;
+  }
+
   return rtsp_pipes[pipe_name];
 }
 
+GstElement *
+RtspServer::ImportRendition(const std::string &pipe_name, const char *query) {
+
+  auto config = mount_configs.find(pipe_name);
+  GCF_WARNING_RETURN_VAL(config == mount_configs.end(), NULL,
+                         "Pipe \"%s\" has no renditions enabled.", pipe_name.c_str());
+
+  RenditionRequest request;
+  GCF_WARNING_RETURN_VAL(!request.Parse(query), NULL,
+                         "Invalid rendition of \"%s\" is requested: \"%s\"", pipe_name.c_str(), query);
+
+  auto name = request.Name(pipe_name);
+
+  // A framerate the temporal layers give is served without another encode
+  guint layer;
+  SharedEncoder *encoder = config->second.SharedEncode() ? GetSharedEncoder(pipe_name) : NULL;
+  if (encoder && !request.width && encoder->LayerOf(request.fps, layer)) {
+    return ImportLayer(encoder, pipe_name, name, layer);
+  }
+
+  GCF_WARNING_RETURN_VAL(!config->second.max_renditions, NULL,
+                         "Pipe \"%s\" has no renditions enabled.", pipe_name.c_str());
+
+  // Cap the renditions of the mount so the encoders can't eat up the CPU
+  guint count = 0;
+  for (const auto &rendition : renditions) {
+    count += rendition.second == pipe_name;
+  }
+
+  GCF_WARNING_RETURN_VAL(count >= config->second.max_renditions, NULL,
+                         "Can't build \"%s\": %u renditions of \"%s\" are already running.",
+                         name.c_str(), count, pipe_name.c_str());
+
+  GstElement *queue, *intersink;
+  GstElement *bin = Rendition::Build(rtsp_pipes.at(pipe_name), pipe_name, name, request, &queue, &intersink);
+  if (!bin) {
+    return NULL;
+  }
+
+  // Same source as the mount itself
+  renditions[name] = pipe_name;
+  intersinks[name] = intersink;
+  queues[name] = queue;
+  source_tees[name] = source_tees.at(pipe_name);
+  source_pipes[name] = source_pipes.at(pipe_name);
+  MemoryGovernor::Register(name, queue, pipe_name);
+
+  return bin;
+}
+
+GstElement *
+RtspServer::ImportLayer(SharedEncoder *encoder, const std::string &pipe_name,
+                        const std::string &name, guint layer) {
+  GstElement *bin = encoder->CreateLayer(name, layer);
+  if (bin) {
+    layers[name] = pipe_name;
+  }
+
+  return bin;
+}
+
+GstElement *
+RtspServer::ImportTimeshift(const std::string &pipe_name) {
+  static guint count = 0;
+
+  auto ring = timeshift_rings.find(pipe_name);
+  GCF_WARNING_RETURN_VAL(ring == timeshift_rings.end(), NULL,
+                         "Pipe \"%s\" has no time-shift enabled.", pipe_name.c_str());
+
+  // Every client seeks on its own, so the media is never shared
+  auto name = pipe_name + "_timeshift_" + std::to_string(++count);
+
+  TimeshiftReader *reader = NULL;
+  GstElement *bin = ring->second->CreateMedia(name, shared_encoders.at(pipe_name)->Payloader(), &reader);
+  if (bin) {
+    timeshift_readers[name] = reader;
+  }
+
+  return bin;
+}
+
+GstElement *
+RtspServer::ImportWorkerStream(const std::string &pipe_name, const char *query) {
+  auto feed = worker_feeds.find(pipe_name);
+  GCF_WARNING_RETURN_VAL(feed == worker_feeds.end() || !feed->second->IsConnected(), NULL,
+                         "Pipe \"%s\" is not exported by the capture process yet.", pipe_name.c_str());
+
+  if (query && *query) {
+    GST_WARNING("Workers serve \"%s\" as it is, \"%s\" is ignored.", pipe_name.c_str(), query);
+  }
+
+  GstElement *payloader = gst_bin_get_by_name(GST_BIN (rtsp_pipes.at(pipe_name)), "pay0");
+  GCF_ERROR_RETURN_VAL(!payloader, NULL, "Pipe \"%s\" has no payloader!", pipe_name.c_str());
+
+  auto name = pipe_name + "_worker";
+  GstElement *bin = gst_pipeline_new(name.c_str());
+  GstElement *appsrc = gst_element_factory_make("appsrc", ("workersrc_" + name).c_str());
+  GstElement *pay = Rendition::Clone(payloader);
+  gst_object_unref(payloader);
+
+  g_object_set(appsrc, "is-live", TRUE, "format", GST_FORMAT_TIME, NULL);
+
+  gst_bin_add_many(GST_BIN (bin), appsrc, pay, NULL);
+  if (!gst_element_link(appsrc, pay)) {
+    GST_ERROR("Can't build worker media \"%s\"!", name.c_str());
+    gst_object_unref(bin);
+    return NULL;
+  }
+
+  worker_streams[name] = pipe_name;
+
+  return bin;
+}
+
+// Worker medias take frames from the feed only while they are playing
+void
+RtspServer::SwitchWorkerStream(GstElement *element, const std::string &element_name, GstState state) {
+  WorkerFeed *feed = worker_feeds.at(worker_streams.at(element_name));
+  GstElement *appsrc = gst_bin_get_by_name(GST_BIN (element), ("workersrc_" + element_name).c_str());
+  if (!appsrc) {
+    return;
+  }
+
+  if (state == GST_STATE_PLAYING) {
+    feed->Attach(appsrc);
+  } else {
+    feed->Detach(appsrc);
+  }
+
+  gst_object_unref(appsrc);
+}
+
+// The encoder is built with the first layer and kept until the server stops
+SharedEncoder *
+RtspServer::GetSharedEncoder(const std::string &pipe_name) {
+  auto found = shared_encoders.find(pipe_name);
+  if (found != shared_encoders.end()) {
+    return found->second->IsValid() ? found->second : NULL;
+  }
+
+  SharedEncoder *encoder = new SharedEncoder(rtsp_pipes.at(pipe_name), pipe_name, mount_configs.at(pipe_name));
+  shared_encoders[pipe_name] = encoder;
+
+  if (!encoder->IsValid()) {
+    return NULL;
+  }
+
+  // Same source as the mount itself
+  auto name = encoder->Name();
+  intersinks[name] = encoder->intersink;
+  queues[name] = encoder->queue;
+  source_tees[name] = source_tees.at(pipe_name);
+  source_pipes[name] = source_pipes.at(pipe_name);
+  MemoryGovernor::Register(name, encoder->queue, pipe_name);
+  rtsp_active[name] = false;
+
+  return encoder;
+}
+
+// Layer medias feed from the encoder only while they are playing
+void
+RtspServer::SwitchLayer(GstElement *element, const std::string &element_name, GstState state) {
+  SharedEncoder *encoder = shared_encoders.at(layers.at(element_name));
+  GstElement *appsrc = gst_bin_get_by_name(GST_BIN (element), ("layersrc_" + element_name).c_str());
+  if (!appsrc) {
+    return;
+  }
+
+  if (state == GST_STATE_PLAYING) {
+    if (encoder->Attach(appsrc)) {
+      LinkToSource(encoder->Name());
+    }
+  } else if (encoder->Detach(appsrc)) {
+    UnlinkFromSource(encoder->Name());
+  }
+
+  gst_object_unref(appsrc);
+}
+
+gchar *
+RtspServer::GenerateKey(GstRTSPMediaFactory *factory, const GstRTSPUrl *url) {
+  guint16 port = 0;
+  gst_rtsp_url_get_port(url, &port);
+
+  // A worker has one media per mount, whatever the query says
+  if (mode == RTSP_MODE_WORKER) {
+    return g_strdup_printf("%u%s", port, url->abspath);
+  }
+
+  // No key: a time-shift media is not shared
+  if (!g_strcmp0(url->query, "timeshift")) {
+    return NULL;
+  }
+
+  // Clients asking for the same parameters share the rendition
+  RenditionRequest request;
+  std::string query;
+  if (url->query && *url->query) {
+    query = request.Parse(url->query) ? "?" + request.Name("") : std::string("?") + url->query;
+  }
+
+  return g_strdup_printf("%u%s%s", port, url->abspath, query.c_str());
+}
+
+void
+RtspServer::RenditionUnprepared(GstRTSPMedia *media, gpointer user_data) {
+  GstElement *element = gst_rtsp_media_get_element(media);
+  std::string name(GST_ELEMENT_NAME(element));
+  gst_object_unref(element);
+
+  GST_INFO("Last client of \"%s\" is gone, tearing it down.", name.c_str());
+
+  auto worker_stream = worker_streams.find(name);
+  if (worker_stream != worker_streams.end()) {
+    element = gst_rtsp_media_get_element(media);
+    SwitchWorkerStream(element, name, GST_STATE_NULL);
+    gst_object_unref(element);
+    worker_streams.erase(worker_stream);
+    rtsp_active.erase(name);
+    medias.erase(name);
+    return;
+  }
+
+  if (layers.count(name)) {
+    layers.erase(name);
+    rtsp_active.erase(name);
+    medias.erase(name);
+    return;
+  }
+
+  auto reader = timeshift_readers.find(name);
+  if (reader != timeshift_readers.end()) {
+    delete reader->second;
+    timeshift_readers.erase(reader);
+    rtsp_active.erase(name);
+    medias.erase(name);
+    return;
+  }
+
+  // Back from the source pipe, the reference sunk at creation is the last one
+  UnlinkFromSource(name);
+  MemoryGovernor::Unregister(name);
+
+  GstElement* intersink = intersinks.at(name);
+  GstElement* queue = queues.at(name);
+  gst_element_set_state(intersink, GST_STATE_NULL);
+  gst_element_set_state(queue, GST_STATE_NULL);
+  gst_object_unref(intersink);
+  gst_object_unref(queue);
+
+  renditions.erase(name);
+  intersinks.erase(name);
+  queues.erase(name);
+  source_tees.erase(name);
+  source_pipes.erase(name);
+  rtsp_active.erase(name);
+  medias.erase(name);
+}
+
 GstElement *
 RtspServer::CreateMediaPipe(GstRTSPMediaFactory *factory, GstRTSPMedia *media) {
 
-  GST_LOG ("Try to create media pipe \"%s\"",
-           gst_element_get_name(gst_rtsp_media_get_element(media)));
+  GstElement *element = gst_rtsp_media_get_element(media);
+  std::string element_name(GST_ELEMENT_NAME(element));
+  gst_object_unref(element);
+
+  GST_LOG ("Try to create media pipe \"%s\"", element_name.c_str());
 
-  auto pipe_name = gst_rtsp_media_factory_get_launch(factory);
-  if (!pipe_name) {
-    GST_ERROR("Error creating media pipe for \"%s\"!",
-               gst_element_get_name(gst_rtsp_media_get_element(media)));
+  gchar *launch = gst_rtsp_media_factory_get_launch(factory);
+  if (!launch) {
+    GST_ERROR("Error creating media pipe for \"%s\"!", element_name.c_str());
 
     return NULL;
   }
 
-  auto ext_pipename = "e_" + std::string(pipe_name);
+  std::string pipe_name(launch);
+  g_free(launch);
+
+  auto ext_pipename = "e_" + element_name;
   GstElement *pipeline = gst_pipeline_new(ext_pipename.c_str());
+  InstanceResources::Watch(pipeline, pipe_name);
   gst_rtsp_media_take_pipeline(media, GST_PIPELINE_CAST (pipeline));
 
-  // This way the media will not be reinitialized - our created pipe is not lost
-  gst_rtsp_media_set_reusable(media, TRUE);
+  bool rendition = renditions.count(element_name) > 0 || layers.count(element_name) > 0
+      || timeshift_readers.count(element_name) > 0 || worker_streams.count(element_name) > 0;
+
+  if (rendition) {
+    // Renditions and layers are built for their clients, drop them with the last one
+    gst_rtsp_media_set_reusable(media, FALSE);
+    g_signal_connect (media, "unprepared", G_CALLBACK(RenditionUnprepared), NULL);
+  } else {
+    // This way the media will not be reinitialized - our created pipe is not lost
+    gst_rtsp_media_set_reusable(media, TRUE);
+  }
 
   // Watch state changes
   g_signal_connect (media, "new-state", G_CALLBACK(StateChange), NULL);
 
+  // Send RTP in batches if the mount asks for it, otherwise packets go out one by one
+  auto config = mount_configs.find(pipe_name);
+  if (config != mount_configs.end() && config->second.udp_batch) {
+    InsertBatchers(media, config->second);
+  }
+
+  // Follow the receiver reports of the clients with the encoder settings
+  if (!rendition && config != mount_configs.end() && config->second.abr && !abr_controllers.count(pipe_name)) {
+    abr_controllers[pipe_name] = new BitrateController(media, pipe_name, config->second);
+  }
+
+  // Tune the retransmission buffers and count what they send
+  if (!rendition && config != mount_configs.end() && config->second.rtx && !rtx_monitors.count(pipe_name)) {
+    rtx_monitors[pipe_name] = new RetransmissionMonitor(media, pipe_name, config->second);
+  }
+
   // TODO very temporary
-  medias[pipe_name] = media;
-  rtsp_active[pipe_name] = false;
+  medias[element_name] = media;
+  rtsp_active[element_name] = false;
 
   return pipeline;
 }
 
+void
+RtspServer::InsertBatchers(GstRTSPMedia *media, const MountConfig &config) {
+  GstElement *element = gst_rtsp_media_get_element(media);
+
+  for (guint i = 0; i < gst_rtsp_media_n_streams(media); i++) {
+    GstRTSPStream *stream = gst_rtsp_media_get_stream(media, i);
+    auto batch_name = std::string("batch_") + GST_ELEMENT_NAME(element) + "_" + std::to_string(i);
+
+    // The media is reusable, so the batcher can be already in place
+    GstElement *batch = gst_bin_get_by_name(GST_BIN (element), batch_name.c_str());
+    if (batch) {
+      gst_object_unref(batch);
+      continue;
+    }
+
+    batch = gst_element_factory_make("gcfrtpbatch", batch_name.c_str());
+    if (!batch) {
+      GST_ERROR("Can't create RTP batcher for \"%s\", sending without batching.", GST_ELEMENT_NAME(element));
+      break;
+    }
+
+    g_object_set(batch,
+                 "max-packets", config.batch_packets,
+                 "tick", (guint64) config.batch_tick_ms * GST_MSECOND,
+                 NULL);
+
+    // The stream output is a ghost pad of the payloader: retarget it to the batcher
+    GstPad *ghost = gst_rtsp_stream_get_srcpad(stream);
+    GstPad *payloader_src = gst_ghost_pad_get_target(GST_GHOST_PAD (ghost));
+    GstPad *batch_src = gst_element_get_static_pad(batch, "src");
+    GstPad *batch_sink = gst_element_get_static_pad(batch, "sink");
+
+    if (!gst_bin_add(GST_BIN (element), batch)
+        || !gst_ghost_pad_set_target(GST_GHOST_PAD (ghost), batch_src)
+        || gst_pad_link(payloader_src, batch_sink) != GST_PAD_LINK_OK) {
+      GST_ERROR("Can't insert RTP batcher into stream %u of \"%s\"!", i, GST_ELEMENT_NAME(element));
+    } else {
+      gst_element_sync_state_with_parent(batch);
+      GST_INFO("Stream %u of \"%s\" is sent in batches of %u packets",
+               i, GST_ELEMENT_NAME(element), config.batch_packets);
+    }
+
+    gst_object_unref(batch_sink);
+    gst_object_unref(batch_src);
+    gst_object_unref(payloader_src);
+    gst_object_unref(ghost);
+  }
+
+  gst_object_unref(element);
+}
+
+void
+RtspServer::ClientConnected(GstRTSPServer *server, GstRTSPClient *client, gpointer user_data) {
+  g_signal_connect(client, "setup-request", G_CALLBACK(SetupRequest), NULL);
+  g_signal_connect(client, "pre-play-request", G_CALLBACK(PrePlayRequest), NULL);
+}
+
+// The server only knows the media timeline, so a Range relative to the live
+// edge or in wall clock is turned into a plain NPT one before it's applied
+GstRTSPStatusCode
+RtspServer::PrePlayRequest(GstRTSPClient *client, GstRTSPContext *ctx, gpointer user_data) {
+  gchar *range = NULL;
+  if (!ctx->media || gst_rtsp_message_get_header(ctx->request, GST_RTSP_HDR_RANGE, &range, 0) != GST_RTSP_OK) {
+    return GST_RTSP_STS_OK;
+  }
+
+  GstElement *element = gst_rtsp_media_get_element(ctx->media);
+  auto reader = timeshift_readers.find(GST_ELEMENT_NAME(element));
+  gst_object_unref(element);
+
+  std::string translated;
+  if (reader == timeshift_readers.end() || !reader->second->TranslateRange(range, translated)) {
+    return GST_RTSP_STS_OK;
+  }
+
+  GST_INFO("Time-shift range \"%s\" => \"%s\"", range, translated.c_str());
+
+  gst_rtsp_message_remove_header(ctx->request, GST_RTSP_HDR_RANGE, -1);
+  gst_rtsp_message_add_header(ctx->request, GST_RTSP_HDR_RANGE, translated.c_str());
+
+  return GST_RTSP_STS_OK;
+}
+
+void
+RtspServer::SetupRequest(GstRTSPClient *client, GstRTSPContext *ctx, gpointer user_data) {
+
+  // The queue takes over the whole connection, install it only once
+  if (g_object_get_data(G_OBJECT (client), "gcf-client-queue")) {
+    return;
+  }
+
+  gchar *transport = NULL;
+  if (gst_rtsp_message_get_header(ctx->request, GST_RTSP_HDR_TRANSPORT, &transport, 0) != GST_RTSP_OK) {
+    return;
+  }
+
+  // The first transport the client offers is the one it gets
+  gchar **offers = g_strsplit(transport, ",", 2);
+  GstRTSPTransport *parsed = NULL;
+  gst_rtsp_transport_new(&parsed);
+  bool tcp = gst_rtsp_transport_parse(offers[0], parsed) == GST_RTSP_OK
+      && parsed->lower_transport == GST_RTSP_LOWER_TRANS_TCP;
+  gst_rtsp_transport_free(parsed);
+  g_strfreev(offers);
+
+  if (!tcp) {
+    return;
+  }
+
+  // The first part of the path is the name of the pipe
+  std::string path(ctx->uri->abspath);
+  auto mount = path.substr(1, path.find('/', 1) - 1);
+
+  auto config = mount_configs.find(mount);
+  if (config == mount_configs.end() || !config->second.tcp_queue) {
+    return;
+  }
+
+  ClientQueue::Install(client, mount, config->second);
+  g_object_set_data(G_OBJECT (client), "gcf-client-queue", GINT_TO_POINTER (TRUE));
+}
+
 gboolean
 RtspServer::SessionPoolTimeout(GstRTSPServer *server) {
   GstRTSPSessionPool *pool = gst_rtsp_server_get_session_pool(server);
@@ -165,80 +931,117 @@ RtspServer::StateChange(GstRTSPMedia *media, gint arg1, gpointer user_data) {
   GstElement *element = gst_rtsp_media_get_element(media);
   GstState state;
   gst_element_get_state(element, &state, NULL, 0);
-  GST_INFO("%s => %s", gst_element_get_name(element), gst_element_state_get_name(state));
+  GST_INFO("%s => %s", GST_ELEMENT_NAME(element), gst_element_state_get_name(state));
+
+  std::string element_name(GST_ELEMENT_NAME(element));
 
+  if (layers.count(element_name)) {
+    SwitchLayer(element, element_name, state);
+  }
+  if (worker_streams.count(element_name)) {
+    SwitchWorkerStream(element, element_name, state);
+  }
   if (state == GST_STATE_PLAYING) {
-	GST_LOG("PLAY");
-    std::string element_name(gst_element_get_name(element));
+    PipeOptimizer::Schedule(element);
+  }
+  gst_object_unref(element);
 
-	//nothing to do
-	if (intersinks.find(element_name) == intersinks.end())
-		return;
+  if (state == GST_STATE_PLAYING) {
+    LinkToSource(element_name);
+  }
 
-    if (rtsp_active.at(element_name)) {
-      GST_LOG("Already linked.");
-      return;
-    }
+  if (state == GST_STATE_NULL) {
+    UnlinkFromSource(element_name);
+  }
+}
 
-    rtsp_active.at(element_name) = true;
+void
+RtspServer::LinkToSource(const std::string &element_name) {
 
+  //nothing to do
+  if (intersinks.find(element_name) == intersinks.end())
+    return;
 
-    GST_DEBUG("Linking \"%s\" to main tee", gst_element_get_name(element));
+  if (rtsp_active.at(element_name)) {
+    GST_LOG("Already linked.");
+    return;
+  }
 
-    GstElement* intersink = intersinks.at(element_name);
-    GstElement* queue = queues.at(element_name);
-      
-    if (!gst_bin_add(GST_BIN (TODO_pipe), queue)
-        || !gst_bin_add(GST_BIN (TODO_pipe), intersink))
-    {
-      GST_ERROR("Linking \"%s\": failed to add elements to source pipe!",
-                gst_element_get_name(element));
-      return;
-    };
+  rtsp_active.at(element_name) = true;
 
-    gst_element_sync_state_with_parent(intersink);
-    gst_element_sync_state_with_parent(queue);
+  GstElement* tee = source_tees.at(element_name);
+  GstElement* source_pipe = source_pipes.at(element_name);
 
-    if (!gst_element_link_many(TODO_tee, queue, intersink, NULL))
-    {
-      GST_ERROR("Linking elements in \"%s\" is failed!", gst_element_get_name(element));
-      return;
-    }
+  GST_DEBUG("Linking \"%s\" to \"%s\"", element_name.c_str(), GST_ELEMENT_NAME(tee));
+
+  GstElement* intersink = intersinks.at(element_name);
+  GstElement* queue = queues.at(element_name);
+
+  // Unlinked before or sunk at creation, the reference the server holds goes over to the bin
+  bool relinked = !g_object_is_floating(queue);
+
+  if (!gst_bin_add(GST_BIN (source_pipe), queue)
+      || !gst_bin_add(GST_BIN (source_pipe), intersink))
+  {
+    GST_ERROR("Linking \"%s\": failed to add elements to source pipe!", element_name.c_str());
+    return;
+  };
+
+  if (relinked) {
+    gst_object_unref(queue);
+    gst_object_unref(intersink);
   }
 
-  if (state == GST_STATE_NULL) {
-	GST_LOG("PLAY");
-    std::string element_name(gst_element_get_name(element));
+  gst_element_sync_state_with_parent(intersink);
+  gst_element_sync_state_with_parent(queue);
 
-	//nothing to do
-	if (intersinks.find(element_name) == intersinks.end())
-		return;
+  if (!gst_element_link_many(tee, queue, intersink, NULL))
+  {
+    GST_ERROR("Linking elements in \"%s\" is failed!", element_name.c_str());
+    return;
+  }
+}
 
-    if (!rtsp_active.at(element_name)) {
-      GST_LOG("Already unlinked.");
-      return;
-    }
+void
+RtspServer::UnlinkFromSource(const std::string &element_name) {
 
-    rtsp_active.at(element_name) = false;
+  //nothing to do
+  if (intersinks.find(element_name) == intersinks.end())
+    return;
 
+  if (!rtsp_active.at(element_name)) {
+    GST_LOG("Already unlinked.");
+    return;
+  }
 
-    GST_LOG("Unlinking from main tee: %s", gst_element_get_name(element));
+  rtsp_active.at(element_name) = false;
 
-    GstElement* intersink = intersinks.at(element_name);
-    GstElement* queue = queues.at(element_name);
+  GstElement* tee = source_tees.at(element_name);
+  GstElement* source_pipe = source_pipes.at(element_name);
 
-    gst_element_set_state(intersink, GST_STATE_READY);
-    gst_element_set_state(queue, GST_STATE_READY);
+  GST_LOG("Unlinking \"%s\" from \"%s\"", element_name.c_str(), GST_ELEMENT_NAME(tee));
 
-    gst_element_unlink(intersink, TODO_tee);
+  GstElement* intersink = intersinks.at(element_name);
+  GstElement* queue = queues.at(element_name);
 
-    gst_object_ref(intersink);
-    gst_bin_remove(GST_BIN (TODO_pipe), intersink);
+  gst_element_set_state(intersink, GST_STATE_READY);
+  gst_element_set_state(queue, GST_STATE_READY);
 
-    gst_object_ref(queue);
-    gst_bin_remove(GST_BIN (TODO_pipe), queue);
+  // Give back the request pad of the tee, so it does not grow with every client
+  GstPad *queue_sink = gst_element_get_static_pad(queue, "sink");
+  GstPad *tee_src = gst_pad_get_peer(queue_sink);
+  if (tee_src) {
+    gst_pad_unlink(tee_src, queue_sink);
+    gst_element_release_request_pad(tee, tee_src);
+    gst_object_unref(tee_src);
   }
+  gst_object_unref(queue_sink);
+
+  gst_object_ref(intersink);
+  gst_bin_remove(GST_BIN (source_pipe), intersink);
 
+  gst_object_ref(queue);
+  gst_bin_remove(GST_BIN (source_pipe), queue);
 }
 
 G_DEFINE_TYPE (AppRTSPMediaFactory, app_rtsp_media_factory,
@@ -250,6 +1053,7 @@ app_rtsp_media_factory_class_init(AppRTSPMediaFactoryClass *test_klass) {
       (GstRTSPMediaFactoryClass *) (test_klass);
   mf_klass->create_element = RtspServer::ImportPipeline;
   mf_klass->create_pipeline = RtspServer::CreateMediaPipe;
+  mf_klass->gen_key = RtspServer::GenerateKey;
 
   GST_DEBUG("Custom MediaFactory initialized.");
 }
@@ -4,21 +4,74 @@
 #include <vector>
 #include <map>
 
+#include "mount.h"
+
+class BitrateController;
+class RetransmissionMonitor;
+class SharedEncoder;
+class HlsPackager;
+class HttpServer;
+class Recorder;
+class TimeshiftRing;
+class TimeshiftReader;
+class StreamExport;
+class WorkerFeed;
+
+// A single process captures and serves; with workers the capture process
+// exports the encoded mounts and the worker processes serve the clients
+enum RtspServerMode {
+  RTSP_MODE_SINGLE,
+  RTSP_MODE_CAPTURE,
+  RTSP_MODE_WORKER
+};
+
 class RtspServer {
 
 public:
 
-  RtspServer();
+  explicit RtspServer(RtspServerMode mode = RTSP_MODE_SINGLE);
   ~RtspServer();
 
   gboolean Start();
 
   gboolean RegisterRtspPipes(const std::map<std::string, GstElement*>& pipes);
 
+  // Starts the stopped and stops the running recordings
+  void ToggleRecording();
+
+  // Listening socket of a previous process, to serve on instead of a new one
+  void Adopt(GSocket *socket);
+  GSocket *ListeningSocket();
+
+  // Connected clients keep being served, no new ones are accepted
+  void StopAccepting();
+  guint CountClients();
+
 private:
 
   GstRTSPServer *gst_rtsp_server;
   guint gst_rtsp_server_source;
+  GSocket *listen_socket;
+
+  // HTTP outputs of the mounts
+  void StartHls();
+  HttpServer *http_server;
+  std::map<std::string, HlsPackager*> hls_packagers;
+
+  // Recordings of the mounts
+  void StartRecording(const std::string &pipe_name);
+  void StopRecording(const std::string &pipe_name);
+  std::map<std::string, Recorder*> recorders;
+
+  // Time-shift rings of the mounts, filled all the time
+  void StartTimeshift();
+
+  // Encoded mounts handed to the worker processes
+  void StartExport();
+  std::map<std::string, StreamExport*> stream_exports;
+
+  // Workers share the RTSP port, the kernel spreads the connections
+  gboolean AttachReusePort();
 
 
 // Override default rtsp gst_rtsp_server mediafactory implementation
@@ -31,11 +84,45 @@ public:
   static std::map<std::string, GstElement*> intersinks;
   static std::map<std::string, GstElement*> queues;
   static std::map<std::string, bool> rtsp_active;
-  static GstElement* TODO_tee;
-  static GstElement* TODO_pipe;
+  static std::map<std::string, GstElement*> source_tees;
+  static std::map<std::string, GstElement*> source_pipes;
+  static std::map<std::string, std::string> renditions;
+  static std::map<std::string, std::string> layers;
+  static std::map<std::string, SharedEncoder*> shared_encoders;
+  static std::map<std::string, TimeshiftRing*> timeshift_rings;
+  static std::map<std::string, TimeshiftReader*> timeshift_readers;
+  static std::map<std::string, MountConfig> mount_configs;
+  static std::map<std::string, BitrateController*> abr_controllers;
+  static std::map<std::string, RetransmissionMonitor*> rtx_monitors;
+  static std::map<std::string, WorkerFeed*> worker_feeds;
+  static std::map<std::string, std::string> worker_streams;
+  static RtspServerMode mode;
+  static gchar * GenerateKey(GstRTSPMediaFactory *factory, const GstRTSPUrl *url);
 
 private:
   // this timeout is periodically run to clean up the expired rtsp sessions from the pool.
   static gboolean SessionPoolTimeout(GstRTSPServer *server);
   static void StateChange(GstRTSPMedia *gstrtspmedia, gint arg1, gpointer user_data);
+  // Tunnel between the source tee and the media
+  static void LinkToSource(const std::string &element_name);
+  static void UnlinkFromSource(const std::string &element_name);
+  // On-demand renditions asked in the URL query
+  static GstElement * ImportRendition(const std::string &pipe_name, const char *query);
+  static void RenditionUnprepared(GstRTSPMedia *media, gpointer user_data);
+  // Layer medias sharing the encoder of a mount
+  static GstElement * ImportLayer(SharedEncoder *encoder, const std::string &pipe_name,
+                                  const std::string &name, guint layer);
+  static SharedEncoder * GetSharedEncoder(const std::string &pipe_name);
+  static void SwitchLayer(GstElement *element, const std::string &element_name, GstState state);
+  // Playback from the time-shift ring, one media per client
+  static GstElement * ImportTimeshift(const std::string &pipe_name);
+  // Worker medias fed from the ring of the capture process
+  static GstElement * ImportWorkerStream(const std::string &pipe_name, const char *query);
+  static void SwitchWorkerStream(GstElement *element, const std::string &element_name, GstState state);
+  static GstRTSPStatusCode PrePlayRequest(GstRTSPClient *client, GstRTSPContext *ctx, gpointer user_data);
+  // Puts a batching element between the payloaders and the media outputs
+  static void InsertBatchers(GstRTSPMedia *media, const MountConfig &config);
+  // Gives the TCP clients of the mounts a bounded send queue
+  static void ClientConnected(GstRTSPServer *server, GstRTSPClient *client, gpointer user_data);
+  static void SetupRequest(GstRTSPClient *client, GstRTSPContext *ctx, gpointer user_data);
 };
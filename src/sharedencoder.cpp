@@ -0,0 +1,332 @@
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
+#include <algorithm>
+
+#include "sharedencoder.h"
+#include "rendition.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_sharedencoder);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_sharedencoder       // set as default
+
+SharedEncoder::SharedEncoder(GstElement *mount_pipe, const std::string &mount, const MountConfig &config)
+    : queue(NULL),
+      intersink(NULL),
+      mount(mount),
+      name("shared_" + mount),
+      levels(MAX (config.temporal_levels, 1)),
+      framerate(0),
+      valid(false),
+      keyframe_requests(0),
+      pipeline(NULL),
+      appsink(NULL),
+      payloader(NULL),
+      dispatching(false) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_SHAREDENCODER", GST_DEBUG_FG_YELLOW, "Shared encoder of the mounts"
+  );
+
+  pipeline = gst_pipeline_new(name.c_str());
+
+  // Copy the chain of the mount up to its payloader, which is left to the layers
+  GstElement *element = gst_bin_get_by_name(GST_BIN (mount_pipe), ("intersrc_" + mount).c_str());
+  GCF_ERROR_RETURN(!element, "Shared encoder of \"%s\": mount is not connected to a source!", mount.c_str());
+
+  auto gateway_name = "gateway_" + name;
+  GstElement *previous = NULL;
+
+  while (element && !payloader) {
+    if (g_str_has_prefix(GST_ELEMENT_NAME (element), "pay")) {
+      payloader = element;
+      break;
+    }
+
+    GstElement *copy = Rendition::Clone(element);
+    GstElementFactory *factory = gst_element_get_factory(element);
+    const gchar *factory_name = factory ? GST_OBJECT_NAME (factory) : "";
+
+    if (!g_strcmp0(factory_name, "intervideosrc")) {
+      g_object_set(copy, "channel", gateway_name.c_str(), NULL);
+    } else if (!g_strcmp0(factory_name, "capsfilter")) {
+      GstCaps *caps = NULL;
+      gint num = 0, den = 1;
+      g_object_get(copy, "caps", &caps, NULL);
+      if (caps && !gst_caps_is_empty(caps)
+          && gst_structure_get_fraction(gst_caps_get_structure(caps, 0), "framerate", &num, &den)
+          && den && num % den == 0) {
+        framerate = num / den;
+      }
+      if (caps) {
+        gst_caps_unref(caps);
+      }
+    }
+
+    if (!gst_bin_add(GST_BIN (pipeline), copy) || (previous && !gst_element_link(previous, copy))) {
+      GST_ERROR("Shared encoder of \"%s\": can't copy \"%s\"!", mount.c_str(), GST_ELEMENT_NAME (element));
+      gst_object_unref(element);
+      return;
+    }
+    previous = copy;
+
+    GstElement *next = Rendition::NextElement(element);
+    gst_object_unref(element);
+    element = next;
+  }
+
+  GCF_ERROR_RETURN(!payloader || !previous, "Shared encoder of \"%s\": mount has no payloader!", mount.c_str());
+  GCF_ERROR_RETURN(!framerate, "Shared encoder of \"%s\": mount has no caps filter with an integer framerate!",
+                   mount.c_str());
+
+  // Ask the encoder for a hierarchical-P structure
+  GstElement *encoder = levels > 1 ? gst_bin_get_by_name(GST_BIN (pipeline), config.temporal_encoder.c_str()) : NULL;
+  GCF_ERROR_RETURN(levels > 1 && !encoder, "Shared encoder of \"%s\": encoder \"%s\" is not found!",
+                   mount.c_str(), config.temporal_encoder.c_str());
+
+  if (encoder) {
+    bool capable = g_object_class_find_property(G_OBJECT_GET_CLASS (encoder), "temporal-levels") != NULL;
+    if (capable) {
+      g_object_set(encoder, "temporal-levels", levels, NULL);
+      if (g_object_class_find_property(G_OBJECT_GET_CLASS (encoder), "prediction-type")) {
+        gst_util_set_object_arg(G_OBJECT (encoder), "prediction-type", "hierarchical-p");
+      }
+    } else {
+      // E.g. an "@h264enc" that got a software encoder on this host: the
+      // full rate, HLS, recording and time-shift still work, layers don't
+      GST_WARNING("Shared encoder of \"%s\": \"%s\" (%s) has no temporal-levels property, "
+                  "serving the full framerate only", mount.c_str(), config.temporal_encoder.c_str(),
+                  GST_OBJECT_NAME (gst_element_get_factory(encoder)));
+      levels = 1;
+    }
+    gst_object_unref(encoder);
+  }
+
+  // Whole frames, so the filters of the layers can count them, with the
+  // parameter sets in the caps as the fragmented MP4 output needs them
+  appsink = gst_element_factory_make("appsink", ("sharedsink_" + mount).c_str());
+  GstCaps *caps = gst_caps_from_string("video/x-h264, stream-format=(string)avc, alignment=(string)au; "
+                                       "video/x-h265, stream-format=(string)hvc1, alignment=(string)au");
+  g_object_set(appsink, "caps", caps, "sync", FALSE, "emit-signals", TRUE, NULL);
+  gst_caps_unref(caps);
+  g_signal_connect(appsink, "new-sample", G_CALLBACK (NewSample), this);
+
+  GCF_ERROR_RETURN(!gst_bin_add(GST_BIN (pipeline), appsink) || !gst_element_link(previous, appsink),
+                   "Shared encoder of \"%s\": can't link the encoder output!", mount.c_str());
+
+  // Other side of the tunnel, the server links it to the source tee
+  queue = gst_element_factory_make("queue", ("queue_" + name).c_str());
+  intersink = gst_element_factory_make("intervideosink", ("intersink_" + name).c_str());
+  GCF_ERROR_RETURN(!queue || !intersink, "Shared encoder of \"%s\": can't create the tunnel elements!",
+                   mount.c_str());
+  g_object_set(intersink, "channel", gateway_name.c_str(), NULL);
+
+  valid = true;
+
+  GST_INFO("Shared encoder of \"%s\": %u temporal levels from %d fps", mount.c_str(), levels, framerate);
+}
+
+SharedEncoder::~SharedEncoder() {
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  if (payloader) {
+    gst_object_unref(payloader);
+  }
+}
+
+bool SharedEncoder::LayerOf(gint fps, guint &layer) const {
+  for (guint i = 0; i < levels; i++) {
+    if (framerate % (1 << i) == 0 && framerate >> i == fps) {
+      layer = levels - 1 - i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+GstElement *SharedEncoder::CreateLayer(const std::string &media_name, guint layer) {
+  GstElement *bin = gst_pipeline_new(media_name.c_str());
+  GstElement *appsrc = gst_element_factory_make("appsrc", ("layersrc_" + media_name).c_str());
+  GstElement *filter = gst_element_factory_make("gcftemporalfilter", NULL);
+  GstElement *pay = Rendition::Clone(payloader);
+
+  g_object_set(appsrc, "is-live", TRUE, "format", GST_FORMAT_TIME, NULL);
+  g_object_set(filter, "levels", levels, "layer", layer, NULL);
+
+  gst_bin_add_many(GST_BIN (bin), appsrc, filter, pay, NULL);
+  if (!gst_element_link_many(appsrc, filter, pay, NULL)) {
+    GST_ERROR("Shared encoder of \"%s\": can't build layer media \"%s\"!", mount.c_str(), media_name.c_str());
+    gst_object_unref(bin);
+    return NULL;
+  }
+
+  GST_INFO("Layer media \"%s\": %d fps", media_name.c_str(), framerate >> (levels - 1 - layer));
+
+  return bin;
+}
+
+bool SharedEncoder::Attach(GstElement *appsrc) {
+  bool first;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (std::find(outlets.begin(), outlets.end(), appsrc) != outlets.end()) {
+      return false;
+    }
+    first = outlets.empty() && listeners.empty();
+    outlets.push_back(GST_ELEMENT (gst_object_ref(appsrc)));
+  }
+
+  if (first) {
+    return Start();
+  }
+
+  // The newcomer waits for a keyframe, don't make it wait a whole GOP
+  RequestKeyframe();
+  return false;
+}
+
+bool SharedEncoder::AddListener(SampleCallback callback, gpointer user_data) {
+  bool first;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    first = outlets.empty() && listeners.empty();
+    listeners.push_back({callback, user_data});
+  }
+
+  if (first) {
+    return Start();
+  }
+
+  // The newcomer waits for a keyframe, don't make it wait a whole GOP
+  RequestKeyframe();
+  return false;
+}
+
+bool SharedEncoder::Start() {
+  GST_INFO("Starting the shared encoder of \"%s\"", mount.c_str());
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+  return true;
+}
+
+void SharedEncoder::Stop() {
+  GST_INFO("Stopping the shared encoder of \"%s\"", mount.c_str());
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+}
+
+bool SharedEncoder::Detach(GstElement *appsrc) {
+  bool last;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto outlet = std::find(outlets.begin(), outlets.end(), appsrc);
+    if (outlet == outlets.end()) {
+      return false;
+    }
+    gst_object_unref(*outlet);
+    outlets.erase(outlet);
+    last = outlets.empty() && listeners.empty();
+  }
+
+  if (last) {
+    Stop();
+  }
+
+  return last;
+}
+
+bool SharedEncoder::RemoveListener(SampleCallback callback, gpointer user_data) {
+  bool last;
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    auto listener = std::find_if(listeners.begin(), listeners.end(), [callback, user_data](const Listener &l) {
+      return l.callback == callback && l.user_data == user_data;
+    });
+    if (listener == listeners.end()) {
+      return false;
+    }
+    listeners.erase(listener);
+    last = outlets.empty() && listeners.empty();
+
+    // A copy of the list may be handed the sample right now, the caller frees the listener after this
+    if (dispatcher != std::this_thread::get_id()) {
+      dispatched.wait(guard, [this]() { return !dispatching; });
+    }
+  }
+
+  if (last) {
+    Stop();
+  }
+
+  return last;
+}
+
+void SharedEncoder::RequestKeyframe() {
+  gst_element_send_event(appsink, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE,
+                                                                              ++keyframe_requests));
+}
+
+// Hand the frame to the listeners, and to every layer media moved to its own running time
+GstFlowReturn SharedEncoder::NewSample(GstElement *appsink, gpointer user_data) {
+  SharedEncoder *self = static_cast<SharedEncoder *>(user_data);
+
+  GstSample *sample = gst_app_sink_pull_sample(GST_APP_SINK (appsink));
+  if (!sample) {
+    return GST_FLOW_EOS;
+  }
+
+  GstBuffer *buffer = gst_sample_get_buffer(sample);
+  GstCaps *caps = gst_sample_get_caps(sample);
+  GstClockTime base_time = gst_element_get_base_time(self->pipeline);
+
+  // Listeners may take their time or come back to the encoder, they are called without the lock
+  std::vector<Listener> listeners;
+  {
+    std::lock_guard<std::mutex> guard(self->lock);
+    listeners = self->listeners;
+    if (!listeners.empty()) {
+      self->dispatching = true;
+      self->dispatcher = std::this_thread::get_id();
+    }
+  }
+
+  for (auto &listener : listeners) {
+    listener.callback(sample, listener.user_data);
+  }
+
+  std::unique_lock<std::mutex> guard(self->lock);
+  if (self->dispatching) {
+    self->dispatching = false;
+    self->dispatcher = std::thread::id();
+    self->dispatched.notify_all();
+  }
+
+  for (auto outlet : self->outlets) {
+    GstClockTime outlet_base = gst_element_get_base_time(outlet);
+    GstClockTime pts = GST_BUFFER_PTS (buffer), dts = GST_BUFFER_DTS (buffer);
+
+    // Started before the layer media did
+    if ((GST_CLOCK_TIME_IS_VALID (pts) && pts + base_time < outlet_base)
+        || (GST_CLOCK_TIME_IS_VALID (dts) && dts + base_time < outlet_base)) {
+      continue;
+    }
+
+    GstBuffer *copy = gst_buffer_copy(buffer);
+    if (GST_CLOCK_TIME_IS_VALID (pts)) {
+      GST_BUFFER_PTS (copy) = pts + base_time - outlet_base;
+    }
+    if (GST_CLOCK_TIME_IS_VALID (dts)) {
+      GST_BUFFER_DTS (copy) = dts + base_time - outlet_base;
+    }
+
+    GstSample *outgoing = gst_sample_new(copy, caps, NULL, NULL);
+    gst_app_src_push_sample(GST_APP_SRC (outlet), outgoing);
+    gst_sample_unref(outgoing);
+    gst_buffer_unref(copy);
+  }
+
+  gst_sample_unref(sample);
+
+  return GST_FLOW_OK;
+}
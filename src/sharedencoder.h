@@ -0,0 +1,93 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mount.h"
+
+// One encode of a mount, shared by every RTSP client of the mount and by
+// its HTTP output. The encoder runs in its own pipeline tunnelled from the
+// source tee, and its frames are handed to the layer medias, which keep a
+// full, half or quarter rate subset with a gcftemporalfilter and payload
+// it for their own clients. With temporal layers the encoder is asked for
+// a hierarchical-P structure, otherwise every layer media gets all frames.
+// An encoder without temporal-levels falls back to one level, the full rate.
+
+class SharedEncoder {
+public:
+
+  // Receives every encoded frame with the encoder's own timestamps
+  typedef void (*SampleCallback)(GstSample *sample, gpointer user_data);
+
+  SharedEncoder(GstElement *mount_pipe, const std::string &mount, const MountConfig &config);
+  ~SharedEncoder();
+
+  bool IsValid() const { return valid; }
+
+  // Name of the encoder pipeline, the server links its tunnel with this name
+  const std::string &Name() const { return name; }
+
+  // Layer giving the requested framerate, false if no layer matches
+  bool LayerOf(gint fps, guint &layer) const;
+
+  // Highest layer, the full framerate
+  guint TopLayer() const { return levels - 1; }
+
+  // Payloader of the mount, copied by every media fed from the encode
+  GstElement *Payloader() const { return payloader; }
+
+  // Clock time of the encoder's running time 0, for listeners in other processes
+  GstClockTime BaseTime() const { return gst_element_get_base_time(pipeline); }
+
+  // Media element for the layers up to the given one
+  GstElement *CreateLayer(const std::string &media_name, guint layer);
+
+  // Start and stop feeding a layer media or a listener, true when the
+  // encoder started with the first or stopped with the last one. Once
+  // RemoveListener returns, the listener is not called anymore, unless it
+  // is removed from its own callback.
+  bool Attach(GstElement *appsrc);
+  bool Detach(GstElement *appsrc);
+  bool AddListener(SampleCallback callback, gpointer user_data);
+  bool RemoveListener(SampleCallback callback, gpointer user_data);
+
+  GstElement *queue;
+  GstElement *intersink;
+
+private:
+
+  static GstFlowReturn NewSample(GstElement *appsink, gpointer user_data);
+
+  bool Start();
+  void Stop();
+  void RequestKeyframe();
+
+  struct Listener {
+    SampleCallback callback;
+    gpointer user_data;
+  };
+
+  std::string mount;
+  std::string name;
+  guint levels;
+  gint framerate;
+  bool valid;
+  guint keyframe_requests;
+
+  GstElement *pipeline;
+  GstElement *appsink;
+  GstElement *payloader;
+
+  std::mutex lock;
+  std::vector<GstElement *> outlets;
+  std::vector<Listener> listeners;
+
+  // The listeners are called without the lock, removing one waits for the call
+  std::condition_variable dispatched;
+  bool dispatching;
+  std::thread::id dispatcher;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+// Layout of the frame ring shared with local readers: raw frames published
+// by gcfshmsink, or encoded access units exported to the RTSP workers. The
+// ring lives in a sealed memfd, which the writer hands out on its unix
+// socket with SCM_RIGHTS. Readers map it read-only and access the frames
+// in place, so this header must not depend on GStreamer.
+//
+//   [ShmFramesHeader][pad to page] [slot 0][slot 1]...[slot N-1]
+//   slot: [ShmFramesSlot][pad to SHM_FRAMES_SLOT_HEADER][frame bytes]
+//
+// Every slot is guarded by a sequence lock: odd while it's written. A
+// reader takes the lock value before touching the frame and checks it
+// again afterwards; if it changed, the frame was overwritten meanwhile.
+
+#define SHM_FRAMES_MAGIC 0x53464347u // "GCFS"
+#define SHM_FRAMES_VERSION 2
+#define SHM_FRAMES_CAPS_SIZE 1024
+#define SHM_FRAMES_MAX_PLANES 4
+#define SHM_FRAMES_SLOT_HEADER 256
+#define SHM_FRAMES_NO_TIME UINT64_MAX
+
+// Slot flags
+#define SHM_FRAMES_FLAG_DELTA 1 // not a keyframe
+
+struct ShmFramesHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slots;
+  uint32_t slot_size;      // bytes of one slot, its descriptor included
+  uint64_t data_offset;    // of the first slot, page aligned
+
+  uint32_t closed;         // the writer stopped or moved to a new memfd: reconnect
+  uint32_t notify;         // futex word, bumped after every frame
+  uint64_t sequence;       // last published frame, starting at 1
+
+  uint32_t caps_version;   // odd while the caps string is changed
+  uint32_t reserved;
+  char caps[SHM_FRAMES_CAPS_SIZE];
+};
+
+struct ShmFramesSlot {
+  uint64_t lock;
+  uint64_t sequence;
+
+  uint64_t pts;            // running time of the frame (ns)
+  uint64_t dts;
+  uint64_t duration;
+  uint64_t base_time;      // CLOCK_MONOTONIC time (ns) of running time 0
+  int64_t wallclock;       // publish time, us since the epoch
+
+  uint32_t size;
+  uint32_t caps_version;
+  uint32_t flags;
+  uint32_t reserved;
+
+  uint32_t width;
+  uint32_t height;
+  uint32_t planes;
+  uint32_t offset[SHM_FRAMES_MAX_PLANES];
+  int32_t stride[SHM_FRAMES_MAX_PLANES];
+};
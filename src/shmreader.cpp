@@ -0,0 +1,240 @@
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <ctime>
+
+#include "shmreader.h"
+
+ShmFrameReader::ShmFrameReader()
+    : fd(-1),
+      map(NULL),
+      map_size(0),
+      header(NULL),
+      last_sequence(0),
+      skipped(0) {
+}
+
+ShmFrameReader::~ShmFrameReader() {
+  Close();
+}
+
+// The sink sends one byte with the memfd attached
+static int ReceiveFd(int socket_fd) {
+  char byte;
+  struct iovec iov = {&byte, 1};
+  union {
+    struct cmsghdr align;
+    char buffer[CMSG_SPACE(sizeof(int))];
+  } control;
+
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+
+  if (recvmsg(socket_fd, &message, MSG_CMSG_CLOEXEC) <= 0) {
+    return -1;
+  }
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+    return -1;
+  }
+
+  int received;
+  memcpy(&received, CMSG_DATA(cmsg), sizeof(int));
+  return received;
+}
+
+bool ShmFrameReader::Connect(const std::string &socket_path) {
+  Close();
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+  int socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket_fd < 0) {
+    return false;
+  }
+
+  if (connect(socket_fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+    close(socket_fd);
+    return false;
+  }
+
+  fd = ReceiveFd(socket_fd);
+  close(socket_fd);
+
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) < 0 || (size_t) info.st_size < sizeof(ShmFramesHeader)) {
+    Close();
+    return false;
+  }
+
+  map_size = (size_t) info.st_size;
+  void *mapped = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mapped == MAP_FAILED) {
+    Close();
+    return false;
+  }
+
+  map = (uint8_t *) mapped;
+  header = (ShmFramesHeader *) map;
+
+  if (header->magic != SHM_FRAMES_MAGIC || header->version != SHM_FRAMES_VERSION
+      || header->data_offset + (uint64_t) header->slots * header->slot_size > map_size) {
+    Close();
+    return false;
+  }
+
+  // Frames published before the connection are not counted as skipped
+  last_sequence = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+  skipped = 0;
+  return true;
+}
+
+void ShmFrameReader::Close() {
+  if (map) {
+    munmap(map, map_size);
+  }
+
+  if (fd >= 0) {
+    close(fd);
+  }
+
+  fd = -1;
+  map = NULL;
+  map_size = 0;
+  header = NULL;
+}
+
+bool ShmFrameReader::Closed() const {
+  return !header || __atomic_load_n(&header->closed, __ATOMIC_ACQUIRE);
+}
+
+bool ShmFrameReader::Wait(int timeout_ms) {
+  struct timespec deadline, now;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  while (!Closed()) {
+    // Read the futex word first, so a frame published in between isn't missed
+    uint32_t notify = __atomic_load_n(&header->notify, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE) > last_sequence) {
+      return true;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t left = (deadline.tv_sec - now.tv_sec) * 1000000000LL + (deadline.tv_nsec - now.tv_nsec);
+    if (left <= 0) {
+      return false;
+    }
+
+    struct timespec timeout = {(time_t) (left / 1000000000LL), (long) (left % 1000000000LL)};
+    syscall(SYS_futex, &header->notify, FUTEX_WAIT, notify, &timeout, NULL, 0);
+  }
+
+  return false;
+}
+
+bool ShmFrameReader::Acquire(ShmFrame &frame) {
+  if (!header) {
+    return false;
+  }
+
+  uint64_t sequence = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+  return sequence && AcquireAt(sequence, frame);
+}
+
+bool ShmFrameReader::Next(ShmFrame &frame) {
+  if (!header) {
+    return false;
+  }
+
+  uint64_t newest = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+  if (newest <= last_sequence) {
+    return false;
+  }
+
+  // The slot after the newest one may be rewritten any moment
+  uint64_t sequence = last_sequence + 1;
+  if (newest - sequence + 1 >= header->slots) {
+    sequence = newest;
+  }
+
+  return AcquireAt(sequence, frame);
+}
+
+bool ShmFrameReader::AcquireAt(uint64_t sequence, ShmFrame &frame) {
+  const ShmFramesSlot *slot = (const ShmFramesSlot *) (map + header->data_offset
+      + ((sequence - 1) % header->slots) * header->slot_size);
+
+  // Being rewritten already: the reader is a whole ring behind
+  uint64_t lock = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+  if ((lock & 1) || slot->sequence != sequence
+      || SHM_FRAMES_SLOT_HEADER + (uint64_t) slot->size > header->slot_size) {
+    return false;
+  }
+
+  if (sequence > last_sequence + 1) {
+    skipped += sequence - last_sequence - 1;
+  }
+  last_sequence = sequence;
+
+  frame.data = (const uint8_t *) slot + SHM_FRAMES_SLOT_HEADER;
+  frame.slot = slot;
+  frame.size = slot->size;
+  frame.sequence = sequence;
+  frame.lock = lock;
+  return true;
+}
+
+bool ShmFrameReader::Valid(const ShmFrame &frame) const {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&frame.slot->lock, __ATOMIC_RELAXED) == frame.lock;
+}
+
+bool ShmFrameReader::Copy(const ShmFrame &frame, std::vector<uint8_t> &buffer) const {
+  buffer.resize(frame.size);
+  memcpy(buffer.data(), frame.data, buffer.size());
+
+  return Valid(frame);
+}
+
+std::string ShmFrameReader::Caps() const {
+  if (!header) {
+    return std::string();
+  }
+
+  // Copied again if the writer changed it meanwhile
+  for (;;) {
+    uint32_t version = __atomic_load_n(&header->caps_version, __ATOMIC_ACQUIRE);
+    if (version & 1) {
+      continue;
+    }
+
+    std::string caps(header->caps, strnlen(header->caps, SHM_FRAMES_CAPS_SIZE));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&header->caps_version, __ATOMIC_RELAXED) == version) {
+      return caps;
+    }
+  }
+}
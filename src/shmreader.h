@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "shmframes.h"
+
+// Reader side of the gcfshmsink frame ring, for the local analytics
+// processes. It depends on nothing but the C library, so it can be
+// copied into other projects together with shmframes.h.
+//
+//   ShmFrameReader reader;
+//   reader.Connect("/tmp/gcf-analytics.sock");
+//   while (reader.Wait(1000)) {
+//     ShmFrame frame;
+//     if (reader.Acquire(frame)) {
+//       Process(frame.data, frame.size);        // in place, no copy
+//       if (!reader.Valid(frame)) { ... }       // overwritten meanwhile
+//     }
+//   }
+
+struct ShmFrame {
+  const uint8_t *data;
+  const ShmFramesSlot *slot;
+  uint32_t size;
+  uint64_t sequence;
+  uint64_t lock;
+};
+
+class ShmFrameReader {
+public:
+
+  ShmFrameReader();
+  ~ShmFrameReader();
+
+  // Receives the memfd from the socket of the sink and maps it
+  bool Connect(const std::string &socket_path);
+  void Close();
+
+  // Waits for a frame newer than the last acquired one. False on timeout,
+  // or when the ring was closed and the reader has to connect again
+  bool Wait(int timeout_ms);
+  bool Closed() const;
+
+  // The newest frame, mapped in place
+  bool Acquire(ShmFrame &frame);
+
+  // The frame after the last acquired one, for streams that can't skip
+  // frames. A reader that fell a whole ring behind jumps to the newest,
+  // which shows up in Skipped()
+  bool Next(ShmFrame &frame);
+
+  // False if the writer reused the slot since the frame was acquired
+  bool Valid(const ShmFrame &frame) const;
+
+  // Private copy of the frame, false if it was torn while copying
+  bool Copy(const ShmFrame &frame, std::vector<uint8_t> &buffer) const;
+
+  // GStreamer caps of the frames, e.g. "video/x-raw, format=NV12, ..."
+  std::string Caps() const;
+
+  // Frames the writer published that this reader never acquired
+  uint64_t Skipped() const { return skipped; }
+
+private:
+
+  bool AcquireAt(uint64_t sequence, ShmFrame &frame);
+
+  int fd;
+  uint8_t *map;
+  size_t map_size;
+  ShmFramesHeader *header;
+  uint64_t last_sequence;
+  uint64_t skipped;
+};
@@ -0,0 +1,237 @@
+#include <gio/gunixconnection.h>
+#include <gio/gunixsocketaddress.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include "shmring.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_shmring);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_shmring       // set as default
+
+// Readers sleeping on the futex word are woken after every change
+static void Notify(ShmFramesHeader *header) {
+  __atomic_add_fetch(&header->notify, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &header->notify, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+ShmRingWriter::ShmRingWriter(const std::string &name, const std::string &socket_path, guint slots)
+    : name(name),
+      socket_path(socket_path),
+      slots(slots),
+      service(NULL),
+      socket_inode(0),
+      fd(-1),
+      map(NULL),
+      map_size(0),
+      header(NULL),
+      sequence(0) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_SHMRING", GST_DEBUG_FG_BLUE, "Shared memory frame rings"
+  );
+}
+
+ShmRingWriter::~ShmRingWriter() {
+  Stop();
+}
+
+bool ShmRingWriter::Start() {
+  GError *error = NULL;
+
+  // Left behind by a previous run
+  unlink(socket_path.c_str());
+
+  GSocketAddress *address = g_unix_socket_address_new(socket_path.c_str());
+  service = g_threaded_socket_service_new(2);
+  gboolean listening = g_socket_listener_add_address(G_SOCKET_LISTENER (service), address,
+                                                     G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+                                                     NULL, NULL, &error);
+  g_object_unref(address);
+
+  if (!listening) {
+    GST_ERROR("Ring \"%s\": can't listen on \"%s\": %s", name.c_str(), socket_path.c_str(), error->message);
+    g_error_free(error);
+    g_object_unref(service);
+    service = NULL;
+    return false;
+  }
+
+  struct stat info;
+  socket_inode = stat(socket_path.c_str(), &info) == 0 ? info.st_ino : 0;
+
+  g_signal_connect(service, "run", G_CALLBACK (Run), this);
+  g_socket_service_start(service);
+
+  GST_INFO("Ring \"%s\" is published on \"%s\"", name.c_str(), socket_path.c_str());
+  return true;
+}
+
+void ShmRingWriter::Stop() {
+  if (service) {
+    g_socket_service_stop(service);
+    g_socket_listener_close(G_SOCKET_LISTENER (service));
+    g_object_unref(service);
+    service = NULL;
+
+    // The readers of this ring reconnect to the process bound there now
+    struct stat info;
+    if (stat(socket_path.c_str(), &info) == 0 && info.st_ino == socket_inode) {
+      unlink(socket_path.c_str());
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  CloseRing();
+}
+
+// Every connection gets the current memfd and is closed
+gboolean ShmRingWriter::Run(GThreadedSocketService *service, GSocketConnection *connection,
+                            GObject *source, gpointer user_data) {
+  ShmRingWriter *self = static_cast<ShmRingWriter *>(user_data);
+  GError *error = NULL;
+  gboolean sent;
+
+  {
+    std::lock_guard<std::mutex> guard(self->lock);
+    sent = self->fd >= 0 && g_unix_connection_send_fd(G_UNIX_CONNECTION (connection), self->fd, NULL, &error);
+  }
+
+  if (error) {
+    GST_WARNING("Ring \"%s\": can't hand out the memfd: %s", self->name.c_str(), error->message);
+    g_error_free(error);
+  } else if (sent) {
+    GST_DEBUG("Ring \"%s\" is handed to a reader", self->name.c_str());
+  }
+
+  return TRUE;
+}
+
+bool ShmRingWriter::SetCaps(const std::string &new_caps, gsize frame_size) {
+  caps = new_caps;
+
+  if (!header || SHM_FRAMES_SLOT_HEADER + frame_size > header->slot_size) {
+    return CreateRing(frame_size);
+  }
+
+  WriteCaps();
+  return true;
+}
+
+bool ShmRingWriter::Publish(GstBuffer *buffer, const ShmFramesSlot &descriptor) {
+  gsize size = gst_buffer_get_size(buffer);
+
+  if (!header || SHM_FRAMES_SLOT_HEADER + size > header->slot_size) {
+    if (!CreateRing(size)) {
+      return false;
+    }
+  }
+
+  guint64 next = ++sequence;
+  ShmFramesSlot *slot = (ShmFramesSlot *) (map + header->data_offset
+      + ((next - 1) % header->slots) * header->slot_size);
+
+  guint64 slot_lock = slot->lock;
+  __atomic_store_n(&slot->lock, slot_lock + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  // Everything but the lock word comes from the descriptor
+  memcpy((guint8 *) slot + sizeof(slot->lock), (const guint8 *) &descriptor + sizeof(descriptor.lock),
+         sizeof(ShmFramesSlot) - sizeof(slot->lock));
+  slot->sequence = next;
+  slot->wallclock = g_get_real_time();
+  slot->size = (guint32) size;
+  slot->caps_version = __atomic_load_n(&header->caps_version, __ATOMIC_RELAXED);
+
+  gst_buffer_extract(buffer, 0, (guint8 *) slot + SHM_FRAMES_SLOT_HEADER, size);
+
+  __atomic_store_n(&slot->lock, slot_lock + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&header->sequence, next, __ATOMIC_RELEASE);
+  Notify(header);
+
+  GST_LOG("Ring \"%s\": frame %" G_GUINT64_FORMAT " published, %" G_GSIZE_FORMAT " bytes", name.c_str(), next, size);
+  return true;
+}
+
+bool ShmRingWriter::CreateRing(gsize frame_size) {
+  gsize page = (gsize) sysconf(_SC_PAGESIZE);
+  gsize slot_size = GST_ROUND_UP_N (SHM_FRAMES_SLOT_HEADER + frame_size, page);
+  gsize data_offset = GST_ROUND_UP_N (sizeof(ShmFramesHeader), page);
+  gsize size = data_offset + slot_size * slots;
+
+  GCF_ERROR_RETURN_VAL(slot_size > G_MAXUINT32, false,
+                       "Ring \"%s\": frames of %" G_GSIZE_FORMAT " bytes are too big", name.c_str(), frame_size);
+
+  // Sealed, so the readers can trust the size they map
+  gint ring_fd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (ring_fd < 0 || ftruncate(ring_fd, size) < 0
+      || fcntl(ring_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+    GST_ERROR("Ring \"%s\": can't create the memfd: %s", name.c_str(), g_strerror(errno));
+    if (ring_fd >= 0) {
+      close(ring_fd);
+    }
+    return false;
+  }
+
+  guint8 *ring_map = (guint8 *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+  if (ring_map == MAP_FAILED) {
+    GST_ERROR("Ring \"%s\": can't map the memfd: %s", name.c_str(), g_strerror(errno));
+    close(ring_fd);
+    return false;
+  }
+
+  ShmFramesHeader *ring_header = (ShmFramesHeader *) ring_map;
+  ring_header->magic = SHM_FRAMES_MAGIC;
+  ring_header->version = SHM_FRAMES_VERSION;
+  ring_header->slots = slots;
+  ring_header->slot_size = (guint32) slot_size;
+  ring_header->data_offset = data_offset;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    CloseRing();
+    fd = ring_fd;
+    map = ring_map;
+    map_size = size;
+    header = ring_header;
+    sequence = 0;
+  }
+
+  WriteCaps();
+
+  GST_INFO("Ring \"%s\": %u slots of %" G_GSIZE_FORMAT " bytes", name.c_str(), slots, slot_size);
+  return true;
+}
+
+// Called with the lock held; the readers keep their own mapping of the memfd
+void ShmRingWriter::CloseRing() {
+  if (!header) {
+    return;
+  }
+
+  __atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+  Notify(header);
+
+  munmap(map, map_size);
+  close(fd);
+
+  fd = -1;
+  map = NULL;
+  map_size = 0;
+  header = NULL;
+}
+
+// Odd version while the string is changed, see ShmFrameReader::Caps()
+void ShmRingWriter::WriteCaps() {
+  __atomic_add_fetch(&header->caps_version, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  g_strlcpy(header->caps, caps.c_str(), SHM_FRAMES_CAPS_SIZE);
+  __atomic_add_fetch(&header->caps_version, 1, __ATOMIC_RELEASE);
+}
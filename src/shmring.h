@@ -0,0 +1,60 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+#include <sys/types.h>
+#include <mutex>
+#include <string>
+
+#include "shmframes.h"
+
+// Writer of a shmframes.h ring. The memfd is handed out to every process
+// connecting to the unix socket. When a frame doesn't fit the slots any
+// more, the ring is replaced by a bigger one, and the readers of the old
+// one see it closed and connect again.
+
+class ShmRingWriter {
+public:
+
+  ShmRingWriter(const std::string &name, const std::string &socket_path, guint slots);
+  ~ShmRingWriter();
+
+  // Listen on the socket, false if it can't be bound
+  bool Start();
+  void Stop();
+
+  // Caps of the next frames, and the slot size they need
+  bool SetCaps(const std::string &caps, gsize frame_size);
+
+  // Copies the buffer into the next slot; the timestamps, flags and plane
+  // layout are taken from the descriptor, the rest is filled in here
+  bool Publish(GstBuffer *buffer, const ShmFramesSlot &descriptor);
+
+  const std::string &SocketPath() const { return socket_path; }
+
+private:
+
+  static gboolean Run(GThreadedSocketService *service, GSocketConnection *connection,
+                      GObject *source, gpointer user_data);
+
+  bool CreateRing(gsize frame_size);
+  void CloseRing();
+  void WriteCaps();
+
+  std::string name;
+  std::string socket_path;
+  guint slots;
+  GSocketService *service;
+  // A process taking over binds the path again, its socket is left alone
+  ino_t socket_inode;
+
+  // Guards the memfd against the socket service handing it out
+  std::mutex lock;
+  gint fd;
+  guint8 *map;
+  gsize map_size;
+  ShmFramesHeader *header;
+
+  std::string caps;
+  guint64 sequence;
+};
@@ -0,0 +1,179 @@
+#include "shmsink.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_plugin_shmsink);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_plugin_shmsink       // set as default
+
+#define DEFAULT_SLOTS 8
+#define MAX_SLOTS 256
+
+enum {
+  PROP_0,
+  PROP_SOCKET_PATH,
+  PROP_SLOTS
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE (
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS ("video/x-raw"));
+
+G_DEFINE_TYPE (GcfShmSink, gcf_shm_sink, GST_TYPE_BASE_SINK);
+
+static gboolean gcf_shm_sink_start(GstBaseSink *sink) {
+  GcfShmSink *self = GCF_SHM_SINK (sink);
+
+  if (!self->socket_path) {
+    self->socket_path = g_strdup_printf("/tmp/gcf-%s.sock", GST_OBJECT_NAME (self));
+  }
+
+  self->writer = new ShmRingWriter(GST_OBJECT_NAME (self), self->socket_path, self->slots);
+  if (!self->writer->Start()) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ_WRITE, ("Can't listen on \"%s\"", self->socket_path), (NULL));
+    delete self->writer;
+    self->writer = NULL;
+    return FALSE;
+  }
+
+  GST_INFO_OBJECT (self, "Publishing frames on \"%s\"", self->socket_path);
+  return TRUE;
+}
+
+static gboolean gcf_shm_sink_stop(GstBaseSink *sink) {
+  GcfShmSink *self = GCF_SHM_SINK (sink);
+
+  delete self->writer;
+  self->writer = NULL;
+
+  return TRUE;
+}
+
+static gboolean gcf_shm_sink_set_caps(GstBaseSink *sink, GstCaps *caps) {
+  GcfShmSink *self = GCF_SHM_SINK (sink);
+
+  if (!gst_video_info_from_caps(&self->info, caps)) {
+    GST_ERROR_OBJECT (self, "Invalid caps: %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  gchar *caps_string = gst_caps_to_string(caps);
+  bool ready = self->writer->SetCaps(caps_string, self->info.size);
+  g_free(caps_string);
+
+  if (!ready) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ_WRITE, ("Can't create the frame ring"), (NULL));
+  }
+
+  return ready;
+}
+
+static GstFlowReturn gcf_shm_sink_render(GstBaseSink *sink, GstBuffer *buffer) {
+  GcfShmSink *self = GCF_SHM_SINK (sink);
+  ShmFramesSlot descriptor = {};
+
+  GstClockTime pts = gst_segment_to_running_time(&sink->segment, GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+
+  descriptor.pts = GST_CLOCK_TIME_IS_VALID (pts) ? pts : SHM_FRAMES_NO_TIME;
+  descriptor.dts = descriptor.pts;
+  descriptor.duration = GST_BUFFER_DURATION_IS_VALID (buffer) ? GST_BUFFER_DURATION (buffer) : SHM_FRAMES_NO_TIME;
+  descriptor.base_time = gst_element_get_base_time(GST_ELEMENT (self));
+  descriptor.width = GST_VIDEO_INFO_WIDTH (&self->info);
+  descriptor.height = GST_VIDEO_INFO_HEIGHT (&self->info);
+
+  // The layout of the buffer itself wins over the one the caps imply
+  descriptor.planes = MIN (meta ? meta->n_planes : GST_VIDEO_INFO_N_PLANES (&self->info), SHM_FRAMES_MAX_PLANES);
+  for (guint i = 0; i < descriptor.planes; i++) {
+    descriptor.offset[i] = meta ? meta->offset[i] : GST_VIDEO_INFO_PLANE_OFFSET (&self->info, i);
+    descriptor.stride[i] = meta ? meta->stride[i] : GST_VIDEO_INFO_PLANE_STRIDE (&self->info, i);
+  }
+
+  // Padded buffers can be larger than the caps tell, the writer grows the ring then
+  if (!self->writer->Publish(buffer, descriptor)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE, ("Can't publish the frame"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static void gcf_shm_sink_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+  GcfShmSink *self = GCF_SHM_SINK (object);
+
+  switch (prop_id) {
+    case PROP_SOCKET_PATH:
+      g_free(self->socket_path);
+      self->socket_path = g_value_dup_string(value);
+      break;
+    case PROP_SLOTS:
+      self->slots = g_value_get_uint(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gcf_shm_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+  GcfShmSink *self = GCF_SHM_SINK (object);
+
+  switch (prop_id) {
+    case PROP_SOCKET_PATH:
+      g_value_set_string(value, self->socket_path);
+      break;
+    case PROP_SLOTS:
+      g_value_set_uint(value, self->slots);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gcf_shm_sink_finalize(GObject *object) {
+  GcfShmSink *self = GCF_SHM_SINK (object);
+
+  g_free(self->socket_path);
+
+  G_OBJECT_CLASS (gcf_shm_sink_parent_class)->finalize(object);
+}
+
+static void gcf_shm_sink_class_init(GcfShmSinkClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_PLUGIN_SHMSINK", GST_DEBUG_FG_BLUE, "Shared memory frame export"
+  );
+
+  gobject_class->set_property = gcf_shm_sink_set_property;
+  gobject_class->get_property = gcf_shm_sink_get_property;
+  gobject_class->finalize = gcf_shm_sink_finalize;
+
+  g_object_class_install_property(gobject_class, PROP_SOCKET_PATH,
+      g_param_spec_string("socket-path", "Socket path", "Unix socket handing out the ring "
+                          "(default: /tmp/gcf-<name>.sock)", NULL,
+                          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class, PROP_SLOTS,
+      g_param_spec_uint("slots", "Slots", "Number of frames kept in the ring",
+                        2, MAX_SLOTS, DEFAULT_SLOTS,
+                        (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  basesink_class->start = gcf_shm_sink_start;
+  basesink_class->stop = gcf_shm_sink_stop;
+  basesink_class->set_caps = gcf_shm_sink_set_caps;
+  basesink_class->render = gcf_shm_sink_render;
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+
+  gst_element_class_set_static_metadata(element_class,
+      "Shared memory frame sink", "Sink/Video",
+      "Publishes raw frames into a memfd ring for local readers", "gst-rtsp-app");
+}
+
+static void gcf_shm_sink_init(GcfShmSink *self) {
+  self->writer = NULL;
+  gst_video_info_init(&self->info);
+
+  self->socket_path = NULL;
+  self->slots = DEFAULT_SLOTS;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/video/video.h>
+
+#include "shmring.h"
+
+// Publishes raw video frames into a memfd ring for local analytics
+// processes. Readers connect to the unix socket, receive the memfd and
+// map the frames without another decode. The ring is replaced when the
+// frames outgrow its slots; readers see it closed and connect again.
+
+#define GCF_TYPE_SHM_SINK (gcf_shm_sink_get_type ())
+#define GCF_SHM_SINK(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GCF_TYPE_SHM_SINK, GcfShmSink))
+
+struct GcfShmSink {
+  GstBaseSink parent;
+
+  ShmRingWriter *writer;
+  GstVideoInfo info;
+
+  // Properties
+  gchar *socket_path;
+  guint slots;
+};
+
+struct GcfShmSinkClass {
+  GstBaseSinkClass parent_class;
+};
+
+GType gcf_shm_sink_get_type(void);
@@ -0,0 +1,77 @@
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "slabarena.h"
+
+static size_t RoundUp(size_t size, size_t unit) {
+  return (size + unit - 1) / unit * unit;
+}
+
+SlabArena::SlabArena(size_t slab_size, size_t slabs, bool hugepages)
+    : slab_size(RoundUp(slab_size, SLAB_PAGE_SIZE)),
+      slabs(slabs),
+      mapped_size(0),
+      huge(false),
+      base(nullptr) {
+
+  if (!slabs || !slab_size || !(Map(hugepages) || (hugepages && Map(false)))) {
+    return;
+  }
+
+  free_slabs.reserve(slabs);
+  for (size_t i = slabs; i > 0; i--) {
+    free_slabs.push_back(base + (i - 1) * this->slab_size);
+  }
+}
+
+SlabArena::~SlabArena() {
+  if (base) {
+    munmap(base, mapped_size);
+  }
+}
+
+size_t SlabArena::Footprint(size_t slab_size, size_t slabs, bool hugepages) {
+  return RoundUp(RoundUp(slab_size, SLAB_PAGE_SIZE) * slabs, hugepages ? SLAB_HUGEPAGE_SIZE : SLAB_PAGE_SIZE);
+}
+
+bool SlabArena::Map(bool hugepages) {
+  size_t size = Footprint(slab_size, slabs, hugepages);
+
+  int fd = memfd_create("gcf-arena", MFD_CLOEXEC | (hugepages ? MFD_HUGETLB : 0));
+  if (fd < 0) {
+    return false;
+  }
+
+  // Populated now: the hugepages are taken from the pool or the mapping fails here
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  }
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  base = (uint8_t *) map;
+  mapped_size = size;
+  huge = hugepages;
+  return true;
+}
+
+uint8_t *SlabArena::Acquire() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (free_slabs.empty()) {
+    return nullptr;
+  }
+
+  uint8_t *slab = free_slabs.back();
+  free_slabs.pop_back();
+  return slab;
+}
+
+void SlabArena::Release(uint8_t *slab) {
+  std::lock_guard<std::mutex> guard(lock);
+  free_slabs.push_back(slab);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Fixed number of equal slabs in one memfd mapping, populated up front so
+// no page is faulted in while frames flow. With hugepages the memfd is
+// backed by 2MB pages when the system has them reserved, and by normal
+// pages otherwise. Needs no GStreamer, so the benchmark can link it alone.
+
+#define SLAB_PAGE_SIZE 4096
+#define SLAB_HUGEPAGE_SIZE (2 << 20)
+
+class SlabArena {
+public:
+
+  // The slab size is rounded up to whole pages, so every slab is page aligned
+  SlabArena(size_t slab_size, size_t slabs, bool hugepages);
+  ~SlabArena();
+
+  // Bytes an arena of these slabs maps at most
+  static size_t Footprint(size_t slab_size, size_t slabs, bool hugepages);
+
+  bool Valid() const { return base != nullptr; }
+
+  // NULL when every slab is in use
+  uint8_t *Acquire();
+  void Release(uint8_t *slab);
+
+  size_t SlabSize() const { return slab_size; }
+  size_t Slabs() const { return slabs; }
+  size_t MappedSize() const { return mapped_size; }
+  bool Huge() const { return huge; }
+
+private:
+
+  bool Map(bool hugepages);
+
+  size_t slab_size;
+  size_t slabs;
+  size_t mapped_size;
+  bool huge;
+  uint8_t *base;
+
+  // Last released first, its pages are still in the cache
+  std::mutex lock;
+  std::vector<uint8_t *> free_slabs;
+};
@@ -0,0 +1,164 @@
+#include "startup.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_startup);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_startup       // set as default
+
+std::mutex Startup::lock;
+gint64 Startup::start = 0;
+gint64 Startup::last = 0;
+gint64 Startup::playing = 0;
+gint64 Startup::first_buffer = 0;
+bool Startup::done = false;
+bool Startup::reported = false;
+GSourceFunc Startup::ready = NULL;
+std::vector<std::pair<std::string, gint64>> Startup::phases;
+std::set<std::string> Startup::waiting_playing;
+std::set<std::string> Startup::waiting_buffer;
+
+void Startup::Begin() {
+  start = last = g_get_monotonic_time();
+}
+
+void Startup::Init() {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_STARTUP", GST_DEBUG_FG_GREEN, "Startup timing"
+  );
+}
+
+void Startup::Mark(const std::string &phase) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  gint64 now = g_get_monotonic_time();
+  phases.emplace_back(phase, now - last);
+  GST_DEBUG("Phase \"%s\" took %.1f ms", phase.c_str(), (now - last) / 1000.0);
+  last = now;
+}
+
+void Startup::Expect(GstElement *pipe) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    waiting_playing.insert(GST_ELEMENT_NAME (pipe));
+    waiting_buffer.insert(GST_ELEMENT_NAME (pipe));
+  }
+
+  // Buffers leave the sources only once the pipe plays
+  GstIterator *iterator = gst_bin_iterate_sources(GST_BIN (pipe));
+  GValue item = G_VALUE_INIT;
+
+  bool iterating = true;
+  while (iterating) {
+    switch (gst_iterator_next(iterator, &item)) {
+      case GST_ITERATOR_OK:
+        gst_element_foreach_src_pad((GstElement *) g_value_get_object(&item), AttachProbe, pipe);
+        g_value_reset(&item);
+        break;
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync(iterator);
+        break;
+      default:
+        iterating = false;
+        break;
+    }
+  }
+
+  g_value_unset(&item);
+  gst_iterator_free(iterator);
+}
+
+gboolean Startup::AttachProbe(GstElement *element, GstPad *pad, gpointer user_data) {
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, FirstBuffer, g_strdup(GST_ELEMENT_NAME (user_data)), g_free);
+  return TRUE;
+}
+
+GstPadProbeReturn Startup::FirstBuffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (waiting_buffer.erase((const char *) user_data) && waiting_buffer.empty()) {
+    first_buffer = g_get_monotonic_time();
+    ReportIfDone(false);
+  }
+  return GST_PAD_PROBE_REMOVE;
+}
+
+void Startup::Playing(GstElement *pipe) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (waiting_playing.erase(GST_ELEMENT_NAME (pipe)) && waiting_playing.empty()) {
+    playing = g_get_monotonic_time();
+    ReportIfDone(false);
+  }
+}
+
+void Startup::Done() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  // Nothing was expected, or it all came up before the last mark
+  done = true;
+  if (waiting_playing.empty() && !playing) {
+    playing = last;
+  }
+  if (waiting_buffer.empty() && !first_buffer) {
+    first_buffer = last;
+  }
+  ReportIfDone(false);
+
+  if (!reported) {
+    g_timeout_add_seconds(STARTUP_REPORT_TIMEOUT, Timeout, NULL);
+  }
+}
+
+void Startup::WhenReady(GSourceFunc func) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (reported) {
+    g_idle_add(func, GINT_TO_POINTER (waiting_playing.empty() && waiting_buffer.empty()));
+  } else {
+    ready = func;
+  }
+}
+
+gboolean Startup::Timeout(gpointer user_data) {
+  std::lock_guard<std::mutex> guard(lock);
+  ReportIfDone(true);
+  return G_SOURCE_REMOVE;
+}
+
+void Startup::ReportIfDone(bool timeout) {
+  if (reported || !done || (!timeout && (!waiting_playing.empty() || !waiting_buffer.empty()))) {
+    return;
+  }
+  reported = true;
+
+  std::string summary;
+  for (const auto &phase : phases) {
+    summary += (summary.empty() ? "" : ", ") + phase.first + " " + std::to_string(phase.second / 1000) + " ms";
+    Metrics::Set("startup." + phase.first + "-us", phase.second);
+  }
+  GST_INFO("Startup phases: %s", summary.c_str());
+
+  for (const auto &pipe : waiting_playing) {
+    GST_WARNING("\"%s\" is not playing after %d s.", pipe.c_str(), STARTUP_REPORT_TIMEOUT);
+  }
+  for (const auto &pipe : waiting_buffer) {
+    GST_WARNING("\"%s\" has not got a buffer from its sources after %d s.", pipe.c_str(), STARTUP_REPORT_TIMEOUT);
+  }
+
+  if (waiting_playing.empty()) {
+    Metrics::Set("startup.playing-us", playing - start);
+  }
+  if (waiting_buffer.empty()) {
+    Metrics::Set("startup.first-buffer-us", first_buffer - start);
+  }
+
+  GST_INFO("Startup: synchronous part %.1f ms, all pipes playing at %s, first buffers at %s",
+           (last - start) / 1000.0,
+           waiting_playing.empty() ? (std::to_string((playing - start) / 1000) + " ms").c_str() : "never",
+           waiting_buffer.empty() ? (std::to_string((first_buffer - start) / 1000) + " ms").c_str() : "never");
+
+  // The report may come from a streaming thread
+  if (ready) {
+    g_idle_add(ready, GINT_TO_POINTER (waiting_playing.empty() && waiting_buffer.empty()));
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Timing of the startup. The synchronous phases are marked one after the
+// other by main; the startup is over once every pipe brought up to PLAYING
+// has reached it and has got its first buffer out of a source. Then the
+// phases are logged and published as startup.* metrics.
+
+#define STARTUP_REPORT_TIMEOUT 30 // seconds
+
+class Startup {
+public:
+
+  // As early as possible, before GStreamer is initialized
+  static void Begin();
+  static void Init();
+
+  // Ends the phase running since the previous mark
+  static void Mark(const std::string &phase);
+
+  // The startup waits for the pipe to play
+  static void Expect(GstElement *pipe);
+  static void Playing(GstElement *pipe);
+
+  // Nothing more is expected, reports as soon as the pipes are up
+  static void Done();
+
+  // Called from the main loop with the report, user_data is TRUE if every
+  // pipe came up and FALSE if the report timed out
+  static void WhenReady(GSourceFunc func);
+
+private:
+
+  static GstPadProbeReturn FirstBuffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+  static gboolean AttachProbe(GstElement *element, GstPad *pad, gpointer user_data);
+  static gboolean Timeout(gpointer user_data);
+
+  // Called with the lock held
+  static void ReportIfDone(bool timeout);
+
+  static std::mutex lock;
+  static gint64 start;
+  static gint64 last;
+  static gint64 playing;
+  static gint64 first_buffer;
+  static bool done;
+  static bool reported;
+  static GSourceFunc ready;
+  static std::vector<std::pair<std::string, gint64>> phases;
+  static std::set<std::string> waiting_playing;
+  static std::set<std::string> waiting_buffer;
+};
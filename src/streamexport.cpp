@@ -0,0 +1,62 @@
+#include "streamexport.h"
+#include "sharedencoder.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_export);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_export       // set as default
+
+#define STREAM_EXPORT_SOCKET_DIR "/tmp"
+
+StreamExport::StreamExport(SharedEncoder *encoder, const std::string &mount)
+    : encoder(encoder),
+      mount(mount),
+      writer("stream_" + mount, SocketPath(mount), STREAM_EXPORT_SLOTS),
+      caps(NULL) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_EXPORT", GST_DEBUG_FG_BLUE, "Encoded stream export"
+  );
+}
+
+StreamExport::~StreamExport() {
+  if (caps) {
+    gst_caps_unref(caps);
+  }
+
+  Metrics::Remove("export." + mount + ".");
+}
+
+bool StreamExport::Start() {
+  return writer.Start();
+}
+
+std::string StreamExport::SocketPath(const std::string &mount) {
+  return std::string(STREAM_EXPORT_SOCKET_DIR) + "/gcf-stream-" + mount + ".sock";
+}
+
+void StreamExport::Push(GstSample *sample, gpointer user_data) {
+  StreamExport *self = static_cast<StreamExport *>(user_data);
+  GstBuffer *buffer = gst_sample_get_buffer(sample);
+  GstCaps *sample_caps = gst_sample_get_caps(sample);
+
+  // New parameter sets go out with the next frame
+  if (sample_caps && (!self->caps || !gst_caps_is_equal(sample_caps, self->caps))) {
+    gst_caps_replace(&self->caps, sample_caps);
+
+    gchar *caps_string = gst_caps_to_string(sample_caps);
+    self->writer.SetCaps(caps_string, STREAM_EXPORT_SLOT_BYTES);
+    g_free(caps_string);
+  }
+
+  ShmFramesSlot descriptor = {};
+  descriptor.pts = GST_BUFFER_PTS_IS_VALID (buffer) ? GST_BUFFER_PTS (buffer) : SHM_FRAMES_NO_TIME;
+  descriptor.dts = GST_BUFFER_DTS_IS_VALID (buffer) ? GST_BUFFER_DTS (buffer) : descriptor.pts;
+  descriptor.duration = GST_BUFFER_DURATION_IS_VALID (buffer) ? GST_BUFFER_DURATION (buffer) : SHM_FRAMES_NO_TIME;
+  descriptor.base_time = self->encoder->BaseTime();
+  descriptor.flags = GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT) ? SHM_FRAMES_FLAG_DELTA : 0;
+
+  if (self->writer.Publish(buffer, descriptor)) {
+    Metrics::Add("export." + self->mount + ".frames", 1);
+  }
+}
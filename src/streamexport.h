@@ -0,0 +1,38 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <string>
+
+#include "shmring.h"
+
+class SharedEncoder;
+
+#define STREAM_EXPORT_SLOTS 64
+#define STREAM_EXPORT_SLOT_BYTES (512 * 1024)
+
+// Publishes the access units of a shared encoder into a memfd ring, so the
+// RTSP worker processes can serve the mount without encoding it again.
+// Timestamps stay in the encoder's running time with its base time next
+// to them; every process on the host shares the monotonic system clock.
+
+class StreamExport {
+public:
+
+  StreamExport(SharedEncoder *encoder, const std::string &mount);
+  ~StreamExport();
+
+  bool Start();
+
+  // Encoded frames from the shared encoder
+  static void Push(GstSample *sample, gpointer user_data);
+
+  // Where the workers find the ring of a mount
+  static std::string SocketPath(const std::string &mount);
+
+private:
+
+  SharedEncoder *encoder;
+  std::string mount;
+  ShmRingWriter writer;
+  GstCaps *caps;
+};
@@ -0,0 +1,173 @@
+#include "temporalfilter.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_plugin_temporalfilter);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_plugin_temporalfilter       // set as default
+
+#define MAX_LEVELS 4
+#define DEFAULT_LEVELS 1
+#define DEFAULT_LAYER (MAX_LEVELS - 1)
+
+enum {
+  PROP_0,
+  PROP_LEVELS,
+  PROP_LAYER
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE (
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-h264, alignment=(string)au; video/x-h265, alignment=(string)au"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE (
+    "src", GST_PAD_SRC, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-h264, alignment=(string)au; video/x-h265, alignment=(string)au"));
+
+G_DEFINE_TYPE (GcfTemporalFilter, gcf_temporal_filter, GST_TYPE_ELEMENT);
+
+// With N levels the pattern repeats every 2^(N-1) frames: the first frame
+// of the period is the base layer, the odd ones are the top layer
+static guint gcf_temporal_filter_layer_of(guint64 position, guint levels) {
+  guint64 index = position % (G_GUINT64_CONSTANT (1) << (levels - 1));
+  guint layer = levels - 1;
+
+  if (index == 0) {
+    return 0;
+  }
+
+  while (index % 2 == 0) {
+    index /= 2;
+    layer--;
+  }
+
+  return layer;
+}
+
+static GstFlowReturn gcf_temporal_filter_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer) {
+  GcfTemporalFilter *self = GCF_TEMPORAL_FILTER (parent);
+
+  // The hierarchy restarts with every keyframe
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    self->position = 0;
+    self->synced = TRUE;
+  }
+
+  // Joined in the middle of a GOP, the references are missing
+  if (!self->synced) {
+    gst_buffer_unref(buffer);
+    return GST_FLOW_OK;
+  }
+
+  guint layer = gcf_temporal_filter_layer_of(self->position++, self->levels);
+
+  if (layer > self->layer) {
+    GST_LOG_OBJECT (self, "Dropping frame of layer %u", layer);
+    gst_buffer_unref(buffer);
+    return GST_FLOW_OK;
+  }
+
+  return gst_pad_push(self->srcpad, buffer);
+}
+
+static gboolean gcf_temporal_filter_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+  GcfTemporalFilter *self = GCF_TEMPORAL_FILTER (parent);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+    self->synced = FALSE;
+  }
+
+  return gst_pad_event_default(pad, parent, event);
+}
+
+static GstStateChangeReturn gcf_temporal_filter_change_state(GstElement *element, GstStateChange transition) {
+  GcfTemporalFilter *self = GCF_TEMPORAL_FILTER (element);
+
+  GstStateChangeReturn ret =
+      GST_ELEMENT_CLASS (gcf_temporal_filter_parent_class)->change_state(element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    self->position = 0;
+    self->synced = FALSE;
+  }
+
+  return ret;
+}
+
+static void gcf_temporal_filter_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+  GcfTemporalFilter *self = GCF_TEMPORAL_FILTER (object);
+
+  switch (prop_id) {
+    case PROP_LEVELS:
+      self->levels = g_value_get_uint(value);
+      break;
+    case PROP_LAYER:
+      self->layer = g_value_get_uint(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gcf_temporal_filter_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+  GcfTemporalFilter *self = GCF_TEMPORAL_FILTER (object);
+
+  switch (prop_id) {
+    case PROP_LEVELS:
+      g_value_set_uint(value, self->levels);
+      break;
+    case PROP_LAYER:
+      g_value_set_uint(value, self->layer);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gcf_temporal_filter_class_init(GcfTemporalFilterClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_PLUGIN_TEMPORALFILTER", GST_DEBUG_FG_BLUE, "Temporal layer filter"
+  );
+
+  gobject_class->set_property = gcf_temporal_filter_set_property;
+  gobject_class->get_property = gcf_temporal_filter_get_property;
+
+  g_object_class_install_property(gobject_class, PROP_LEVELS,
+      g_param_spec_uint("levels", "Levels", "Number of temporal layers the encoder produces",
+                        1, MAX_LEVELS, DEFAULT_LEVELS,
+                        (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property(gobject_class, PROP_LAYER,
+      g_param_spec_uint("layer", "Layer", "Highest temporal layer passed, 0 is the base layer",
+                        0, MAX_LEVELS - 1, DEFAULT_LAYER,
+                        (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  element_class->change_state = gcf_temporal_filter_change_state;
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+
+  gst_element_class_set_static_metadata(element_class,
+      "Temporal layer filter", "Filter/Video",
+      "Drops the upper temporal layers of a hierarchically coded stream", "gst-rtsp-app");
+}
+
+static void gcf_temporal_filter_init(GcfTemporalFilter *self) {
+  self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+  gst_pad_set_chain_function(self->sinkpad, gcf_temporal_filter_chain);
+  gst_pad_set_event_function(self->sinkpad, gcf_temporal_filter_sink_event);
+  GST_PAD_SET_PROXY_CAPS (self->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION (self->sinkpad);
+  gst_element_add_pad(GST_ELEMENT (self), self->sinkpad);
+
+  self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+  GST_PAD_SET_PROXY_CAPS (self->srcpad);
+  gst_element_add_pad(GST_ELEMENT (self), self->srcpad);
+
+  self->levels = DEFAULT_LEVELS;
+  self->layer = DEFAULT_LAYER;
+  self->position = 0;
+  self->synced = FALSE;
+}
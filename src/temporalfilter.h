@@ -0,0 +1,31 @@
+#pragma once
+
+#include <gst/gst.h>
+
+// Passes a subset of the temporal layers of a hierarchically predicted
+// stream. The layer of a frame follows from its position after the last
+// keyframe, so non-reference frames can be dropped without decoding.
+
+#define GCF_TYPE_TEMPORAL_FILTER (gcf_temporal_filter_get_type ())
+#define GCF_TEMPORAL_FILTER(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GCF_TYPE_TEMPORAL_FILTER, GcfTemporalFilter))
+
+struct GcfTemporalFilter {
+  GstElement parent;
+
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  // Frames since the last keyframe, and whether one has been seen yet
+  guint64 position;
+  gboolean synced;
+
+  // Properties
+  guint levels;
+  guint layer;
+};
+
+struct GcfTemporalFilterClass {
+  GstElementClass parent_class;
+};
+
+GType gcf_temporal_filter_get_type(void);
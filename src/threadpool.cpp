@@ -0,0 +1,67 @@
+#include "threadpool.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_threadpool);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_threadpool       // set as default
+
+G_DEFINE_TYPE_WITH_CODE (GcfThreadPool, gcf_thread_pool, GST_TYPE_TASK_POOL,
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "GCF_APP_THREADPOOL", GST_DEBUG_FG_GREEN, "Thread per task pool"));
+
+struct GcfThreadTask {
+  GstTaskPoolFunction func;
+  gpointer user_data;
+};
+
+static gpointer gcf_thread_pool_run(gpointer data) {
+  auto *task = (GcfThreadTask *) data;
+
+  task->func(task->user_data);
+  g_slice_free(GcfThreadTask, task);
+
+  return NULL;
+}
+
+// Nothing to set up, every push starts its own thread
+static void gcf_thread_pool_prepare(GstTaskPool *pool, GError **error) {
+}
+
+static void gcf_thread_pool_cleanup(GstTaskPool *pool) {
+}
+
+static gpointer gcf_thread_pool_push(GstTaskPool *pool, GstTaskPoolFunction func, gpointer user_data,
+                                     GError **error) {
+  auto *task = g_slice_new(GcfThreadTask);
+  task->func = func;
+  task->user_data = user_data;
+
+  GThread *thread = g_thread_try_new(GST_OBJECT_NAME (pool), gcf_thread_pool_run, task, error);
+  if (!thread) {
+    GST_WARNING_OBJECT (pool, "Can't start a thread: %s", error && *error ? (*error)->message : "unknown error");
+    g_slice_free(GcfThreadTask, task);
+  }
+
+  return thread;
+}
+
+// The id is the thread, joining it drops the reference push kept
+static void gcf_thread_pool_join(GstTaskPool *pool, gpointer id) {
+  g_thread_join((GThread *) id);
+}
+
+static void gcf_thread_pool_class_init(GcfThreadPoolClass *klass) {
+  GstTaskPoolClass *pool_class = GST_TASK_POOL_CLASS (klass);
+
+  pool_class->prepare = gcf_thread_pool_prepare;
+  pool_class->cleanup = gcf_thread_pool_cleanup;
+  pool_class->push = gcf_thread_pool_push;
+  pool_class->join = gcf_thread_pool_join;
+}
+
+static void gcf_thread_pool_init(GcfThreadPool *self) {
+}
+
+GstTaskPool *gcf_thread_pool_new(const gchar *name) {
+  auto *self = (GstTaskPool *) g_object_new(GCF_TYPE_THREAD_POOL, "name", name, NULL);
+  gst_object_ref_sink(self);
+
+  return self;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <gst/gst.h>
+
+// GstTaskPool starting a thread of its own for every task and joining it
+// when the task is joined. The stock pool hands its tasks to a shared
+// GThreadPool, whose idle threads go to whichever pool pushes next, so a
+// thread pinned for one pool may later run the tasks of another.
+
+#define GCF_TYPE_THREAD_POOL (gcf_thread_pool_get_type ())
+#define GCF_THREAD_POOL(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), GCF_TYPE_THREAD_POOL, GcfThreadPool))
+#define GCF_IS_THREAD_POOL(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GCF_TYPE_THREAD_POOL))
+
+struct GcfThreadPool {
+  GstTaskPool parent;
+};
+
+struct GcfThreadPoolClass {
+  GstTaskPoolClass parent_class;
+};
+
+GType gcf_thread_pool_get_type(void);
+
+// The threads are named after the pool
+GstTaskPool *gcf_thread_pool_new(const gchar *name);
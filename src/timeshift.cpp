@@ -0,0 +1,345 @@
+#include <gst/app/gstappsrc.h>
+#include <gst/rtsp/gstrtsprange.h>
+#include <algorithm>
+#include <cstring>
+
+#include "timeshift.h"
+#include "rendition.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_timeshift);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_timeshift       // set as default
+
+#define TIMESHIFT_QUEUE_BYTES (4 * 1024 * 1024)
+
+TimeshiftRing::TimeshiftRing(const std::string &mount, const MountConfig &config)
+    : mount(mount),
+      max_time(config.timeshift_max_s * GST_SECOND),
+      arena(NULL),
+      capacity((gsize) config.timeshift_mb << 20),
+      write_offset(0),
+      next_sequence(0),
+      caps(NULL) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_TIMESHIFT", GST_DEBUG_FG_CYAN, "Time-shift ring"
+  );
+
+  // Touch every page now, so the budget is taken at startup and not while streaming
+  arena = (guint8 *) g_malloc(capacity);
+  memset(arena, 0, capacity);
+
+  GST_INFO("Time-shift of \"%s\": %" G_GSIZE_FORMAT " MB arena", mount.c_str(), capacity >> 20);
+}
+
+TimeshiftRing::~TimeshiftRing() {
+  if (caps) {
+    gst_caps_unref(caps);
+  }
+
+  g_free(arena);
+  Metrics::Remove("timeshift." + mount + ".");
+}
+
+void TimeshiftRing::Push(GstSample *sample, gpointer user_data) {
+  TimeshiftRing *self = static_cast<TimeshiftRing *>(user_data);
+
+  self->Store(gst_sample_get_buffer(sample), gst_sample_get_caps(sample));
+
+  // Readers at the live edge continue with the new unit
+  std::lock_guard<std::mutex> guard(self->readers_lock);
+  for (auto reader : self->readers) {
+    reader->Feed();
+  }
+}
+
+void TimeshiftRing::Store(GstBuffer *buffer, GstCaps *sample_caps) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  // Units of other parameter sets can't be decoded with the new ones
+  if (sample_caps && (!caps || !gst_caps_is_equal(sample_caps, caps))) {
+    gst_caps_replace(&caps, sample_caps);
+    units.clear();
+  }
+
+  gsize size = gst_buffer_get_size(buffer);
+  if (size > capacity / 4) {
+    GST_WARNING("Time-shift of \"%s\": %" G_GSIZE_FORMAT " bytes unit doesn't fit the arena", mount.c_str(), size);
+    units.clear();
+    return;
+  }
+
+  // The end of the arena is skipped when the unit doesn't fit there
+  if (write_offset + size > capacity) {
+    Evict(write_offset, capacity - write_offset);
+    write_offset = 0;
+  }
+  Evict(write_offset, size);
+
+  gst_buffer_extract(buffer, 0, arena + write_offset, size);
+
+  bool keyframe = !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  units.push_back({next_sequence++, write_offset, size, GST_BUFFER_DTS_OR_PTS (buffer), GST_BUFFER_PTS (buffer),
+                   g_get_real_time(), keyframe});
+  write_offset += size;
+
+  if (max_time) {
+    while (units.back().dts - units.front().dts > max_time) {
+      units.pop_front();
+    }
+  }
+
+  // Playback can only start with a keyframe
+  while (!units.empty() && !units.front().keyframe) {
+    units.pop_front();
+  }
+
+  if (keyframe && !units.empty()) {
+    Metrics::Set("timeshift." + mount + ".seconds", (units.back().dts - units.front().dts) / GST_SECOND);
+    Metrics::Set("timeshift." + mount + ".units", units.size());
+  }
+}
+
+// The oldest units are always the ones right after the write offset
+void TimeshiftRing::Evict(gsize offset, gsize size) {
+  while (!units.empty() && units.front().offset < offset + size
+      && units.front().offset + units.front().size > offset) {
+    units.pop_front();
+  }
+}
+
+GstElement *TimeshiftRing::CreateMedia(const std::string &name, GstElement *payloader, TimeshiftReader **reader) {
+  GstCaps *current = GetCaps();
+  GstClockTime oldest, newest;
+  GCF_WARNING_RETURN_VAL(!current || !Span(oldest, newest), NULL,
+                         "Time-shift of \"%s\" has nothing recorded yet.", mount.c_str());
+
+  GstElement *bin = gst_pipeline_new(name.c_str());
+  GstElement *appsrc = gst_element_factory_make("appsrc", ("timeshiftsrc_" + name).c_str());
+  GstElement *pacer = gst_element_factory_make("identity", NULL);
+  GstElement *pay = Rendition::Clone(payloader);
+
+  // Seekable, so the server can apply the Range of PLAY; paced at real time
+  g_object_set(appsrc, "format", GST_FORMAT_TIME, "is-live", FALSE, "caps", current,
+               "max-bytes", (guint64) TIMESHIFT_QUEUE_BYTES, NULL);
+  gst_util_set_object_arg(G_OBJECT (appsrc), "stream-type", "seekable");
+  g_object_set(pacer, "sync", TRUE, NULL);
+  gst_caps_unref(current);
+
+  gst_bin_add_many(GST_BIN (bin), appsrc, pacer, pay, NULL);
+  if (!gst_element_link_many(appsrc, pacer, pay, NULL)) {
+    GST_ERROR("Time-shift of \"%s\": can't build media \"%s\"!", mount.c_str(), name.c_str());
+    gst_object_unref(bin);
+    return NULL;
+  }
+
+  *reader = new TimeshiftReader(this, appsrc);
+
+  GST_INFO("Time-shift media \"%s\": %" GST_TIME_FORMAT " of \"%s\" available",
+           name.c_str(), GST_TIME_ARGS (newest - oldest), mount.c_str());
+
+  return bin;
+}
+
+bool TimeshiftRing::Read(guint64 &sequence, GstBuffer **buffer) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (units.empty() || sequence > units.back().sequence) {
+    return false;
+  }
+
+  if (sequence < units.front().sequence) {
+    GST_DEBUG("Time-shift of \"%s\": reader fell behind the ring", mount.c_str());
+    sequence = units.front().sequence;
+  }
+
+  const Unit &unit = units[sequence - units.front().sequence];
+
+  *buffer = gst_buffer_new_allocate(NULL, unit.size, NULL);
+  gst_buffer_fill(*buffer, 0, arena + unit.offset, unit.size);
+  GST_BUFFER_DTS (*buffer) = unit.dts;
+  GST_BUFFER_PTS (*buffer) = unit.pts;
+  if (!unit.keyframe) {
+    GST_BUFFER_FLAG_SET (*buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  }
+
+  sequence++;
+  return true;
+}
+
+guint64 TimeshiftRing::KeyframeAt(GstClockTime dts) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  for (auto unit = units.rbegin(); unit != units.rend(); ++unit) {
+    if (unit->keyframe && unit->dts <= dts) {
+      return unit->sequence;
+    }
+  }
+
+  return units.empty() ? next_sequence : units.front().sequence;
+}
+
+bool TimeshiftRing::KeyframeAtWallclock(gint64 wallclock, GstClockTime &dts) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (units.empty()) {
+    return false;
+  }
+
+  dts = units.front().dts;
+  for (auto unit = units.rbegin(); unit != units.rend(); ++unit) {
+    if (unit->keyframe && unit->wallclock <= wallclock) {
+      dts = unit->dts;
+      break;
+    }
+  }
+
+  return true;
+}
+
+bool TimeshiftRing::Span(GstClockTime &oldest, GstClockTime &newest) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (units.empty()) {
+    return false;
+  }
+
+  oldest = units.front().dts;
+  newest = units.back().dts;
+  return true;
+}
+
+GstCaps *TimeshiftRing::GetCaps() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  return caps ? gst_caps_ref(caps) : NULL;
+}
+
+void TimeshiftRing::AddReader(TimeshiftReader *reader) {
+  std::lock_guard<std::mutex> guard(readers_lock);
+  readers.push_back(reader);
+
+  Metrics::Set("timeshift." + mount + ".readers", readers.size());
+}
+
+void TimeshiftRing::RemoveReader(TimeshiftReader *reader) {
+  std::lock_guard<std::mutex> guard(readers_lock);
+  readers.erase(std::remove(readers.begin(), readers.end(), reader), readers.end());
+
+  Metrics::Set("timeshift." + mount + ".readers", readers.size());
+}
+
+TimeshiftReader::TimeshiftReader(TimeshiftRing *ring, GstElement *appsrc)
+    : ring(ring),
+      appsrc(appsrc),
+      epoch(0),
+      cursor(0),
+      wanted(false) {
+
+  GstClockTime newest;
+  ring->Span(epoch, newest);
+  cursor = ring->KeyframeAt(epoch);
+
+  g_signal_connect(appsrc, "need-data", G_CALLBACK (NeedData), this);
+  g_signal_connect(appsrc, "enough-data", G_CALLBACK (EnoughData), this);
+  g_signal_connect(appsrc, "seek-data", G_CALLBACK (SeekData), this);
+
+  ring->AddReader(this);
+}
+
+TimeshiftReader::~TimeshiftReader() {
+  ring->RemoveReader(this);
+}
+
+bool TimeshiftReader::TranslateRange(const gchar *range, std::string &translated) {
+  GstClockTime position, oldest, newest;
+  gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+  if (!ring->Span(oldest, newest)) {
+    return false;
+  }
+
+  // Relative to the live edge
+  if (g_str_has_prefix(range, "npt=-") && g_str_has_suffix(range, "-")) {
+    gchar *end = NULL;
+    gdouble back = g_ascii_strtod(range + strlen("npt=-"), &end);
+    if (!end || *end != '-' || back < 0) {
+      return false;
+    }
+
+    GstClockTime live = newest > epoch ? newest - epoch : 0;
+    GstClockTime shift = (GstClockTime) (back * GST_SECOND);
+    position = live > shift ? live - shift : 0;
+  } else {
+    GstRTSPTimeRange *parsed = NULL;
+    if (gst_rtsp_range_parse(range, &parsed) != GST_RTSP_OK) {
+      return false;
+    }
+
+    bool clock = parsed->unit == GST_RTSP_RANGE_CLOCK && parsed->min.type == GST_RTSP_TIME_UTC;
+    GstClockTime dts = 0;
+
+    // The seconds count from midnight, they don't fit in the seconds field of a date
+    if (clock) {
+      GDateTime *midnight = g_date_time_new_utc(parsed->min2.year, parsed->min2.month, parsed->min2.day, 0, 0, 0);
+      GDateTime *time = midnight ? g_date_time_add_seconds(midnight, parsed->min.seconds) : NULL;
+      clock = time && ring->KeyframeAtWallclock(g_date_time_to_unix(time) * G_USEC_PER_SEC
+                                                    + g_date_time_get_microsecond(time), dts);
+      if (time) {
+        g_date_time_unref(time);
+      }
+      if (midnight) {
+        g_date_time_unref(midnight);
+      }
+    }
+    gst_rtsp_range_free(parsed);
+
+    if (!clock) {
+      return false;
+    }
+
+    position = dts > epoch ? dts - epoch : 0;
+  }
+
+  translated = std::string("npt=") + g_ascii_formatd(buffer, sizeof(buffer), "%.3f", (gdouble) position / GST_SECOND)
+      + "-";
+  return true;
+}
+
+void TimeshiftReader::Feed() {
+  std::lock_guard<std::mutex> guard(feeding);
+  GstBuffer *buffer;
+
+  while (wanted && ring->Read(cursor, &buffer)) {
+    // Media time starts at the epoch
+    GstClockTime dts = GST_BUFFER_DTS (buffer), pts = GST_BUFFER_PTS (buffer);
+    GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_IS_VALID (dts) && dts > epoch ? dts - epoch : 0;
+    GST_BUFFER_PTS (buffer) = GST_CLOCK_TIME_IS_VALID (pts) && pts > epoch ? pts - epoch : GST_BUFFER_DTS (buffer);
+
+    gst_app_src_push_buffer(GST_APP_SRC (appsrc), buffer);
+  }
+}
+
+void TimeshiftReader::NeedData(GstElement *appsrc, guint length, gpointer user_data) {
+  TimeshiftReader *self = static_cast<TimeshiftReader *>(user_data);
+
+  self->wanted = true;
+  self->Feed();
+}
+
+void TimeshiftReader::EnoughData(GstElement *appsrc, gpointer user_data) {
+  TimeshiftReader *self = static_cast<TimeshiftReader *>(user_data);
+
+  self->wanted = false;
+}
+
+gboolean TimeshiftReader::SeekData(GstElement *appsrc, guint64 offset, gpointer user_data) {
+  TimeshiftReader *self = static_cast<TimeshiftReader *>(user_data);
+  std::lock_guard<std::mutex> guard(self->feeding);
+
+  self->cursor = self->ring->KeyframeAt(self->epoch + offset);
+
+  GST_DEBUG("Time-shift seek to %" GST_TIME_FORMAT, GST_TIME_ARGS (offset));
+  return TRUE;
+}
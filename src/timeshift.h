@@ -0,0 +1,108 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mount.h"
+
+class TimeshiftReader;
+
+// Keeps the last encoded access units of a mount in a preallocated arena,
+// used as a byte ring. The oldest units are dropped as the arena wraps,
+// and the ring always starts with a keyframe. Readers copy the units out
+// under the lock, so they never see a unit being overwritten.
+
+class TimeshiftRing {
+public:
+
+  TimeshiftRing(const std::string &mount, const MountConfig &config);
+  ~TimeshiftRing();
+
+  // Encoded frames from the shared encoder
+  static void Push(GstSample *sample, gpointer user_data);
+
+  // Seekable playback media starting from the ring
+  GstElement *CreateMedia(const std::string &name, GstElement *payloader, TimeshiftReader **reader);
+
+  // Copy of unit "sequence", an evicted one continues at the oldest
+  // keyframe; false at the live edge
+  bool Read(guint64 &sequence, GstBuffer **buffer);
+
+  // Last keyframe at or before the time, by running time or by wall clock (us)
+  guint64 KeyframeAt(GstClockTime dts);
+  bool KeyframeAtWallclock(gint64 wallclock, GstClockTime &dts);
+
+  // Running time of the oldest and the newest unit
+  bool Span(GstClockTime &oldest, GstClockTime &newest);
+
+  GstCaps *GetCaps();
+
+  void AddReader(TimeshiftReader *reader);
+  void RemoveReader(TimeshiftReader *reader);
+
+private:
+
+  struct Unit {
+    guint64 sequence;
+    gsize offset;
+    gsize size;
+    GstClockTime dts;
+    GstClockTime pts;
+    gint64 wallclock;
+    bool keyframe;
+  };
+
+  void Store(GstBuffer *buffer, GstCaps *caps);
+  void Evict(gsize offset, gsize size);
+
+  std::string mount;
+  GstClockTime max_time;
+
+  std::mutex lock;
+  guint8 *arena;
+  gsize capacity;
+  gsize write_offset;
+  guint64 next_sequence;
+  std::deque<Unit> units;
+  GstCaps *caps;
+
+  std::mutex readers_lock;
+  std::vector<TimeshiftReader *> readers;
+};
+
+// Feeds the appsrc of one playback media from the ring. The media timeline
+// starts at the oldest keyframe the ring had when the media was created.
+
+class TimeshiftReader {
+public:
+
+  TimeshiftReader(TimeshiftRing *ring, GstElement *appsrc);
+  ~TimeshiftReader();
+
+  // Converts the Range of a PLAY request to the timeline of the media:
+  // "npt=-30-" is 30 seconds before the live edge, a clock range is
+  // looked up by wall clock. Other ranges are left as they are.
+  bool TranslateRange(const gchar *range, std::string &translated);
+
+  // Pushes the units the appsrc asked for
+  void Feed();
+
+private:
+
+  static void NeedData(GstElement *appsrc, guint length, gpointer user_data);
+  static void EnoughData(GstElement *appsrc, gpointer user_data);
+  static gboolean SeekData(GstElement *appsrc, guint64 offset, gpointer user_data);
+
+  TimeshiftRing *ring;
+  GstElement *appsrc;
+  GstClockTime epoch;
+
+  std::mutex feeding;
+  guint64 cursor;
+  // Set by need-data and enough-data in the appsrc's threads, read by Feed in the encoder's
+  std::atomic<bool> wanted;
+};
@@ -91,10 +91,16 @@ Topology::ConnectPipe(const char *pipe,
     );
   }
 
+  // The queue holds the frames of the branch until the pipe takes them
+  MemoryGovernor::Register(pipe_name, queue);
+  FlowWatchdog::Register(pipe_name, GetPipe(source_pipe), GetElement(source_end_point), queue, intersink);
+
   // TODO Temporary
   if (HasRtspPipe(pipe_name)) {
     intersinks[pipe_name] = intersink;
     queues[pipe_name] = queue;
+    source_tees[pipe_name] = GetElement(source_end_point);
+    source_pipes[pipe_name] = GetPipe(source_pipe);
   }
 }
 
@@ -117,6 +123,21 @@ void Topology::CreateElement(const string& elem_name, const string& elem_type) {
   CreateElement(elem_name.c_str(), elem_type.c_str());
 }
 
+// The factory is resolved by the caller, once for all elements of its type
+void Topology::CreateElement(const string& elem_name, GstElementFactory* factory) {
+
+  GCF_WARNING_RETURN(HasElement(elem_name), "Can't create \"%s\": it already exists.", elem_name.c_str());
+
+  GstElement *element = factory ? gst_element_factory_create(factory, elem_name.c_str()) : NULL;
+
+  GCF_ASSERT(element, TopologyGstreamerException,
+             "Element \"" + elem_name + "\" (type: " + (factory ? GST_OBJECT_NAME (factory) : "unknown")
+             + ") could not be created.");
+
+  elements[elem_name] = element;
+  GST_DEBUG("Element \"%s\" (type: %s) is created.", elem_name.c_str(), GST_OBJECT_NAME (factory));
+}
+
 void Topology::CreatePipeline(const char* pipe_name) {
 
   GCF_WARNING_RETURN (HasPipe(pipe_name),"Can't create \"%s\": it already exists.", pipe_name);
@@ -141,6 +162,12 @@ void Topology::ConnectElements(const string& src_name, const string& dst_name) {
              TopologyInvalidAttributeException, "Unable to link \"" +src_name + "\" to \"" + dst_name + "\": "
                  + (HasElement(src_name) ? dst_name : src_name) + " does not exist.");
 
+  // Both are the same fused element
+  if (GetElement(src_name) == GetElement(dst_name)) {
+    GST_DEBUG("\"%s\" and \"%s\" are fused, nothing to link", src_name.c_str(), dst_name.c_str());
+    return;
+  }
+
 
   GCF_ASSERT(gst_element_link(GetElement(src_name), GetElement(dst_name)), TopologyGstreamerException,
              "Unable to link \"" +src_name + "\" to \"" + dst_name + "\"");
@@ -148,6 +175,86 @@ void Topology::ConnectElements(const string& src_name, const string& dst_name) {
   GST_DEBUG ("Element \"%s\" is connected to \"%s\"", src_name.c_str(), dst_name.c_str());
 }
 
+// Only elements left as the factory makes them can be fused, nothing set in the json may be lost.
+// Compared with a fresh instance, not the pspec defaults: base classes set some at init (qos of
+// GstVideoFilter).
+static bool IsFusable(GstElement *element, const char *factory_name) {
+  GstElementFactory *factory = gst_element_get_factory(element);
+  if (!factory || g_strcmp0(GST_OBJECT_NAME (factory), factory_name)) {
+    return false;
+  }
+
+  GstElement *fresh = gst_element_factory_create(factory, NULL);
+  if (!fresh) {
+    return false;
+  }
+  gst_object_ref_sink(fresh);
+
+  guint n_properties;
+  GParamSpec **properties = g_object_class_list_properties(G_OBJECT_GET_CLASS (element), &n_properties);
+  bool untouched = true;
+
+  for (guint i = 0; i < n_properties && untouched; i++) {
+    GParamSpec *property = properties[i];
+    if ((property->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE
+        || !g_strcmp0(property->name, "name") || !g_strcmp0(property->name, "parent")) {
+      continue;
+    }
+
+    GValue value = G_VALUE_INIT, fresh_value = G_VALUE_INIT;
+    g_value_init(&value, property->value_type);
+    g_value_init(&fresh_value, property->value_type);
+    g_object_get_property(G_OBJECT (element), property->name, &value);
+    g_object_get_property(G_OBJECT (fresh), property->name, &fresh_value);
+    untouched = g_param_values_cmp(property, &value, &fresh_value) == 0;
+    g_value_unset(&value);
+    g_value_unset(&fresh_value);
+  }
+
+  g_free(properties);
+  gst_object_unref(fresh);
+
+  return untouched;
+}
+
+void Topology::FuseScaleConvert(vector<string>& chain) {
+  for (size_t i = 0; i + 1 < chain.size(); i++) {
+    if (!HasElement(chain[i]) || !HasElement(chain[i + 1])) {
+      continue;
+    }
+
+    GstElement *first = GetElement(chain[i]);
+    GstElement *second = GetElement(chain[i + 1]);
+    GstObject *bin = GST_OBJECT_PARENT (first);
+
+    // Either order: the fused element scales before it converts anyway
+    if (!bin || GST_OBJECT_PARENT (second) != bin
+        || !((IsFusable(first, "videoscale") && IsFusable(second, "videoconvert"))
+             || (IsFusable(first, "videoconvert") && IsFusable(second, "videoscale")))) {
+      continue;
+    }
+
+    GstElement *fused = gst_element_factory_make("gcfscaleconvert", NULL);
+    GCF_WARNING_RETURN(!fused, "Can't fuse \"%s\" and \"%s\": no gcfscaleconvert.",
+                       chain[i].c_str(), chain[i + 1].c_str());
+
+    // The bin holds the only reference of the originals
+    gst_bin_remove(GST_BIN (bin), first);
+    gst_bin_remove(GST_BIN (bin), second);
+    gst_element_set_name(fused, chain[i].c_str());
+
+    GCF_ASSERT(gst_bin_add(GST_BIN (bin), fused), TopologyGstreamerException,
+               "Can't add fused \"" + chain[i] + "\" to \"" + GST_OBJECT_NAME (bin) + "\"");
+
+    elements[chain[i]] = fused;
+    elements[chain[i + 1]] = fused;
+
+    GST_INFO("Fused \"%s\" and \"%s\" into one gcfscaleconvert", chain[i].c_str(), chain[i + 1].c_str());
+
+    chain.erase(chain.begin() + i + 1);
+  }
+}
+
 void Topology::AddElementToBin (const string& elem_name, const string& pipe_name) {
 
   GST_LOG("Try to add element \"%s\" to \"%s\"", elem_name.c_str(), pipe_name.c_str());
@@ -206,6 +313,97 @@ const std::map<std::string, GstElement *> &Topology::GetRtspPipes() {
   return rtsp_pipes;
 };
 
+void Topology::SetMountConfig(const std::string& name, const MountConfig& config) {
+
+  // Options can be assigned only to registered RTSP pipes
+  GCF_ASSERT(HasRtspPipe(name), TopologyInvalidAttributeException,
+             "Can't set mount options: \"" + name + "\" is not an RTSP pipe!");
+
+  mount_configs[name] = config;
+}
+
+const std::map<std::string, MountConfig> &Topology::GetMountConfigs() {
+  return mount_configs;
+};
+
+void Topology::SetOptimizeConfig(const OptimizeConfig& config) {
+  optimize_config = config;
+}
+
+const OptimizeConfig &Topology::GetOptimizeConfig() {
+  return optimize_config;
+}
+
+void Topology::SetInitialState(const std::string& name, GstState state) {
+
+  GCF_ASSERT(HasPipe(name), TopologyInvalidAttributeException,
+             "Can't set the initial state: there is no pipe \"" + name + "\"!");
+  GCF_ASSERT(!HasRtspPipe(name), TopologyInvalidAttributeException,
+             "Can't set the initial state: \"" + name + "\" is an RTSP pipe, the server starts it!");
+
+  initial_states[name] = state;
+}
+
+const std::map<std::string, GstState> &Topology::GetInitialStates() {
+  return initial_states;
+}
+
+void Topology::SetMemoryConfig(const MemoryConfig& config) {
+  memory_config = config;
+}
+
+const MemoryConfig &Topology::GetMemoryConfig() {
+  return memory_config;
+}
+
+void Topology::SetGovernorConfig(const GovernorConfig& config) {
+  governor_config = config;
+}
+
+const GovernorConfig &Topology::GetGovernorConfig() {
+  return governor_config;
+}
+
+void Topology::SetFailoverConfig(const std::string& name, const FailoverConfig& config) {
+
+  // RTSP pipes are made again for every media, their sources are not switched here
+  GCF_ASSERT(HasPipe(name) && !HasRtspPipe(name), TopologyInvalidAttributeException,
+             "Can't set failover options: \"" + name + "\" is not a pipe or is an RTSP pipe!");
+  GCF_ASSERT(HasElement(config.source), TopologyInvalidAttributeException,
+             "Can't set failover options of \"" + name + "\": no element \"" + config.source + "\"!");
+  GCF_ASSERT(GST_OBJECT_PARENT (GetElement(config.source)) == GST_OBJECT (GetPipe(name)),
+             TopologyInvalidAttributeException,
+             "Can't set failover options of \"" + name + "\": \"" + config.source + "\" is not in this pipe!");
+
+  failover_configs[name] = config;
+}
+
+const std::map<std::string, FailoverConfig> &Topology::GetFailoverConfigs() {
+  return failover_configs;
+}
+
+void Topology::SetWatchdogConfig(const WatchdogConfig& config) {
+  watchdog_config = config;
+}
+
+const WatchdogConfig &Topology::GetWatchdogConfig() {
+  return watchdog_config;
+}
+
+void Topology::SetInstanceConfig(const std::string& name, const InstanceConfig& config) {
+
+  for (const auto &pipe : config.pipes) {
+    GCF_ASSERT(HasPipe(pipe), TopologyInvalidAttributeException,
+               "Instance \"" + name + "\" has no pipe \"" + pipe + "\"!");
+  }
+
+  instance_configs[name] = config;
+}
+
+const std::map<std::string, InstanceConfig> &Topology::GetInstanceConfigs() {
+  return instance_configs;
+}
+
 GstElement *Topology::GetElement(const std::string& name) {
   return elements.at(name);
 }
@@ -251,7 +449,12 @@ gboolean Topology::LinkToTee(GstElement *tee, GstElement *element) {
 
   // Link the tee to the queue
   if (gst_pad_link(tee_queue_pad, queue_tee_pad) != GST_PAD_LINK_OK) {
-    GST_ERROR ("Tee and %s could not be linked.", gst_element_get_name(element));
+    GST_ERROR ("Tee and %s could not be linked.", GST_ELEMENT_NAME(element));
+    gst_object_unref(queue_tee_pad);
+
+    // Nobody will take the request pad, the tee keeps no pad per failed link
+    gst_element_release_request_pad(tee, tee_queue_pad);
+    gst_object_unref(tee_queue_pad);
     return FALSE;
   }
 
@@ -296,7 +499,10 @@ void Topology::AssignCap(const char *filter_name, const char *cap_name) {
 
   GST_DEBUG ("Set filter \"%s\" to use cap \"%s\"", filter_name, cap_name);
 
-  g_object_set (GetElement(filter_name), "caps", GetCaps(cap_name), NULL);
+  // The filter takes its own reference
+  GstCaps *cap = GetCaps(cap_name);
+  g_object_set (GetElement(filter_name), "caps", cap, NULL);
+  gst_caps_unref(cap);
 }
 
 void Topology::SetProperty(const char *elem_name, const char *prop_name, const char *prop_value) {
@@ -307,6 +513,14 @@ void Topology::SetProperty(const char *elem_name, const char *prop_name, const c
   gst_util_set_object_arg(G_OBJECT(GetElement(elem_name)), prop_name, prop_value);
 }
 
+void Topology::SetProperty(const char *elem_name, const char *prop_name, const GValue *prop_value) {
+
+  GCF_ASSERT(HasElement(elem_name), TopologyInvalidAttributeException,
+             std::string("Can't set properties of \"") + elem_name + "\": it does not exist!");
+
+  g_object_set_property(G_OBJECT(GetElement(elem_name)), prop_name, prop_value);
+}
+
 bool Topology::HasRtspPipe(const string &elem_name) {
   return rtsp_pipes.find(elem_name) != rtsp_pipes.end();
 }
@@ -6,11 +6,25 @@
 #include <map>
 #include <vector>
 
+#include "mount.h"
+#include "optimizer.h"
+#include "arenapool.h"
+#include "governor.h"
+#include "failover.h"
+#include "watchdog.h"
+#include "instances.h"
+
 #define JSON_TAG_CAPS "caps"
 #define JSON_TAG_LINKS "links"
 #define JSON_TAG_PIPES "pipes"
 #define JSON_TAG_RTSP "rtsp"
 #define JSON_TAG_CONNECTIONS "connections"
+#define JSON_TAG_OPTIMIZE "optimize"
+#define JSON_TAG_MEMORY "memory"
+#define JSON_TAG_GOVERNOR "governor"
+#define JSON_TAG_FAILOVER "failover"
+#define JSON_TAG_WATCHDOG "watchdog"
+#define JSON_TAG_STATES "states"
 
 using namespace std;
 
@@ -35,10 +49,16 @@ class Topology {
   const map<string, GstElement*>& GetElements();
   void CreateElement(const char* elem_name, const char* elem_type);
   void CreateElement(const string& elem_name, const string& elem_type);
+  void CreateElement(const string& elem_name, GstElementFactory* factory);
   void SetProperty(const char* elem_name, const char* prop_name, const char* prop_value);
+  void SetProperty(const char* elem_name, const char* prop_name, const GValue* prop_value);
   void AddElementToBin (const string& elem_name, const string& pipe_name);
   void ConnectElements(const string& src_name, const string& dst_name);
 
+  // Replaces the videoscale/videoconvert pairs of a linked chain with a
+  // gcfscaleconvert, both names are kept pointing to it
+  void FuseScaleConvert(vector<string>& chain);
+
   // Connects an element to a tee, creating a new branch on it
   static gboolean LinkToTee(GstElement* tee, GstElement* element);
 
@@ -63,15 +83,57 @@ class Topology {
   void SetRtspPipe(const string& name, GstElement* element);
   const map<string, GstElement*>& GetRtspPipes();
 
+  // Options of the RTSP mounts
+  void SetMountConfig(const string& name, const MountConfig& config);
+  const map<string, MountConfig>& GetMountConfigs();
+
+  // Options of the "optimize" object
+  void SetOptimizeConfig(const OptimizeConfig& config);
+  const OptimizeConfig& GetOptimizeConfig();
+
+  // State the pipes are brought to at startup, RTSP pipes are up to the server
+  void SetInitialState(const string& name, GstState state);
+  const map<string, GstState>& GetInitialStates();
+
+  // Options of the "memory" object
+  void SetMemoryConfig(const MemoryConfig& config);
+  const MemoryConfig& GetMemoryConfig();
+
+  // Options of the "governor" object
+  void SetGovernorConfig(const GovernorConfig& config);
+  const GovernorConfig& GetGovernorConfig();
+
+  // Backup inputs of the pipes, from the "failover" object
+  void SetFailoverConfig(const string& name, const FailoverConfig& config);
+  const map<string, FailoverConfig>& GetFailoverConfigs();
+
+  // Options of the "watchdog" object
+  void SetWatchdogConfig(const WatchdogConfig& config);
+  const WatchdogConfig& GetWatchdogConfig();
+
+  // Instances of the templates and the pipes made for them
+  void SetInstanceConfig(const string& name, const InstanceConfig& config);
+  const map<string, InstanceConfig>& GetInstanceConfigs();
+
   // TEMP
   map<string, GstElement*> intersinks;
   map<string, GstElement*> queues;
+  map<string, GstElement*> source_tees;
+  map<string, GstElement*> source_pipes;
 
  private:
   map<string, GstElement*> elements;
   map<string, GstElement*> pipes;
   map<string, GstElement*> rtsp_pipes;
   map<string, GstCaps*> caps;
+  map<string, MountConfig> mount_configs;
+  OptimizeConfig optimize_config;
+  MemoryConfig memory_config;
+  GovernorConfig governor_config;
+  map<string, FailoverConfig> failover_configs;
+  WatchdogConfig watchdog_config;
+  map<string, InstanceConfig> instance_configs;
+  map<string, GstState> initial_states;
 
 };
 
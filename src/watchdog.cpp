@@ -0,0 +1,246 @@
+#include <set>
+
+#include "watchdog.h"
+#include "topology.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_watchdog);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_watchdog       // set as default
+
+WatchdogConfig FlowWatchdog::config;
+std::map<std::string, FlowWatchdog::Unit> FlowWatchdog::units;
+
+void FlowWatchdog::Init(const WatchdogConfig &config) {
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_WATCHDOG", GST_DEBUG_FG_GREEN, "Buffer flow watchdog"
+  );
+
+  FlowWatchdog::config = config;
+
+  if (!config.stall_ms) {
+    return;
+  }
+
+  // The branches are known from the topology by now
+  for (auto &entry : units) {
+    Unit &unit = entry.second;
+    GstPad *queue_sink = gst_element_get_static_pad(unit.queue, "sink");
+    GstPad *intersink_sink = gst_element_get_static_pad(unit.intersink, "sink");
+    Arm(queue_sink, &unit.head);
+    Arm(intersink_sink, &unit.tail);
+    gst_object_unref(queue_sink);
+    gst_object_unref(intersink_sink);
+  }
+
+  GST_INFO("Stalls of %u ms are restarted, backing off from %u to %u ms", config.stall_ms, config.backoff_ms,
+           config.max_backoff_ms);
+  g_timeout_add(config.interval_ms, Check, NULL);
+}
+
+// The probes are armed by Init, nothing is logged before that
+void FlowWatchdog::Register(const std::string &branch, GstElement *pipe, GstElement *tee, GstElement *queue,
+                            GstElement *intersink) {
+  Unit &unit = units["branch." + branch];
+  unit.kind = "Branch";
+  unit.name = branch;
+  unit.pipe = pipe;
+  unit.tee = tee;
+  unit.queue = queue;
+  unit.intersink = intersink;
+}
+
+void FlowWatchdog::Watch(GstElement *pipe) {
+  if (!config.stall_ms) {
+    return;
+  }
+
+  std::string key = std::string("pipe.") + GST_ELEMENT_NAME (pipe);
+  Unit &unit = units[key];
+  unit.kind = "Pipe";
+  unit.name = GST_ELEMENT_NAME (pipe);
+  unit.pipe = pipe;
+  guint tails = 0;
+
+  // Heads are the sources
+  GstIterator *iterator = gst_bin_iterate_sources(GST_BIN (pipe));
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(iterator, &item) == GST_ITERATOR_OK) {
+    auto *source = (GstElement *) g_value_get_object(&item);
+    gst_element_foreach_src_pad(source, [](GstElement *element, GstPad *pad, gpointer last) -> gboolean {
+      Arm(pad, (std::atomic<gint64> *) last);
+      return TRUE;
+    }, &unit.head);
+    g_value_reset(&item);
+  }
+  gst_iterator_free(iterator);
+
+  // Tails are the sinks, the branches are timed on their own: their tees stand for them
+  iterator = gst_bin_iterate_sinks(GST_BIN (pipe));
+  while (gst_iterator_next(iterator, &item) == GST_ITERATOR_OK) {
+    auto *sink = (GstElement *) g_value_get_object(&item);
+    bool branch = false;
+    for (const auto &entry : units) {
+      branch |= entry.second.intersink == sink;
+    }
+
+    if (!branch) {
+      tails++;
+      gst_element_foreach_sink_pad(sink, [](GstElement *element, GstPad *pad, gpointer last) -> gboolean {
+        Arm(pad, (std::atomic<gint64> *) last);
+        return TRUE;
+      }, &unit.tail);
+    }
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(iterator);
+
+  std::set<GstElement *> tees;
+  for (const auto &entry : units) {
+    if (entry.second.tee && entry.second.pipe == pipe && tees.insert(entry.second.tee).second) {
+      GstPad *tee_sink = gst_element_get_static_pad(entry.second.tee, "sink");
+      Arm(tee_sink, &unit.tail);
+      gst_object_unref(tee_sink);
+      tails++;
+    }
+  }
+
+  if (!tails) {
+    GST_DEBUG("Pipe \"%s\" has no tail to watch.", unit.name.c_str());
+    units.erase(key);
+  }
+}
+
+void FlowWatchdog::Arm(GstPad *pad, std::atomic<gint64> *last) {
+  gst_pad_add_probe(pad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                    Flow, last, NULL);
+}
+
+// On every buffer, so no more than a clock read
+GstPadProbeReturn FlowWatchdog::Flow(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  ((std::atomic<gint64> *) user_data)->store(g_get_monotonic_time(), std::memory_order_relaxed);
+  return GST_PAD_PROBE_OK;
+}
+
+gint64 FlowWatchdog::Backoff(guint attempts) {
+  gint64 backoff = (gint64) config.backoff_ms << MIN (attempts, 16u);
+  return MIN (backoff, (gint64) config.max_backoff_ms) * 1000;
+}
+
+gboolean FlowWatchdog::Check(gpointer user_data) {
+  gint64 now = g_get_monotonic_time();
+  gint64 stall = (gint64) config.stall_ms * 1000;
+
+  for (auto &entry : units) {
+    const std::string &name = entry.first;
+    Unit &unit = entry.second;
+
+    if (unit.cycling) {
+      continue;
+    }
+
+    // Nothing is expected from what doesn't play; unlinked RTSP branches are out of their pipe
+    GstElement *element = unit.queue ? unit.queue : unit.pipe;
+    if ((unit.queue && !GST_ELEMENT_PARENT (unit.queue)) || GST_STATE (element) != GST_STATE_PLAYING) {
+      // A restart in progress is over with the first buffer, not with the state
+      if (!unit.stalled_since) {
+        unit.head = now;
+        unit.tail = now;
+      }
+      continue;
+    }
+
+    gint64 tail = unit.tail;
+
+    // The first buffer after the stall ends the recovery
+    if (unit.stalled_since && tail > unit.last_attempt) {
+      gint64 took = tail - unit.stalled_since;
+      GST_INFO("%s \"%s\" recovered in %" G_GINT64_FORMAT " ms, %u restarts", unit.kind.c_str(),
+               unit.name.c_str(), took / 1000, unit.attempts);
+
+      Metrics::Set("watchdog." + name + ".recovery-ms", took / 1000);
+      Metrics::Add("watchdog." + name + ".recoveries", 1);
+      Metrics::Add("watchdog.recoveries", 1);
+      unit.stalled_since = 0;
+      unit.recovered_at = now;
+    }
+
+    if (now - MAX (tail, unit.last_attempt) < stall) {
+      // Flowing long enough, the next stall starts from the shortest backoff
+      if (unit.attempts && !unit.stalled_since && now - unit.recovered_at >= Backoff(unit.attempts)) {
+        unit.attempts = 0;
+      }
+      continue;
+    }
+
+    // A quiet head is a stall upstream, that is up to the pipe
+    if (unit.queue && now - unit.head >= stall) {
+      continue;
+    }
+
+    if (unit.stalled_since && now - unit.last_attempt < Backoff(unit.attempts - 1)) {
+      continue;
+    }
+
+    if (!unit.stalled_since) {
+      unit.stalled_since = MAX (tail, now - stall);
+      Metrics::Add("watchdog." + name + ".stalls", 1);
+    }
+
+    unit.attempts++;
+    unit.last_attempt = now;
+    Metrics::Set("watchdog." + name + ".attempts", unit.attempts);
+
+    GST_WARNING("%s \"%s\": no buffer out for %" G_GINT64_FORMAT " ms, in %" G_GINT64_FORMAT " ms ago, restart %u",
+                unit.kind.c_str(), unit.name.c_str(), (now - tail) / 1000, (now - unit.head) / 1000, unit.attempts);
+
+    if (unit.queue) {
+      RestartBranch(unit);
+    } else {
+      unit.cycling = true;
+      gst_element_call_async(unit.pipe, CyclePipe, &unit, NULL);
+    }
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+// Same as a client leaving and coming back, in the main loop like the server does it
+void FlowWatchdog::RestartBranch(Unit &unit) {
+  GstPad *queue_sink = gst_element_get_static_pad(unit.queue, "sink");
+  GstPad *tee_src = gst_pad_get_peer(queue_sink);
+  if (tee_src) {
+    gst_pad_unlink(tee_src, queue_sink);
+    gst_element_release_request_pad(unit.tee, tee_src);
+    gst_object_unref(tee_src);
+  }
+  gst_object_unref(queue_sink);
+
+  gst_element_set_state(unit.intersink, GST_STATE_NULL);
+  gst_element_set_state(unit.queue, GST_STATE_NULL);
+  gst_element_sync_state_with_parent(unit.intersink);
+  gst_element_sync_state_with_parent(unit.queue);
+
+  if (!Topology::LinkToTee(unit.tee, unit.queue)) {
+    GST_ERROR("Can't link \"%s\" back to \"%s\".", GST_ELEMENT_NAME (unit.queue), GST_ELEMENT_NAME (unit.tee));
+  }
+}
+
+// Runs in a thread of GStreamer's pool, a pipe may take its time to stop
+void FlowWatchdog::CyclePipe(GstElement *pipe, gpointer user_data) {
+  auto *unit = (Unit *) user_data;
+
+  gst_element_set_state(pipe, GST_STATE_NULL);
+  if (gst_element_set_state(pipe, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+    GST_ERROR("Can't bring \"%s\" back to PLAYING.", GST_ELEMENT_NAME (pipe));
+  }
+
+  g_idle_add(CycleDone, unit);
+}
+
+// Back in the main loop, the pipe is watched again from the next check
+gboolean FlowWatchdog::CycleDone(gpointer user_data) {
+  ((Unit *) user_data)->cycling = false;
+  return G_SOURCE_REMOVE;
+}
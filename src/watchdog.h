@@ -0,0 +1,73 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <atomic>
+#include <map>
+#include <string>
+
+// Options of the "watchdog" json object
+struct WatchdogConfig {
+  // No buffer out of a pipe or branch for this long is a stall, 0 disables the watchdog
+  guint stall_ms = 0;
+  guint interval_ms = 500;
+  // Wait before the next restart of a unit that stalls again, doubled every time
+  guint backoff_ms = 1000;
+  guint max_backoff_ms = 60000;
+};
+
+// Buffer flow of every pipe and branch is timed by probes on their heads
+// and tails. A pipe whose tail goes quiet is cycled through NULL. A branch
+// whose tail goes quiet while buffers still reach its head is taken off the
+// tee, cycled and linked again, the rest of the pipe is not touched; if its
+// head is quiet too, the stall is upstream and left to the pipe. Restarts
+// of a unit that keeps stalling back off exponentially. Every recovery is
+// logged and counted with the time from the stall to the first buffer.
+
+class FlowWatchdog {
+public:
+
+  static void Init(const WatchdogConfig &config);
+
+  // Tee -> queue -> intersink of a branch in "pipe", may be called before Init
+  static void Register(const std::string &branch, GstElement *pipe, GstElement *tee, GstElement *queue,
+                       GstElement *intersink);
+
+  // A pipe the application plays, after Init
+  static void Watch(GstElement *pipe);
+
+private:
+
+  struct Unit {
+    std::string kind;
+    std::string name;
+    GstElement *pipe;
+    // Branches only
+    GstElement *tee;
+    GstElement *queue;
+    GstElement *intersink;
+
+    // Monotonic time of the last buffer in and out
+    std::atomic<gint64> head;
+    std::atomic<gint64> tail;
+
+    // Main loop only, like the rest below; a pipe cycle reports back through it
+    bool cycling;
+
+    guint attempts;
+    gint64 stalled_since;
+    gint64 last_attempt;
+    gint64 recovered_at;
+  };
+
+  static void Arm(GstPad *pad, std::atomic<gint64> *last);
+  static GstPadProbeReturn Flow(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+  static gboolean Check(gpointer user_data);
+  static gint64 Backoff(guint attempts);
+
+  static void RestartBranch(Unit &unit);
+  static void CyclePipe(GstElement *pipe, gpointer user_data);
+  static gboolean CycleDone(gpointer user_data);
+
+  static WatchdogConfig config;
+  static std::map<std::string, Unit> units;
+};
@@ -0,0 +1,172 @@
+#include <gst/app/gstappsrc.h>
+#include <algorithm>
+#include <chrono>
+
+#include "workerfeed.h"
+#include "streamexport.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_feed);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_feed       // set as default
+
+#define WORKER_FEED_WAIT_MS 500
+#define WORKER_FEED_RETRY_MS 500
+
+WorkerFeed::WorkerFeed(const std::string &mount)
+    : mount(mount),
+      running(true),
+      connected(false),
+      caps(NULL),
+      caps_version(0) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_FEED", GST_DEBUG_FG_BLUE, "Worker stream feeds"
+  );
+
+  thread = std::thread(&WorkerFeed::Run, this);
+}
+
+WorkerFeed::~WorkerFeed() {
+  running = false;
+  thread.join();
+
+  for (auto &outlet : outlets) {
+    gst_object_unref(outlet.appsrc);
+  }
+
+  if (caps) {
+    gst_caps_unref(caps);
+  }
+}
+
+void WorkerFeed::Attach(GstElement *appsrc) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (std::find_if(outlets.begin(), outlets.end(), [appsrc](const Outlet &o) { return o.appsrc == appsrc; })
+      == outlets.end()) {
+    outlets.push_back({GST_ELEMENT (gst_object_ref(appsrc)), false});
+  }
+}
+
+void WorkerFeed::Detach(GstElement *appsrc) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  auto outlet = std::find_if(outlets.begin(), outlets.end(), [appsrc](const Outlet &o) { return o.appsrc == appsrc; });
+  if (outlet != outlets.end()) {
+    gst_object_unref(outlet->appsrc);
+    outlets.erase(outlet);
+  }
+}
+
+void WorkerFeed::Run() {
+  uint64_t skipped = 0;
+
+  while (running) {
+    if (!connected) {
+      if (!reader.Connect(StreamExport::SocketPath(mount))) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(WORKER_FEED_RETRY_MS));
+        continue;
+      }
+
+      GST_INFO("Feed of \"%s\" is connected: %s", mount.c_str(), reader.Caps().c_str());
+      connected = true;
+      caps_version = 0;
+      skipped = 0;
+    }
+
+    if (!reader.Wait(WORKER_FEED_WAIT_MS)) {
+      // The capture process restarted or grew the ring
+      if (reader.Closed()) {
+        GST_WARNING("Ring of \"%s\" is closed, connecting again", mount.c_str());
+        reader.Close();
+        connected = false;
+      }
+      continue;
+    }
+
+    ShmFrame frame;
+    while (running && reader.Next(frame)) {
+      // Frames were lost, every media has to wait for a keyframe
+      if (reader.Skipped() != skipped) {
+        GST_WARNING("Feed of \"%s\" fell behind, %" G_GUINT64_FORMAT " frames skipped",
+                    mount.c_str(), (guint64) (reader.Skipped() - skipped));
+        skipped = reader.Skipped();
+
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto &outlet : outlets) {
+          outlet.synced = false;
+        }
+      }
+
+      Deliver(frame);
+    }
+  }
+
+  reader.Close();
+}
+
+// Frames are moved from the encoder's base time to the base time of each media
+void WorkerFeed::Deliver(const ShmFrame &frame) {
+  const ShmFramesSlot *slot = frame.slot;
+
+  if (slot->caps_version != caps_version) {
+    GstCaps *received = gst_caps_from_string(reader.Caps().c_str());
+    if (received) {
+      gst_caps_replace(&caps, received);
+      gst_caps_unref(received);
+    }
+    caps_version = slot->caps_version;
+  }
+
+  // Nobody is watching the mount in this worker
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (outlets.empty()) {
+      return;
+    }
+  }
+
+  GstBuffer *buffer = gst_buffer_new_allocate(NULL, frame.size, NULL);
+  gst_buffer_fill(buffer, 0, frame.data, frame.size);
+
+  GstClockTime pts = slot->pts, dts = slot->dts, duration = slot->duration, base_time = slot->base_time;
+  bool delta = slot->flags & SHM_FRAMES_FLAG_DELTA;
+
+  // Overwritten while it was copied
+  if (!reader.Valid(frame) || !caps) {
+    gst_buffer_unref(buffer);
+    return;
+  }
+
+  if (delta) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  }
+  if (duration != SHM_FRAMES_NO_TIME) {
+    GST_BUFFER_DURATION (buffer) = duration;
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+
+  for (auto &outlet : outlets) {
+    GstClockTime outlet_base = gst_element_get_base_time(outlet.appsrc);
+
+    // Started before the media did, or still waiting for a keyframe
+    if ((pts != SHM_FRAMES_NO_TIME && pts + base_time < outlet_base)
+        || (dts != SHM_FRAMES_NO_TIME && dts + base_time < outlet_base)
+        || (!outlet.synced && delta)) {
+      continue;
+    }
+    outlet.synced = true;
+
+    GstBuffer *copy = gst_buffer_copy(buffer);
+    GST_BUFFER_PTS (copy) = pts != SHM_FRAMES_NO_TIME ? pts + base_time - outlet_base : GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DTS (copy) = dts != SHM_FRAMES_NO_TIME ? dts + base_time - outlet_base : GST_CLOCK_TIME_NONE;
+
+    GstSample *outgoing = gst_sample_new(copy, caps, NULL, NULL);
+    gst_app_src_push_sample(GST_APP_SRC (outlet.appsrc), outgoing);
+    gst_sample_unref(outgoing);
+    gst_buffer_unref(copy);
+  }
+
+  gst_buffer_unref(buffer);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shmreader.h"
+
+// Worker side of a StreamExport: reads the access units of one mount from
+// the ring of the capture process and pushes them to the appsrc of the
+// worker's media. The ring is followed across capture restarts, and a
+// newly attached media starts with the next keyframe.
+
+class WorkerFeed {
+public:
+
+  explicit WorkerFeed(const std::string &mount);
+  ~WorkerFeed();
+
+  // True once the ring of the capture process was mapped
+  bool IsConnected() const { return connected; }
+
+  void Attach(GstElement *appsrc);
+  void Detach(GstElement *appsrc);
+
+private:
+
+  struct Outlet {
+    GstElement *appsrc;
+    bool synced;
+  };
+
+  void Run();
+  void Deliver(const ShmFrame &frame);
+
+  std::string mount;
+  ShmFrameReader reader;
+  std::thread thread;
+  std::atomic<bool> running;
+  std::atomic<bool> connected;
+
+  GstCaps *caps;
+  uint32_t caps_version;
+
+  std::mutex lock;
+  std::vector<Outlet> outlets;
+};
@@ -0,0 +1,121 @@
+#include <gst/gst.h>
+#include <sys/prctl.h>
+#include <signal.h>
+
+#include "workers.h"
+#include "metrics.h"
+#include "logger.h"
+
+GST_DEBUG_CATEGORY_STATIC (log_app_workers);  // define debug category (statically)
+#define GST_CAT_DEFAULT log_app_workers       // set as default
+
+WorkerPool::WorkerPool(const std::string &executable, guint count, const std::vector<std::string> &arguments)
+    : executable(executable),
+      arguments(arguments),
+      workers(count),
+      stopping(false) {
+
+  GST_DEBUG_CATEGORY_INIT (
+      GST_CAT_DEFAULT, "GCF_APP_WORKERS", GST_DEBUG_FG_GREEN, "RTSP worker processes"
+  );
+
+  // Sized once, the watches keep pointers to the entries
+  for (guint i = 0; i < count; i++) {
+    workers[i] = {this, i, 0, 0, 0};
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  stopping = true;
+
+  for (auto &worker : workers) {
+    if (worker.watch) {
+      g_source_remove(worker.watch);
+    }
+    if (worker.pid) {
+      kill(worker.pid, SIGTERM);
+      g_spawn_close_pid(worker.pid);
+    }
+  }
+
+  Metrics::Remove("workers.");
+}
+
+void WorkerPool::Start() {
+  for (auto &worker : workers) {
+    Spawn(worker);
+  }
+
+  UpdateMetrics();
+}
+
+// The worker goes down with the capture process, however that one ends
+void WorkerPool::ChildSetup(gpointer user_data) {
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+}
+
+bool WorkerPool::Spawn(Worker &worker) {
+  GError *error = NULL;
+  std::vector<gchar *> argv = {(gchar *) executable.c_str(), (gchar *) "--worker"};
+  for (const auto &argument : arguments) {
+    argv.push_back((gchar *) argument.c_str());
+  }
+  argv.push_back(NULL);
+
+  if (!g_spawn_async(NULL, argv.data(), NULL, G_SPAWN_DO_NOT_REAP_CHILD, ChildSetup, NULL, &worker.pid, &error)) {
+    GST_ERROR("Can't start worker %u: %s", worker.index, error->message);
+    g_clear_error(&error);
+    worker.pid = 0;
+    return false;
+  }
+
+  worker.watch = g_child_watch_add(worker.pid, Exited, &worker);
+
+  GST_INFO("Worker %u is running as %d, %u restarts", worker.index, worker.pid, worker.restarts);
+
+  return true;
+}
+
+void WorkerPool::Exited(GPid pid, gint status, gpointer user_data) {
+  Worker *worker = static_cast<Worker *>(user_data);
+  WorkerPool *self = worker->pool;
+
+  GST_WARNING("Worker %u (%d) exited with status %d", worker->index, pid, status);
+
+  g_spawn_close_pid(pid);
+  worker->pid = 0;
+  worker->watch = 0;
+  self->UpdateMetrics();
+
+  // Clients of the other workers don't notice, this one's reconnect elsewhere
+  if (!self->stopping) {
+    worker->watch = g_timeout_add_seconds(WORKER_RESPAWN_DELAY, Respawn, worker);
+  }
+}
+
+gboolean WorkerPool::Respawn(gpointer user_data) {
+  Worker *worker = static_cast<Worker *>(user_data);
+  WorkerPool *self = worker->pool;
+
+  worker->watch = 0;
+  worker->restarts++;
+  Metrics::Add("workers.restarts", 1);
+
+  // Try again later if the process can't be started
+  if (!self->Spawn(*worker)) {
+    worker->watch = g_timeout_add_seconds(WORKER_RESPAWN_DELAY, Respawn, worker);
+  }
+
+  self->UpdateMetrics();
+
+  return FALSE;
+}
+
+void WorkerPool::UpdateMetrics() {
+  guint running = 0;
+  for (const auto &worker : workers) {
+    running += worker.pid != 0;
+  }
+
+  Metrics::Set("workers.running", running);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glib.h>
+#include <string>
+#include <vector>
+
+#define WORKER_RESPAWN_DELAY 1 // seconds
+
+// RTSP worker processes started by the capture process. Every worker runs
+// the same executable with --worker and the topology, registry snapshot
+// and handover options of the capture process, binds the RTSP port with
+// SO_REUSEPORT and serves the streams the capture process exports. A worker that dies
+// takes only its own clients with it and is started again.
+
+class WorkerPool {
+public:
+
+  WorkerPool(const std::string &executable, guint count, const std::vector<std::string> &arguments);
+  ~WorkerPool();
+
+  void Start();
+
+private:
+
+  struct Worker {
+    WorkerPool *pool;
+    guint index;
+    GPid pid;
+    guint watch;
+    guint restarts;
+  };
+
+  static void Exited(GPid pid, gint status, gpointer user_data);
+  static gboolean Respawn(gpointer user_data);
+  static void ChildSetup(gpointer user_data);
+
+  bool Spawn(Worker &worker);
+  void UpdateMetrics();
+
+  std::string executable;
+  std::vector<std::string> arguments;
+  std::vector<Worker> workers;
+  bool stopping;
+};
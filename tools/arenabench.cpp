@@ -0,0 +1,159 @@
+// Page faults, RSS and CPU of raw 1080p frames going through convert and
+// scale, with heap allocated buffers and with the slab arenas.
+//
+//   gcf-arena-bench [cameras] [frames] [hugepages]
+//   gcf-arena-bench 4 900 1
+//
+// Every run is a fresh process, so the RSS peaks don't mix.
+
+#include <gst/gst.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "arenapool.h"
+
+#define BENCH_DEFAULT_CAMERAS 4
+#define BENCH_DEFAULT_FRAMES 900
+
+struct Usage {
+  long minor_faults;
+  long major_faults;
+  long max_rss_kb;
+  double cpu_ms;
+  double wall_ms;
+};
+
+static bool Run(int cameras, int frames, const MemoryConfig *memory, Usage &usage) {
+  gst_init(NULL, NULL);
+
+  if (memory) {
+    ArenaPool::Init(*memory);
+  }
+
+  std::vector<GstElement *> pipelines;
+  for (int i = 0; i < cameras; i++) {
+    auto description = "videotestsrc num-buffers=" + std::to_string(frames)
+        + " pattern=ball ! video/x-raw,format=NV12,width=1920,height=1080,framerate=30/1"
+        + " ! videoconvert ! video/x-raw,format=I420 ! videoscale ! video/x-raw,width=1280,height=720"
+        + " ! fakesink sync=false";
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(description.c_str(), &error);
+    if (!pipeline) {
+      fprintf(stderr, "Can't build \"%s\": %s\n", description.c_str(), error->message);
+      g_clear_error(&error);
+      return false;
+    }
+
+    if (memory) {
+      ArenaPool::Attach(pipeline);
+    }
+    pipelines.push_back(pipeline);
+  }
+
+  struct rusage before;
+  getrusage(RUSAGE_SELF, &before);
+  gint64 start = g_get_monotonic_time();
+
+  for (auto pipeline : pipelines) {
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  }
+
+  bool failed = false;
+  for (auto pipeline : pipelines) {
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *message = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                     (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    failed = failed || GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR;
+    gst_message_unref(message);
+    gst_object_unref(bus);
+  }
+
+  gint64 end = g_get_monotonic_time();
+  struct rusage after;
+  getrusage(RUSAGE_SELF, &after);
+
+  for (auto pipeline : pipelines) {
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+  }
+
+  auto ms = [](const struct timeval &time) { return time.tv_sec * 1000.0 + time.tv_usec / 1000.0; };
+  usage.minor_faults = after.ru_minflt - before.ru_minflt;
+  usage.major_faults = after.ru_majflt - before.ru_majflt;
+  usage.max_rss_kb = after.ru_maxrss;
+  usage.cpu_ms = ms(after.ru_utime) + ms(after.ru_stime) - ms(before.ru_utime) - ms(before.ru_stime);
+  usage.wall_ms = (end - start) / 1000.0;
+
+  return !failed;
+}
+
+// GStreamer is only initialized in the children
+static bool RunChild(int cameras, int frames, const MemoryConfig *memory, Usage &usage) {
+  int fds[2];
+  if (pipe(fds)) {
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    bool ok = Run(cameras, frames, memory, usage);
+    ok = ok && write(fds[1], &usage, sizeof(usage)) == sizeof(usage);
+    _exit(ok ? 0 : 1);
+  }
+
+  close(fds[1]);
+  bool ok = pid > 0 && read(fds[0], &usage, sizeof(usage)) == sizeof(usage);
+  close(fds[0]);
+
+  int status = 0;
+  if (pid > 0) {
+    waitpid(pid, &status, 0);
+  }
+  return ok && WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+int main(int argc, char *argv[]) {
+  int cameras = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_CAMERAS;
+  int frames = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_FRAMES;
+
+  MemoryConfig memory;
+  memory.arena = true;
+  memory.hugepages = argc > 3 ? atoi(argv[3]) != 0 : memory.hugepages;
+  memory.budget_mb = 96 * cameras;
+
+  if (cameras <= 0 || frames <= 0) {
+    fprintf(stderr, "Usage: %s [cameras] [frames] [hugepages]\n", argv[0]);
+    return 1;
+  }
+
+  struct {
+    const char *name;
+    const MemoryConfig *memory;
+  } runs[] = {
+      {"heap", NULL},
+      {memory.hugepages ? "arena, hugepages" : "arena", &memory},
+  };
+
+  printf("%d cameras, %d frames of NV12 1920x1080 => I420 1280x720\n", cameras, frames);
+  printf("%-18s %12s %8s %10s %10s %10s\n", "", "minor faults", "major", "max RSS MB", "CPU ms", "wall ms");
+
+  for (const auto &run : runs) {
+    Usage usage;
+    if (!RunChild(cameras, frames, run.memory, usage)) {
+      fprintf(stderr, "\"%s\" run failed\n", run.name);
+      return 1;
+    }
+
+    printf("%-18s %12ld %8ld %10.1f %10.1f %10.1f\n", run.name, usage.minor_faults, usage.major_faults,
+           usage.max_rss_kb / 1024.0, usage.cpu_ms, usage.wall_ms);
+  }
+
+  return 0;
+}
@@ -0,0 +1,235 @@
+// Scale-out of the camera template: 1, 2, 4... up to N videotestsrc cameras
+// made as instances of one template, each feeding an encoder branch. The
+// frame rate every camera keeps and the CPU and memory of the process are
+// taken at every step.
+//
+//   gcf-camera-bench [cameras] [seconds] [encoder] [pin]
+//   gcf-camera-bench 16 10 x264enc 1
+//
+// The encoder is an element type, identity by default. With pin set, every
+// camera is pinned to a CPU of its own, round robin over the CPUs there are.
+// Every step is a fresh process, so the threads and the RSS don't mix.
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "json.h"
+
+#define BENCH_DEFAULT_CAMERAS 16
+#define BENCH_DEFAULT_SECONDS 10
+#define BENCH_WARMUP_SECONDS 2
+#define BENCH_CAPS "video/x-raw,width=(int)1280,height=(int)720,framerate=(fraction)30/1"
+#define BENCH_FPS 30
+
+struct Usage {
+  double min_fps;
+  double avg_fps;
+  double cpu_percent;
+  long max_rss_kb;
+};
+
+static std::string Generate(int cameras, const std::string &encoder, bool pin) {
+  std::string json = std::string("{\"templates\":{\"camera\":{")
+      + "\"params\":{\"caps\":\"" + BENCH_CAPS + "\",\"encoder\":\"" + encoder + "\"},"
+      + "\"caps\":{\"Caps${instance}\":\"${caps}\"},"
+      + "\"pipes\":{"
+      + "\"Cam${instance}\":{"
+      + "\"Source${instance}\":{\"type\":\"videotestsrc\",\"is-live\":\"true\",\"pattern\":\"ball\"},"
+      + "\"Convert${instance}\":{\"type\":\"videoconvert\"},"
+      + "\"Scale${instance}\":{\"type\":\"videoscale\"},"
+      + "\"Filter${instance}\":{\"type\":\"capsfilter\",\"filter\":\"Caps${instance}\"},"
+      + "\"Tee${instance}\":{\"type\":\"tee\"}},"
+      + "\"Enc${instance}\":{"
+      + "\"EncConvert${instance}\":{\"type\":\"videoconvert\"},"
+      + "\"Encoder${instance}\":{\"type\":\"${encoder}\"},"
+      + "\"Sink${instance}\":{\"type\":\"fakesink\",\"sync\":\"false\",\"async\":\"false\"}}},"
+      + "\"connections\":{\"Enc${instance}\":{\"first_elem\":\"EncConvert${instance}\","
+      + "\"src_pipe\":\"Cam${instance}\",\"src_last_elem\":\"Tee${instance}\"}},"
+      + "\"links\":[[\"Source${instance}\",\"Convert${instance}\",\"Scale${instance}\",\"Filter${instance}\","
+      + "\"Tee${instance}\"],[\"EncConvert${instance}\",\"Encoder${instance}\",\"Sink${instance}\"]],"
+      + "\"states\":{\"Cam${instance}\":\"playing\",\"Enc${instance}\":\"playing\"}}},"
+      + "\"instances\":[";
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int i = 0; i < cameras; i++) {
+    json += std::string(i ? "," : "") + "{\"template\":\"camera\",\"name\":\"" + std::to_string(i) + "\"";
+    if (pin) {
+      json += ",\"cpus\":\"" + std::to_string(i % MAX (cpus, 1L)) + "\"";
+    }
+    json += "}";
+  }
+
+  return json + "],\"optimize\":{\"fuse-scale-convert\":false,\"analyze\":false}}";
+}
+
+static GstPadProbeReturn Count(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  ((std::atomic<guint64> *) user_data)->fetch_add(1, std::memory_order_relaxed);
+  return GST_PAD_PROBE_OK;
+}
+
+static GstBusSyncReply Place(GstBus *bus, GstMessage *message, gpointer user_data) {
+  InstanceResources::Place(message, GST_ELEMENT_NAME (user_data));
+  return GST_BUS_PASS;
+}
+
+static bool Run(const std::string &path, int cameras, int seconds, Usage &usage) {
+  gst_init(NULL, NULL);
+
+  auto *topology = new Topology();
+  try {
+    Json(path.c_str()).CreateTopology(topology);
+  } catch (GcfException &exception) {
+    fprintf(stderr, "Can't build the topology: %s\n", exception.what());
+    return false;
+  }
+  InstanceResources::Init(topology->GetInstanceConfigs());
+
+  // Frames out of every camera, before the branch takes them
+  std::vector<std::atomic<guint64>> frames(cameras);
+  for (int i = 0; i < cameras; i++) {
+    GstPad *pad = gst_element_get_static_pad(topology->GetElement("Tee" + std::to_string(i)), "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, Count, &frames[i], NULL);
+    gst_object_unref(pad);
+  }
+
+  for (const auto &pipe : topology->GetPipes()) {
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE (pipe.second));
+    gst_bus_set_sync_handler(bus, Place, pipe.second, NULL);
+    gst_object_unref(bus);
+  }
+
+  bool failed = false;
+  for (const auto &initial : topology->GetInitialStates()) {
+    failed |= gst_element_set_state(topology->GetPipe(initial.first), initial.second) == GST_STATE_CHANGE_FAILURE;
+  }
+
+  g_usleep(BENCH_WARMUP_SECONDS * G_USEC_PER_SEC);
+
+  std::vector<guint64> before_frames;
+  for (const auto &count : frames) {
+    before_frames.push_back(count);
+  }
+  struct rusage before;
+  getrusage(RUSAGE_SELF, &before);
+  gint64 start = g_get_monotonic_time();
+
+  g_usleep(seconds * G_USEC_PER_SEC);
+
+  gint64 end = g_get_monotonic_time();
+  struct rusage after;
+  getrusage(RUSAGE_SELF, &after);
+
+  double wall_s = (end - start) / (double) G_USEC_PER_SEC;
+  usage.min_fps = G_MAXDOUBLE;
+  usage.avg_fps = 0;
+  for (int i = 0; i < cameras; i++) {
+    double fps = (frames[i] - before_frames[i]) / wall_s;
+    usage.min_fps = MIN (usage.min_fps, fps);
+    usage.avg_fps += fps / cameras;
+  }
+
+  auto ms = [](const struct timeval &time) { return time.tv_sec * 1000.0 + time.tv_usec / 1000.0; };
+  double cpu_ms = ms(after.ru_utime) + ms(after.ru_stime) - ms(before.ru_utime) - ms(before.ru_stime);
+  usage.cpu_percent = cpu_ms / (wall_s * 10);
+  usage.max_rss_kb = after.ru_maxrss;
+
+  delete topology;
+  return !failed;
+}
+
+// GStreamer is only initialized in the children
+static bool RunChild(const std::string &path, int cameras, int seconds, Usage &usage) {
+  int fds[2];
+  if (pipe(fds)) {
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    bool ok = Run(path, cameras, seconds, usage);
+    ok = ok && write(fds[1], &usage, sizeof(usage)) == sizeof(usage);
+    _exit(ok ? 0 : 1);
+  }
+
+  close(fds[1]);
+  bool ok = pid > 0 && read(fds[0], &usage, sizeof(usage)) == sizeof(usage);
+  close(fds[0]);
+
+  int status = 0;
+  if (pid > 0) {
+    waitpid(pid, &status, 0);
+  }
+  return ok && WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+int main(int argc, char *argv[]) {
+  int cameras = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_CAMERAS;
+  int seconds = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_SECONDS;
+  std::string encoder = argc > 3 ? argv[3] : "identity";
+  bool pin = argc > 4 && atoi(argv[4]) != 0;
+
+  if (cameras <= 0 || seconds <= 0) {
+    fprintf(stderr, "Usage: %s [cameras] [seconds] [encoder] [pin]\n", argv[0]);
+    return 1;
+  }
+
+  // The plans are compiled into a directory of their own, before GLib reads it
+  gchar *cache = g_dir_make_tmp("gcf-camera-bench-XXXXXX", NULL);
+  g_setenv("XDG_CACHE_HOME", cache, TRUE);
+
+  std::vector<int> steps;
+  for (int step = 1; step < cameras; step *= 2) {
+    steps.push_back(step);
+  }
+  steps.push_back(cameras);
+
+  printf("videotestsrc 1280x720@%d => %s, %s, %d s per step\n", BENCH_FPS, encoder.c_str(),
+         pin ? "pinned" : "not pinned", seconds);
+  printf("%8s %12s %12s %10s %14s %10s\n", "cameras", "min fps", "avg fps", "CPU %", "CPU % / camera",
+         "max RSS MB");
+
+  int result = 0;
+  for (int step : steps) {
+    std::string path = std::string(cache) + "/cameras-" + std::to_string(step) + ".json";
+    std::ofstream(path) << Generate(step, encoder, pin);
+
+    Usage usage;
+    if (!RunChild(path, step, seconds, usage)) {
+      fprintf(stderr, "%d cameras: run failed\n", step);
+      result = 1;
+      break;
+    }
+
+    printf("%8d %12.1f %12.1f %10.1f %14.1f %10.1f%s\n", step, usage.min_fps, usage.avg_fps, usage.cpu_percent,
+           usage.cpu_percent / step, usage.max_rss_kb / 1024.0, usage.min_fps < BENCH_FPS * 0.95 ? "  dropping" : "");
+    g_unlink(path.c_str());
+  }
+
+  // Plans of the runs and their directory
+  gchar *plans = g_build_filename(cache, "gcf", NULL);
+  GDir *dir = g_dir_open(plans, 0, NULL);
+  for (const gchar *name = dir ? g_dir_read_name(dir) : NULL; name; name = g_dir_read_name(dir)) {
+    gchar *plan = g_build_filename(plans, name, NULL);
+    g_unlink(plan);
+    g_free(plan);
+  }
+  if (dir) {
+    g_dir_close(dir);
+  }
+  g_rmdir(plans);
+  g_free(plans);
+  g_rmdir(cache);
+  g_free(cache);
+
+  return result;
+}
@@ -0,0 +1,264 @@
+// Loopback UDP egress of one mount to 10, 50 and 200 unicast clients, with
+// every RTP packet sent on its own and batched by gcfrtpbatch, as the
+// "udp-batch" mount option does it. Reports the packets per second the
+// sender gets out, its system CPU per thousand packets and how many of the
+// packets the receivers got.
+//
+//   gcf-egress-bench [clients,...] [frames] [packets-per-frame]
+//   gcf-egress-bench 10,50,200 300 20
+//
+// The packets are made up front and pushed as fast as multiudpsink takes
+// them, the marker ends every frame like a payloader sets it. The clients
+// are sockets of another process, so only the sending is in the CPU time.
+// Every run is a fresh process.
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "rtpbatch.h"
+
+#define BENCH_DEFAULT_CLIENTS "10,50,200"
+#define BENCH_DEFAULT_FRAMES 300
+#define BENCH_DEFAULT_PACKETS 20
+#define BENCH_PAYLOAD_BYTES 1200
+#define BENCH_RECEIVE_BUFFER (4 * 1024 * 1024)
+
+struct Usage {
+  double wall_ms;
+  double sys_ms;
+  guint64 sent;
+  guint64 received;
+};
+
+// Binds the clients, writes their ports and counts what arrives until "stop" closes
+static void Receive(int clients, int ports_fd, int stop_fd, int count_fd) {
+  std::vector<struct pollfd> fds;
+  for (int i = 0; i < clients; i++) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    int size = BENCH_RECEIVE_BUFFER;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    struct sockaddr_in address = {};
+    socklen_t length = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &address, sizeof(address))
+        || getsockname(fd, (struct sockaddr *) &address, &length)) {
+      _exit(1);
+    }
+
+    guint16 port = ntohs(address.sin_port);
+    if (write(ports_fd, &port, sizeof(port)) != sizeof(port)) {
+      _exit(1);
+    }
+    fds.push_back({fd, POLLIN, 0});
+  }
+  fds.push_back({stop_fd, POLLIN, 0});
+  close(ports_fd);
+
+  guint64 received = 0;
+  char packet[2048];
+  bool stopping = false;
+  while (!stopping) {
+    poll(fds.data(), fds.size(), -1);
+    stopping = fds.back().revents != 0;
+
+    // What is still queued when the sender is done counts as well
+    for (size_t i = 0; i + 1 < fds.size(); i++) {
+      while (recv(fds[i].fd, packet, sizeof(packet), 0) > 0) {
+        received++;
+      }
+    }
+  }
+
+  _exit(write(count_fd, &received, sizeof(received)) == sizeof(received) ? 0 : 1);
+}
+
+static GstBuffer *MakePacket(guint16 sequence, guint32 timestamp, bool marker, GstClockTime pts) {
+  GstBuffer *buffer = gst_rtp_buffer_new_allocate(BENCH_PAYLOAD_BYTES, 0, 0);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  gst_rtp_buffer_map(buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_payload_type(&rtp, 96);
+  gst_rtp_buffer_set_ssrc(&rtp, 0x6763660a);
+  gst_rtp_buffer_set_seq(&rtp, sequence);
+  gst_rtp_buffer_set_timestamp(&rtp, timestamp);
+  gst_rtp_buffer_set_marker(&rtp, marker);
+  gst_rtp_buffer_unmap(&rtp);
+
+  GST_BUFFER_PTS (buffer) = pts;
+  return buffer;
+}
+
+static bool Run(int clients, int frames, int packets, bool batched, Usage &usage) {
+  int ports[2], stop[2], count[2];
+  if (pipe(ports) || pipe(stop) || pipe(count)) {
+    return false;
+  }
+
+  pid_t receiver = fork();
+  if (receiver == 0) {
+    close(ports[0]);
+    close(stop[1]);
+    close(count[0]);
+    Receive(clients, ports[1], stop[0], count[1]);
+  }
+  close(ports[1]);
+  close(stop[0]);
+  close(count[1]);
+
+  std::string destinations;
+  for (int i = 0; i < clients; i++) {
+    guint16 port;
+    if (read(ports[0], &port, sizeof(port)) != sizeof(port)) {
+      return false;
+    }
+    destinations += std::string(i ? "," : "") + "127.0.0.1:" + std::to_string(port);
+  }
+  close(ports[0]);
+
+  gst_init(NULL, NULL);
+  gst_element_register(NULL, "gcfrtpbatch", GST_RANK_NONE, GCF_TYPE_RTP_BATCH);
+
+  auto description = std::string("appsrc name=source format=time block=true max-bytes=65536")
+      + " caps=application/x-rtp,media=video,clock-rate=90000,encoding-name=H264,payload=96"
+      + (batched ? " ! gcfrtpbatch" : "")
+      + " ! multiudpsink sync=false async=false clients=" + destinations;
+
+  GError *error = NULL;
+  GstElement *pipeline = gst_parse_launch(description.c_str(), &error);
+  if (!pipeline) {
+    fprintf(stderr, "Can't build the sender: %s\n", error->message);
+    g_clear_error(&error);
+    return false;
+  }
+  GstElement *source = gst_bin_get_by_name(GST_BIN (pipeline), "source");
+
+  // Made before the clock starts, only the sending is timed
+  std::vector<GstBuffer *> buffers;
+  guint16 sequence = 0;
+  for (int frame = 0; frame < frames; frame++) {
+    GstClockTime pts = gst_util_uint64_scale(frame, GST_SECOND, 30);
+    for (int packet = 0; packet < packets; packet++) {
+      buffers.push_back(MakePacket(sequence++, frame * 3000, packet == packets - 1, pts));
+    }
+  }
+
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+  struct rusage before;
+  getrusage(RUSAGE_SELF, &before);
+  gint64 start = g_get_monotonic_time();
+
+  for (GstBuffer *buffer : buffers) {
+    gst_app_src_push_buffer(GST_APP_SRC (source), buffer);
+  }
+  gst_app_src_end_of_stream(GST_APP_SRC (source));
+
+  GstBus *bus = gst_element_get_bus(pipeline);
+  GstMessage *message = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                   (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+  bool failed = GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR;
+
+  gint64 end = g_get_monotonic_time();
+  struct rusage after;
+  getrusage(RUSAGE_SELF, &after);
+
+  gst_message_unref(message);
+  gst_object_unref(bus);
+  gst_object_unref(source);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  // Whatever is in flight lands before the receiver is stopped
+  g_usleep(200 * 1000);
+  close(stop[1]);
+  failed |= read(count[0], &usage.received, sizeof(usage.received)) != sizeof(usage.received);
+  close(count[0]);
+  waitpid(receiver, NULL, 0);
+
+  auto ms = [](const struct timeval &time) { return time.tv_sec * 1000.0 + time.tv_usec / 1000.0; };
+  usage.wall_ms = (end - start) / 1000.0;
+  usage.sys_ms = ms(after.ru_stime) - ms(before.ru_stime);
+  usage.sent = (guint64) frames * packets * clients;
+
+  return !failed;
+}
+
+// GStreamer is only initialized in the children
+static bool RunChild(int clients, int frames, int packets, bool batched, Usage &usage) {
+  int fds[2];
+  if (pipe(fds)) {
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    bool ok = Run(clients, frames, packets, batched, usage);
+    ok = ok && write(fds[1], &usage, sizeof(usage)) == sizeof(usage);
+    _exit(ok ? 0 : 1);
+  }
+
+  close(fds[1]);
+  bool ok = pid > 0 && read(fds[0], &usage, sizeof(usage)) == sizeof(usage);
+  close(fds[0]);
+
+  int status = 0;
+  if (pid > 0) {
+    waitpid(pid, &status, 0);
+  }
+  return ok && WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+int main(int argc, char *argv[]) {
+  std::string client_counts = argc > 1 ? argv[1] : BENCH_DEFAULT_CLIENTS;
+  int frames = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_FRAMES;
+  int packets = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_PACKETS;
+
+  std::vector<int> steps;
+  gchar **counts = g_strsplit(client_counts.c_str(), ",", -1);
+  for (gchar **item = counts; *item; item++) {
+    steps.push_back(atoi(*item));
+  }
+  g_strfreev(counts);
+
+  bool valid = frames > 0 && packets > 0 && !steps.empty();
+  for (int clients : steps) {
+    valid = valid && clients > 0;
+  }
+  if (!valid) {
+    fprintf(stderr, "Usage: %s [clients,...] [frames] [packets-per-frame]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%d frames of %d RTP packets of %d bytes to every client over loopback\n", frames, packets,
+         BENCH_PAYLOAD_BYTES);
+  printf("%8s %-11s %12s %16s %10s\n", "clients", "", "packets/s", "sys ms/kpacket", "received");
+
+  for (int clients : steps) {
+    for (bool batched : {false, true}) {
+      Usage usage;
+      if (!RunChild(clients, frames, packets, batched, usage)) {
+        fprintf(stderr, "%d clients, %s: run failed\n", clients, batched ? "batched" : "per packet");
+        return 1;
+      }
+
+      printf("%8d %-11s %12.0f %16.3f %9.1f%%\n", clients, batched ? "batched" : "per packet",
+             usage.sent * 1000.0 / usage.wall_ms, usage.sys_ms * 1000.0 / usage.sent,
+             100.0 * usage.received / usage.sent);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,162 @@
+// Failover check: stalls the watched source of a running app again and
+// again and reads back how many frames every switch to the backup and
+// back cost, as the app measures them at the output of its selector.
+//
+//   gcf-failover-check [--switches N] [--max-frames N] <app> <config> <element>
+//   gcf-failover-check --switches 10 --max-frames 2 ./bin/gst-rtsp-app headless.json MainStall
+//
+// The element is an identity at the failover source, stalled by giving it a
+// sleep-time longer than the failover timeout through the app's stdin and
+// released once the app switched over. A switch back follows after the
+// recover time. The app's "frames lost in the switch" lines of
+// GCF_APP_FAILOVER are the measurement.
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define FAILOVER_DEFAULT_SWITCHES 10
+#define FAILOVER_DEFAULT_MAX_FRAMES 2
+#define FAILOVER_STALL_US 3000000
+#define FAILOVER_SWITCH_TIMEOUT_S 15
+#define FAILOVER_STARTUP_S 5
+#define FAILOVER_APP_LOG "/tmp/gcf-failover-check.log"
+
+static GPid app = 0;
+static gint stdin_fd = -1;
+
+static bool Start(const char *binary, const char *config) {
+  gchar **env = g_get_environ();
+  const gchar *debug = g_environ_getenv(env, "GST_DEBUG");
+  gchar *app_debug = g_strconcat(debug ? debug : "*:2", ",GCF_APP_FAILOVER:4", NULL);
+
+  g_unlink(FAILOVER_APP_LOG);
+  env = g_environ_setenv(env, "GST_DEBUG", app_debug, TRUE);
+  env = g_environ_setenv(env, "GST_DEBUG_FILE", FAILOVER_APP_LOG, TRUE);
+  env = g_environ_setenv(env, "GST_DEBUG_NO_COLOR", "1", TRUE);
+  g_free(app_debug);
+
+  const gchar *argv[] = {binary, "--config", config, NULL};
+  GError *error = NULL;
+  gboolean spawned = g_spawn_async_with_pipes(NULL, (gchar **) argv, env, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL,
+                                              &app, &stdin_fd, NULL, NULL, &error);
+  g_strfreev(env);
+
+  if (!spawned) {
+    fprintf(stderr, "Can't start %s: %s\n", binary, error->message);
+    g_clear_error(&error);
+  }
+  return spawned;
+}
+
+// A command line of the app, "<element> <property> <value>"
+static bool Command(const std::string &command) {
+  auto line = command + "\n";
+  return write(stdin_fd, line.data(), line.size()) == (ssize_t) line.size();
+}
+
+// Frames of every switch measured so far, in order
+static std::vector<gint> Switches() {
+  std::vector<gint> frames;
+  gchar *log = NULL;
+
+  if (g_file_get_contents(FAILOVER_APP_LOG, &log, NULL, NULL)) {
+    const gchar *tag = " frames lost in the switch";
+    for (const gchar *line = strstr(log, tag); line; line = strstr(line + 1, tag)) {
+      // The count is the number right before the tag
+      const gchar *start = line;
+      while (start > log && g_ascii_isdigit(start[-1])) {
+        start--;
+      }
+      frames.push_back(atoi(start));
+    }
+    g_free(log);
+  }
+  return frames;
+}
+
+static bool WaitSwitches(size_t count) {
+  gint64 deadline = g_get_monotonic_time() + FAILOVER_SWITCH_TIMEOUT_S * G_USEC_PER_SEC;
+  while (Switches().size() < count) {
+    if (g_get_monotonic_time() > deadline || waitpid(app, NULL, WNOHANG) != 0) {
+      return false;
+    }
+    g_usleep(50 * G_TIME_SPAN_MILLISECOND);
+  }
+  return true;
+}
+
+static void Quit() {
+  close(stdin_fd);
+  kill(app, SIGTERM);
+  waitpid(app, NULL, 0);
+  g_spawn_close_pid(app);
+}
+
+int main(int argc, char *argv[]) {
+  gint switches = FAILOVER_DEFAULT_SWITCHES;
+  gint max_frames = FAILOVER_DEFAULT_MAX_FRAMES;
+
+  GOptionEntry options[] = {
+      {"switches", 0, 0, G_OPTION_ARG_INT, &switches, "Stalls to cause, each one switches over and back", "N"},
+      {"max-frames", 0, 0, G_OPTION_ARG_INT, &max_frames, "Most frames a switch may lose", "N"},
+      {NULL}
+  };
+
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("<app> <config> <element>");
+  g_option_context_add_main_entries(context, options, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error) || argc < 4 || switches <= 0 || max_frames < 0) {
+    fprintf(stderr, "Usage: %s [--switches N] [--max-frames N] <app> <config> <element>\n", argv[0]);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  std::string element = argv[3];
+  if (!Start(argv[1], argv[2])) {
+    return 1;
+  }
+  g_usleep(FAILOVER_STARTUP_S * G_USEC_PER_SEC);
+
+  for (gint i = 0; i < switches; i++) {
+    // Over to the backup, then the source is let go and comes back
+    bool ok = Command(element + " sleep-time " + std::to_string(FAILOVER_STALL_US))
+        && WaitSwitches(2 * i + 1)
+        && Command(element + " sleep-time 0")
+        && WaitSwitches(2 * i + 2);
+
+    if (!ok) {
+      fprintf(stderr, "Stall %d: the app did not switch over and back in %d s\n", i + 1, FAILOVER_SWITCH_TIMEOUT_S);
+      Quit();
+      return 1;
+    }
+  }
+
+  Quit();
+
+  auto frames = Switches();
+  gint worst = 0;
+  double sum = 0;
+  printf("%6s %14s %14s\n", "stall", "to backup", "back");
+  for (size_t i = 0; i + 1 < frames.size(); i += 2) {
+    printf("%6zu %14d %14d\n", i / 2 + 1, frames[i], frames[i + 1]);
+  }
+  for (gint count : frames) {
+    worst = MAX (worst, count);
+    sum += count;
+  }
+
+  bool ok = worst <= max_frames;
+  printf("%s: %zu switches, %.2f frames lost per switch on average, %d at most (limit %d)\n", ok ? "PASS" : "FAIL",
+         frames.size(), frames.empty() ? 0.0 : sum / frames.size(), worst, max_frames);
+  return ok ? 0 : 1;
+}
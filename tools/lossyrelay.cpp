@@ -0,0 +1,472 @@
+// Lossy UDP relay between a mount and one RTSP client, to tune the bitrate
+// adaptation and the retransmission buffers without a real network. The
+// client is an rtspsrc with retransmission requests on, talking to the
+// server through a small RTSP proxy that points the server's RTP and RTCP
+// at the relay. The relay drops a share of the RTP packets and delays the
+// rest before they reach the client.
+//
+//   gcf-lossy-relay <url> [loss-%] [delay-ms] [seconds] [latency-ms]
+//   gcf-lossy-relay rtsp://127.0.0.1:8554/h264 3 40 60 200
+//
+// Prints, every second, the bitrate the client gets and what the relay
+// passed and dropped, then the jitter buffer's account of lost packets and
+// retransmissions. The server's side, "abr.<mount>.*" and "rtx.<mount>.*",
+// is in its metrics log. RTCP passes the relay untouched, the receiver
+// reports go straight to the server.
+
+#include <gst/gst.h>
+#include <gst/rtsp/gstrtspurl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#define RELAY_DEFAULT_LOSS 2.0
+#define RELAY_DEFAULT_DELAY_MS 20
+#define RELAY_DEFAULT_SECONDS 30
+#define RELAY_DEFAULT_LATENCY_MS 200
+#define RELAY_RECEIVE_BUFFER (4 * 1024 * 1024)
+
+struct Stream {
+  guint16 client_rtp;
+  guint16 client_rtcp;
+  guint16 relay_rtp;
+  guint16 relay_rtcp;
+  int rtp_fd;
+  int rtcp_fd;
+};
+
+struct Delayed {
+  gint64 due;
+  int fd;
+  guint16 port;
+  std::string data;
+};
+
+// Set up by main before the relay thread starts
+static double loss = RELAY_DEFAULT_LOSS / 100;
+static gint64 delay_us = RELAY_DEFAULT_DELAY_MS * 1000;
+static std::string server_host;
+static guint16 server_port = 0;
+static std::string server_authority;
+static std::string proxy_authority;
+static int listen_fd = -1;
+static int stop_fd = -1;
+
+static std::atomic<guint64> relayed(0);
+static std::atomic<guint64> dropped(0);
+
+static GMainLoop *loop = NULL;
+static GstElement *jitterbuffer = NULL;
+static std::atomic<gint64> received_bytes(0);
+
+static int BindLoopback(guint16 &port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int size = RELAY_RECEIVE_BUFFER;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  struct sockaddr_in address = {};
+  socklen_t length = sizeof(address);
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd < 0 || bind(fd, (struct sockaddr *) &address, sizeof(address))
+      || getsockname(fd, (struct sockaddr *) &address, &length)) {
+    return -1;
+  }
+
+  port = ntohs(address.sin_port);
+  return fd;
+}
+
+static void SendTo(int fd, guint16 port, const std::string &data) {
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  sendto(fd, data.data(), data.size(), 0, (struct sockaddr *) &address, sizeof(address));
+}
+
+static bool SendAll(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t size = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (size <= 0) {
+      return false;
+    }
+    sent += size;
+  }
+  return true;
+}
+
+static void ReplaceAll(std::string &text, const std::string &from, const std::string &to) {
+  for (size_t at = text.find(from); at != std::string::npos; at = text.find(from, at + to.size())) {
+    text.replace(at, from.size(), to);
+  }
+}
+
+static size_t ContentLength(const std::string &head) {
+  gchar **lines = g_strsplit(head.c_str(), "\r\n", -1);
+  size_t length = 0;
+  for (gchar **line = lines; *line; line++) {
+    if (!g_ascii_strncasecmp(*line, "Content-Length:", 15)) {
+      length = strtoul(*line + 15, NULL, 10);
+    }
+  }
+  g_strfreev(lines);
+  return length;
+}
+
+// Cuts one complete RTSP message off the front of the buffer
+static bool NextMessage(std::string &buffer, std::string &message) {
+  size_t end = buffer.find("\r\n\r\n");
+  if (end == std::string::npos) {
+    return false;
+  }
+
+  end += 4;
+  size_t length = end + ContentLength(buffer.substr(0, end));
+  if (buffer.size() < length) {
+    return false;
+  }
+
+  message = buffer.substr(0, length);
+  buffer.erase(0, length);
+  return true;
+}
+
+// SETUP gets the relay's ports in place of the client's, the URLs point at the server
+static std::string RewriteRequest(std::string message, std::vector<Stream> &streams) {
+  ReplaceAll(message, proxy_authority, server_authority);
+
+  size_t at = message.find("client_port=");
+  guint rtp = 0, rtcp = 0;
+  if (at == std::string::npos || sscanf(message.c_str() + at, "client_port=%u-%u", &rtp, &rtcp) != 2) {
+    return message;
+  }
+
+  Stream stream = {(guint16) rtp, (guint16) rtcp, 0, 0, -1, -1};
+  stream.rtp_fd = BindLoopback(stream.relay_rtp);
+  stream.rtcp_fd = BindLoopback(stream.relay_rtcp);
+  streams.push_back(stream);
+
+  auto ports = "client_port=" + std::to_string(stream.relay_rtp) + "-" + std::to_string(stream.relay_rtcp);
+  ReplaceAll(message, "client_port=" + std::to_string(rtp) + "-" + std::to_string(rtcp), ports);
+  return message;
+}
+
+// The other way round, with the body's URLs rewritten and its length fixed
+static std::string RewriteResponse(std::string message, const std::vector<Stream> &streams) {
+  size_t end = message.find("\r\n\r\n") + 4;
+  std::string head = message.substr(0, end);
+  std::string body = message.substr(end);
+  ReplaceAll(head, server_authority, proxy_authority);
+  ReplaceAll(body, server_authority, proxy_authority);
+
+  if (!body.empty()) {
+    size_t at = head.find("Content-Length:");
+    size_t line_end = head.find("\r\n", at);
+    if (at != std::string::npos) {
+      head.replace(at, line_end - at, "Content-Length: " + std::to_string(body.size()));
+    }
+  }
+
+  for (const auto &stream : streams) {
+    ReplaceAll(head, "client_port=" + std::to_string(stream.relay_rtp) + "-" + std::to_string(stream.relay_rtcp),
+               "client_port=" + std::to_string(stream.client_rtp) + "-" + std::to_string(stream.client_rtcp));
+  }
+
+  return head + body;
+}
+
+static int ConnectServer() {
+  struct addrinfo hints = {}, *result = NULL;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(server_host.c_str(), std::to_string(server_port).c_str(), &hints, &result)) {
+    return -1;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen)) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  return fd;
+}
+
+// One client connection at a time, everything on one poll
+static gpointer Relay(gpointer user_data) {
+  int client_fd = -1, server_fd = -1;
+  std::string from_client, from_server;
+  std::vector<Stream> streams;
+  std::deque<Delayed> delayed;
+  char data[65536];
+
+  while (true) {
+    std::vector<struct pollfd> fds = {{stop_fd, POLLIN, 0}, {listen_fd, POLLIN, 0},
+                                      {client_fd, POLLIN, 0}, {server_fd, POLLIN, 0}};
+    for (const auto &stream : streams) {
+      fds.push_back({stream.rtp_fd, POLLIN, 0});
+      fds.push_back({stream.rtcp_fd, POLLIN, 0});
+    }
+
+    gint64 now = g_get_monotonic_time();
+    int timeout = delayed.empty() ? -1 : (int) MAX ((delayed.front().due - now + 999) / 1000, 0);
+    poll(fds.data(), fds.size(), timeout);
+
+    if (fds[0].revents) {
+      break;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      int fd = accept(listen_fd, NULL, NULL);
+      if (client_fd >= 0 || fd < 0 || (server_fd = ConnectServer()) < 0) {
+        fprintf(stderr, "Relay: can't take the client to %s\n", server_authority.c_str());
+        close(fd);
+      } else {
+        client_fd = fd;
+      }
+    }
+
+    bool closed = false;
+    if (client_fd >= 0 && (fds[2].revents & (POLLIN | POLLHUP))) {
+      ssize_t size = recv(client_fd, data, sizeof(data), 0);
+      closed |= size <= 0;
+      from_client.append(data, MAX (size, 0));
+
+      std::string message;
+      while (!closed && NextMessage(from_client, message)) {
+        closed |= !SendAll(server_fd, RewriteRequest(message, streams));
+      }
+    }
+    if (server_fd >= 0 && (fds[3].revents & (POLLIN | POLLHUP))) {
+      ssize_t size = recv(server_fd, data, sizeof(data), 0);
+      closed |= size <= 0;
+      from_server.append(data, MAX (size, 0));
+
+      std::string message;
+      while (!closed && NextMessage(from_server, message)) {
+        closed |= !SendAll(client_fd, RewriteResponse(message, streams));
+      }
+    }
+    if (closed) {
+      close(client_fd);
+      close(server_fd);
+      client_fd = server_fd = -1;
+      from_client.clear();
+      from_server.clear();
+    }
+
+    // RTP is thinned out and delayed, RTCP goes on as it came
+    for (size_t i = 0; i < streams.size(); i++) {
+      const Stream &stream = streams[i];
+      if (fds[4 + 2 * i].revents & POLLIN) {
+        ssize_t size = recv(stream.rtp_fd, data, sizeof(data), 0);
+        if (size > 0 && g_random_double() < loss) {
+          dropped++;
+        } else if (size > 0) {
+          delayed.push_back({now + delay_us, stream.rtp_fd, stream.client_rtp, std::string(data, size)});
+        }
+      }
+      if (fds[5 + 2 * i].revents & POLLIN) {
+        ssize_t size = recv(stream.rtcp_fd, data, sizeof(data), 0);
+        if (size > 0) {
+          SendTo(stream.rtcp_fd, stream.client_rtcp, std::string(data, size));
+        }
+      }
+    }
+
+    now = g_get_monotonic_time();
+    while (!delayed.empty() && delayed.front().due <= now) {
+      SendTo(delayed.front().fd, delayed.front().port, delayed.front().data);
+      delayed.pop_front();
+      relayed++;
+    }
+  }
+
+  for (const auto &stream : streams) {
+    close(stream.rtp_fd);
+    close(stream.rtcp_fd);
+  }
+  close(client_fd);
+  close(server_fd);
+  return NULL;
+}
+
+static void Handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer user_data) {
+  received_bytes += gst_buffer_get_size(buffer);
+}
+
+static void NewJitterbuffer(GstElement *manager, GstElement *element, guint session, guint ssrc,
+                            gpointer user_data) {
+  if (!jitterbuffer) {
+    jitterbuffer = GST_ELEMENT (gst_object_ref(element));
+  }
+}
+
+static void NewManager(GstElement *source, GstElement *manager, gpointer user_data) {
+  g_signal_connect(manager, "new-jitterbuffer", G_CALLBACK (NewJitterbuffer), NULL);
+}
+
+static gboolean Report(gpointer user_data) {
+  static gint64 last_bytes = 0;
+  static guint64 last_relayed = 0, last_dropped = 0;
+  static guint second = 0;
+
+  gint64 bytes = received_bytes;
+  guint64 now_relayed = relayed, now_dropped = dropped;
+  printf("%6u %12" G_GINT64_FORMAT " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT "\n", ++second,
+         (bytes - last_bytes) * 8 / 1000, now_relayed - last_relayed, now_dropped - last_dropped);
+
+  last_bytes = bytes;
+  last_relayed = now_relayed;
+  last_dropped = now_dropped;
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean Quit(gpointer user_data) {
+  g_main_loop_quit(loop);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean BusHandler(GstBus *bus, GstMessage *message, gpointer user_data) {
+  if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR || GST_MESSAGE_TYPE (message) == GST_MESSAGE_EOS) {
+    GError *error = NULL;
+    if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR) {
+      gst_message_parse_error(message, &error, NULL);
+    }
+    fprintf(stderr, "The client stopped: %s\n", error ? error->message : "end of stream");
+    g_clear_error(&error);
+    g_main_loop_quit(loop);
+  }
+  return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+  gst_init(&argc, &argv);
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <url> [loss-%%] [delay-ms] [seconds] [latency-ms]\n", argv[0]);
+    return 1;
+  }
+
+  GstRTSPUrl *url = NULL;
+  if (gst_rtsp_url_parse(argv[1], &url) != GST_RTSP_OK) {
+    fprintf(stderr, "\"%s\" is not an RTSP URL\n", argv[1]);
+    return 1;
+  }
+  loss = (argc > 2 ? atof(argv[2]) : RELAY_DEFAULT_LOSS) / 100;
+  delay_us = (argc > 3 ? atoi(argv[3]) : RELAY_DEFAULT_DELAY_MS) * (gint64) 1000;
+  guint seconds = argc > 4 ? (guint) atoi(argv[4]) : RELAY_DEFAULT_SECONDS;
+  guint latency = argc > 5 ? (guint) atoi(argv[5]) : RELAY_DEFAULT_LATENCY_MS;
+
+  server_host = url->host;
+  gst_rtsp_url_get_port(url, &server_port);
+  server_authority = server_host + ":" + std::to_string(server_port);
+  std::string path = url->abspath;
+  if (url->query) {
+    path += std::string("?") + url->query;
+  }
+  gst_rtsp_url_free(url);
+
+  // The proxy takes the client's RTSP connection
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address = {};
+  socklen_t length = sizeof(address);
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &address, sizeof(address))
+      || listen(listen_fd, 1) || getsockname(listen_fd, (struct sockaddr *) &address, &length)) {
+    fprintf(stderr, "Can't listen for the client\n");
+    return 1;
+  }
+  proxy_authority = "127.0.0.1:" + std::to_string(ntohs(address.sin_port));
+
+  int stop[2];
+  if (!seconds || loss < 0 || loss > 1 || delay_us < 0 || pipe(stop)) {
+    fprintf(stderr, "Usage: %s <url> [loss-%%] [delay-ms] [seconds] [latency-ms]\n", argv[0]);
+    return 1;
+  }
+  stop_fd = stop[0];
+  GThread *relay = g_thread_new("relay", Relay, NULL);
+
+  auto launch = "rtspsrc name=source location=\"rtsp://" + proxy_authority + path + "\" protocols=udp"
+      " do-retransmission=true latency=" + std::to_string(latency)
+      + " ! fakesink sync=false signal-handoffs=true name=sink";
+
+  GError *error = NULL;
+  GstElement *pipeline = gst_parse_launch(launch.c_str(), &error);
+  if (!pipeline) {
+    fprintf(stderr, "Can't create the client: %s\n", error->message);
+    g_clear_error(&error);
+    return 1;
+  }
+
+  GstElement *source = gst_bin_get_by_name(GST_BIN (pipeline), "source");
+  GstElement *sink = gst_bin_get_by_name(GST_BIN (pipeline), "sink");
+  g_signal_connect(source, "new-manager", G_CALLBACK (NewManager), NULL);
+  g_signal_connect(sink, "handoff", G_CALLBACK (Handoff), NULL);
+  gst_object_unref(source);
+  gst_object_unref(sink);
+
+  loop = g_main_loop_new(NULL, FALSE);
+  GstBus *bus = gst_element_get_bus(pipeline);
+  gst_bus_add_watch(bus, BusHandler, NULL);
+  gst_object_unref(bus);
+
+  printf("%s through a relay dropping %.1f%% and delaying %" G_GINT64_FORMAT " ms, %u ms latency\n",
+         argv[1], loss * 100, delay_us / 1000, latency);
+  printf("%6s %12s %10s %10s\n", "second", "kbit/s", "relayed", "dropped");
+
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  g_timeout_add_seconds(1, Report, NULL);
+  g_timeout_add_seconds(seconds, Quit, NULL);
+  g_main_loop_run(loop);
+
+  // What the jitter buffer made of it, before the client tears it down
+  GstStructure *stats = NULL;
+  if (jitterbuffer) {
+    g_object_get(jitterbuffer, "stats", &stats, NULL);
+  }
+  if (stats) {
+    guint64 pushed = 0, lost = 0, late = 0, rtx = 0, rtx_success = 0, rtx_rtt = 0;
+    gst_structure_get_uint64(stats, "num-pushed", &pushed);
+    gst_structure_get_uint64(stats, "num-lost", &lost);
+    gst_structure_get_uint64(stats, "num-late", &late);
+    gst_structure_get_uint64(stats, "rtx-count", &rtx);
+    gst_structure_get_uint64(stats, "rtx-success-count", &rtx_success);
+    gst_structure_get_uint64(stats, "rtx-rtt", &rtx_rtt);
+
+    printf("Relay: %" G_GUINT64_FORMAT " packets passed, %" G_GUINT64_FORMAT " dropped\n",
+           (guint64) relayed, (guint64) dropped);
+    printf("Client: %" G_GUINT64_FORMAT " pushed, %" G_GUINT64_FORMAT " lost, %" G_GUINT64_FORMAT " late\n",
+           pushed, lost, late);
+    printf("Retransmission: %" G_GUINT64_FORMAT " requested, %" G_GUINT64_FORMAT " recovered, rtt %"
+           G_GUINT64_FORMAT " ms\n", rtx, rtx_success, rtx_rtt / GST_MSECOND);
+    gst_structure_free(stats);
+  } else {
+    fprintf(stderr, "The client got no stream\n");
+  }
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+  if (jitterbuffer) {
+    gst_object_unref(jitterbuffer);
+  }
+
+  close(stop[1]);
+  g_thread_join(relay);
+  close(listen_fd);
+  g_main_loop_unref(loop);
+
+  return relayed ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+// Benchmark of the motion detector kernel: runs the selected SIMD variant
+// and the plain C one over the same synthetic frames, checks that they
+// agree and prints what a frame costs.
+//
+//   gcf-motion-bench [width] [height] [step] [frames]
+//
+// Only every step-th row is compared, as the detector does.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "motionsad.h"
+
+#define BENCH_DEFAULT_WIDTH 1920
+#define BENCH_DEFAULT_HEIGHT 1080
+#define BENCH_DEFAULT_STEP 4
+#define BENCH_DEFAULT_FRAMES 1000
+#define BENCH_VARIANTS 8
+
+typedef std::chrono::steady_clock Clock;
+
+// Frames that differ a little everywhere and a lot in a moving square
+static void Fill(std::vector<uint8_t> &frame, size_t width, size_t height, unsigned seed) {
+  uint32_t state = seed * 2654435761u + 1;
+
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      state = state * 1103515245u + 12345u;
+      frame[y * width + x] = (uint8_t) (128 + (state >> 28));
+    }
+  }
+
+  size_t offset = (seed * 37) % (width > 64 ? width - 64 : 1);
+  for (size_t y = 0; y < 64 && y < height; y++) {
+    memset(&frame[y * width + offset], 255, 64 < width ? 64 : width);
+  }
+}
+
+// One pass of the detector over a frame, the sums of all blocks added up
+static uint64_t Run(MotionRowSadFunc kernel, const std::vector<uint8_t> &frame, std::vector<uint8_t> &reference,
+                    size_t width, size_t height, size_t step, std::vector<uint32_t> &sums) {
+  size_t blocks = width / MOTION_BLOCK;
+  uint64_t total = 0;
+
+  for (size_t block_row = 0; block_row + MOTION_BLOCK <= height; block_row += MOTION_BLOCK) {
+    memset(sums.data(), 0, blocks * sizeof(uint32_t));
+
+    for (size_t y = block_row; y < block_row + MOTION_BLOCK; y += step) {
+      kernel(&frame[y * width], &reference[y * width], blocks, sums.data());
+    }
+    for (size_t i = 0; i < blocks; i++) {
+      total += sums[i];
+    }
+  }
+
+  return total;
+}
+
+int main(int argc, char *argv[]) {
+  size_t width = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_WIDTH;
+  size_t height = argc > 2 ? strtoul(argv[2], NULL, 10) : BENCH_DEFAULT_HEIGHT;
+  size_t step = argc > 3 ? strtoul(argv[3], NULL, 10) : BENCH_DEFAULT_STEP;
+  size_t frames = argc > 4 ? strtoul(argv[4], NULL, 10) : BENCH_DEFAULT_FRAMES;
+
+  if (width < MOTION_BLOCK || height < MOTION_BLOCK || !step || step > MOTION_BLOCK || !frames) {
+    fprintf(stderr, "Usage: %s [width>=16] [height>=16] [step 1-16] [frames]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<std::vector<uint8_t>> variants(BENCH_VARIANTS, std::vector<uint8_t>(width * height));
+  for (unsigned i = 0; i < BENCH_VARIANTS; i++) {
+    Fill(variants[i], width, height, i);
+  }
+
+  std::vector<uint8_t> reference_simd(width * height), reference_scalar(width * height);
+  std::vector<uint32_t> sums(width / MOTION_BLOCK);
+
+  // Same results on every frame, or the SIMD variant is broken
+  for (unsigned i = 0; i < BENCH_VARIANTS * 2; i++) {
+    const std::vector<uint8_t> &frame = variants[i % BENCH_VARIANTS];
+    uint64_t simd = Run(MotionRowSad(), frame, reference_simd, width, height, step, sums);
+    uint64_t scalar = Run(MotionRowSadScalar, frame, reference_scalar, width, height, step, sums);
+    if (simd != scalar) {
+      fprintf(stderr, "Mismatch on frame %u: %s %llu, scalar %llu\n",
+              i, MotionRowSadName(), (unsigned long long) simd, (unsigned long long) scalar);
+      return 1;
+    }
+  }
+
+  struct {
+    MotionRowSadFunc kernel;
+    const char *name;
+  } runs[] = {{MotionRowSadScalar, "scalar"}, {MotionRowSad(), MotionRowSadName()}};
+
+  double scalar_us = 0;
+  for (const auto &run : runs) {
+    uint64_t checksum = 0;
+    auto start = Clock::now();
+    for (size_t i = 0; i < frames; i++) {
+      checksum += Run(run.kernel, variants[i % BENCH_VARIANTS], reference_simd, width, height, step, sums);
+    }
+    double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / frames;
+
+    if (run.kernel == MotionRowSadScalar) {
+      scalar_us = us;
+    }
+    printf("%-7s %zux%zu step %zu: %8.1f us/frame, %5.2fx (checksum %llu)\n",
+           run.name, width, height, step, us, scalar_us / us, (unsigned long long) checksum);
+  }
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+// Unit tests of the motion detector kernel: the selected SIMD variant
+// against known sums and against the plain C one, on aligned and
+// unaligned rows, with odd block counts and with pixels past the last
+// full block that must be left alone.
+//
+//   gcf-motion-test
+//
+// Exits non-zero on the first failed check. Run by ctest.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "motionsad.h"
+
+#define TEST_MAX_BLOCKS 127
+#define TEST_ROUNDS 200
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__); \
+      fprintf(stderr, "\n"); \
+      failures++; \
+    } \
+  } while (0)
+
+static uint32_t state = 12345;
+
+static uint8_t Random() {
+  state = state * 1103515245u + 12345u;
+  return (uint8_t) (state >> 24);
+}
+
+// Equal rows sum to nothing, and the sums are added to, not overwritten
+static void TestEqualRows(MotionRowSadFunc sad) {
+  std::vector<uint8_t> current(4 * MOTION_BLOCK, 77), reference(4 * MOTION_BLOCK, 77);
+  uint32_t sums[4] = {1, 2, 3, 4};
+
+  sad(current.data(), reference.data(), 4, sums);
+  for (uint32_t i = 0; i < 4; i++) {
+    CHECK(sums[i] == i + 1, "equal rows: block %u sum %u, expected %u", i, sums[i], i + 1);
+  }
+}
+
+// Every pixel as far apart as it gets, in both directions
+static void TestExtremes(MotionRowSadFunc sad) {
+  std::vector<uint8_t> current(3 * MOTION_BLOCK), reference(3 * MOTION_BLOCK);
+  for (size_t i = 0; i < current.size(); i++) {
+    current[i] = i % 2 ? 255 : 0;
+    reference[i] = i % 2 ? 0 : 255;
+  }
+  uint32_t sums[3] = {0, 0, 0};
+
+  sad(current.data(), reference.data(), 3, sums);
+  for (int i = 0; i < 3; i++) {
+    CHECK(sums[i] == MOTION_BLOCK * 255, "extremes: block %d sum %u, expected %u", i, sums[i],
+          MOTION_BLOCK * 255);
+  }
+}
+
+// The difference of one pixel lands in its own block only
+static void TestSinglePixel(MotionRowSadFunc sad) {
+  for (size_t pixel = 0; pixel < 5 * MOTION_BLOCK; pixel++) {
+    std::vector<uint8_t> current(5 * MOTION_BLOCK, 10), reference(5 * MOTION_BLOCK, 10);
+    current[pixel] = 13;
+    uint32_t sums[5] = {0, 0, 0, 0, 0};
+
+    sad(current.data(), reference.data(), 5, sums);
+    for (size_t block = 0; block < 5; block++) {
+      uint32_t expected = block == pixel / MOTION_BLOCK ? 3 : 0;
+      CHECK(sums[block] == expected, "pixel %zu: block %zu sum %u, expected %u", pixel, block, sums[block],
+            expected);
+    }
+  }
+}
+
+// The reference takes the compared pixels, the ones after the last block stay
+static void TestReferenceUpdate(MotionRowSadFunc sad) {
+  size_t blocks = 3, tail = 7;
+  std::vector<uint8_t> current(blocks * MOTION_BLOCK + tail), reference(current.size(), 0xee);
+  for (auto &pixel : current) {
+    pixel = Random();
+  }
+  std::vector<uint32_t> sums(blocks, 0);
+
+  sad(current.data(), reference.data(), blocks, sums.data());
+  CHECK(!memcmp(current.data(), reference.data(), blocks * MOTION_BLOCK), "reference not updated");
+  for (size_t i = blocks * MOTION_BLOCK; i < reference.size(); i++) {
+    CHECK(reference[i] == 0xee, "reference pixel %zu after the last block was written", i);
+  }
+
+  // Compared again, nothing changed
+  std::vector<uint32_t> again(blocks, 0);
+  sad(current.data(), reference.data(), blocks, again.data());
+  for (size_t i = 0; i < blocks; i++) {
+    CHECK(again[i] == 0, "block %zu differs from its own reference: %u", i, again[i]);
+  }
+}
+
+// Any block count and alignment, against the plain C variant
+static void TestAgainstScalar(MotionRowSadFunc sad) {
+  for (int round = 0; round < TEST_ROUNDS; round++) {
+    size_t blocks = 1 + Random() % TEST_MAX_BLOCKS;
+    size_t offset = Random() % 32;
+    size_t size = blocks * MOTION_BLOCK + 32 + offset;
+
+    std::vector<uint8_t> current(size), reference(size);
+    for (size_t i = 0; i < size; i++) {
+      current[i] = Random();
+      reference[i] = round % 4 ? (uint8_t) (current[i] + Random() % 9 - 4) : Random();
+    }
+    std::vector<uint8_t> expected_reference = reference;
+
+    std::vector<uint32_t> sums(blocks), expected(blocks);
+    for (size_t i = 0; i < blocks; i++) {
+      sums[i] = expected[i] = Random();
+    }
+
+    MotionRowSadScalar(current.data() + offset, expected_reference.data() + offset, blocks, expected.data());
+    sad(current.data() + offset, reference.data() + offset, blocks, sums.data());
+
+    CHECK(sums == expected, "round %d: %zu blocks at offset %zu differ from the plain C sums", round, blocks, offset);
+    CHECK(reference == expected_reference, "round %d: %zu blocks at offset %zu leave another reference", round,
+          blocks, offset);
+  }
+}
+
+int main() {
+  struct {
+    MotionRowSadFunc func;
+    const char *name;
+  } variants[] = {{MotionRowSadScalar, "scalar"}, {MotionRowSad(), MotionRowSadName()}};
+
+  for (const auto &variant : variants) {
+    int before = failures;
+
+    TestEqualRows(variant.func);
+    TestExtremes(variant.func);
+    TestSinglePixel(variant.func);
+    TestReferenceUpdate(variant.func);
+    TestAgainstScalar(variant.func);
+
+    printf("%-8s %s\n", variant.name, failures == before ? "ok" : "FAILED");
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+// Build time of a generated topology with hundreds of pipes, compiled from
+// the json against built from the cached plan.
+//
+//   gcf-plan-bench [pipes] [runs]
+//   gcf-plan-bench 300 5
+//
+// The plans are cached in a temporary directory, removed before every cold
+// run and at the end.
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "json.h"
+
+#define BENCH_DEFAULT_PIPES 300
+#define BENCH_DEFAULT_RUNS 5
+
+static std::string Generate(int pipes) {
+  std::string json = "{\"caps\":{\"Small\":\"video/x-raw,width=(int)640,height=(int)360\"},\"pipes\":{";
+  std::string links;
+
+  for (int i = 0; i < pipes; i++) {
+    auto n = std::to_string(i);
+    json += std::string(i ? "," : "") + "\"Pipe" + n + "\":{"
+        + "\"Source" + n + "\":{\"type\":\"videotestsrc\",\"is-live\":\"true\",\"pattern\":\"ball\"},"
+        + "\"Convert" + n + "\":{\"type\":\"videoconvert\",\"qos\":\"false\"},"
+        + "\"Scale" + n + "\":{\"type\":\"videoscale\",\"method\":\"bilinear\",\"add-borders\":\"false\"},"
+        + "\"Filter" + n + "\":{\"type\":\"capsfilter\",\"filter\":\"Small\"},"
+        + "\"Queue" + n + "\":{\"type\":\"queue\",\"max-size-buffers\":\"4\",\"leaky\":\"downstream\"},"
+        + "\"Sink" + n + "\":{\"type\":\"fakesink\",\"sync\":\"false\",\"async\":\"false\"}}";
+    links += std::string(i ? "," : "") + "[\"Source" + n + "\",\"Convert" + n + "\",\"Scale" + n
+        + "\",\"Filter" + n + "\",\"Queue" + n + "\",\"Sink" + n + "\"]";
+  }
+
+  return json + "},\"links\":[" + links + "],\"optimize\":{\"fuse-scale-convert\":false,\"analyze\":false}}";
+}
+
+static void ClearPlans(const gchar *cache) {
+  gchar *plans = g_build_filename(cache, "gcf", NULL);
+  GDir *dir = g_dir_open(plans, 0, NULL);
+
+  for (const gchar *name = dir ? g_dir_read_name(dir) : NULL; name; name = g_dir_read_name(dir)) {
+    gchar *plan = g_build_filename(plans, name, NULL);
+    g_unlink(plan);
+    g_free(plan);
+  }
+
+  if (dir) {
+    g_dir_close(dir);
+  }
+  g_rmdir(plans);
+  g_free(plans);
+}
+
+static double Build(const std::string &path) {
+  gint64 start = g_get_monotonic_time();
+
+  auto *topology = new Topology();
+  Json(path.c_str()).CreateTopology(topology);
+  double ms = (g_get_monotonic_time() - start) / 1000.0;
+
+  delete topology;
+  return ms;
+}
+
+int main(int argc, char *argv[]) {
+  int pipes = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_PIPES;
+  int runs = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_RUNS;
+  if (pipes <= 0 || runs <= 0) {
+    fprintf(stderr, "Usage: %s [pipes] [runs]\n", argv[0]);
+    return 1;
+  }
+
+  // Before GLib reads it
+  gchar *cache = g_dir_make_tmp("gcf-plan-bench-XXXXXX", NULL);
+  g_setenv("XDG_CACHE_HOME", cache, TRUE);
+  gst_init(&argc, &argv);
+
+  std::string path = std::string(cache) + "/topology.json";
+  std::ofstream(path) << Generate(pipes);
+
+  double cold = 0, warm = 0;
+  for (int i = 0; i < runs; i++) {
+    // No plan cached: parsed, checked, typed and written, then built
+    ClearPlans(cache);
+
+    try {
+      cold += Build(path);
+      warm += Build(path);
+    } catch (GcfException &exception) {
+      fprintf(stderr, "Can't build the topology: %s\n", exception.what());
+      return 1;
+    }
+  }
+
+  printf("%d pipes, %d elements\n", pipes, pipes * 6);
+  printf("compiled from json %10.1f ms\n", cold / runs);
+  printf("from cached plan   %10.1f ms %6.2fx\n", warm / runs, cold / warm);
+
+  ClearPlans(cache);
+  g_unlink(path.c_str());
+  g_rmdir(cache);
+  g_free(cache);
+  return 0;
+}
@@ -0,0 +1,189 @@
+// RTSP load generator: keeps a number of TCP clients on one URL and reports
+// how many RTP packets they get, the longest gap between two packets and how
+// long the clients were away when their connection broke.
+//
+//   gcf-rtsp-load rtsp://127.0.0.1:8554/h264 [clients] [seconds]
+//
+// A client that fails or hits EOS connects again right away, the time until
+// its next packet is counted as a reconnect gap.
+//
+// Upgrade gaps: keep it running while "gst-rtsp-app --upgrade" takes over.
+// The port never closes, so the only gaps are of the clients dropped at the
+// end of the drain, reported as the longest time away.
+
+#include <gst/gst.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define LOAD_DEFAULT_CLIENTS 10
+#define LOAD_DEFAULT_SECONDS 30
+#define LOAD_RECONNECT_MS 100
+
+struct Client {
+  guint index;
+  GstElement *pipeline;
+  gint frames;
+  gint64 last_frame;       // monotonic, us
+  gint64 max_gap;          // between two packets of one connection, us
+  gint64 broken;           // when the connection broke, 0 while connected
+  guint reconnects;
+  gint64 max_reconnect;    // from the break to the next packet, us
+};
+
+static std::string url;
+static std::vector<Client> clients;
+static GMainLoop *loop = NULL;
+static gint64 started = 0;
+static guint64 last_frames = 0;
+
+static void Handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer user_data) {
+  Client *client = static_cast<Client *>(user_data);
+  gint64 now = g_get_monotonic_time();
+
+  // Runs in the streaming thread, the main loop only reads the counters
+  if (client->broken) {
+    gint64 gap = now - client->broken;
+    client->max_reconnect = MAX (client->max_reconnect, gap);
+    client->broken = 0;
+  } else if (client->last_frame) {
+    client->max_gap = MAX (client->max_gap, now - client->last_frame);
+  }
+
+  client->last_frame = now;
+  g_atomic_int_inc(&client->frames);
+}
+
+static gboolean Reconnect(gpointer user_data) {
+  Client *client = static_cast<Client *>(user_data);
+
+  gst_element_set_state(client->pipeline, GST_STATE_NULL);
+  gst_element_set_state(client->pipeline, GST_STATE_PLAYING);
+
+  return FALSE;
+}
+
+static gboolean BusHandler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+  Client *client = static_cast<Client *>(user_data);
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_ERROR && GST_MESSAGE_TYPE (msg) != GST_MESSAGE_EOS) {
+    return TRUE;
+  }
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    GError *err = NULL;
+    gst_message_parse_error(msg, &err, NULL);
+    fprintf(stderr, "Client %u: %s\n", client->index, err->message);
+    g_clear_error(&err);
+  } else {
+    fprintf(stderr, "Client %u: end of stream\n", client->index);
+  }
+
+  if (!client->broken) {
+    client->broken = g_get_monotonic_time();
+  }
+  client->reconnects++;
+  client->last_frame = 0;
+
+  g_timeout_add(LOAD_RECONNECT_MS, Reconnect, client);
+
+  return TRUE;
+}
+
+static bool CreateClient(Client &client) {
+  GError *error = NULL;
+  auto launch = "rtspsrc location=" + url + " protocols=tcp latency=0 ! fakesink sync=false signal-handoffs=true"
+      " name=sink";
+
+  client.pipeline = gst_parse_launch(launch.c_str(), &error);
+  if (!client.pipeline) {
+    fprintf(stderr, "Can't create client %u: %s\n", client.index, error->message);
+    g_clear_error(&error);
+    return false;
+  }
+
+  GstElement *sink = gst_bin_get_by_name(GST_BIN (client.pipeline), "sink");
+  g_signal_connect(sink, "handoff", G_CALLBACK(Handoff), &client);
+  gst_object_unref(sink);
+
+  GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE (client.pipeline));
+  gst_bus_add_watch(bus, BusHandler, &client);
+  gst_object_unref(bus);
+
+  return gst_element_set_state(client.pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE;
+}
+
+static gboolean Report(gpointer user_data) {
+  guint64 frames = 0;
+  guint connected = 0;
+
+  for (auto &client : clients) {
+    frames += (guint) g_atomic_int_get(&client.frames);
+    connected += !client.broken && client.last_frame;
+  }
+
+  printf("%4" G_GINT64_FORMAT " s: %u/%zu clients receiving, %" G_GUINT64_FORMAT " packets/s\n",
+         (g_get_monotonic_time() - started) / G_USEC_PER_SEC, connected, clients.size(), frames - last_frames);
+  fflush(stdout);
+  last_frames = frames;
+
+  return TRUE;
+}
+
+static gboolean Finish(gpointer user_data) {
+  g_main_loop_quit(loop);
+  return FALSE;
+}
+
+int main(int argc, char *argv[]) {
+  gst_init(&argc, &argv);
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <url> [clients] [seconds]\n", argv[0]);
+    return 1;
+  }
+
+  url = argv[1];
+  guint count = argc > 2 ? (guint) atoi(argv[2]) : LOAD_DEFAULT_CLIENTS;
+  guint seconds = argc > 3 ? (guint) atoi(argv[3]) : LOAD_DEFAULT_SECONDS;
+
+  // Sized once, the callbacks keep pointers to the entries
+  clients.resize(count);
+  started = g_get_monotonic_time();
+
+  for (guint i = 0; i < count; i++) {
+    clients[i] = {i, NULL, 0, 0, 0, 0, 0, 0};
+    if (!CreateClient(clients[i])) {
+      return 1;
+    }
+  }
+
+  loop = g_main_loop_new(NULL, FALSE);
+  g_timeout_add_seconds(1, Report, NULL);
+  g_timeout_add_seconds(seconds, Finish, NULL);
+  g_main_loop_run(loop);
+
+  guint64 frames = 0;
+  gint64 max_gap = 0, max_reconnect = 0;
+  guint reconnects = 0;
+
+  for (auto &client : clients) {
+    gst_element_set_state(client.pipeline, GST_STATE_NULL);
+    gst_object_unref(client.pipeline);
+
+    frames += (guint) client.frames;
+    reconnects += client.reconnects;
+    max_gap = MAX (max_gap, client.max_gap);
+    max_reconnect = MAX (max_reconnect, client.max_reconnect);
+  }
+
+  printf("\n%u clients, %u s: %" G_GUINT64_FORMAT " packets (%.1f/s per client)\n",
+         count, seconds, frames, count && seconds ? (double) frames / count / seconds : 0.0);
+  printf("Longest gap between packets: %.1f ms\n", max_gap / 1000.0);
+  printf("Reconnects: %u, longest away: %.1f ms\n", reconnects, max_reconnect / 1000.0);
+
+  g_main_loop_unref(loop);
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+// Benchmark of gcfscaleconvert against the stock videoscale ! videoconvert
+// chain, and against videoconvert ! videoscale as WebPipe used to do it.
+//
+//   gcf-scale-bench [frames] [in-format] [in-size] [out-format] [out-size]
+//   gcf-scale-bench 500 NV12 1920x1080 I420 640x360
+//
+// The source frame is made once and repeated by imagefreeze, so the time
+// of the source alone is measured first and left out of the results.
+
+#include <gst/gst.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "scaleconvert.h"
+
+#define BENCH_DEFAULT_FRAMES 500
+
+static double Run(const std::string &description) {
+  GError *error = NULL;
+  GstElement *pipeline = gst_parse_launch(description.c_str(), &error);
+  if (!pipeline) {
+    fprintf(stderr, "Can't build \"%s\": %s\n", description.c_str(), error->message);
+    g_clear_error(&error);
+    return -1;
+  }
+
+  gint64 start = g_get_monotonic_time();
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+  GstBus *bus = gst_element_get_bus(pipeline);
+  GstMessage *message = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                   (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+  gint64 end = g_get_monotonic_time();
+
+  bool failed = GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR;
+  if (failed) {
+    gst_message_parse_error(message, &error, NULL);
+    fprintf(stderr, "\"%s\" failed: %s\n", description.c_str(), error->message);
+    g_clear_error(&error);
+  }
+
+  gst_message_unref(message);
+  gst_object_unref(bus);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  return failed ? -1 : (end - start) / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+  gst_init(&argc, &argv);
+
+  gst_element_register(NULL, "gcfscaleconvert", GST_RANK_NONE, GCF_TYPE_SCALE_CONVERT);
+
+  int frames = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_FRAMES;
+  std::string in_format = argc > 2 ? argv[2] : "NV12";
+  std::string in_size = argc > 3 ? argv[3] : "1920x1080";
+  std::string out_format = argc > 4 ? argv[4] : "I420";
+  std::string out_size = argc > 5 ? argv[5] : "640x360";
+
+  int in_width, in_height, out_width, out_height;
+  if (frames <= 0 || sscanf(in_size.c_str(), "%dx%d", &in_width, &in_height) != 2
+      || sscanf(out_size.c_str(), "%dx%d", &out_width, &out_height) != 2) {
+    fprintf(stderr, "Usage: %s [frames] [in-format] [in-size] [out-format] [out-size]\n", argv[0]);
+    return 1;
+  }
+
+  auto source = "videotestsrc num-buffers=1 pattern=smpte ! video/x-raw,format=" + in_format
+      + ",width=" + std::to_string(in_width) + ",height=" + std::to_string(in_height)
+      + ",framerate=30/1 ! imagefreeze num-buffers=" + std::to_string(frames) + " ! ";
+  auto sink = " ! video/x-raw,format=" + out_format + ",width=" + std::to_string(out_width)
+      + ",height=" + std::to_string(out_height) + " ! fakesink sync=false";
+
+  struct {
+    const char *name;
+    std::string chain;
+  } runs[] = {
+      {"videoscale ! videoconvert", "videoscale ! videoconvert"},
+      {"videoconvert ! videoscale", "videoconvert ! videoscale"},
+      {"gcfscaleconvert", "gcfscaleconvert"},
+  };
+
+  double baseline = Run(source + "fakesink sync=false");
+  if (baseline < 0) {
+    return 1;
+  }
+
+  printf("%s %s => %s %s, %d frames, source alone %.3f ms/frame\n",
+         in_format.c_str(), in_size.c_str(), out_format.c_str(), out_size.c_str(), frames, baseline / frames);
+
+  double reference = 0;
+  for (const auto &run : runs) {
+    double ms = Run(source + run.chain + sink);
+    if (ms < 0) {
+      return 1;
+    }
+
+    double per_frame = (ms - baseline) / frames;
+    if (!reference) {
+      reference = per_frame;
+    }
+    printf("%-28s %8.3f ms/frame %6.2fx\n", run.name, per_frame, reference / per_frame);
+  }
+
+  return 0;
+}
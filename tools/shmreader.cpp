@@ -0,0 +1,128 @@
+// Example reader of a gcfshmsink frame ring, and a benchmark of what a
+// copy costs the consumer compared to working on the mapped frame.
+//
+//   gcf-shm-reader /tmp/gcf-analytics.sock [frames]
+//
+// Every frame is scanned once in place, then copied and scanned again.
+// The difference is what a reader pays for keeping private frames.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "shmreader.h"
+
+#define READER_TIMEOUT_MS 2000
+#define READER_DEFAULT_FRAMES 300
+
+typedef std::chrono::steady_clock Clock;
+
+// Stands in for the analytics work: touches every byte once
+static uint64_t Scan(const uint8_t *data, size_t size) {
+  uint64_t sum = 0, word;
+  size_t i = 0;
+
+  for (; i + sizeof(word) <= size; i += sizeof(word)) {
+    memcpy(&word, data + i, sizeof(word));
+    sum += word;
+  }
+  for (; i < size; i++) {
+    sum += data[i];
+  }
+
+  return sum;
+}
+
+static double Microseconds(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+static bool Connect(ShmFrameReader &reader, const char *path) {
+  for (int attempt = 0; attempt < 10; attempt++) {
+    if (reader.Connect(path)) {
+      printf("Connected to %s: %s\n", path, reader.Caps().c_str());
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
+
+  fprintf(stderr, "Can't connect to %s\n", path);
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <socket> [frames]\n", argv[0]);
+    return 1;
+  }
+
+  const char *path = argv[1];
+  long frames = argc > 2 ? strtol(argv[2], NULL, 10) : READER_DEFAULT_FRAMES;
+
+  ShmFrameReader reader;
+  if (!Connect(reader, path)) {
+    return 1;
+  }
+
+  std::vector<uint8_t> copy;
+  double in_place_us = 0, copy_us = 0, copy_scan_us = 0, bytes = 0;
+  long done = 0, torn = 0;
+  uint64_t checksum = 0;
+
+  while (done < frames) {
+    if (!reader.Wait(READER_TIMEOUT_MS)) {
+      // The sink restarted or moved to bigger slots
+      if (reader.Closed() && Connect(reader, path)) {
+        continue;
+      }
+      fprintf(stderr, "No frames for %d ms\n", READER_TIMEOUT_MS);
+      break;
+    }
+
+    ShmFrame frame;
+    if (!reader.Acquire(frame)) {
+      continue;
+    }
+
+    Clock::time_point start = Clock::now();
+    checksum += Scan(frame.data, frame.size);
+    Clock::time_point scanned = Clock::now();
+    bool valid = reader.Copy(frame, copy);
+    Clock::time_point copied = Clock::now();
+    checksum += Scan(copy.data(), copy.size());
+    Clock::time_point copy_scanned = Clock::now();
+
+    if (!valid) {
+      torn++;
+      continue;
+    }
+
+    in_place_us += Microseconds(start, scanned);
+    copy_us += Microseconds(scanned, copied);
+    copy_scan_us += Microseconds(copied, copy_scanned);
+    bytes += frame.size;
+    done++;
+
+    if (done % 100 == 0) {
+      printf("Frame %llu: %ux%u, %u bytes, pts %llu\n",
+             (unsigned long long) frame.sequence, frame.slot->width, frame.slot->height, frame.size,
+             (unsigned long long) frame.slot->pts);
+    }
+  }
+
+  if (!done) {
+    return 1;
+  }
+
+  printf("\n%ld frames of %.0f bytes on average, %ld torn, %llu skipped (checksum %llx)\n",
+         done, bytes / done, torn, (unsigned long long) reader.Skipped(), (unsigned long long) checksum);
+  printf("  in place:    %8.1f us/frame\n", in_place_us / done);
+  printf("  copy:        %8.1f us/frame, %.2f GB/s\n", copy_us / done, bytes / copy_us / 1000.0);
+  printf("  copy + scan: %8.1f us/frame, %.1f%% more than in place\n",
+         (copy_us + copy_scan_us) / done, 100.0 * (copy_us + copy_scan_us - in_place_us) / in_place_us);
+
+  return 0;
+}
@@ -0,0 +1,317 @@
+// Soak run: starts the app under the leaks tracer and cycles RTSP clients
+// against it. Every cycle connects the clients, spread over the URLs, waits
+// for a packet on each and tears them all down, so the mount branches are
+// linked to their tee and unlinked again and the renditions are built and
+// dropped.
+//
+//   gcf-soak [--cycles N] [--clients N] [--max-rss-kb N] [--max-objects N] [--config FILE] <app> <url> [url...]
+//   gcf-soak --cycles 2000 --config headless.json ./bin/gst-rtsp-app rtsp://127.0.0.1:8554/low
+//       "rtsp://127.0.0.1:8554/h264?width=640"
+//
+// The app runs in the current directory on the given topology, the
+// test.json there by default.
+// After the warm-up cycles the resident memory of the app is taken and the
+// leaks tracer starts tracking; at the end the memory growth and the objects
+// made since then and still alive are reported. Either one over its limit,
+// or clients that get no packets, fails the run.
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#define SOAK_DEFAULT_CYCLES 1000
+#define SOAK_DEFAULT_CLIENTS 2
+#define SOAK_DEFAULT_SETTLE_MS 200
+#define SOAK_DEFAULT_MAX_RSS_KB 4096
+#define SOAK_CLIENT_TIMEOUT_MS 10000
+#define SOAK_STARTUP_TIMEOUT_S 30
+#define SOAK_TRACER_LOG "/tmp/gcf-soak-tracer.log"
+
+struct Client {
+  GstElement *pipeline;
+  gint packets;
+};
+
+static GPid app = 0;
+static gchar *config = NULL;
+
+static void Handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer user_data) {
+  g_atomic_int_inc((gint *) user_data);
+}
+
+static bool Connect(const std::string &url, Client &client) {
+  GError *error = NULL;
+  auto launch = "rtspsrc location=\"" + url + "\" protocols=tcp latency=0 ! fakesink sync=false"
+      " signal-handoffs=true name=sink";
+
+  client.packets = 0;
+  client.pipeline = gst_parse_launch(launch.c_str(), &error);
+  if (!client.pipeline) {
+    fprintf(stderr, "Can't create a client of %s: %s\n", url.c_str(), error->message);
+    g_clear_error(&error);
+    return false;
+  }
+
+  GstElement *sink = gst_bin_get_by_name(GST_BIN (client.pipeline), "sink");
+  g_signal_connect(sink, "handoff", G_CALLBACK(Handoff), &client.packets);
+  gst_object_unref(sink);
+
+  return gst_element_set_state(client.pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE;
+}
+
+static bool Failed(Client &client) {
+  GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE (client.pipeline));
+  GstMessage *message = gst_bus_pop_filtered(bus, (GstMessageType) (GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+  gst_object_unref(bus);
+
+  if (message) {
+    gst_message_unref(message);
+  }
+  return message != NULL;
+}
+
+// Connects the clients, waits for a packet on each, then tears them down
+static bool Cycle(const std::vector<std::string> &urls, guint clients, guint offset) {
+  std::vector<Client> connected(clients);
+  bool ok = true;
+
+  for (guint i = 0; i < clients; i++) {
+    connected[i] = {NULL, 0};
+    ok = Connect(urls[(offset + i) % urls.size()], connected[i]) && ok;
+  }
+
+  gint64 deadline = g_get_monotonic_time() + SOAK_CLIENT_TIMEOUT_MS * G_TIME_SPAN_MILLISECOND;
+  while (ok) {
+    bool waiting = false;
+    for (auto &client : connected) {
+      if (g_atomic_int_get(&client.packets)) {
+        continue;
+      }
+      if (Failed(client) || g_get_monotonic_time() > deadline) {
+        ok = false;
+        break;
+      }
+      waiting = true;
+    }
+
+    if (!waiting) {
+      break;
+    }
+    g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+  }
+
+  for (auto &client : connected) {
+    if (client.pipeline) {
+      gst_element_set_state(client.pipeline, GST_STATE_NULL);
+      gst_object_unref(client.pipeline);
+    }
+  }
+
+  return ok;
+}
+
+// VmRSS of the app in kB, -1 once it is gone
+static gint64 ResidentKb() {
+  gchar *path = g_strdup_printf("/proc/%d/status", app);
+  gchar *status = NULL;
+  gint64 rss = -1;
+
+  if (g_file_get_contents(path, &status, NULL, NULL)) {
+    const gchar *line = strstr(status, "VmRSS:");
+    if (line) {
+      rss = g_ascii_strtoll(line + strlen("VmRSS:"), NULL, 10);
+    }
+    g_free(status);
+  }
+
+  g_free(path);
+  return rss;
+}
+
+static bool Alive() {
+  return waitpid(app, NULL, WNOHANG) == 0;
+}
+
+static bool Start(const char *binary) {
+  gchar **env = g_get_environ();
+  const gchar *debug = g_environ_getenv(env, "GST_DEBUG");
+  gchar *tracer_debug = g_strconcat(debug ? debug : "*:2,GCF_APP_*:4", ",GST_TRACER:7", NULL);
+
+  env = g_environ_setenv(env, "GST_TRACERS", "leaks", TRUE);
+  env = g_environ_setenv(env, "GST_LEAKS_TRACER_SIG", "1", TRUE);
+  env = g_environ_setenv(env, "GST_DEBUG", tracer_debug, TRUE);
+  env = g_environ_setenv(env, "GST_DEBUG_FILE", SOAK_TRACER_LOG, TRUE);
+  env = g_environ_setenv(env, "GST_DEBUG_NO_COLOR", "1", TRUE);
+  g_free(tracer_debug);
+
+  const gchar *argv[] = {binary, config ? "--config" : NULL, config, NULL};
+  GError *error = NULL;
+  gboolean spawned = g_spawn_async(NULL, (gchar **) argv, env, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &app, &error);
+  g_strfreev(env);
+
+  if (!spawned) {
+    fprintf(stderr, "Can't start %s: %s\n", binary, error->message);
+    g_clear_error(&error);
+  }
+  return spawned;
+}
+
+// Objects made since the first checkpoint and still alive, by type
+static std::map<std::string, guint> Leaks(goffset from) {
+  std::map<std::string, guint> leaks;
+  gchar *log = NULL;
+  gsize length = 0;
+
+  if (!g_file_get_contents(SOAK_TRACER_LOG, &log, &length, NULL)) {
+    return leaks;
+  }
+
+  const gchar *type_tag = "type-name=(string)";
+  for (const gchar *line = strstr(log + MIN ((gsize) from, length), "object-added"); line;
+       line = strstr(line + 1, "object-added")) {
+    const gchar *type = strstr(line, type_tag);
+    const gchar *end = strchr(line, '\n');
+    if (!type || (end && type > end)) {
+      continue;
+    }
+
+    type += strlen(type_tag);
+    leaks[std::string(type, strcspn(type, ",;\n"))]++;
+  }
+
+  g_free(log);
+  return leaks;
+}
+
+static goffset LogSize() {
+  GStatBuf stat;
+  return g_stat(SOAK_TRACER_LOG, &stat) ? 0 : stat.st_size;
+}
+
+int main(int argc, char *argv[]) {
+  gint cycles = SOAK_DEFAULT_CYCLES;
+  gint clients = SOAK_DEFAULT_CLIENTS;
+  gint settle_ms = SOAK_DEFAULT_SETTLE_MS;
+  gint max_rss_kb = SOAK_DEFAULT_MAX_RSS_KB;
+  gint max_objects = -1;
+
+  GOptionEntry entries[] = {
+      {"cycles", 0, 0, G_OPTION_ARG_INT, &cycles, "Connect and tear down the clients N times", "N"},
+      {"clients", 0, 0, G_OPTION_ARG_INT, &clients, "Clients of one cycle, spread over the URLs", "N"},
+      {"settle-ms", 0, 0, G_OPTION_ARG_INT, &settle_ms, "Pause after the teardown of a cycle", "MS"},
+      {"max-rss-kb", 0, 0, G_OPTION_ARG_INT, &max_rss_kb, "Allowed growth of the resident memory", "KB"},
+      {"max-objects", 0, 0, G_OPTION_ARG_INT, &max_objects,
+       "Allowed objects left alive, a tenth of the cycles by default", "N"},
+      {"config", 0, 0, G_OPTION_ARG_FILENAME, &config, "Topology json of the app", "FILE"},
+      {NULL}
+  };
+
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("<app> <url> [url...]");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error) || argc < 3 || cycles <= 0 || clients <= 0) {
+    gchar *help = g_option_context_get_help(context, TRUE, NULL);
+    fprintf(stderr, "%s\n", error ? error->message : help);
+    g_free(help);
+    g_clear_error(&error);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  std::vector<std::string> urls(argv + 2, argv + argc);
+  guint warmup = MAX (cycles / 10, 1);
+  if (max_objects < 0) {
+    max_objects = cycles / 10;
+  }
+
+  // The tracer has to see the start of the app, an old log would be read
+  g_unlink(SOAK_TRACER_LOG);
+  if (!Start(argv[1])) {
+    return 1;
+  }
+
+  // The app is up once the first client gets packets
+  gint64 deadline = g_get_monotonic_time() + SOAK_STARTUP_TIMEOUT_S * G_TIME_SPAN_SECOND;
+  while (!Cycle(urls, 1, 0)) {
+    if (!Alive() || g_get_monotonic_time() > deadline) {
+      fprintf(stderr, "The app did not come up in %d s\n", SOAK_STARTUP_TIMEOUT_S);
+      kill(app, SIGTERM);
+      waitpid(app, NULL, 0);
+      return 1;
+    }
+    g_usleep(G_TIME_SPAN_SECOND);
+  }
+
+  guint failures = 0;
+  gint64 baseline = 0;
+  gint64 started = g_get_monotonic_time();
+  guint report = MAX (cycles / 20, 1);
+
+  for (guint cycle = 0; cycle < warmup + (guint) cycles && Alive(); cycle++) {
+    if (!Cycle(urls, (guint) clients, cycle)) {
+      failures += cycle >= warmup;
+      fprintf(stderr, "Cycle %u: not every client got packets\n", cycle);
+    }
+    g_usleep((gulong) settle_ms * G_TIME_SPAN_MILLISECOND);
+
+    // Whatever is made from here on should be gone by the end
+    if (cycle + 1 == warmup) {
+      baseline = ResidentKb();
+      kill(app, SIGUSR2);
+      printf("Warm-up of %u cycles done: %" G_GINT64_FORMAT " kB resident\n", warmup, baseline);
+    } else if (cycle >= warmup && (cycle - warmup + 1) % report == 0) {
+      gint64 rss = ResidentKb();
+      printf("%6u cycles, %4" G_GINT64_FORMAT " s: %" G_GINT64_FORMAT " kB resident (%+" G_GINT64_FORMAT " kB)\n",
+             cycle - warmup + 1, (g_get_monotonic_time() - started) / G_USEC_PER_SEC, rss, rss - baseline);
+    }
+    fflush(stdout);
+  }
+
+  if (!Alive()) {
+    fprintf(stderr, "The app is gone during the run\n");
+    return 1;
+  }
+
+  // Sessions and medias are dropped a bit after the teardown
+  g_usleep(SOAK_DEFAULT_SETTLE_MS * 10 * G_TIME_SPAN_MILLISECOND);
+  gint64 growth = ResidentKb() - baseline;
+
+  goffset from = LogSize();
+  kill(app, SIGUSR2);
+  g_usleep(G_TIME_SPAN_SECOND);
+
+  kill(app, SIGTERM);
+  waitpid(app, NULL, 0);
+  g_spawn_close_pid(app);
+
+  auto leaks = Leaks(from);
+  std::vector<std::pair<guint, std::string>> types;
+  guint objects = 0;
+  for (const auto &leak : leaks) {
+    types.push_back(std::make_pair(leak.second, leak.first));
+    objects += leak.second;
+  }
+  std::sort(types.rbegin(), types.rend());
+
+  printf("\n%d cycles of %d clients over %zu URLs, %u failed\n", cycles, clients, urls.size(), failures);
+  printf("Resident memory growth: %" G_GINT64_FORMAT " kB (limit %d kB)\n", growth, max_rss_kb);
+  printf("Objects left alive: %u (limit %d)\n", objects, max_objects);
+  for (const auto &type : types) {
+    printf("  %6u %s\n", type.first, type.second.c_str());
+  }
+  printf("Tracer log: %s\n", SOAK_TRACER_LOG);
+
+  bool passed = growth <= max_rss_kb && objects <= (guint) max_objects && failures <= (guint) cycles / 100;
+  printf("%s\n", passed ? "PASSED" : "FAILED");
+
+  return passed ? 0 : 1;
+}
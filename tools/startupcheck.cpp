@@ -0,0 +1,168 @@
+// Startup budget check: starts the app on a topology and measures the time
+// from the start of the process to the first RTP packet a client gets from
+// a mount. Fails if that is over the budget.
+//
+//   gcf-startup-check [--budget-ms N] [--runs N] <app> <config> <url>
+//   gcf-startup-check --budget-ms 3000 ./bin/gst-rtsp-app headless.json rtsp://127.0.0.1:8554/h264
+//
+// The client tries again every 50 ms until the server answers, so the
+// time includes the server coming up. Every run is a cold start of the
+// app, the slowest run counts. The app's own phase report, the line
+// "Startup phases" of GCF_APP_STARTUP, is printed along with it.
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#define STARTUP_DEFAULT_BUDGET_MS 3000
+#define STARTUP_DEFAULT_RUNS 3
+#define STARTUP_RETRY_MS 50
+#define STARTUP_GIVE_UP_S 30
+#define STARTUP_APP_LOG "/tmp/gcf-startup-check.log"
+
+static void Handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer user_data) {
+  g_atomic_int_inc((gint *) user_data);
+}
+
+// True once the client got a packet, false when it failed or gave up first
+static bool Play(const std::string &url, gint64 deadline) {
+  GError *error = NULL;
+  auto launch = "rtspsrc location=\"" + url + "\" protocols=tcp latency=0 ! fakesink sync=false"
+      " signal-handoffs=true name=sink";
+
+  GstElement *pipeline = gst_parse_launch(launch.c_str(), &error);
+  if (!pipeline) {
+    fprintf(stderr, "Can't create the client: %s\n", error->message);
+    g_clear_error(&error);
+    return false;
+  }
+
+  gint packets = 0;
+  GstElement *sink = gst_bin_get_by_name(GST_BIN (pipeline), "sink");
+  g_signal_connect(sink, "handoff", G_CALLBACK (Handoff), &packets);
+  gst_object_unref(sink);
+
+  GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE (pipeline));
+  bool failed = gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE;
+  while (!failed && !g_atomic_int_get(&packets) && g_get_monotonic_time() < deadline) {
+    GstMessage *message = gst_bus_timed_pop_filtered(bus, 5 * GST_MSECOND,
+                                                     (GstMessageType) (GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    if (message) {
+      failed = true;
+      gst_message_unref(message);
+    }
+  }
+  gst_object_unref(bus);
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  return g_atomic_int_get(&packets) > 0;
+}
+
+static GPid Start(const char *binary, const char *config) {
+  gchar **env = g_get_environ();
+  const gchar *debug = g_environ_getenv(env, "GST_DEBUG");
+  gchar *app_debug = g_strconcat(debug ? debug : "*:2", ",GCF_APP_STARTUP:4", NULL);
+
+  g_unlink(STARTUP_APP_LOG);
+  env = g_environ_setenv(env, "GST_DEBUG", app_debug, TRUE);
+  env = g_environ_setenv(env, "GST_DEBUG_FILE", STARTUP_APP_LOG, TRUE);
+  env = g_environ_setenv(env, "GST_DEBUG_NO_COLOR", "1", TRUE);
+  g_free(app_debug);
+
+  const gchar *argv[] = {binary, "--config", config, NULL};
+  GError *error = NULL;
+  GPid app = 0;
+  if (!g_spawn_async(NULL, (gchar **) argv, env, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &app, &error)) {
+    fprintf(stderr, "Can't start %s: %s\n", binary, error->message);
+    g_clear_error(&error);
+  }
+  g_strfreev(env);
+  return app;
+}
+
+// The app's own account of the phases, empty if it has not reported yet
+static std::string Phases() {
+  gchar *log = NULL;
+  std::string phases;
+
+  if (g_file_get_contents(STARTUP_APP_LOG, &log, NULL, NULL)) {
+    const gchar *line = strstr(log, "Startup phases: ");
+    if (line) {
+      line += strlen("Startup phases: ");
+      phases = std::string(line, strcspn(line, "\n"));
+    }
+    g_free(log);
+  }
+  return phases;
+}
+
+int main(int argc, char *argv[]) {
+  gint budget_ms = STARTUP_DEFAULT_BUDGET_MS;
+  gint runs = STARTUP_DEFAULT_RUNS;
+
+  GOptionEntry options[] = {
+      {"budget-ms", 0, 0, G_OPTION_ARG_INT, &budget_ms, "Longest allowed time to the first packet", "N"},
+      {"runs", 0, 0, G_OPTION_ARG_INT, &runs, "Cold starts to measure", "N"},
+      {NULL}
+  };
+
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("<app> <config> <url>");
+  g_option_context_add_main_entries(context, options, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error) || argc < 4 || budget_ms <= 0 || runs <= 0) {
+    fprintf(stderr, "Usage: %s [--budget-ms N] [--runs N] <app> <config> <url>\n", argv[0]);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  gint64 slowest = 0;
+  for (gint run = 1; run <= runs; run++) {
+    gint64 start = g_get_monotonic_time();
+    GPid app = Start(argv[1], argv[2]);
+    if (!app) {
+      return 1;
+    }
+
+    gint64 deadline = start + STARTUP_GIVE_UP_S * G_USEC_PER_SEC;
+    bool played = false;
+    while (!played && g_get_monotonic_time() < deadline && waitpid(app, NULL, WNOHANG) == 0) {
+      played = Play(argv[3], deadline);
+      if (!played) {
+        g_usleep(STARTUP_RETRY_MS * G_TIME_SPAN_MILLISECOND);
+      }
+    }
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    // Give the report a moment, it is written once every pipe is up
+    g_usleep(200 * G_TIME_SPAN_MILLISECOND);
+    std::string phases = Phases();
+
+    kill(app, SIGTERM);
+    waitpid(app, NULL, 0);
+    g_spawn_close_pid(app);
+
+    if (!played) {
+      fprintf(stderr, "Run %d: no packet from %s within %d s\n", run, argv[3], STARTUP_GIVE_UP_S);
+      return 1;
+    }
+
+    printf("Run %d: first packet after %.1f ms (%s)\n", run, elapsed / 1000.0,
+           phases.empty() ? "no phase report" : phases.c_str());
+    slowest = MAX (slowest, elapsed);
+  }
+
+  bool within = slowest <= (gint64) budget_ms * G_TIME_SPAN_MILLISECOND;
+  printf("%s: slowest cold start to first packet %.1f ms, budget %d ms\n", within ? "PASS" : "FAIL",
+         slowest / 1000.0, budget_ms);
+  return within ? 0 : 1;
+}
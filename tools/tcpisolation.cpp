@@ -0,0 +1,260 @@
+// Isolation of RTP-over-TCP clients: a number of healthy TCP clients take
+// one mount on their own first, then again while another client on the same
+// mount reads its interleaved connection at a trickle. The mount needs a
+// "tcp-queue"; the healthy clients must not notice the slow one.
+//
+//   gcf-tcp-isolation <url> [clients] [seconds] [throttle-bytes/s]
+//   gcf-tcp-isolation rtsp://127.0.0.1:8554/h264 5 20 16384
+//
+// Fails if, with the slow client on, a healthy client gets less than 90% of
+// its packet rate alone or waits longer between two packets than twice the
+// longest gap alone (500 ms at least). The slow client is a plain RTSP
+// connection with a small receive buffer, read every 100 ms.
+
+#include <gst/gst.h>
+#include <gst/rtsp/gstrtspconnection.h>
+#include <sys/socket.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define ISOLATION_DEFAULT_CLIENTS 5
+#define ISOLATION_DEFAULT_SECONDS 20
+#define ISOLATION_DEFAULT_THROTTLE 16384
+#define ISOLATION_READ_MS 100
+#define ISOLATION_WARMUP_S 2
+#define ISOLATION_TIMEOUT_US (5 * G_USEC_PER_SEC)
+
+struct Client {
+  GstElement *pipeline;
+  gint packets;
+  gint64 last_packet;
+  gint64 max_gap;
+};
+
+struct SlowClient {
+  GstRTSPConnection *connection;
+  int fd;
+  guint64 bytes;
+  gint64 closed_at;
+};
+
+struct Phase {
+  double min_rate;
+  double avg_rate;
+  gint64 max_gap;
+};
+
+static GMainLoop *loop = NULL;
+static guint throttle = ISOLATION_DEFAULT_THROTTLE;
+
+static void Handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer user_data) {
+  auto *client = (Client *) user_data;
+  gint64 now = g_get_monotonic_time();
+
+  // Only the main loop resets them, between the phases
+  if (client->last_packet) {
+    client->max_gap = MAX (client->max_gap, now - client->last_packet);
+  }
+  client->last_packet = now;
+  g_atomic_int_inc(&client->packets);
+}
+
+static bool StartClient(const std::string &url, Client &client) {
+  GError *error = NULL;
+  auto launch = "rtspsrc location=\"" + url + "\" protocols=tcp latency=0 ! fakesink sync=false"
+      " signal-handoffs=true name=sink";
+
+  client.pipeline = gst_parse_launch(launch.c_str(), &error);
+  if (!client.pipeline) {
+    fprintf(stderr, "Can't create a client: %s\n", error->message);
+    g_clear_error(&error);
+    return false;
+  }
+
+  GstElement *sink = gst_bin_get_by_name(GST_BIN (client.pipeline), "sink");
+  g_signal_connect(sink, "handoff", G_CALLBACK (Handoff), &client);
+  gst_object_unref(sink);
+
+  return gst_element_set_state(client.pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE;
+}
+
+// Sends a request and waits for its response, the interleaved data before it is skipped
+static bool Request(GstRTSPConnection *connection, GstRTSPMethod method, const std::string &uri,
+                    const std::string &session, const char *transport, std::string *session_out) {
+  static gint cseq = 0;
+  GstRTSPMessage *request = NULL;
+  gst_rtsp_message_new_request(&request, method, uri.c_str());
+  gst_rtsp_message_add_header(request, GST_RTSP_HDR_CSEQ, std::to_string(++cseq).c_str());
+  if (!session.empty()) {
+    gst_rtsp_message_add_header(request, GST_RTSP_HDR_SESSION, session.c_str());
+  }
+  if (transport) {
+    gst_rtsp_message_add_header(request, GST_RTSP_HDR_TRANSPORT, transport);
+  }
+  if (method == GST_RTSP_DESCRIBE) {
+    gst_rtsp_message_add_header(request, GST_RTSP_HDR_ACCEPT, "application/sdp");
+  }
+
+  bool ok = gst_rtsp_connection_send_usec(connection, request, ISOLATION_TIMEOUT_US) == GST_RTSP_OK;
+  gst_rtsp_message_free(request);
+
+  GstRTSPMessage response;
+  GstRTSPStatusCode code = GST_RTSP_STS_INVALID;
+  while (ok) {
+    gst_rtsp_message_init(&response);
+    ok = gst_rtsp_connection_receive_usec(connection, &response, ISOLATION_TIMEOUT_US) == GST_RTSP_OK;
+    if (ok && gst_rtsp_message_get_type(&response) == GST_RTSP_MESSAGE_RESPONSE) {
+      gst_rtsp_message_parse_response(&response, &code, NULL, NULL);
+
+      gchar *value = NULL;
+      if (session_out && gst_rtsp_message_get_header(&response, GST_RTSP_HDR_SESSION, &value, 0) == GST_RTSP_OK) {
+        *session_out = std::string(value).substr(0, std::string(value).find(';'));
+      }
+      gst_rtsp_message_unset(&response);
+      break;
+    }
+    gst_rtsp_message_unset(&response);
+  }
+
+  return ok && code == GST_RTSP_STS_OK;
+}
+
+// Stream 0 of the mount over the connection, then the socket is left to Trickle
+static bool StartSlowClient(const std::string &url, SlowClient &slow) {
+  GstRTSPUrl *parsed = NULL;
+  if (gst_rtsp_url_parse(url.c_str(), &parsed) != GST_RTSP_OK) {
+    fprintf(stderr, "\"%s\" is not an RTSP URL\n", url.c_str());
+    return false;
+  }
+
+  gst_rtsp_connection_create(parsed, &slow.connection);
+  gst_rtsp_url_free(parsed);
+
+  std::string session;
+  bool ok = gst_rtsp_connection_connect_usec(slow.connection, ISOLATION_TIMEOUT_US) == GST_RTSP_OK
+      && Request(slow.connection, GST_RTSP_DESCRIBE, url, "", NULL, NULL)
+      && Request(slow.connection, GST_RTSP_SETUP, url + "/stream=0", "",
+                 "RTP/AVP/TCP;unicast;interleaved=0-1", &session)
+      && Request(slow.connection, GST_RTSP_PLAY, url, session, NULL, NULL);
+  if (!ok) {
+    fprintf(stderr, "The slow client can't start playing \"%s\"\n", url.c_str());
+    return false;
+  }
+
+  // A small window, so the backlog builds up at the server and not in this kernel
+  slow.fd = g_socket_get_fd(gst_rtsp_connection_get_read_socket(slow.connection));
+  int size = 4096;
+  setsockopt(slow.fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  return true;
+}
+
+static gboolean Trickle(gpointer user_data) {
+  auto *slow = (SlowClient *) user_data;
+  if (slow->closed_at) {
+    return G_SOURCE_REMOVE;
+  }
+
+  std::vector<char> buffer(MAX (throttle * ISOLATION_READ_MS / 1000, 1u));
+  ssize_t size = recv(slow->fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+  if (size > 0) {
+    slow->bytes += size;
+  } else if (size == 0) {
+    slow->closed_at = g_get_monotonic_time();
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean Quit(gpointer user_data) {
+  g_main_loop_quit(loop);
+  return G_SOURCE_REMOVE;
+}
+
+// The clients play on, their counters start over
+static Phase Measure(std::vector<Client> &clients, guint seconds) {
+  g_timeout_add_seconds(ISOLATION_WARMUP_S, Quit, NULL);
+  g_main_loop_run(loop);
+
+  for (auto &client : clients) {
+    g_atomic_int_set(&client.packets, 0);
+    client.max_gap = 0;
+  }
+
+  g_timeout_add_seconds(seconds, Quit, NULL);
+  g_main_loop_run(loop);
+
+  Phase phase = {G_MAXDOUBLE, 0, 0};
+  for (auto &client : clients) {
+    double rate = (double) g_atomic_int_get(&client.packets) / seconds;
+    phase.min_rate = MIN (phase.min_rate, rate);
+    phase.avg_rate += rate / clients.size();
+    phase.max_gap = MAX (phase.max_gap, client.max_gap);
+  }
+  return phase;
+}
+
+int main(int argc, char *argv[]) {
+  gst_init(&argc, &argv);
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <url> [clients] [seconds] [throttle-bytes/s]\n", argv[0]);
+    return 1;
+  }
+
+  std::string url = argv[1];
+  guint count = argc > 2 ? (guint) atoi(argv[2]) : ISOLATION_DEFAULT_CLIENTS;
+  guint seconds = argc > 3 ? (guint) atoi(argv[3]) : ISOLATION_DEFAULT_SECONDS;
+  throttle = argc > 4 ? (guint) atoi(argv[4]) : ISOLATION_DEFAULT_THROTTLE;
+  if (!count || !seconds || !throttle) {
+    fprintf(stderr, "Usage: %s <url> [clients] [seconds] [throttle-bytes/s]\n", argv[0]);
+    return 1;
+  }
+
+  loop = g_main_loop_new(NULL, FALSE);
+
+  // Sized once, the handoffs keep pointers to the entries
+  std::vector<Client> clients(count, Client{NULL, 0, 0, 0});
+  for (auto &client : clients) {
+    if (!StartClient(url, client)) {
+      return 1;
+    }
+  }
+
+  Phase alone = Measure(clients, seconds);
+
+  SlowClient slow = {NULL, -1, 0, 0};
+  if (!StartSlowClient(url, slow)) {
+    return 1;
+  }
+  g_timeout_add(ISOLATION_READ_MS, Trickle, &slow);
+  gint64 slow_started = g_get_monotonic_time();
+
+  Phase shared = Measure(clients, seconds);
+
+  for (auto &client : clients) {
+    gst_element_set_state(client.pipeline, GST_STATE_NULL);
+    gst_object_unref(client.pipeline);
+  }
+
+  printf("%u healthy TCP clients, %u s per phase, slow client reading %u bytes/s\n", count, seconds, throttle);
+  printf("%-18s %14s %14s %14s\n", "", "min packets/s", "avg packets/s", "max gap ms");
+  printf("%-18s %14.1f %14.1f %14.1f\n", "alone", alone.min_rate, alone.avg_rate, alone.max_gap / 1000.0);
+  printf("%-18s %14.1f %14.1f %14.1f\n", "with slow client", shared.min_rate, shared.avg_rate,
+         shared.max_gap / 1000.0);
+
+  if (slow.closed_at) {
+    printf("Slow client: %" G_GUINT64_FORMAT " bytes, disconnected by the server after %.1f s\n", slow.bytes,
+           (slow.closed_at - slow_started) / (double) G_USEC_PER_SEC);
+  } else {
+    printf("Slow client: %" G_GUINT64_FORMAT " bytes, still connected\n", slow.bytes);
+  }
+  gst_rtsp_connection_free(slow.connection);
+  g_main_loop_unref(loop);
+
+  gint64 allowed_gap = MAX (2 * alone.max_gap, (gint64) 500 * 1000);
+  bool isolated = shared.min_rate >= 0.9 * alone.min_rate && shared.max_gap <= allowed_gap;
+  printf("%s\n", isolated ? "PASS: the healthy clients are not affected"
+                          : "FAIL: the slow client holds the healthy ones back");
+  return isolated ? 0 : 1;
+}
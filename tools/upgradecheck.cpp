@@ -0,0 +1,242 @@
+// Upgrade check: clients play a mount of a running app while a second app
+// is started with --upgrade and takes over. Reports how long the clients
+// were without packets, across the drain and the reconnect to the new
+// process, and fails if that is over the limit.
+//
+//   gcf-upgrade-check [--clients N] [--max-gap-ms N] <app> <config> <url>
+//   gcf-upgrade-check --clients 10 ./bin/gst-rtsp-app headless.json rtsp://127.0.0.1:8554/h264
+//
+// The clients reconnect right away when their connection breaks. Both apps
+// use a handover path of their own. The run ends a few seconds after the
+// old app quit, at the latest after its drain timeout.
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define UPGRADE_DEFAULT_CLIENTS 5
+#define UPGRADE_DEFAULT_MAX_GAP_MS 1000
+#define UPGRADE_RECONNECT_MS 100
+#define UPGRADE_STEADY_S 5
+#define UPGRADE_STARTUP_TIMEOUT_S 30
+#define UPGRADE_DRAIN_TIMEOUT_S 40
+#define UPGRADE_HANDOVER "/tmp/gcf-upgrade-check.sock"
+
+struct Client {
+  guint index;
+  GstElement *pipeline;
+  gint packets;
+  gint64 last_packet;      // monotonic, us
+  gint64 max_gap;          // between two packets, across reconnects, us
+  guint reconnects;
+};
+
+static std::string url;
+static std::vector<Client> clients;
+static GMainLoop *loop = NULL;
+
+static void Handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer user_data) {
+  Client *client = static_cast<Client *>(user_data);
+  gint64 now = g_get_monotonic_time();
+
+  // Runs in the streaming thread, the main loop only reads the counters
+  if (client->last_packet) {
+    client->max_gap = MAX (client->max_gap, now - client->last_packet);
+  }
+  client->last_packet = now;
+  g_atomic_int_inc(&client->packets);
+}
+
+static gboolean Reconnect(gpointer user_data) {
+  Client *client = static_cast<Client *>(user_data);
+
+  gst_element_set_state(client->pipeline, GST_STATE_NULL);
+  gst_element_set_state(client->pipeline, GST_STATE_PLAYING);
+
+  return G_SOURCE_REMOVE;
+}
+
+// The gap keeps running from the last packet, until the next connection delivers
+static gboolean BusHandler(GstBus *bus, GstMessage *msg, gpointer user_data) {
+  Client *client = static_cast<Client *>(user_data);
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR || GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS) {
+    client->reconnects++;
+    g_timeout_add(UPGRADE_RECONNECT_MS, Reconnect, client);
+  }
+  return TRUE;
+}
+
+static bool CreateClient(Client &client) {
+  GError *error = NULL;
+  auto launch = "rtspsrc location=\"" + url + "\" protocols=tcp latency=0 ! fakesink sync=false"
+      " signal-handoffs=true name=sink";
+
+  client.pipeline = gst_parse_launch(launch.c_str(), &error);
+  if (!client.pipeline) {
+    fprintf(stderr, "Can't create client %u: %s\n", client.index, error->message);
+    g_clear_error(&error);
+    return false;
+  }
+
+  GstElement *sink = gst_bin_get_by_name(GST_BIN (client.pipeline), "sink");
+  g_signal_connect(sink, "handoff", G_CALLBACK (Handoff), &client);
+  gst_object_unref(sink);
+
+  GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE (client.pipeline));
+  gst_bus_add_watch(bus, BusHandler, &client);
+  gst_object_unref(bus);
+
+  return gst_element_set_state(client.pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE;
+}
+
+static GPid Start(const char *binary, const char *config, bool upgrade) {
+  const gchar *argv[] = {binary, "--config", config, "--handover", UPGRADE_HANDOVER,
+                         upgrade ? "--upgrade" : NULL, NULL};
+  GError *error = NULL;
+  GPid app = 0;
+
+  if (!g_spawn_async(NULL, (gchar **) argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &app, &error)) {
+    fprintf(stderr, "Can't start %s: %s\n", binary, error->message);
+    g_clear_error(&error);
+  }
+  return app;
+}
+
+// Runs the main loop for a while, or until the condition holds
+static void Wait(guint seconds, bool (*done)()) {
+  gint64 deadline = g_get_monotonic_time() + seconds * G_USEC_PER_SEC;
+  while (g_get_monotonic_time() < deadline && !(done && done())) {
+    g_main_context_iteration(NULL, FALSE);
+    g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+  }
+}
+
+static bool AllPlaying() {
+  for (auto &client : clients) {
+    if (!g_atomic_int_get(&client.packets)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static GPid old_app = 0;
+static int old_status = -1;
+
+static bool OldAppGone() {
+  return waitpid(old_app, &old_status, WNOHANG) == old_app;
+}
+
+int main(int argc, char *argv[]) {
+  gint count = UPGRADE_DEFAULT_CLIENTS;
+  gint max_gap_ms = UPGRADE_DEFAULT_MAX_GAP_MS;
+
+  GOptionEntry options[] = {
+      {"clients", 0, 0, G_OPTION_ARG_INT, &count, "Clients playing the mount", "N"},
+      {"max-gap-ms", 0, 0, G_OPTION_ARG_INT, &max_gap_ms, "Longest allowed time without packets", "N"},
+      {NULL}
+  };
+
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new("<app> <config> <url>");
+  g_option_context_add_main_entries(context, options, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error) || argc < 4 || count <= 0 || max_gap_ms <= 0) {
+    fprintf(stderr, "Usage: %s [--clients N] [--max-gap-ms N] <app> <config> <url>\n", argv[0]);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 1;
+  }
+  g_option_context_free(context);
+  url = argv[3];
+
+  g_unlink(UPGRADE_HANDOVER);
+  old_app = Start(argv[1], argv[2], false);
+  if (!old_app) {
+    return 1;
+  }
+
+  // Sized once, the callbacks keep pointers to the entries
+  loop = g_main_loop_new(NULL, FALSE);
+  clients.resize(count);
+  for (gint i = 0; i < count; i++) {
+    clients[i] = {(guint) i, NULL, 0, 0, 0, 0};
+    if (!CreateClient(clients[i])) {
+      return 1;
+    }
+  }
+
+  Wait(UPGRADE_STARTUP_TIMEOUT_S, AllPlaying);
+  if (!AllPlaying()) {
+    fprintf(stderr, "Not every client plays %s after %d s\n", url.c_str(), UPGRADE_STARTUP_TIMEOUT_S);
+    kill(old_app, SIGTERM);
+    waitpid(old_app, NULL, 0);
+    return 1;
+  }
+
+  // Only the gaps of the upgrade count
+  Wait(UPGRADE_STEADY_S, NULL);
+  guint reconnects_before = 0;
+  for (auto &client : clients) {
+    client.max_gap = 0;
+    reconnects_before += client.reconnects;
+  }
+
+  gint64 upgrade_start = g_get_monotonic_time();
+  GPid new_app = Start(argv[1], argv[2], true);
+  if (!new_app) {
+    kill(old_app, SIGTERM);
+    waitpid(old_app, NULL, 0);
+    return 1;
+  }
+
+  Wait(UPGRADE_DRAIN_TIMEOUT_S, OldAppGone);
+  bool drained = old_status >= 0;
+  gint64 drain_time = g_get_monotonic_time() - upgrade_start;
+  if (!drained) {
+    kill(old_app, SIGKILL);
+    waitpid(old_app, &old_status, 0);
+  }
+
+  // The clients the old app dropped come back to the new one
+  Wait(UPGRADE_STEADY_S, NULL);
+
+  gint64 max_gap = 0;
+  guint reconnects = 0, playing = 0;
+  for (auto &client : clients) {
+    max_gap = MAX (max_gap, client.max_gap);
+    reconnects += client.reconnects;
+    playing += client.last_packet && g_get_monotonic_time() - client.last_packet < G_USEC_PER_SEC;
+  }
+  reconnects -= reconnects_before;
+
+  bool new_alive = waitpid(new_app, NULL, WNOHANG) == 0;
+  kill(new_app, SIGTERM);
+  waitpid(new_app, NULL, 0);
+  g_spawn_close_pid(new_app);
+
+  for (auto &client : clients) {
+    gst_element_set_state(client.pipeline, GST_STATE_NULL);
+    gst_object_unref(client.pipeline);
+  }
+  g_main_loop_unref(loop);
+
+  printf("%d clients of %s\n", count, url.c_str());
+  printf("Old process: %s after %.1f s\n",
+         drained ? (WIFEXITED (old_status) && WEXITSTATUS (old_status) == 0 ? "drained and quit" : "failed")
+                 : "still there, killed",
+         drain_time / (double) G_USEC_PER_SEC);
+  printf("New process: %s, %u/%d clients playing\n", new_alive ? "serving" : "gone", playing, count);
+  printf("Reconnects: %u, longest time without packets: %.1f ms\n", reconnects, max_gap / 1000.0);
+
+  bool ok = drained && new_alive && playing == (guint) count
+      && max_gap <= (gint64) max_gap_ms * G_TIME_SPAN_MILLISECOND;
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}